@@ -0,0 +1,138 @@
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "AdcSampler.h"
+#include "Trace.h"
+#include "NoHeap.h"
+
+// Sentinel value for when the sampler isn't running.
+static const uint8_t NOT_RUNNING = UINT8_MAX;
+
+// The internal temperature sensor, in the same numbering as `start()`.
+static const uint8_t INTERNAL_SENSOR_CHANNEL = 15;
+
+static uint8_t currentChannel = NOT_RUNNING;
+
+/* Samples to throw away before accumulating. The first conversion after
+ * switching to the internal temperature sensor is inaccurate, so that one
+ * discards an extra sample.
+ */
+static volatile uint8_t samplesToDiscard;
+static volatile uint16_t accumulator;
+static volatile uint8_t numSamples;
+static volatile uint16_t result;
+static volatile bool newResult;
+// Set while sampling is paused, waiting for `newResult` to be read.
+static volatile bool paused;
+
+// Keeping the accumulator to 16 bits keeps the interrupt handler quick.
+static_assert(
+  1023UL * ADC_OVERSAMPLING_SAMPLES <= UINT16_MAX,
+  "Too many samples for a 16-bit accumulator"
+);
+
+void AdcSampler::start(uint8_t channel) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // Disabling the ADC aborts any conversion in progress.
+    ADCSRA = 0;
+    currentChannel = channel;
+    samplesToDiscard = channel == INTERNAL_SENSOR_CHANNEL ? 2 : 1;
+    accumulator = 0;
+    numSamples = 0;
+    newResult = false;
+    paused = false;
+    // Use the internal 2.56V reference, and the lower bits of the channel.
+    ADMUX = _BV(REFS1) | _BV(REFS0) | (channel & 0x7);
+    /* The upper channels are selected with MUX5 in ADCSRB. Clearing the rest
+     * of ADCSRB selects free running mode as the auto trigger source.
+     */
+    ADCSRB = channel > 7 ? _BV(MUX5) : 0;
+    /* The ADC clock needs to be between 50kHz and 200kHz for full resolution.
+     * The 128x prescaler gets a 16MHz clock down to 125kHz, which is about 9600
+     * samples (and interrupts) a second. That's plenty of samples, and keeps
+     * the interrupt overhead to a couple percent of the CPU.
+     */
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) |
+      _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+  }
+}
+
+void AdcSampler::select(uint8_t channel) {
+  if (!isRunning()) {
+    start(channel);
+    return;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    bool mux5Changed = (channel > 7) != (currentChannel > 7);
+    if (channel == INTERNAL_SENSOR_CHANNEL) {
+      samplesToDiscard = 2;
+    } else {
+      samplesToDiscard = mux5Changed ? 1 : 0;
+    }
+    // A conversion still running was started on the old channel.
+    if (bit_is_set(ADCSRA, ADSC)) {
+      samplesToDiscard++;
+    }
+    currentChannel = channel;
+    accumulator = 0;
+    numSamples = 0;
+    newResult = false;
+    paused = false;
+    // The reference stays the same, only the channel changes.
+    ADMUX = (ADMUX & ~0x7) | (channel & 0x7);
+    ADCSRB = channel > 7 ? _BV(MUX5) : 0;
+    ADCSRA |= _BV(ADATE) | _BV(ADSC);
+  }
+}
+
+void AdcSampler::stop() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ADCSRA = 0;
+    currentChannel = NOT_RUNNING;
+    newResult = false;
+  }
+}
+
+bool AdcSampler::isRunning() {
+  return currentChannel != NOT_RUNNING;
+}
+
+bool AdcSampler::read(uint16_t *value) {
+  bool hasResult;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    hasResult = newResult;
+    if (hasResult) {
+      *value = result;
+      newResult = false;
+      paused = false;
+      // Resume free running.
+      ADCSRA |= _BV(ADATE) | _BV(ADSC);
+    }
+  }
+  return hasResult;
+}
+
+ISR(ADC_vect) {
+  TRACE_SCOPE(traceAdcInterrupt);
+  uint16_t sample = ADCW;
+  if (paused) {
+    /* The conversion that was already running when sampling was paused. It's
+     * stale by the time sampling resumes, so drop it.
+     */
+    return;
+  }
+  if (samplesToDiscard > 0) {
+    --samplesToDiscard;
+    return;
+  }
+  accumulator += sample;
+  if (++numSamples == ADC_OVERSAMPLING_SAMPLES) {
+    result = accumulator >> ADC_OVERSAMPLING_BITS;
+    newResult = true;
+    accumulator = 0;
+    numSamples = 0;
+    // Pause until the result has been read.
+    paused = true;
+    ADCSRA &= ~_BV(ADATE);
+  }
+}
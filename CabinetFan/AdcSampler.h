@@ -0,0 +1,53 @@
+#ifndef FAN_ADC_SAMPLER_H
+#define FAN_ADC_SAMPLER_H
+
+#include <stdint.h>
+
+/* The number of extra bits of resolution gained by oversampling. Each extra bit
+ * takes four times as many samples, so 2 bits is 16 samples per result, giving
+ * 12-bit results from the 10-bit ADC.
+ */
+#define ADC_OVERSAMPLING_BITS 2
+#define ADC_OVERSAMPLING_SAMPLES (1 << (2 * ADC_OVERSAMPLING_BITS))
+
+/* Runs the ADC continuously in the background on a single channel, using the
+ * internal 2.56V reference.
+ *
+ * The ADC is put in free running mode, and `ADC_vect` adds each sample to an
+ * accumulator. Every `ADC_OVERSAMPLING_SAMPLES` samples the sum is decimated
+ * (shifted right by `ADC_OVERSAMPLING_BITS`) into a result with
+ * `10 + ADC_OVERSAMPLING_BITS` bits. Oversampling only adds real resolution if
+ * there's at least an LSB or so of noise on the signal, which is the case for
+ * the temperature sensors being used.
+ *
+ * The main loop never waits on the ADC; it just picks up the latest result.
+ *
+ * Once a result is ready, sampling pauses until it has been read. Otherwise the
+ * ADC interrupt would wake the CPU from idle sleep almost ten thousand times a
+ * second, to produce results that are mostly never read.
+ */
+class AdcSampler {
+  public:
+    /* Start sampling `channel`, using the same numbering as the MUX bits: 0-7
+     * are ADC0-ADC7, 8-15 have MUX5 set (and 15 is the internal temperature
+     * sensor). Restarts sampling if it was already running.
+     */
+    static void start(uint8_t channel);
+
+    /* Switch to sampling `channel` (in the same numbering as `start()`),
+     * without restarting the ADC. Any result that hasn't been read is thrown
+     * away. Switching MUX5 (between channels 0-7 and 8-15) costs a discarded
+     * sample while the input settles, and switching to the internal sensor
+     * costs two, but switching within the same half of the MUX costs nothing.
+     * Starts sampling if it wasn't running.
+     */
+    static void select(uint8_t channel);
+    static void stop();
+    static bool isRunning();
+
+    /* If a new result has been decimated since the last call, store it in
+     * `value`, start sampling for the next result, and return true.
+     */
+    static bool read(uint16_t *value);
+};
+#endif
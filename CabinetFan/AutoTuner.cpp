@@ -0,0 +1,174 @@
+#include <float.h>
+#include <math.h>
+#include <Arduino.h>
+#include "AutoTuner.h"
+#include "util.h"
+#include "NoHeap.h"
+
+// The fan speeds the relay switches between.
+static const float HIGH_SPEED = 1.0;
+static const float LOW_SPEED = 0.2;
+
+/* How far (in degrees Celsius) the temperature has to go past the set point
+ * before the relay switches.
+ */
+static const float HYSTERESIS = 0.2;
+
+// Cycles ignored at the start, then cycles averaged for the result.
+static const uint8_t SETTLING_CYCLES = 1;
+static const uint8_t MEASURED_CYCLES = 3;
+
+/* If the relay hasn't switched in this long (in milliseconds), the set point
+ * can't be reached with the fans at one of the relay speeds.
+ */
+static const unsigned long SWITCH_TIMEOUT = 3600000UL;
+
+/* How many controller runs there are per ultimate period. Each run can only
+ * react to what's happened since the last one, so they need to be a good bit
+ * shorter than the oscillation being controlled.
+ */
+static const uint8_t RUNS_PER_PERIOD = 8;
+
+// The controller doesn't need to run any more often than the temperature.
+static const unsigned long MIN_CONTROLLER_PERIOD = THERMOMETER_UPDATE_PERIOD;
+
+AutoTuner::AutoTuner(FanArray *fans, ThermometerBank *thermometers):
+  fans(fans),
+  thermometers(thermometers)
+{}
+
+void AutoTuner::start(uint8_t members, float setPoint) {
+  this->members = members;
+  this->setPoint = setPoint;
+  state = autoTuneSettling;
+  highSwitches = 0;
+  totalHeight = 0.0;
+  totalPeriod = 0;
+  /* Start out cooling. If the cabinet's already below the set point, this
+   * switches to heating on the first run.
+   */
+  cooling = true;
+  peak = -FLT_MAX;
+  lastSwitch = millis();
+  fans->setSpeed(HIGH_SPEED, members);
+}
+
+void AutoTuner::stop() {
+  if (isRunning()) {
+    state = autoTuneIdle;
+  }
+}
+
+AutoTuneState AutoTuner::getState() const {
+  return state;
+}
+
+bool AutoTuner::isRunning() const {
+  return state == autoTuneSettling || state == autoTuneMeasuring;
+}
+
+uint8_t AutoTuner::getCycles() const {
+  return highSwitches > 0 ? highSwitches - 1 : 0;
+}
+
+float AutoTuner::getUltimateGain() const {
+  // The relay's amplitude, and the amplitude of the temperature oscillation.
+  const float relayAmplitude = (HIGH_SPEED - LOW_SPEED) / 2;
+  float amplitude = totalHeight / (2 * MEASURED_CYCLES);
+  /* The describing function of a relay with hysteresis. The hysteresis is
+   * only left out if the oscillation is too small for the correction to make
+   * sense.
+   */
+  if (amplitude > HYSTERESIS) {
+    amplitude = sqrt(amplitude * amplitude - HYSTERESIS * HYSTERESIS);
+  }
+  return 4 * relayAmplitude / (M_PI * amplitude);
+}
+
+unsigned long AutoTuner::getUltimatePeriod() const {
+  return totalPeriod / MEASURED_CYCLES;
+}
+
+AutoTuneGains AutoTuner::getGains() const {
+  /* The Ziegler-Nichols PI rules give a proportional gain and an integral
+   * time (in seconds).
+   */
+  const float gain = 0.45 * getUltimateGain();
+  const float integralTime = getUltimatePeriod() / 1200.0;
+  AutoTuneGains gains;
+  gains.period = max(
+    getUltimatePeriod() / RUNS_PER_PERIOD,
+    MIN_CONTROLLER_PERIOD
+  );
+  const float periodSeconds = gains.period / 1000.0;
+  /* `BasicPIDFanController` adds its correction to the fans' current speed
+   * every period, so it's a PID controller in velocity form: its `k_p` term
+   * is really the integral action, and its `k_d` term (the change in error)
+   * is the proportional action. A derivative would need the change in the
+   * change in error, which it doesn't have, so the result is a PI
+   * controller. Its `k_i` term is left off, as it would be integrating twice.
+   */
+  gains.k_p = gain * periodSeconds / integralTime;
+  gains.k_i = 0.0;
+  gains.k_d = gain * periodSeconds;
+  return gains;
+}
+
+void AutoTuner::periodic(unsigned long currentMillis) {
+  if (!isRunning()) {
+    return;
+  }
+  if (periodPassed(currentMillis, lastSwitch, SWITCH_TIMEOUT)) {
+    state = autoTuneFailed;
+    fans->setSpeed(HIGH_SPEED, members);
+    return;
+  }
+  float temperature = thermometers->getTemperature();
+  if (isnan(temperature)) {
+    return;
+  }
+  if (cooling) {
+    peak = max(peak, temperature);
+    if (temperature < setPoint - HYSTERESIS) {
+      switchRelay(false, currentMillis);
+    }
+  } else {
+    trough = min(trough, temperature);
+    if (temperature > setPoint + HYSTERESIS) {
+      switchRelay(true, currentMillis);
+    }
+  }
+}
+
+unsigned long AutoTuner::getPeriod() const {
+  return AUTO_TUNER_PERIOD;
+}
+
+const __FlashStringHelper * AutoTuner::getTaskName() const {
+  return F("auto-tuner");
+}
+
+void AutoTuner::switchRelay(bool newCooling, unsigned long currentMillis) {
+  if (newCooling) {
+    // Every switch to high after the first finishes a cycle.
+    uint8_t finishedCycle = highSwitches;
+    if (finishedCycle > SETTLING_CYCLES) {
+      totalHeight += peak - trough;
+      totalPeriod += currentMillis - lastHighSwitch;
+    }
+    highSwitches++;
+    if (finishedCycle == SETTLING_CYCLES + MEASURED_CYCLES) {
+      state = autoTuneFinished;
+      return;
+    } else if (finishedCycle == SETTLING_CYCLES) {
+      state = autoTuneMeasuring;
+    }
+    lastHighSwitch = currentMillis;
+    peak = -FLT_MAX;
+  } else {
+    trough = FLT_MAX;
+  }
+  cooling = newCooling;
+  lastSwitch = currentMillis;
+  fans->setSpeed(newCooling ? HIGH_SPEED : LOW_SPEED, members);
+}
@@ -0,0 +1,113 @@
+#ifndef FAN_AUTO_TUNER_H
+#define FAN_AUTO_TUNER_H
+
+#include <stdint.h>
+#include "FanArray.h"
+#include "Scheduler.h"
+#include "ThermometerBank.h"
+
+// How often (in milliseconds) the auto-tuner checks the temperature.
+#define AUTO_TUNER_PERIOD THERMOMETER_UPDATE_PERIOD
+
+enum AutoTuneState {
+  autoTuneIdle,
+  // Switching the fans, waiting for the oscillation to settle.
+  autoTuneSettling,
+  // Switching the fans, measuring the oscillation.
+  autoTuneMeasuring,
+  autoTuneFinished,
+  /* The temperature didn't cross the set point in time, or there wasn't a
+   * temperature to measure.
+   */
+  autoTuneFailed
+};
+
+// The result of auto-tuning, in the form `BasicPIDFanController` uses.
+struct AutoTuneGains {
+  float k_p;
+  float k_i;
+  float k_d;
+  unsigned long period;
+};
+
+/* Relay feedback (Astrom-Hagglund) auto-tuning for the PID controller.
+ *
+ * While running, the auto-tuner stands in for the controller. It switches the
+ * fans between a high and a low speed whenever the temperature crosses the
+ * set point (with a little hysteresis to keep noise from switching it), which
+ * makes the temperature oscillate around the set point. The size and period
+ * of that oscillation give the ultimate gain `Ku` (the proportional gain that
+ * would keep the loop oscillating) and the ultimate period `Tu`, which are
+ * turned into gains with the Ziegler-Nichols rules.
+ *
+ * The first cycle is ignored while the oscillation settles, then the next few
+ * are averaged. It takes as long as the cabinet takes to heat up and cool
+ * down a few times, usually tens of minutes.
+ */
+class AutoTuner: public Task {
+  public:
+    AutoTuner(FanArray *fans, ThermometerBank *thermometers);
+
+    /* Start tuning the fans selected by `members` (see `ALL_FANS`) around
+     * `setPoint` degrees Celsius.
+     */
+    void start(uint8_t members, float setPoint);
+    void stop();
+
+    AutoTuneState getState() const;
+
+    // True from `start()` until tuning has finished, failed or been stopped.
+    bool isRunning() const;
+
+    // The number of full cycles measured so far.
+    uint8_t getCycles() const;
+
+    /* The ultimate gain (in fan speed per degree) and period (in
+     * milliseconds) that were measured. Only valid once finished.
+     */
+    float getUltimateGain() const;
+    unsigned long getUltimatePeriod() const;
+
+    /* The gains for `BasicPIDFanController`, worked out from the ultimate gain
+     * and period. Only valid once finished.
+     */
+    AutoTuneGains getGains() const;
+
+    // Checks the temperature and switches the fans.
+    void periodic(unsigned long currentMillis);
+    unsigned long getPeriod() const;
+    const __FlashStringHelper * getTaskName() const;
+
+  private:
+    FanArray *fans;
+    ThermometerBank *thermometers;
+    uint8_t members = ALL_FANS;
+    float setPoint = 0.0;
+
+    AutoTuneState state = autoTuneIdle;
+
+    // Whether the fans are at the high speed (so the cabinet is cooling).
+    bool cooling = false;
+
+    // When the relay was last switched, and when it was last switched high.
+    unsigned long lastSwitch = 0;
+    unsigned long lastHighSwitch = 0;
+
+    /* The highest temperature while cooling (the peak comes after the switch,
+     * as the cabinet takes a while to respond) and the lowest while heating.
+     */
+    float peak = 0.0;
+    float trough = 0.0;
+
+    /* The number of times the relay has been switched to high. Each switch
+     * after the first completes a cycle.
+     */
+    uint8_t highSwitches = 0;
+
+    // Running totals over the measured cycles.
+    float totalHeight = 0.0;
+    unsigned long totalPeriod = 0;
+
+    void switchRelay(bool newCooling, unsigned long currentMillis);
+};
+#endif
@@ -0,0 +1,95 @@
+#include <Arduino.h>
+#include "BasicFanController.h"
+#include "NoHeap.h"
+
+ControllerBase::ControllerBase(
+  FanArray *fans,
+  uint8_t members,
+  const __FlashStringHelper * name
+):
+  name(name),
+  fans(fans),
+  members(members),
+  value(0)
+{}
+
+const __FlashStringHelper * ControllerBase::getName() const {
+  return name;
+}
+
+float ControllerBase::getValue() const {
+  return value;
+}
+
+uint8_t ControllerBase::getMembers() const {
+  return members;
+}
+
+void ControllerBase::setMembers(uint8_t newMembers) {
+  members = newMembers;
+}
+
+ControllerTerms ControllerBase::getTerms() const {
+  return ControllerTerms();
+}
+
+void ControllerBase::toggleDebug() {
+  debug = !debug;
+}
+
+void ControllerBase::debugLabel(const __FlashStringHelper * message) {
+  Serial.print('\t');
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print(message);
+  Serial.print(F(": "));
+}
+
+void ControllerBase::controllerDebug(const __FlashStringHelper * message) {
+  if (debug) {
+    Serial.print('\t');
+    Serial.print(name);
+    Serial.print(F(": "));
+    Serial.println(message);
+  }
+}
+
+void ControllerBase::controllerDebug(
+  const __FlashStringHelper * message,
+  const __FlashStringHelper * value
+) {
+  if (debug) {
+    debugLabel(message);
+    Serial.println(value);
+  }
+}
+
+void ControllerBase::controllerDebug(
+  const __FlashStringHelper * message,
+  float value
+) {
+  if (debug) {
+    debugLabel(message);
+    Serial.println(value);
+  }
+}
+
+void ControllerBase::controllerDebug(
+  const __FlashStringHelper * message,
+  unsigned long value
+) {
+  if (debug) {
+    debugLabel(message);
+    Serial.println(value);
+  }
+}
+
+void ControllerBase::controllerDebug(
+  const __FlashStringHelper * message,
+  uint16_t value
+) {
+  if (debug) {
+    debugLabel(message);
+    Serial.println(value);
+  }
+}
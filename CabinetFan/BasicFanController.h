@@ -0,0 +1,128 @@
+#ifndef FAN_BASIC_FAN_CONTROLLER_H
+#define FAN_BASIC_FAN_CONTROLLER_H
+
+#include <math.h>
+#include "Arduino.h"
+#include "FanArray.h"
+#include "Fixed.h"
+#include "util.h"
+
+/* How much each term contributed to a controller's last correction, for
+ * telemetry.
+ */
+struct ControllerTerms {
+  Fixed<16> proportional;
+  Fixed<16> integral;
+  Fixed<16> derivative;
+};
+
+/* The state and debug logging shared by every controller. There are no
+ * virtual functions here; see `BasicFanController` for building a controller,
+ * and `FanController` for how they're called.
+ */
+class ControllerBase {
+  public:
+    // A short display name describing this controller, in flash.
+    const __FlashStringHelper * getName() const;
+
+    // Get the current set point.
+    float getValue() const;
+
+    // The mask of fans being controlled.
+    uint8_t getMembers() const;
+    void setMembers(uint8_t newMembers);
+
+    /* The terms behind the last correction. Controllers that don't have them
+     * report zeros.
+     */
+    ControllerTerms getTerms() const;
+
+    // When enabled, debug statements are logged to the serial console.
+#if DEBUG
+#warning Debug Mode Enabled!
+    bool debug = true;
+#else
+    bool debug = false;
+#endif
+
+    void toggleDebug();
+    /* The messages are kept in flash (use `F()`), as they're only printed
+     * while debugging.
+     */
+    void controllerDebug(const __FlashStringHelper * message);
+    void controllerDebug(
+      const __FlashStringHelper * message,
+      const __FlashStringHelper * value
+    );
+    void controllerDebug(const __FlashStringHelper * message, float value);
+    void controllerDebug(
+      const __FlashStringHelper * message,
+      unsigned long value
+    );
+    void controllerDebug(const __FlashStringHelper * message, uint16_t value);
+
+  protected:
+    /* `members` selects which of the fans in `fans` are controlled (see
+     * `ALL_FANS`). `name` is in flash.
+     */
+    ControllerBase(
+      FanArray *fans,
+      uint8_t members,
+      const __FlashStringHelper * name
+    );
+
+    const __FlashStringHelper * name;
+    FanArray *fans;
+    uint8_t members;
+    float value;
+
+  private:
+    // Print the start of a debug line with a value, up to the value.
+    void debugLabel(const __FlashStringHelper * message);
+};
+
+/* The base for a controller of type `Derived` (the curiously recurring
+ * template pattern). `Derived` provides, as compile time constants:
+ *
+ *   static constexpr float minValue;   // The minimum set point.
+ *   static constexpr float maxValue;   // The maximum set point.
+ *   static constexpr float valueStep;  // A suggested set point increment.
+ *
+ * and the set point's units, as a string defined with `PROGMEM`:
+ *
+ *   static const char valueUnits[];
+ *
+ * along with (non-virtual) `periodic(unsigned long)` and `getPeriod()`
+ * methods. It can hide `getTerms()` if it has terms to report.
+ */
+template<typename Derived>
+class BasicFanController: public ControllerBase {
+  public:
+    // Set a new set point, clamped to the controller's limits.
+    void setValue(float newValue) {
+      value = clamp(newValue);
+    }
+
+  protected:
+    /* An invalid (NaN) `initialValue` starts the set point in the middle of
+     * the controller's range.
+     */
+    BasicFanController(
+      FanArray *fans,
+      uint8_t members,
+      const __FlashStringHelper * name,
+      float initialValue
+    ): ControllerBase(fans, members, name) {
+      if (isnan(initialValue)) {
+        value = (Derived::minValue + Derived::maxValue) / 2;
+      } else {
+        value = clamp(initialValue);
+      }
+    }
+
+  private:
+    static float clamp(float newValue) {
+      return min(Derived::maxValue, max(Derived::minValue, newValue));
+    }
+};
+#endif
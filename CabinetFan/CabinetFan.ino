@@ -2,17 +2,33 @@
 #include <util/atomic.h>
 
 #include "Thermometer.h"
+#include "ThermometerBank.h"
 #include "Fan.h"
+#include "FanArray.h"
 #include "util.h"
 #include "Menu.h"
+#include "NoHeap.h"
 
 // Pin Definitions are for the 32u4 Adafruit ItsyBitsy
 const byte tachPin = 0;     // Digital 0   PD2  INT2
 const byte controlPin = 9;  // Digital 9   PB5  TIMER1A
 const byte tempPin = A11;    // D12/A11     PD6  ADC9
 
-Thermometer thermometer = Thermometer(tempPin);
-Fan *fan;
+FilteredThermometer<> thermometer = FilteredThermometer<>(tempPin);
+/* More thermometers (up to `THERMOMETER_BANK_MAX_SENSORS`) can be added to the
+ * bank in `setup()`, with names to pick them out from the menu, and their own
+ * filters (see Filters.h). The names are kept in flash with `F()`, which only
+ * works inside a function, so named thermometers are static locals there, like
+ * the fans. For example:
+ *   static FilteredThermometer<> intake(A0, F("intake"));
+ *   static FilteredThermometer< MedianFilter<uint16_t, 5> > internal(
+ *     Thermometer::INTERNAL_SENSOR, F("mcu")
+ *   );
+ *   thermometers.add(&intake);
+ *   thermometers.add(&internal);
+ */
+ThermometerBank thermometers;
+FanArray fans;
 Menu *menu;
 
 void setup() {
@@ -24,15 +40,27 @@ void setup() {
 #endif
 
   /* Fan needs to be constructed *after* Arduino setup has completed, or else
-   * the PWM settings will be clobbered.
+   * the PWM settings will be clobbered. So the fans (and the menu, which uses
+   * them) are static locals, built the first (and only) time through here.
    */
   /* For reference:
   * Noctua NF-A4x20 speed ranges from 1200 to 5000 rpm
   * Noctua NF-S12A speed ranges from 300 to 1200 rpm
   * Gelid Silent 12 PWM speed ranges from 750 to 1500 rpm
   */
-  fan = new Fan(controlPin, tachPin, phaseFrequencyCorrect);
-  menu = new Menu(fan, &thermometer, &Serial);
+  /* More fans can be added (up to one per external interrupt for the
+   * tachometers), each on its own PWM pin. For example, a second fan on pin 10
+   * (OC1B) with its tachometer on pin 1 (INT3). The tachometer pin has to be a
+   * `byte`, as an `int` picks the constructor for fans without a tachometer.
+   *   const byte tach2Pin = 1;
+   *   static Fan fan2(10, tach2Pin, phaseFrequencyCorrect);
+   *   fans.add(&fan2);
+   */
+  static Fan fan(controlPin, tachPin, phaseFrequencyCorrect);
+  fans.add(&fan);
+  thermometers.add(&thermometer);
+  static Menu staticMenu(&fans, &thermometers, &Serial);
+  menu = &staticMenu;
 }
 
 void loop() {
@@ -1,24 +1,27 @@
 #include "ConstantSpeed.h"
-#include "util.h"
+#include "NoHeap.h"
 
 // The period of time between updates to the fan speed, in milliseconds.
 static const int FAN_UPDATE_PERIOD = 500;
 
-const char * ConstantSpeedController::valueUnits = "RPM";
+const char ConstantSpeedController::valueUnits[] PROGMEM = "";
+constexpr float ConstantSpeedController::valueStep;
+constexpr float ConstantSpeedController::minValue;
+constexpr float ConstantSpeedController::maxValue;
 
 ConstantSpeedController::ConstantSpeedController(
-  Fan *fan,
+  FanArray *fans,
+  uint8_t members,
   float initialSpeed
 ):
-  FanController(fan, 0.0, 1.0, initialSpeed)
-{
-  this->name = "Constant Speed";
+  BasicFanController(fans, members, F("Constant Speed"), initialSpeed)
+{}
+
+void ConstantSpeedController::periodic(unsigned long /* currentMillis */) {
+  controllerDebug(F("new speed"), value);
+  fans->setSpeed(value, members);
 }
 
-void ConstantSpeedController::periodic(unsigned long currentMillis) {
-  if (periodPassed(currentMillis, lastUpdate, FAN_UPDATE_PERIOD)) {
-    controllerDebug("new speed", value);
-    lastUpdate = currentMillis;
-    fan->setSpeed(value);
-  }
+unsigned long ConstantSpeedController::getPeriod() const {
+  return FAN_UPDATE_PERIOD;
 }
\ No newline at end of file
@@ -2,21 +2,34 @@
 #define FAN_CONSTANT_SPEED_H
 
 #include <math.h>
-#include "FanController.h"
-class ConstantSpeedController: public FanController {
+#include "BasicFanController.h"
+class ConstantSpeedController:
+  public BasicFanController<ConstantSpeedController>
+{
   public:
-    ConstantSpeedController(Fan *fan, float initialSpeed = NAN);
+    ConstantSpeedController(
+      FanArray *fans,
+      uint8_t members,
+      float initialSpeed = NAN
+    );
 
-    // The abbreviation for the units for the set point.
-    static const char * valueUnits;
+    /* The abbreviation for the units for the set point. The set point is a
+     * fraction of full speed, so there aren't any.
+     */
+    static const char valueUnits[];
 
     // A suggested amount to increment the set point value by.
-    const float valueStep = 0.1;
+    static constexpr float valueStep = 0.1;
 
-    // Called each iteration of the run loop.
-    virtual void periodic(unsigned long currentMillis);
-  private:
-    // When the fan speed was last checked.
-    unsigned long lastUpdate = 0;
+    // Stopped is the minimum value.
+    static constexpr float minValue = 0.0;
+
+    // Full speed is the maximum value.
+    static constexpr float maxValue = 1.0;
+
+    // Called once every `getPeriod()` milliseconds.
+    void periodic(unsigned long currentMillis);
+
+    unsigned long getPeriod() const;
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,86 @@
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "EEPROMWriter.h"
+#include "NoHeap.h"
+
+/* The block being written. The buffer is only changed with interrupts disabled,
+ * and once a byte has been handed to the EEPROM controller (in `EEDR`) the
+ * buffer can be safely overwritten.
+ */
+static uint8_t buffer[EEPROM_WRITER_BUFFER_SIZE];
+static volatile uint16_t baseAddress;
+static volatile uint8_t length;
+// The index into `buffer` of the next byte to check (and maybe write).
+static volatile uint8_t nextIndex;
+static volatile EEPROMWriter::Status status = EEPROMWriter::writerIdle;
+static volatile uint16_t completedCount;
+
+bool EEPROMWriter::write(uint16_t address, const void *data, size_t size) {
+  if (size > EEPROM_WRITER_BUFFER_SIZE) {
+    return false;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    /* If a write is already in progress, this restarts it from the beginning
+     * with the new data. The byte currently being written (if any) has already
+     * been latched into EEDR, and the interrupt won't fire until it's done.
+     */
+    memcpy(buffer, data, size);
+    baseAddress = address;
+    length = size;
+    nextIndex = 0;
+    status = writerBusy;
+    EECR |= _BV(EERIE);
+  }
+  return true;
+}
+
+EEPROMWriter::Status EEPROMWriter::getStatus() {
+  return status;
+}
+
+bool EEPROMWriter::isBusy() {
+  return status == writerBusy;
+}
+
+uint16_t EEPROMWriter::getCompletedCount() {
+  uint16_t count;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    count = completedCount;
+  }
+  return count;
+}
+
+void EEPROMWriter::flush() {
+  /* Interrupts need to be enabled for this to ever finish, as every byte after
+   * the current one is started from the interrupt handler.
+   */
+  while (isBusy()) {
+    eeprom_busy_wait();
+  }
+}
+
+/* The EEPROM ready interrupt fires continuously for as long as the EEPROM isn't
+ * busy, so it has to be disabled once there's nothing left to write.
+ */
+ISR(EE_READY_vect) {
+  // Skip over any bytes that don't need to change.
+  while (nextIndex < length) {
+    uint8_t index = nextIndex;
+    nextIndex = index + 1;
+    EEAR = baseAddress + index;
+    EECR |= _BV(EERE);
+    if (EEDR != buffer[index]) {
+      EEDR = buffer[index];
+      // EEPE has to be set within four cycles of EEMPE.
+      EECR |= _BV(EEMPE);
+      EECR |= _BV(EEPE);
+      return;
+    }
+  }
+  EECR &= ~_BV(EERIE);
+  status = EEPROMWriter::writerComplete;
+  ++completedCount;
+}
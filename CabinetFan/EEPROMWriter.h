@@ -0,0 +1,55 @@
+#ifndef FAN_EEPROM_WRITER_H
+#define FAN_EEPROM_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The largest block that can be queued for writing at once.
+#define EEPROM_WRITER_BUFFER_SIZE 96
+
+/* Writes a block to EEPROM in the background, driven by the EEPROM ready
+ * interrupt.
+ *
+ * Each byte takes about 3.4ms to write, so writing even a small struct with
+ * `eeprom_update_block()` stalls everything else for tens of milliseconds.
+ * Instead, `write()` copies the data into a buffer and returns right away, and
+ * `EE_READY_vect` writes one byte each time the EEPROM is ready for another.
+ * Like `eeprom_update_block()`, bytes that already hold the right value are
+ * skipped.
+ *
+ * Only one block is queued at a time. Writing a new block while one is still in
+ * flight replaces it: the writer starts over with the new data, and any bytes
+ * the first write already finished are skipped if they're unchanged.
+ *
+ * Don't read the EEPROM while `isBusy()`, as the interrupt handler changes the
+ * EEPROM address register.
+ */
+class EEPROMWriter {
+  public:
+    enum Status: uint8_t {
+      // Nothing has been written yet.
+      writerIdle,
+      // Bytes are still being written.
+      writerBusy,
+      // The last block was completely written.
+      writerComplete,
+    };
+
+    /* Queue `size` bytes from `data` to be written at `address`. Returns false
+     * (and doesn't write anything) if the block doesn't fit in the buffer.
+     */
+    static bool write(uint16_t address, const void *data, size_t size);
+
+    static Status getStatus();
+    static bool isBusy();
+
+    /* The number of blocks completely written since boot. Comparing this from
+     * before and after a write shows when that write (or one that replaced it)
+     * has finished.
+     */
+    static uint16_t getCompletedCount();
+
+    // Block until the current write has finished.
+    static void flush();
+};
+#endif
@@ -1,8 +1,9 @@
 #include <Arduino.h>
 #include <util/atomic.h>
-#include <limits.h>
 #include "Fan.h"
+#include "Trace.h"
 #include "util.h"
+#include "NoHeap.h"
 
 // The 4-pin fan spec says the PWM frequency should be 25kHz.
 #define F_CONTROL_PWM 25000
@@ -12,6 +13,8 @@ bool Fan::isTimer1Setup;
 bool Fan::isTimer3Setup;
 bool Fan::isTimer4Setup;
 bool Fan::isExternalInterruptSetup[NUM_EXTERNAL_INTERRUPTS];
+bool Fan::isInputCaptureSetup[NUM_INPUT_CAPTURE_UNITS];
+bool Fan::deferCompareWrites;
 
 /* Keep track of how many times the fan has "ticked" and when we last
  * calculated the RPMs of the fans.
@@ -24,6 +27,88 @@ static unsigned long lastTickUpdate[NUM_EXTERNAL_INTERRUPTS];
  */
 static const int RPM_UPDATE_PERIOD = 1000;
 
+/* State for measuring the tachometer signal with the input capture units.
+ * Timestamps are in timer ticks, extended to 32 bits by counting overflows.
+ * Index 0 is Timer/Counter1, index 1 is Timer/Counter3.
+ */
+static volatile uint16_t captureOverflows[NUM_INPUT_CAPTURE_UNITS];
+static volatile uint32_t lastCapture[NUM_INPUT_CAPTURE_UNITS];
+static volatile uint32_t lastPulseTicks[NUM_INPUT_CAPTURE_UNITS];
+static volatile uint32_t revolutionTicks[NUM_INPUT_CAPTURE_UNITS];
+/* The number of pulses seen since the capture was (re)started, saturating at
+ * 3. It takes three pulses to measure a full revolution (two pulses).
+ */
+static volatile uint8_t numPulses[NUM_INPUT_CAPTURE_UNITS];
+// Set when `revolutionTicks` has a new measurement.
+static volatile bool newRevolution[NUM_INPUT_CAPTURE_UNITS];
+
+// The Arduino pins connected to ICP1 (PD4) and ICP3 (PC7).
+static const uint8_t ICP1_PIN = 4;
+static const uint8_t ICP3_PIN = 13;
+
+/* The input capture timers run with a 64x prescaler, giving 4 microsecond
+ * resolution at 16MHz. The counter overflows every 262ms, so it only takes a
+ * handful of overflow interrupts a second to extend it to 32 bits.
+ */
+static const uint32_t CAPTURE_TICKS_PER_MINUTE = F_CPU / 64 * 60;
+
+/* If there's been no pulse for this many ticks (one second, about the same as
+ * edge counting), the fan is considered stopped.
+ */
+static const uint32_t CAPTURE_STALL_TICKS = F_CPU / 64;
+
+/* How long (in milliseconds) the fan is run at 100% before measuring its
+ * maximum speed.
+ */
+static const unsigned long CALIBRATION_SPIN_UP_PERIOD = RPM_UPDATE_PERIOD * 2;
+
+/* How long (in milliseconds) the maximum speed is measured for. This matches
+ * the edge counting window, so it gets at least one full RPM update.
+ */
+static const unsigned long CALIBRATION_MEASURE_PERIOD = RPM_UPDATE_PERIOD;
+
+/* How long (in milliseconds) the fan is given to settle at each duty cycle
+ * while characterizing, before it's measured (for the same time as above).
+ */
+static const unsigned long CHARACTERIZE_SETTLE_PERIOD = 2000;
+
+// The duty cycles between the points of a `FanCurve`.
+static const uint8_t CURVE_STEPS = FAN_CURVE_POINTS - 1;
+
+/* How much of the RPM error (converted to a duty cycle with the fan's curve)
+ * is taken off the duty cycle with each correction while holding an RPM. Less
+ * than all of it, as the fan is usually still settling from the last
+ * correction when it's measured.
+ */
+static const float RPM_LOOP_GAIN = 0.5;
+
+// How long (in milliseconds) a fan is kept at the ramp up speed.
+static const unsigned long RAMP_UP_PERIOD = 2000;
+
+/* How long (in milliseconds) a fan has to be stalled before it's restarted,
+ * long enough for edge counting to measure it twice.
+ */
+static const unsigned long STALL_TIMEOUT = RPM_UPDATE_PERIOD * 3;
+
+/* A fan is stalled if it's running slower than this fraction of the speed its
+ * curve gives for the duty cycle.
+ */
+static const float STALL_FRACTION = 0.25;
+
+/* Without a maximum speed to compare against (calibration measured nothing),
+ * a fan that's being driven is stalled if it's slower than this.
+ */
+static const uint16_t STALL_MIN_RPM = 100;
+
+// The most the wait before a restart is doubled, for about a minute and a half.
+static const uint8_t MAX_RESTART_BACKOFF = 5;
+
+/* How much the minimum duty cycle is raised above the one a fan stalled at,
+ * and the furthest it's raised.
+ */
+static const float MINIMUM_DUTY_STEP = 0.05;
+static const float MAX_MINIMUM_DUTY = 0.5;
+
 // Sentinel value for when a tachometer pin is not connected.
 static const uint8_t NOT_SET = UINT8_MAX;
 
@@ -38,16 +123,26 @@ static const uint8_t NOT_SET = UINT8_MAX;
 
 /* Set up the 16-bit timers (aka Timer/Counter1 and Timer/Counter 3 on the 32u4)
  * for PWM. This macro must be used in a context that has `topValue` and `mode`
- * defined.
+ * defined. It's refused, setting `setupError`, if the timer is already timing
+ * a tachometer with its input capture unit.
  *
  * `timerN` is a 16-bit Timer/Counter (either 1 or 3).
  * `outPort` is one of the output port letters (A, B, or C).
  */
 // NOTE: within a multiline #define, "//" comments will break things
 #define setup16BitPWM(timerN, outPort) do {\
-  /* Set the PWM output pins for the given timer and output port. */\
-  TCCR ## timerN ## outPort |= _BV(COM ## timerN ## outPort ## 1);\
-  TCCR ## timerN ## outPort &= ~_BV(COM ## timerN ## outPort ## 0);\
+  /* Set the PWM output pins for the given timer and output port. The COM \
+   * bits for all three ports are in TCCRnA. \
+   */\
+  if (isInputCaptureSetup[timerN == 1 ? 0 : 1]) {\
+    /* The timer is counting in normal mode for input capture, and changing \
+     * that would break the other fan's speed measurements. \
+     */\
+    setupError = pwmTimerInUse;\
+    break;\
+  }\
+  TCCR ## timerN ## A |= _BV(COM ## timerN ## outPort ## 1);\
+  TCCR ## timerN ## A &= ~_BV(COM ## timerN ## outPort ## 0);\
   if (!isTimer ## timerN ## Setup) {\
     /* Set the clock prescaler to match the system clock one to one. */\
     TCCR ## timerN ## B = _BV(CS ## timerN ## 0);\
@@ -75,6 +170,41 @@ static const uint8_t NOT_SET = UINT8_MAX;
   }\
 } while(0);
 
+/* Set up a 16-bit timer (1 or 3) for timestamping tachometer pulses with its
+ * input capture unit. The timer is run in normal mode, counting all the way up
+ * to 0xFFFF, so it can't also be used for PWM. `setupInputCapture()` keeps
+ * track of it being set up, separately from the PWM flags.
+ *
+ * `timerN` is a 16-bit Timer/Counter (either 1 or 3).
+ */
+#define setupCaptureTimer(timerN) do {\
+  TCCR ## timerN ## A = 0;\
+  /* Enable the noise canceler, capture on rising edges, and use the 64x \
+   * prescaler. \
+   */\
+  TCCR ## timerN ## B = _BV(ICNC ## timerN) | _BV(ICES ## timerN) |\
+    _BV(CS ## timerN ## 1) | _BV(CS ## timerN ## 0);\
+  TCNT ## timerN = 0;\
+  /* Clear any stale flags (by writing ones to them), then enable the \
+   * capture and overflow interrupts. \
+   */\
+  TIFR ## timerN = _BV(ICF ## timerN) | _BV(TOV ## timerN);\
+  TIMSK ## timerN = _BV(ICIE ## timerN) | _BV(TOIE ## timerN);\
+} while(0);
+
+/* Read the current 32-bit extended timestamp of an input capture timer into
+ * `result`. Must be used with interrupts disabled.
+ */
+#define readCaptureTimer(timerN, index, result) do {\
+  uint16_t count = TCNT ## timerN;\
+  uint16_t overflows = captureOverflows[index];\
+  /* Account for an overflow that the interrupt hasn't been run for yet. */\
+  if (bit_is_set(TIFR ## timerN, TOV ## timerN) && count < 0x8000) {\
+    overflows++;\
+  }\
+  result = ((uint32_t)overflows << 16) | count;\
+} while(0);
+
 /* Helper macro for setting 10-bit values for Timer 4. See section 15.11 in the
  * 32u4 datasheet for more details.
  */
@@ -106,20 +236,16 @@ Fan::Fan(
   PWMMode mode
 ):
   controlPin(controlPin),
-  sensePin(sensePin)
+  sensePin(sensePin),
+  maxRPM(0)
 {
   setupPWM(mode);
   setupInterrupts();
-  /* To set maxRPM, we set a 100% duty cycle, wait a few seconds, then count
-   * the number of ticks that occurred.
+  /* Start off at full speed, and stay there after calibration until something
+   * else sets a speed.
    */
   _setSpeed(1.0);
-  // delay() is safe to use here, as interrupts and PWM will still worked
-  // TODO: integrate the maxRPM discovery into normal periodic() operation.
-  delay(RPM_UPDATE_PERIOD * 2.);
-  periodic();
-  delay(RPM_UPDATE_PERIOD);
-  periodic();
+  calibrate();
 }
 
 Fan::Fan(
@@ -191,15 +317,15 @@ void Fan::setupPWM(PWMMode mode) {
      * `setup10BitPWM` macro, so it's being done in this `switch` statement.
      */
     case TIMER4A:
-      // OC4A is enabled in TCCR4A.
-      TCCR4A |= _BV(COM4A1);
+      // OC4A is enabled in TCCR4A, along with PWM mode for it.
+      TCCR4A |= _BV(COM4A1) | _BV(PWM4A);
       // Explicitly unset this pin to disable ~OC4A (aka OC4A complement) port.
       TCCR4A &= ~_BV(COM4A0);
       setup10BitPWM(mode);
       break;
     case TIMER4B:
       // OC4B is also enabled in TCCR4A.
-      TCCR4A |= _BV(COM4B1);
+      TCCR4A |= _BV(COM4B1) | _BV(PWM4B);
       // As above, disabling ~OC4B.
       TCCR4A &= ~_BV(COM4B0);
       setup10BitPWM(mode);
@@ -212,7 +338,7 @@ void Fan::setupPWM(PWMMode mode) {
       /* OC4D is enabled in TCCR4_C_. Additionally, shadow bits in TCCR4C have
        * no relevanance to us.
        */
-      TCCR4C |= _BV(COM4D1);
+      TCCR4C |= _BV(COM4D1) | _BV(PWM4D);
       // Ditto on disabling ~OC4D.
       TCCR4C &= ~_BV(COM4D0);
       setup10BitPWM(mode);
@@ -255,8 +381,13 @@ void Fan::setup10BitPWM(PWMMode mode) {
 }
 
 void Fan::setupInterrupts() {
+  if (sensePin == ICP1_PIN || sensePin == ICP3_PIN) {
+    setupInputCapture();
+    return;
+  }
   // Set up external interrupts (if needed)
   if (sensePin != NOT_SET) {
+    tachMode = edgeCounting;
     // TODO: untangle this mess of different numbering schemes.
     interruptIndex = digitalPinToInterrupt(sensePin);
     uint8_t vectorNumber = interruptIndex + 1;
@@ -301,6 +432,33 @@ void Fan::setupInterrupts() {
   }
 }
 
+void Fan::setupInputCapture() {
+  interruptIndex = sensePin == ICP1_PIN ? 0 : 1;
+  if (!isInputCaptureSetup[interruptIndex]) {
+    /* If the timer is already generating PWM, its counter can't be used for
+     * timing, so the fan's speed will have to go unmeasured.
+     */
+    if (interruptIndex == 0 ? isTimer1Setup : isTimer3Setup) {
+      setupError = captureTimerInUse;
+      return;
+    }
+    pinMode(sensePin, INPUT);
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+      captureOverflows[interruptIndex] = 0;
+      numPulses[interruptIndex] = 0;
+      newRevolution[interruptIndex] = false;
+      if (interruptIndex == 0) {
+        setupCaptureTimer(1);
+      } else {
+        setupCaptureTimer(3);
+      }
+    }
+    isInputCaptureSetup[interruptIndex] = true;
+  }
+  tachMode = inputCapture;
+  lastKnownRPM = 0;
+}
+
 /* Get the current speed of the fan as a percentage of the maximum speed.
  * If `sensePin` is `NOT_SET`, the speed is assumed to be equal to the last
  * requested speed.
@@ -309,15 +467,28 @@ float Fan::getSpeed() const {
   return currentSpeed;
 }
 
+void Fan::setSpeed(float fanSpeed) {
+  targetRPM = 0;
+  requestSpeed(fanSpeed);
+}
+
 /*
  * Set fan speed as a percentage of the maximum, accounting for ramp up as
  * needed.
  */
-void Fan::setSpeed(float fanSpeed) {
+void Fan::requestSpeed(float fanSpeed) {
+  if (isCalibrating()) {
+    // Calibration needs the fan at full speed, so wait until it's done.
+    calibrationTarget = fanSpeed;
+    return;
+  }
   float scaledSpeed = constrain(fanSpeed, 0.0, 1.0);
-  // Enforce a minimum of 5% (except for 0, which turns the fan off)
+  /* Enforce a minimum of 5%, or where the fan's curve says it stalls, or
+   * where it's been seen to stall (except for 0, which turns the fan off)
+   */
   if (scaledSpeed != 0.0) {
-    scaledSpeed = max(scaledSpeed, 0.05);
+    scaledSpeed = max(scaledSpeed, max(0.05, curve.getStallDuty()));
+    scaledSpeed = max(scaledSpeed, minimumDuty);
   }
   // See ramp up notes in `periodic` for explanation of the ramp-up
   bool stopped = getSpeed() == 0.0;
@@ -346,7 +517,10 @@ void Fan::_setSpeed(float fanSpeed) {
   /* Calculate the closest value for the OCRnx register for the appropriate
    * duty cycle.
    */
-  uint16_t ocrSpeed = (uint16_t)(currentSpeed * topValue);
+  compareValue = (uint16_t)(currentSpeed * topValue);
+  if (deferCompareWrites) {
+    return;
+  }
   /* All of the registers in question are either 16-bits (so really two 8-bit
    * registers) or 10-bit registers (so a weird shared high register). In both
    * cases it's possible for them to be clobbered if an interrupt is triggered
@@ -354,36 +528,44 @@ void Fan::_setSpeed(float fanSpeed) {
    * disabled while the OCRnx register is being set.
    */
   ATOMIC_BLOCK(ATOMIC_FORCEON) {
-    switch (digitalPinToTimer(controlPin)) {
-      case TIMER1A:
-        OCR1A = ocrSpeed;
-        break;
-      case TIMER1B:
-        OCR1B = ocrSpeed;
-        break;
-      case TIMER1C:
-        OCR1C = ocrSpeed;
-        break;
-      case TIMER3A:
-        OCR3A = ocrSpeed;
-        break;
-      case TIMER3B:
-        OCR3B = ocrSpeed;
-        break;
-      case TIMER3C:
-        OCR3C = ocrSpeed;
-        break;
-      case TIMER4A:
-        set10Bit(OCR4A, ocrSpeed);
-        break;
-      case TIMER4B:
-        set10Bit(OCR4B, ocrSpeed);
-        break;
-      // Skipping OCR4C, as it's used for setting the TOP value
-      case TIMER4D:
-        set10Bit(OCR4D, ocrSpeed);
-        break;
-    }
+    writeCompare();
+  }
+}
+
+void Fan::writeCompare() {
+  // The timer is timing another fan's tachometer, not generating PWM.
+  if (setupError == pwmTimerInUse) {
+    return;
+  }
+  switch (digitalPinToTimer(controlPin)) {
+    case TIMER1A:
+      OCR1A = compareValue;
+      break;
+    case TIMER1B:
+      OCR1B = compareValue;
+      break;
+    case TIMER1C:
+      OCR1C = compareValue;
+      break;
+    case TIMER3A:
+      OCR3A = compareValue;
+      break;
+    case TIMER3B:
+      OCR3B = compareValue;
+      break;
+    case TIMER3C:
+      OCR3C = compareValue;
+      break;
+    case TIMER4A:
+      set10Bit(OCR4A, compareValue);
+      break;
+    case TIMER4B:
+      set10Bit(OCR4B, compareValue);
+      break;
+    // Skipping OCR4C, as it's used for setting the TOP value
+    case TIMER4D:
+      set10Bit(OCR4D, compareValue);
+      break;
   }
 }
 
@@ -392,20 +574,246 @@ void Fan::_setSpeed(float fanSpeed) {
  * requested fractional speed and the provided maximum speed.
  */
 uint16_t Fan::getRPM() const {
-  if (sensePin != NOT_SET) {
+  if (tachMode != notSensed) {
     return lastKnownRPM;
   } else {
     /* If we're not sensing, we don't definitively know how fast we're going.
      * Instead we fudge it based on the requested speed and the provided top
      * speed.
      */
-    return maxRPM * currentSpeed;
+    return maxRPM * curve.getSpeed(currentSpeed);
+  }
+}
+
+uint16_t Fan::getMaxRPM() const {
+  return maxRPM;
+}
+
+void Fan::calibrate() {
+  if (tachMode == notSensed) {
+    return;
+  }
+  characterizing = false;
+  minimumDuty = 0.0;
+  if (!isCalibrating()) {
+    // Return to the current speed (or the end of a ramp) when done.
+    calibrationTarget = rampTarget != 0.0 ? rampTarget : currentSpeed;
+  }
+  rampTarget = 0.0;
+  _setSpeed(1.0);
+  calibrationState = calibrationSpinUp;
+  calibrationStepStart = millis();
+}
+
+void Fan::characterize() {
+  if (tachMode == notSensed) {
+    return;
+  }
+  calibrate();
+  characterizing = true;
+}
+
+const FanCurve & Fan::getCurve() const {
+  return curve;
+}
+
+void Fan::setCurve(const fanCurveValues &values) {
+  curve.set(values);
+}
+
+uint16_t Fan::getStallCount() const {
+  return stallCount;
+}
+
+uint16_t Fan::getFailedRestartCount() const {
+  return failedRestartCount;
+}
+
+bool Fan::isStalled() const {
+  return restartAttempts > 0;
+}
+
+bool Fan::hasCalibrationFault() const {
+  return calibrationFault;
+}
+
+FanSetupError Fan::getSetupError() const {
+  return setupError;
+}
+
+float Fan::getMinimumDuty() const {
+  return minimumDuty;
+}
+
+CalibrationState Fan::getCalibrationState() const {
+  return calibrationState;
+}
+
+bool Fan::isCalibrating() const {
+  return calibrationState != calibrated;
+}
+
+uint8_t Fan::getCalibrationProgress() const {
+  const unsigned long calibrationTotal = CALIBRATION_SPIN_UP_PERIOD + CALIBRATION_MEASURE_PERIOD;
+  const unsigned long pointTotal = CHARACTERIZE_SETTLE_PERIOD + CALIBRATION_MEASURE_PERIOD;
+  // The points measured by characterizing (full speed is from calibrating).
+  const uint8_t curvePoints = FAN_CURVE_POINTS - 2;
+  unsigned long total = calibrationTotal;
+  if (characterizing) {
+    total += curvePoints * pointTotal;
+  }
+  unsigned long elapsed = millis() - calibrationStepStart;
+  // Characterizing counts down from the point below full speed.
+  const unsigned long pointsDone = curvePoints - characterizePoint;
+  switch (calibrationState) {
+    case calibrationSpinUp:
+      elapsed = min(elapsed, CALIBRATION_SPIN_UP_PERIOD);
+      break;
+    case calibrationMeasuring:
+      elapsed = CALIBRATION_SPIN_UP_PERIOD + min(elapsed, CALIBRATION_MEASURE_PERIOD);
+      break;
+    case characterizeSettling:
+      elapsed = calibrationTotal + pointsDone * pointTotal + min(elapsed, CHARACTERIZE_SETTLE_PERIOD);
+      break;
+    case characterizeMeasuring:
+      elapsed = calibrationTotal + pointsDone * pointTotal + CHARACTERIZE_SETTLE_PERIOD + min(elapsed, CALIBRATION_MEASURE_PERIOD);
+      break;
+    default:
+      return 100;
+  }
+  // Don't claim to be done until it actually is.
+  return min(elapsed * 100 / total, 99UL);
+}
+
+void Fan::updateCalibration(unsigned long currentMillis) {
+  switch (calibrationState) {
+    case calibrationSpinUp:
+      if (periodPassed(currentMillis, calibrationStepStart, CALIBRATION_SPIN_UP_PERIOD)) {
+        calibrationState = calibrationMeasuring;
+        calibrationStepStart = currentMillis;
+        calibrationRPM = 0;
+        // Start a fresh window, so none of the spin up is included.
+        restartTachWindow(currentMillis);
+      }
+      break;
+    case calibrationMeasuring:
+      calibrationRPM = max(calibrationRPM, lastKnownRPM);
+      if (periodPassed(currentMillis, calibrationStepStart, CALIBRATION_MEASURE_PERIOD)) {
+        // Replace the old maximum, in case the fan has slowed down with age.
+        maxRPM = calibrationRPM;
+        calibrationFault = maxRPM == 0;
+        if (characterizing && maxRPM != 0) {
+          // Full speed is the maximum, by definition.
+          measuredCurve.speeds[CURVE_STEPS] = 255;
+          characterizePoint = CURVE_STEPS - 1;
+          startCurvePoint(currentMillis);
+        } else {
+          finishCalibration(currentMillis);
+        }
+      }
+      break;
+    case characterizeSettling:
+      if (periodPassed(currentMillis, calibrationStepStart, CHARACTERIZE_SETTLE_PERIOD)) {
+        calibrationState = characterizeMeasuring;
+        calibrationStepStart = currentMillis;
+        restartTachWindow(currentMillis);
+      }
+      break;
+    case characterizeMeasuring:
+      if (periodPassed(currentMillis, calibrationStepStart, CALIBRATION_MEASURE_PERIOD)) {
+        measuredCurve.speeds[characterizePoint] = min(
+          (uint32_t)lastKnownRPM * 255 / maxRPM,
+          255UL
+        );
+        if (lastKnownRPM == 0 || characterizePoint == 1) {
+          // Everything below a stall is stalled too, and 0% is off.
+          for (uint8_t i = 0; i < characterizePoint; i++) {
+            measuredCurve.speeds[i] = 0;
+          }
+          curve.set(measuredCurve);
+          finishCalibration(currentMillis);
+        } else {
+          characterizePoint--;
+          startCurvePoint(currentMillis);
+        }
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void Fan::restartTachWindow(unsigned long currentMillis) {
+  if (tachMode == edgeCounting) {
+    ATOMIC_BLOCK(ATOMIC_FORCEON) {
+      numTicks[interruptIndex] = 0;
+    }
+    lastTickUpdate[interruptIndex] = currentMillis;
+  }
+}
+
+void Fan::startCurvePoint(unsigned long currentMillis) {
+  calibrationState = characterizeSettling;
+  calibrationStepStart = currentMillis;
+  _setSpeed((float)characterizePoint / CURVE_STEPS);
+}
+
+void Fan::finishCalibration(unsigned long currentMillis) {
+  calibrationState = calibrated;
+  characterizing = false;
+  if (targetRPM != 0 && maxRPM != 0) {
+    // Now there's a maximum to estimate the duty cycle from.
+    calibrationTarget = estimateDuty(targetRPM);
+    lastRPMCorrection = currentMillis;
+  }
+  requestSpeed(calibrationTarget);
+}
+
+float Fan::estimateDuty(uint16_t rpmSpeed) const {
+  return curve.getDuty((float)rpmSpeed / maxRPM);
+}
+
+void Fan::setRPM(uint16_t rpmSpeed) {
+  if (rpmSpeed == 0) {
+    setSpeed(0.0);
+    return;
+  }
+  const uint16_t previousTarget = targetRPM;
+  targetRPM = rpmSpeed;
+  if (maxRPM == 0) {
+    // Still calibrating, so there's nothing to estimate from yet.
+    requestSpeed(1.0);
+  } else if (previousTarget != 0 && rampTarget == 0.0 && !isCalibrating()) {
+    /* Already holding a speed, so keep the correction found so far and just
+     * move by the change in target.
+     */
+    requestSpeed(
+      currentSpeed + estimateDuty(rpmSpeed) - estimateDuty(previousTarget)
+    );
+  } else {
+    requestSpeed(estimateDuty(rpmSpeed));
+    lastRPMCorrection = millis();
   }
 }
 
-// An inexact method of setting the fan speed by giving a target RPM.
-void Fan::setRPM(int rpmSpeed) {
-  setSpeed(rpmSpeed / maxRPM);
+uint16_t Fan::getTargetRPM() const {
+  return targetRPM;
+}
+
+void Fan::correctRPM(unsigned long currentMillis) {
+  if (
+    targetRPM == 0 ||
+    maxRPM == 0 ||
+    rampTarget != 0.0 ||
+    isCalibrating() ||
+    !periodPassed(currentMillis, lastRPMCorrection, RPM_LOOP_PERIOD)
+  ) {
+    return;
+  }
+  lastRPMCorrection = currentMillis;
+  // The error as a duty cycle, following the slope of the curve.
+  const float error = estimateDuty(targetRPM) - estimateDuty(lastKnownRPM);
+  requestSpeed(currentSpeed + RPM_LOOP_GAIN * error);
 }
 
 /* Like `periodic(unsigned long)`, but it fills in the current number of
@@ -416,48 +824,161 @@ void Fan::periodic() {
   periodic(millis());
 }
 
-/* Handle various period tasks. This method should be called roughly every
- * second or so.
+/* Handle various period tasks. This is run by the scheduler every
+ * `FAN_TASK_PERIOD` milliseconds, but it can be called more (or less) often.
  */
 void Fan::periodic(unsigned long currentMillis) {
+  TRACE_SCOPE(traceFans);
+  TachSample sample;
+  /* Disable interrupts while we're retrieving and resetting the tick counts.
+   * It's also important to disable interrupts when accessing these values so
+   * they don't get corrupted in between operating on the high and low bits.
+   */
+  ATOMIC_BLOCK(ATOMIC_FORCEON) {
+    sampleTach(currentMillis, &sample);
+  }
+  update(currentMillis, sample);
+}
+
+unsigned long Fan::getPeriod() const {
+  return FAN_TASK_PERIOD;
+}
+
+void Fan::sampleTach(unsigned long currentMillis, TachSample *sample) {
+  sample->ready = false;
+  sample->stalled = false;
+  if (tachMode == inputCapture) {
+    sample->ready = newRevolution[interruptIndex];
+    newRevolution[interruptIndex] = false;
+    sample->revolutionTicks = revolutionTicks[interruptIndex];
+    uint32_t now;
+    if (interruptIndex == 0) {
+      readCaptureTimer(1, 0, now);
+    } else {
+      readCaptureTimer(3, 1, now);
+    }
+    uint32_t sinceLastPulse = now - lastCapture[interruptIndex];
+    if (numPulses[interruptIndex] > 0 && sinceLastPulse > CAPTURE_STALL_TICKS) {
+      /* Start measuring from scratch, as the last pulse is too old to use
+       * for the next revolution.
+       */
+      numPulses[interruptIndex] = 0;
+      sample->ready = false;
+      sample->stalled = true;
+    }
+  } else if (
+    tachMode == edgeCounting &&
+    periodPassed(currentMillis, lastTickUpdate[interruptIndex], RPM_UPDATE_PERIOD)
+  ) {
+    // Unsigned subtraction gives the right answer across `millis()` overflow.
+    sample->period = currentMillis - lastTickUpdate[interruptIndex];
+    // Reset lastTickUpdate *after* the period has been calculated.
+    lastTickUpdate[interruptIndex] = currentMillis;
+    sample->tickCount = numTicks[interruptIndex];
+    numTicks[interruptIndex] = 0;
+    sample->ready = true;
+  }
+}
+
+void Fan::update(unsigned long currentMillis, const TachSample &sample) {
   /* Check if we're doing a ramp-up cycle and finish it if needed.
    * When starting from a dead stop, the fan should be set to a 30% duty cycle
    * for 2 seconds and then move to the final speed.
    */
-  if (rampTarget != 0.0 && periodPassed(currentMillis, rampStartTime, 2000)) {
+  if (
+    rampTarget != 0.0 &&
+    periodPassed(currentMillis, rampStartTime, RAMP_UP_PERIOD)
+  ) {
     _setSpeed(rampTarget);
     rampTarget = 0.0;
+    // The next RPM measurement is mostly of the ramp, so skip it.
+    lastRPMCorrection = currentMillis;
   }
-  // Update the current fan speed if we have a sense pin set.
-  if (
-    sensePin != NOT_SET &&
-    periodPassed(currentMillis, lastTickUpdate[interruptIndex], RPM_UPDATE_PERIOD)
-  ) {
-    unsigned long period;
-    if (currentMillis < lastTickUpdate[interruptIndex]) {
-      period = currentMillis - lastTickUpdate[interruptIndex];
-    } else {
-      // Handle the case where `millis()` has overflowed.
-      period = ULONG_MAX - lastTickUpdate[interruptIndex] + currentMillis;
-    }
-    // Reset lastTickUpdate *after* the period has been calculated.
-    lastTickUpdate[interruptIndex] = currentMillis;
-    uint16_t tickCount;
-    /* Disable interrupts while we're retrieving and resetting the tick counts.
-     * It's also important to disable interrupts when accessing these values so
-     * they don't get corrupted in between operating on the high and low bits.
+  if (sample.stalled) {
+    lastKnownRPM = 0;
+  }
+  if (sample.ready && tachMode == inputCapture) {
+    /* A glitch on the tachometer can make a revolution look impossibly short,
+     * so the speed is clamped before it's narrowed.
      */
-    ATOMIC_BLOCK(ATOMIC_FORCEON) {
-      tickCount = numTicks[interruptIndex];
-      numTicks[interruptIndex] = 0;
-    }
-    float periodSeconds = (float)period / 1000.0;
+    const uint32_t rpm = sample.revolutionTicks != 0 ?
+      CAPTURE_TICKS_PER_MINUTE / sample.revolutionTicks : UINT32_MAX;
+    lastKnownRPM = filterRPM(min(rpm, (uint32_t)UINT16_MAX));
+    maxRPM = max(lastKnownRPM, maxRPM);
+  }
+  // Update the current fan speed if we're counting tachometer edges.
+  if (sample.ready && tachMode == edgeCounting) {
     /* The tachometer signal transitions four times per rotation (twice up,
-     * twice down).
+     * twice down), and there are 60000 milliseconds in a minute.
      */
-    lastKnownRPM = (tickCount / 4 * periodSeconds * 60.);
+    lastKnownRPM = filterRPM(
+      (uint32_t)sample.tickCount * 15000UL / sample.period
+    );
     maxRPM = max(lastKnownRPM, maxRPM);
   }
+  if (sample.ready || sample.stalled) {
+    correctRPM(currentMillis);
+  }
+  if (isCalibrating()) {
+    updateCalibration(currentMillis);
+  }
+  superviseStall(currentMillis);
+}
+
+void Fan::superviseStall(unsigned long currentMillis) {
+  if (tachMode == notSensed) {
+    return;
+  }
+  const unsigned long recoveryPeriod = RAMP_UP_PERIOD + STALL_TIMEOUT;
+  /* A fan jammed when it was calibrated has a maximum of 0, which would
+   * expect it to be stopped.
+   */
+  const float stallRPM = maxRPM != 0 ?
+    maxRPM * curve.getSpeed(currentSpeed) * STALL_FRACTION :
+    STALL_MIN_RPM;
+  if (
+    currentSpeed == 0.0 ||
+    rampTarget != 0.0 ||
+    isCalibrating() ||
+    lastKnownRPM >= stallRPM
+  ) {
+    lastRunning = currentMillis;
+    /* It's only recovered once it's kept running after the restart's kick
+     * (the speed measured during the kick doesn't count).
+     */
+    if (
+      currentSpeed != 0.0 &&
+      rampTarget == 0.0 &&
+      !isCalibrating() &&
+      periodPassed(currentMillis, rampStartTime, recoveryPeriod)
+    ) {
+      restartAttempts = 0;
+    }
+    return;
+  }
+  const unsigned long timeout =
+    STALL_TIMEOUT << min(restartAttempts, MAX_RESTART_BACKOFF);
+  if (!periodPassed(currentMillis, lastRunning, timeout)) {
+    return;
+  }
+  if (restartAttempts == 0) {
+    stallCount++;
+  } else {
+    failedRestartCount++;
+  }
+  // It stalled at this duty cycle, so don't go this low again.
+  minimumDuty = max(minimumDuty, currentSpeed + MINIMUM_DUTY_STEP);
+  minimumDuty = min(minimumDuty, MAX_MINIMUM_DUTY);
+  restartAttempts = min(restartAttempts + 1, UINT8_MAX);
+  // Kick it, then settle at the new minimum (at least).
+  rampTarget = max(currentSpeed, minimumDuty);
+  rampStartTime = currentMillis;
+  _setSpeed(1.0);
+  lastRunning = currentMillis;
+}
+
+uint16_t Fan::filterRPM(uint16_t measured) {
+  return measured;
 }
 
 /* Super simple interrupt handlers, just incrementing the appropriate tick
@@ -468,8 +989,40 @@ void Fan::periodic(unsigned long currentMillis) {
  * EIFR, while this approach is pretty simple, just a two-ish cycle increment
  * of a 16-bit variable (in addition to the interrupt preamble and teardown).
  */
-ISR(INT0_vect) { ++numTicks[0]; }
-ISR(INT1_vect) { ++numTicks[1]; }
-ISR(INT2_vect) { ++numTicks[2]; }
-ISR(INT3_vect) { ++numTicks[3]; }
-ISR(INT6_vect) { ++numTicks[4]; }
\ No newline at end of file
+ISR(INT0_vect) { TRACE_SCOPE(traceTachInterrupt); ++numTicks[0]; }
+ISR(INT1_vect) { TRACE_SCOPE(traceTachInterrupt); ++numTicks[1]; }
+ISR(INT2_vect) { TRACE_SCOPE(traceTachInterrupt); ++numTicks[2]; }
+ISR(INT3_vect) { TRACE_SCOPE(traceTachInterrupt); ++numTicks[3]; }
+ISR(INT6_vect) { TRACE_SCOPE(traceTachInterrupt); ++numTicks[4]; }
+
+/* The input capture handlers timestamp each pulse (two per revolution) and
+ * keep the length of the latest full revolution. Like `setup16BitPWM`, this is
+ * a macro to handle the register names for both timers.
+ */
+#define captureISR(timerN, index) \
+ISR(TIMER ## timerN ## _CAPT_vect) {\
+  TRACE_SCOPE(traceTachInterrupt);\
+  uint16_t captured = ICR ## timerN;\
+  uint16_t overflows = captureOverflows[index];\
+  /* If the timer overflowed just before the capture, the overflow interrupt \
+   * hasn't been run yet (it's lower priority). \
+   */\
+  if (bit_is_set(TIFR ## timerN, TOV ## timerN) && captured < 0x8000) {\
+    overflows++;\
+  }\
+  uint32_t timestamp = ((uint32_t)overflows << 16) | captured;\
+  uint32_t pulseTicks = timestamp - lastCapture[index];\
+  lastCapture[index] = timestamp;\
+  if (numPulses[index] < 3) {\
+    ++numPulses[index];\
+  }\
+  if (numPulses[index] == 3) {\
+    revolutionTicks[index] = pulseTicks + lastPulseTicks[index];\
+    newRevolution[index] = true;\
+  }\
+  lastPulseTicks[index] = pulseTicks;\
+}\
+ISR(TIMER ## timerN ## _OVF_vect) { ++captureOverflows[index]; }
+
+captureISR(1, 0)
+captureISR(3, 1)
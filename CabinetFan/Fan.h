@@ -2,6 +2,9 @@
 #define FAN_FAN_H
 
 #include <stdint.h>
+#include "FanCurve.h"
+#include "Filters.h"
+#include "Scheduler.h"
 
 /* Hardcoding five external interrupts, tying this to the 32u4 pretty hard.
  * Ordering is external interrupts 0, 1, 2, 3, 6 (with interrupt numbers
@@ -9,21 +12,87 @@
  */
 #define NUM_EXTERNAL_INTERRUPTS 5
 
+/* The 32u4 has two input capture units, on the 16-bit Timer/Counters 1 and 3.
+ * Their pins are ICP1 (PD4, Arduino pin 4) and ICP3 (PC7, Arduino pin 13).
+ */
+#define NUM_INPUT_CAPTURE_UNITS 2
+
+/* How frequently (in milliseconds) `periodic()` is run. The individual jobs in
+ * there (ramping up, counting edges, calibration) each have their own longer
+ * periods, this just sets how closely those are followed.
+ */
+#define FAN_TASK_PERIOD 100UL
+
+/* The shortest time (in milliseconds) between corrections of the duty cycle
+ * while holding an RPM. A fan takes a good part of a second to settle at a new
+ * speed, so correcting on every input capture measurement would only chase
+ * its inertia. This matches how often edge counting measures the RPM.
+ */
+#define RPM_LOOP_PERIOD 1000UL
+
 enum PWMMode {
   fast,
   phaseCorrect,
   phaseFrequencyCorrect
 };
 
-class Fan {
+// How the speed of a fan is measured.
+enum TachMode {
+  // There's no tachometer signal, so the speed is estimated.
+  notSensed,
+  /* Tachometer edges are counted with an external interrupt, and the RPM is
+   * calculated from the count once a second.
+   */
+  edgeCounting,
+  /* Each tachometer pulse is timestamped by a 16-bit timer's input capture
+   * unit, and the RPM is calculated from the length of the last revolution.
+   */
+  inputCapture
+};
+
+/* Why a fan couldn't be set up as it was asked to be. Timer/Counters 1 and 3
+ * can either generate PWM or time a tachometer with their input capture unit,
+ * not both, so whichever is asked for second is refused.
+ */
+enum FanSetupError {
+  fanSetupOK,
+  // The control pin's timer is timing a tachometer, so there's no PWM.
+  pwmTimerInUse,
+  // The tachometer pin's timer is generating PWM, so the speed isn't sensed.
+  captureTimerInUse
+};
+
+/* Progress through discovering a fan's maximum speed. The fan is run at 100%
+ * for a couple of seconds to spin up, then its speed is measured. When
+ * characterizing, it then steps down through the duty cycles of its
+ * `FanCurve`, settling then measuring at each.
+ */
+enum CalibrationState {
+  calibrationSpinUp,
+  calibrationMeasuring,
+  characterizeSettling,
+  characterizeMeasuring,
+  calibrated
+};
+
+class FanArray;
+
+class Fan: public Task {
   public:
     /* Create a `Fan` that is able to detect the actual speed with a tachometer
      * pin.
      *
+     * The maximum speed of the fan is calibrated in the background by
+     * `periodic()` over the first few seconds (see `calibrate()`).
+     *
      * ` controlPin` - An Arduino PWM output pin connected to either a 16-bit or
      * 10-bit Timer/Counter.
-     * `sensePin` - An Arduino pin number that is able to be used as an external
-     * interrupt.
+     * `sensePin` - An Arduino pin number that is able to be used as either an
+     * external interrupt or an input capture pin (4 or 13). With an input
+     * capture pin, that pin's Timer/Counter is used for timing the tachometer
+     * pulses, so it can't also be used for PWM. For example, with `controlPin`
+     * on Timer/Counter1 (pin 9 or 10), `sensePin` can be pin 13 (ICP3) but not
+     * pin 4 (ICP1). A conflicting request is refused (see `getSetupError()`).
      * `mode` - A `PWMMode` defining the specifics of the PWM signal.
      */
     Fan(
@@ -49,7 +118,8 @@ class Fan {
     // Get the current speed of the attached fan as a range from 0.0 to 1.0.
     float getSpeed() const;
 
-    /* Set the speed of the attached fan.
+    /* Set the speed of the attached fan, as a duty cycle. This stops holding
+     * an RPM set with `setRPM()`.
      *
      * If the requested speed is less than 30% of the maximum and the fan is
      * currently stopped, a ramp up cycle is started. The fan is started at a
@@ -62,12 +132,109 @@ class Fan {
     void setSpeed(float fanSpeed);
 
     uint16_t getRPM() const;
-    void setRPM(int rpmSpeed);
+
+    /* Hold the attached fan at `rpmSpeed` rotations per minute, 0 to stop it.
+     *
+     * The duty cycle starts at what `rpmSpeed` would be if the speed was
+     * proportional to the duty cycle, then each RPM measurement (every
+     * `RPM_LOOP_PERIOD` at most) nudges it towards the target, so the fan ends
+     * up at the requested speed whatever its supply voltage or age. Without a
+     * tachometer, the duty cycle is only set from the estimate.
+     */
+    void setRPM(uint16_t rpmSpeed);
+
+    // The RPM being held, or 0 when the speed was set as a duty cycle.
+    uint16_t getTargetRPM() const;
+
+    /* The maximum speed of the fan, in RPM. For fans with a tachometer, this
+     * is only accurate once calibration has finished.
+     */
+    uint16_t getMaxRPM() const;
+
+    /* (Re)discover the maximum speed of the fan. The fan is run at 100% while
+     * `periodic()` measures it, which takes about three seconds. Any speed set
+     * in the mean time is applied once calibration is done. Does nothing for
+     * fans without a tachometer.
+     */
+    void calibrate();
+
+    /* Calibrate, then measure the fan's speed at each of the duty cycles in
+     * its `FanCurve`, from the top down. That takes about three seconds a
+     * point, less if the fan stalls part way down (as everything below is
+     * stalled too). Like `calibrate()`, speeds set in the mean time are
+     * applied once it's done. Does nothing for fans without a tachometer.
+     */
+    void characterize();
+
+    /* How the fan's speed depends on the duty cycle, used for estimating the
+     * RPM without a tachometer and the duty cycle for an RPM. A straight line
+     * until set or characterized.
+     */
+    const FanCurve & getCurve() const;
+    void setCurve(const fanCurveValues &values);
+
+    /* The fault counters from the stall supervisor (see `superviseStall()`):
+     * how many times the fan has stalled, and how many restarts didn't get it
+     * going again.
+     */
+    uint16_t getStallCount() const;
+    uint16_t getFailedRestartCount() const;
+
+    // True from a stall being detected until the fan is running again.
+    bool isStalled() const;
+
+    /* True when the last calibration measured 0 RPM at full speed: the fan is
+     * jammed, or its tachometer isn't connected. While its maximum RPM is 0,
+     * it's taken as stalled whenever it's slower than a fixed minimum RPM.
+     */
+    bool hasCalibrationFault() const;
+
+    // What went wrong setting up the fan's timers, if anything.
+    FanSetupError getSetupError() const;
+
+    /* The lowest duty cycle the fan is run at, raised each time it stalls.
+     * Reset by `calibrate()`.
+     */
+    float getMinimumDuty() const;
+
+    CalibrationState getCalibrationState() const;
+    bool isCalibrating() const;
+
+    // How far along calibration is, as a percentage.
+    uint8_t getCalibrationProgress() const;
 
     void periodic();
+    // Called by the scheduler once every `getPeriod()` milliseconds.
     void periodic(unsigned long currentMillis);
 
+    unsigned long getPeriod() const;
+
+  protected:
+    /* Smooth a new RPM measurement, returning the RPM to report. Plain fans
+     * report every measurement as is, see `FilteredFan`. A stalled fan is
+     * reported as stopped straight away, without going through the filter.
+     */
+    virtual uint16_t filterRPM(uint16_t measured);
+
   private:
+    // A `FanArray` batches the tachometer sampling and PWM updates of its fans.
+    friend class FanArray;
+
+    /* The tachometer state needed to update the RPM, copied out of the
+     * interrupt handlers' variables by `sampleTach()`.
+     */
+    struct TachSample {
+      // Set when there's a new measurement to calculate the RPM from.
+      bool ready;
+      // Edge counting: the edges counted, over `period` milliseconds.
+      uint16_t tickCount;
+      unsigned long period;
+      // Input capture: the length of the last revolution, in timer ticks.
+      uint32_t revolutionTicks;
+      // Input capture: set when the pulses have stopped.
+      bool stalled;
+    };
+
     // The Arduino pin the PWM signal is generated on.
     const uint8_t controlPin;
 
@@ -89,8 +256,11 @@ class Fan {
      */
     uint16_t topValue;
 
-    /* The array index used for tracking tachometer ticks from the interrupt
-     * handler.
+    // How the tachometer signal (if any) is being measured.
+    TachMode tachMode = notSensed;
+
+    /* The array index used for tracking tachometer ticks (or input captures)
+     * from the interrupt handlers.
      */
     uint8_t interruptIndex;
 
@@ -107,11 +277,61 @@ class Fan {
     // The last requested speed (as a percentage of the maximum speed).
     float currentSpeed = 0.0;
 
+    // The RPM being held by `correctRPM()`, 0 if none is.
+    uint16_t targetRPM = 0;
+
+    // When the duty cycle was last corrected towards `targetRPM`.
+    unsigned long lastRPMCorrection = 0;
+
+    CalibrationState calibrationState = calibrated;
+
+    // When the current calibration step was started.
+    unsigned long calibrationStepStart = 0;
+
+    // The highest RPM seen while measuring during calibration.
+    uint16_t calibrationRPM = 0;
+
+    // See `hasCalibrationFault()`.
+    bool calibrationFault = false;
+
+    // The speed to go to once calibration is done.
+    float calibrationTarget = 0.0;
+
+    FanCurve curve;
+
+    /* Set while calibrating to characterize, then the curve point being
+     * measured.
+     */
+    bool characterizing = false;
+    uint8_t characterizePoint = 0;
+
+    // The curve being measured.
+    fanCurveValues measuredCurve;
+
+    // See `getMinimumDuty()`.
+    float minimumDuty = 0.0;
+
+    /* The last time the fan was running as fast as it should be, or wasn't
+     * expected to be (stopped, ramping or calibrating).
+     */
+    unsigned long lastRunning = 0;
+
+    // Restarts tried since the fan stalled, 0 while it's running.
+    uint8_t restartAttempts = 0;
+
+    uint16_t stallCount = 0;
+    uint16_t failedRestartCount = 0;
+
     // The last known sensed RPM.
     uint16_t lastKnownRPM;
 
+    // See `getSetupError()`.
+    FanSetupError setupError = fanSetupOK;
+
     /* Flags to ensure a timer is not double-configured. It shouldn't hurt
      * anything if it is, but it might be able to disrupt an operating signal.
+     * The `isTimerNSetup` flags are for PWM, and `isInputCaptureSetup` for
+     * timing a tachometer, so one can refuse the other.
      *
      * These values are all initialized to 0 (which is equivalent to false) by
      * nature of being declared static.
@@ -120,13 +340,94 @@ class Fan {
     static bool isTimer3Setup;
     static bool isTimer4Setup;
     static bool isExternalInterruptSetup[NUM_EXTERNAL_INTERRUPTS];
+    static bool isInputCaptureSetup[NUM_INPUT_CAPTURE_UNITS];
+
+    // The output compare value for the current duty cycle.
+    uint16_t compareValue = 0;
+
+    /* While set, `_setSpeed()` only updates `compareValue`, and the output
+     * compare registers are left for a `FanArray` to write all at once.
+     */
+    static bool deferCompareWrites;
 
     // Private method for directly setting the duty cycle of the PWM signal.
     void _setSpeed(float fanSpeed);
 
+    /* `setSpeed()` without cancelling `targetRPM`, accounting for ramp up
+     * and calibration.
+     */
+    void requestSpeed(float fanSpeed);
+
+    /* Move the duty cycle towards `targetRPM` after a new RPM measurement,
+     * called from `update()`.
+     */
+    void correctRPM(unsigned long currentMillis);
+
+    /* Copy `compareValue` to the output compare register. Must be called with
+     * interrupts disabled.
+     */
+    void writeCompare();
+
     // Private setup methods
     void setupPWM(PWMMode mode);
     void setup10BitPWM(PWMMode mode);
     void setupInterrupts();
+    void setupInputCapture();
+
+    /* Take a snapshot of the tachometer state, resetting the edge count if its
+     * window has finished. Must be called with interrupts disabled.
+     */
+    void sampleTach(unsigned long currentMillis, TachSample *sample);
+
+    /* The rest of `periodic()`: ramping, updating the RPM from a tachometer
+     * sample, and calibration.
+     */
+    void update(unsigned long currentMillis, const TachSample &sample);
+
+    // Advance calibration, called from `periodic()`.
+    void updateCalibration(unsigned long currentMillis);
+
+    /* Restart the edge counting window, so a measurement doesn't include what
+     * the fan was doing before.
+     */
+    void restartTachWindow(unsigned long currentMillis);
+
+    // Start settling at the next curve point.
+    void startCurvePoint(unsigned long currentMillis);
+
+    // Done calibrating, go back to the speed that was set.
+    void finishCalibration(unsigned long currentMillis);
+
+    // The duty cycle for `rpmSpeed`, from the curve. Needs `maxRPM`.
+    float estimateDuty(uint16_t rpmSpeed) const;
+
+    /* Watch for the fan stopping (or barely turning) while it's being driven,
+     * called from `update()`. Once it's been stalled for `STALL_TIMEOUT`, the
+     * minimum duty cycle is raised and it's kicked at full speed, like the
+     * ramp up from a stop. Each further restart waits twice as long as the
+     * last, so a jammed fan isn't kicked constantly.
+     */
+    void superviseStall(unsigned long currentMillis);
+};
+
+/* A `Fan` smoothing its tachometer measurements with the filter `F`, any of
+ * the filters in Filters.h. Worth it with input capture, which measures every
+ * revolution and so picks up the odd glitched pulse; a `MedianFilter` throws
+ * those out. Like any `Fan`, it's built in `setup()`. For example:
+ *
+ *   static FilteredFan< MedianFilter<uint16_t, 3> > fan(controlPin, tachPin);
+ */
+template<typename F>
+class FilteredFan: public Fan {
+  public:
+    using Fan::Fan;
+
+  protected:
+    virtual uint16_t filterRPM(uint16_t measured) {
+      return filter.update(measured);
+    }
+
+  private:
+    F filter;
 };
 #endif
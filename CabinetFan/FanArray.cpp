@@ -0,0 +1,188 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "FanArray.h"
+#include "Trace.h"
+#include "NoHeap.h"
+
+FanArray::FanArray(): numFans(0), fullSpeedRPM(0) {}
+
+bool FanArray::add(Fan *fan) {
+  if (numFans == FAN_ARRAY_MAX_FANS) {
+    return false;
+  }
+  fans[numFans++] = fan;
+  return true;
+}
+
+uint8_t FanArray::size() const {
+  return numFans;
+}
+
+Fan * FanArray::get(uint8_t index) const {
+  return index < numFans ? fans[index] : NULL;
+}
+
+float FanArray::getSpeed(uint8_t members) const {
+  if (fullSpeedRPM == 0) {
+    return getDutyCycle(members);
+  }
+  uint32_t total = 0;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      total += fans[i]->getTargetRPM();
+      count++;
+    }
+  }
+  return count > 0 ? (float)total / count / fullSpeedRPM : 0.0;
+}
+
+void FanArray::setSpeed(float fanSpeed, uint8_t members) {
+  if (fullSpeedRPM != 0) {
+    setRPM(constrain(fanSpeed, 0.0, 1.0) * fullSpeedRPM, members);
+    return;
+  }
+  Fan::deferCompareWrites = true;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      fans[i]->setSpeed(fanSpeed);
+    }
+  }
+  Fan::deferCompareWrites = false;
+  writeCompares(members);
+}
+
+float FanArray::getDutyCycle(uint8_t members) const {
+  float total = 0.0;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      total += fans[i]->getSpeed();
+      count++;
+    }
+  }
+  return count > 0 ? total / count : 0.0;
+}
+
+void FanArray::setRPM(uint16_t rpmSpeed, uint8_t members) {
+  Fan::deferCompareWrites = true;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      fans[i]->setRPM(rpmSpeed);
+    }
+  }
+  Fan::deferCompareWrites = false;
+  writeCompares(members);
+}
+
+void FanArray::setFullSpeedRPM(uint16_t rpmSpeed) {
+  fullSpeedRPM = rpmSpeed;
+}
+
+uint16_t FanArray::getFullSpeedRPM() const {
+  return fullSpeedRPM;
+}
+
+uint16_t FanArray::getRPM(uint8_t members) const {
+  uint32_t total = 0;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      total += fans[i]->getRPM();
+      count++;
+    }
+  }
+  return count > 0 ? total / count : 0;
+}
+
+uint16_t FanArray::getMaxRPM(uint8_t members) const {
+  uint32_t total = 0;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      total += fans[i]->getMaxRPM();
+      count++;
+    }
+  }
+  return count > 0 ? total / count : 0;
+}
+
+void FanArray::calibrate(uint8_t members) {
+  Fan::deferCompareWrites = true;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      fans[i]->calibrate();
+    }
+  }
+  Fan::deferCompareWrites = false;
+  writeCompares(members);
+}
+
+void FanArray::characterize(uint8_t members) {
+  Fan::deferCompareWrites = true;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      fans[i]->characterize();
+    }
+  }
+  Fan::deferCompareWrites = false;
+  writeCompares(members);
+}
+
+bool FanArray::isCalibrating(uint8_t members) const {
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members) && fans[i]->isCalibrating()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t FanArray::getCalibrationProgress(uint8_t members) const {
+  uint8_t progress = 100;
+  for (uint8_t i = 0; i < numFans; i++) {
+    if (isSelected(i, members)) {
+      progress = min(progress, fans[i]->getCalibrationProgress());
+    }
+  }
+  return progress;
+}
+
+void FanArray::periodic(unsigned long currentMillis) {
+  TRACE_SCOPE(traceFans);
+  Fan::TachSample samples[FAN_ARRAY_MAX_FANS];
+  ATOMIC_BLOCK(ATOMIC_FORCEON) {
+    for (uint8_t i = 0; i < numFans; i++) {
+      fans[i]->sampleTach(currentMillis, &samples[i]);
+    }
+  }
+  // Ramps and calibration can change speeds, so batch those writes too.
+  Fan::deferCompareWrites = true;
+  for (uint8_t i = 0; i < numFans; i++) {
+    fans[i]->update(currentMillis, samples[i]);
+  }
+  Fan::deferCompareWrites = false;
+  writeCompares(ALL_FANS);
+}
+
+unsigned long FanArray::getPeriod() const {
+  return FAN_TASK_PERIOD;
+}
+
+const __FlashStringHelper * FanArray::getTaskName() const {
+  return F("fans");
+}
+
+bool FanArray::isSelected(uint8_t index, uint8_t members) {
+  return (members >> index) & 1;
+}
+
+void FanArray::writeCompares(uint8_t members) {
+  ATOMIC_BLOCK(ATOMIC_FORCEON) {
+    for (uint8_t i = 0; i < numFans; i++) {
+      if (isSelected(i, members)) {
+        fans[i]->writeCompare();
+      }
+    }
+  }
+}
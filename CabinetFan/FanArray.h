@@ -0,0 +1,109 @@
+#ifndef FAN_FAN_ARRAY_H
+#define FAN_FAN_ARRAY_H
+
+#include <stdint.h>
+#include "Fan.h"
+#include "Scheduler.h"
+
+/* There's one external interrupt for each tachometer, so that's as many fans
+ * as can be measured.
+ */
+#define FAN_ARRAY_MAX_FANS NUM_EXTERNAL_INTERRUPTS
+
+/* Fans in a `FanArray` are selected with a bit mask, bit 0 being the first fan
+ * added. `ALL_FANS` selects every fan.
+ */
+#define ALL_FANS 0xFF
+
+/* A group of fans driven together, for cabinets with more than one fan.
+ *
+ * The fans can be controlled as a group or one at a time, by passing a mask of
+ * the fans to act on (see `ALL_FANS`). Speeds and RPMs read from more than one
+ * fan are averaged.
+ *
+ * Setting the speed of several fans computes every fan's duty cycle first,
+ * then writes all of the output compare registers in one critical section, so
+ * they change together. Likewise `periodic()` takes every fan's tachometer
+ * counts in one critical section, instead of one per fan.
+ */
+class FanArray: public Task {
+  public:
+    FanArray();
+
+    /* Add a fan (set up by the caller) to the array. Returns false if the
+     * array is full.
+     */
+    bool add(Fan *fan);
+
+    uint8_t size() const;
+
+    // The fan at `index`, in the order they were added.
+    Fan * get(uint8_t index) const;
+
+    /* The average requested speed of the selected fans, from 0.0 to 1.0.
+     * While controlling RPM (see `setFullSpeedRPM()`), this is the requested
+     * RPM as a fraction of the full speed RPM.
+     */
+    float getSpeed(uint8_t members = ALL_FANS) const;
+
+    /* Set the speed of the selected fans. Normally it's the duty cycle (see
+     * `Fan::setSpeed()`), and while controlling RPM it's the fraction of the
+     * full speed RPM to hold (see `Fan::setRPM()`).
+     */
+    void setSpeed(float fanSpeed, uint8_t members = ALL_FANS);
+
+    // The average duty cycle of the selected fans, from 0.0 to 1.0.
+    float getDutyCycle(uint8_t members = ALL_FANS) const;
+
+    // Hold the selected fans at `rpmSpeed`, see `Fan::setRPM()`.
+    void setRPM(uint16_t rpmSpeed, uint8_t members = ALL_FANS);
+
+    /* Control RPM instead of duty cycle, with `rpmSpeed` being what a speed
+     * of 1.0 means to `setSpeed()`. Whatever is setting speeds (the fan
+     * controller) then becomes the outer loop of a cascade, and the fans all
+     * move the same amount of air no matter how their duty cycles differ.
+     * 0 goes back to setting duty cycles. Takes effect with the next speed
+     * that's set.
+     */
+    void setFullSpeedRPM(uint16_t rpmSpeed);
+    uint16_t getFullSpeedRPM() const;
+
+    // The average RPM of the selected fans.
+    uint16_t getRPM(uint8_t members = ALL_FANS) const;
+
+    // The average maximum RPM of the selected fans.
+    uint16_t getMaxRPM(uint8_t members = ALL_FANS) const;
+
+    // Recalibrate the selected fans, see `Fan::calibrate()`.
+    void calibrate(uint8_t members = ALL_FANS);
+
+    // Characterize the selected fans, see `Fan::characterize()`.
+    void characterize(uint8_t members = ALL_FANS);
+
+    // True if any of the selected fans are calibrating.
+    bool isCalibrating(uint8_t members = ALL_FANS) const;
+
+    // The calibration progress of the furthest behind selected fan.
+    uint8_t getCalibrationProgress(uint8_t members = ALL_FANS) const;
+
+    // True if the fan at `index` is selected by `members`.
+    static bool isSelected(uint8_t index, uint8_t members);
+
+    // Runs `periodic()` for every fan.
+    void periodic(unsigned long currentMillis);
+    unsigned long getPeriod() const;
+    const __FlashStringHelper * getTaskName() const;
+
+  private:
+    Fan *fans[FAN_ARRAY_MAX_FANS];
+    uint8_t numFans;
+
+    // See `setFullSpeedRPM()`, 0 when setting duty cycles.
+    uint16_t fullSpeedRPM;
+
+    /* Write the output compare registers of the selected fans, all in one
+     * critical section.
+     */
+    void writeCompares(uint8_t members);
+};
+#endif
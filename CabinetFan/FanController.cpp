@@ -1,103 +1,247 @@
+#include <new>
 #include <Arduino.h>
 #include "FanController.h"
+#include "Trace.h"
+#include "NoHeap.h"
 
-const char * FanController::valueUnits = NULL;
-
-FanController::FanController(
-  Fan * fan,
-  float minValue,
-  float maxValue,
-  float initialValue
-):
-  minValue(minValue),
-  maxValue(maxValue),
-  fan(fan)
-{
-  /* Default to the middle of the acceptable range if an invalid initial value
-   * is given.
-   */
-  if (initialValue == NAN) {
-    value = (maxValue - minValue) / 2.;
-  } else {
-    value = min(maxValue, max(minValue, initialValue));
+FanController::FanController():
+  type(constant),
+  current(NULL)
+{}
+
+FanController::~FanController() {
+  destroy();
+}
+
+void FanController::destroy() {
+  if (current == NULL) {
+    return;
+  }
+  switch (type) {
+    case constant:
+      constantSpeedController.~ConstantSpeedController();
+      break;
+    case feedforward:
+      feedforwardController.~FeedforwardFanController();
+      break;
+    default:
+      pidController.~PIDFanController();
+      break;
+  }
+  current = NULL;
+}
+
+void FanController::createConstantSpeed(
+  FanArray *fans,
+  uint8_t members,
+  float initialSpeed
+) {
+  destroy();
+  type = constant;
+  current = new (&constantSpeedController) ConstantSpeedController(
+    fans,
+    members,
+    initialSpeed
+  );
+}
+
+void FanController::createPID(
+  ControllerType pidType,
+  FanArray *fans,
+  uint8_t members,
+  ThermometerBank * thermometers,
+  const __FlashStringHelper * name,
+  float target,
+  float k_p,
+  float k_i,
+  float k_d,
+  unsigned long period
+) {
+  destroy();
+  type = pidType;
+  current = new (&pidController) PIDFanController(
+    fans,
+    members,
+    thermometers,
+    name,
+    target,
+    k_p,
+    k_i,
+    k_d,
+    period
+  );
+}
+
+void FanController::createFeedforward(
+  FanArray *fans,
+  uint8_t members,
+  ThermometerBank * thermometers,
+  float target,
+  float k_p,
+  float k_i,
+  float k_d,
+  unsigned long period,
+  const thermalModelValues &model
+) {
+  destroy();
+  type = feedforward;
+  current = new (&feedforwardController) FeedforwardFanController(
+    fans,
+    members,
+    thermometers,
+    target,
+    k_p,
+    k_i,
+    k_d,
+    period,
+    model
+  );
+}
+
+ControllerType FanController::getType() const {
+  return type;
+}
+
+bool FanController::getThermalModel(thermalModelValues *model) const {
+  if (type != feedforward || !feedforwardController.getModel().isValid()) {
+    return false;
+  }
+  *model = feedforwardController.getModel().getValues();
+  return true;
+}
+
+const __FlashStringHelper * FanController::getName() const {
+  return current->getName();
+}
+
+const __FlashStringHelper * FanController::getValueUnits() const {
+  switch (type) {
+    case constant:
+      return flashString(ConstantSpeedController::valueUnits);
+    case feedforward:
+      return flashString(FeedforwardFanController::valueUnits);
+    default:
+      return flashString(PIDFanController::valueUnits);
+  }
+}
+
+float FanController::getValueStep() const {
+  switch (type) {
+    case constant:
+      return ConstantSpeedController::valueStep;
+    case feedforward:
+      return FeedforwardFanController::valueStep;
+    default:
+      return PIDFanController::valueStep;
+  }
+}
+
+float FanController::getMinValue() const {
+  switch (type) {
+    case constant:
+      return ConstantSpeedController::minValue;
+    case feedforward:
+      return FeedforwardFanController::minValue;
+    default:
+      return PIDFanController::minValue;
+  }
+}
+
+float FanController::getMaxValue() const {
+  switch (type) {
+    case constant:
+      return ConstantSpeedController::maxValue;
+    case feedforward:
+      return FeedforwardFanController::maxValue;
+    default:
+      return PIDFanController::maxValue;
   }
 }
 
 float FanController::getValue() const {
-  return value;
+  return current->getValue();
 }
 
 void FanController::setValue(float newValue) {
-  value = min(maxValue, max(minValue, newValue));
+  switch (type) {
+    case constant:
+      constantSpeedController.setValue(newValue);
+      break;
+    case feedforward:
+      feedforwardController.setValue(newValue);
+      break;
+    default:
+      pidController.setValue(newValue);
+      break;
+  }
 }
 
-void FanController::periodic() {
-  periodic(millis());
+uint8_t FanController::getMembers() const {
+  return current->getMembers();
 }
 
-size_t FanController::printTo(Print& p) const {
-  size_t total = 0;
-  total += p.print(name);
-  total += p.print(": ");
-  total += p.print(value);
-  total += p.print(" ");
-  total += p.print(this->valueUnits);
-  return total;
+void FanController::setMembers(uint8_t newMembers) {
+  current->setMembers(newMembers);
+}
+
+ControllerTerms FanController::getTerms() const {
+  switch (type) {
+    case constant:
+      return constantSpeedController.getTerms();
+    case feedforward:
+      return feedforwardController.getTerms();
+    default:
+      return pidController.getTerms();
+  }
 }
 
 void FanController::toggleDebug() {
-  debug = !debug;
+  current->toggleDebug();
 }
 
-void FanController::controllerDebug(const char * message) {
-  if (debug) {
-    Serial.print("\t");
-    Serial.print(name);
-    Serial.print(": ");
-    Serial.println(message);
-  }
+void FanController::periodic() {
+  periodic(millis());
 }
 
-void FanController::controllerDebug(const char * message, const char * value) {
-  if (debug) {
-    Serial.print("\t");
-    Serial.print(name);
-    Serial.print(": ");
-    Serial.print(message);
-    Serial.print(": ");
-    Serial.println(value);
+void FanController::periodic(unsigned long currentMillis) {
+  TRACE_SCOPE(traceController);
+  switch (type) {
+    case constant:
+      constantSpeedController.periodic(currentMillis);
+      break;
+    case feedforward:
+      feedforwardController.periodic(currentMillis);
+      break;
+    default:
+      pidController.periodic(currentMillis);
+      break;
   }
 }
 
-void FanController::controllerDebug(const char * message, float value) {
-  if (debug) {
-    Serial.print("\t");
-    Serial.print(name);
-    Serial.print(": ");
-    Serial.print(message);
-    Serial.print(": ");
-    Serial.println(value);
+unsigned long FanController::getPeriod() const {
+  switch (type) {
+    case constant:
+      return constantSpeedController.getPeriod();
+    case feedforward:
+      return feedforwardController.getPeriod();
+    default:
+      return pidController.getPeriod();
   }
 }
 
-void FanController::controllerDebug(const char * message, unsigned long value) {
-  if (debug) {
-    Serial.print("\t");
-    Serial.print(name);
-    Serial.print(": ");
-    Serial.print(message);
-    Serial.print(": ");
-    Serial.println(value);
-  }
+const __FlashStringHelper * FanController::getTaskName() const {
+  return F("controller");
 }
 
-void FanController::controllerDebug(const char * message, uint16_t value) {
-  if (debug) {
-    Serial.print("\t");
-    Serial.print(name);
-    Serial.print(": ");
-    Serial.print(message);
-    Serial.print(": ");
-    Serial.println(value);
+size_t FanController::printTo(Print& p) const {
+  size_t total = 0;
+  total += p.print(getName());
+  total += p.print(F(": "));
+  total += p.print(getValue());
+  const __FlashStringHelper * units = getValueUnits();
+  if (pgm_read_byte(units) != '\0') {
+    total += p.print(' ');
+    total += p.print(units);
   }
-}
\ No newline at end of file
+  return total;
+}
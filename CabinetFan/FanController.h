@@ -1,70 +1,148 @@
 #ifndef FAN_FAN_CONTROLLER_H
 #define FAN_FAN_CONTROLLER_H
 
-#include <float.h>
-#include <math.h>
 #include "Arduino.h"
-#include "Fan.h"
+#include "BasicFanController.h"
+#include "ConstantSpeed.h"
+#include "FanArray.h"
+#include "FeedforwardFanController.h"
+#include "PIDFanController.h"
+#include "Scheduler.h"
+#include "ThermometerBank.h"
 
-class FanController: public Printable {
+enum ControllerType: uint8_t {
+  constant = 0,
+  proportional = 1,
+  pid = 2,
+  feedforward = 3
+};
+
+/* The fan controller, whichever type it currently is.
+ *
+ * The controllers themselves don't have any virtual functions. Each one is a
+ * `BasicFanController`, with its limits and units as compile time constants.
+ * This holds one of them in place (so nothing is allocated), and forwards to
+ * it with a switch on its type. The compiler sees exactly which controller's
+ * method is being called, so it can inline it, and the limits become
+ * constants. Only `FanController` itself is a `Task`, and the scheduler calls
+ * it directly (see `Scheduler`), so running the controller takes no virtual
+ * calls at all.
+ *
+ * A controller has to be created before any of the other methods are used.
+ */
+class FanController: public Printable, public Task {
   public:
-    FanController(
-      Fan *fan,
-      float minValue = FLT_MIN,
-      float maxValue = FLT_MAX,
-      float initialValue = NAN
+    FanController();
+    ~FanController();
+
+    // Replace the current controller with a constant speed controller.
+    void createConstantSpeed(
+      FanArray *fans,
+      uint8_t members,
+      float initialSpeed = NAN
+    );
+
+    /* Replace the current controller with a PID controller (see
+     * `BasicPIDFanController`). `pidType` is either `proportional` or `pid`,
+     * and is only used to report which type this is.
+     */
+    void createPID(
+      ControllerType pidType,
+      FanArray *fans,
+      uint8_t members,
+      ThermometerBank * thermometers,
+      const __FlashStringHelper * name,
+      float target,
+      float k_p,
+      float k_i,
+      float k_d,
+      unsigned long period
     );
 
-    virtual ~FanController() {}
+    /* Replace the current controller with a feedforward controller (see
+     * `FeedforwardFanController`).
+     */
+    void createFeedforward(
+      FanArray *fans,
+      uint8_t members,
+      ThermometerBank * thermometers,
+      float target,
+      float k_p,
+      float k_i,
+      float k_d,
+      unsigned long period,
+      const thermalModelValues &model
+    );
+
+    ControllerType getType() const;
 
-    // A short display name describing this controller type.
-    const char * name;
+    /* Copy out the current controller's model of the cabinet, if it has a
+     * valid one. Returns false otherwise.
+     */
+    bool getThermalModel(thermalModelValues *model) const;
+
+    // A short display name describing the current controller, in flash.
+    const __FlashStringHelper * getName() const;
 
-    // The abbreviation for the units for the set point.
-    static const char * valueUnits;
+    // The abbreviation for the units for the set point, in flash.
+    const __FlashStringHelper * getValueUnits() const;
 
     // A suggested amount to increment the set point value by.
-    const float valueStep = 0;
+    float getValueStep() const;
 
     // The minimum value for the set point.
-    const float minValue;
+    float getMinValue() const;
 
     // The maximum value for the set point.
-    const float maxValue;
-
-    // When enabled, debug statements are logged to the serial console.
-#if DEBUG
-#warning Debug Mode Enabled!
-    bool debug = true;
-#else
-    bool debug = false;
-#endif
+    float getMaxValue() const;
 
     // Get the current set point.
-    virtual float getValue() const;
+    float getValue() const;
 
-    // Set a new set point.
-    virtual void setValue(float newValue);
+    // Set a new set point, clamped to the current controller's limits.
+    void setValue(float newValue);
+
+    // The mask of fans being controlled.
+    uint8_t getMembers() const;
+    void setMembers(uint8_t newMembers);
+
+    /* The terms behind the last correction. Controllers that don't have them
+     * report zeros.
+     */
+    ControllerTerms getTerms() const;
+
+    void toggleDebug();
 
     /* Convenience function that calls `periodic()` with the result of
      * `millis()`
      */
     void periodic();
 
-    // Called each iteration of the run loop.
-    virtual void periodic(unsigned long currentMillis) = 0;
+    // Called by the scheduler once every `getPeriod()` milliseconds.
+    void periodic(unsigned long currentMillis);
 
-    void toggleDebug();
-    void controllerDebug(const char * message);
-    void controllerDebug(const char * message, const char * value);
-    void controllerDebug(const char * message, float value);
-    void controllerDebug(const char * message, unsigned long value);
-    void controllerDebug(const char * message, uint16_t value);
+    unsigned long getPeriod() const;
+    const __FlashStringHelper * getTaskName() const;
 
     // Inheriting from Printable
     virtual size_t printTo(Print& p) const;
-  protected:
-    Fan *fan;
-    float value;
+
+  private:
+    ControllerType type;
+
+    // The current controller, as its common base. `NULL` until one's created.
+    ControllerBase *current;
+
+    /* Storage for the current controller, one of these depending on `type`.
+     * Both `proportional` and `pid` are PID controllers.
+     */
+    union {
+      ConstantSpeedController constantSpeedController;
+      PIDFanController pidController;
+      FeedforwardFanController feedforwardController;
+    };
+
+    // Destroy the current controller, if there is one.
+    void destroy();
 };
-#endif
\ No newline at end of file
+#endif
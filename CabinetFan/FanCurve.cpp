@@ -0,0 +1,90 @@
+#include <Arduino.h>
+#include "FanCurve.h"
+#include "NoHeap.h"
+
+// The last index, and the number of steps between the points.
+static const uint8_t LAST_POINT = FAN_CURVE_POINTS - 1;
+
+/* Look `x` (from 0.0 to 1.0) up in a table of evenly spaced points, returning
+ * the interpolated value from 0.0 to 1.0.
+ */
+static float interpolate(const uint8_t *table, float x) {
+  x = constrain(x, 0.0, 1.0) * LAST_POINT;
+  uint8_t index = min((uint8_t)x, (uint8_t)(LAST_POINT - 1));
+  float fraction = x - index;
+  float lower = table[index];
+  float upper = table[index + 1];
+  return (lower + (upper - lower) * fraction) / 255.0;
+}
+
+FanCurve::FanCurve() {
+  fanCurveValues linear;
+  for (uint8_t i = 0; i < FAN_CURVE_POINTS; i++) {
+    linear.speeds[i] = (uint16_t)i * 255 / LAST_POINT;
+  }
+  set(linear);
+}
+
+void FanCurve::set(const fanCurveValues &newValues) {
+  values = newValues;
+  firstRunning = LAST_POINT;
+  for (uint8_t i = 0; i < FAN_CURVE_POINTS; i++) {
+    if (i > 0) {
+      values.speeds[i] = max(values.speeds[i], values.speeds[i - 1]);
+    }
+    if (values.speeds[i] > 0 && i < firstRunning) {
+      firstRunning = i;
+    }
+  }
+  /* Each speed in the reverse table is found between the first point at least
+   * that fast and the one before it. Both tables are non-decreasing, so the
+   * search carries on from where the last one stopped.
+   */
+  duties[0] = 0;
+  uint8_t upper = max(firstRunning, (uint8_t)1);
+  for (uint8_t j = 1; j < FAN_CURVE_POINTS; j++) {
+    const uint8_t speed = (uint16_t)j * 255 / LAST_POINT;
+    while (upper < LAST_POINT && values.speeds[upper] < speed) {
+      upper++;
+    }
+    float duty;
+    const uint8_t lowerSpeed = values.speeds[upper - 1];
+    const uint8_t upperSpeed = values.speeds[upper];
+    if (upperSpeed <= speed || upperSpeed == lowerSpeed) {
+      // Too fast for the fan, or there's nothing to interpolate.
+      duty = upper;
+    } else if (upper == firstRunning && firstRunning > 1) {
+      // Below the fan's slowest, where it's stalled.
+      duty = upper;
+    } else {
+      duty = upper - 1 +
+        (float)(speed - lowerSpeed) / (upperSpeed - lowerSpeed);
+    }
+    duties[j] = (uint8_t)(duty * 255 / LAST_POINT + 0.5);
+  }
+}
+
+const fanCurveValues & FanCurve::getValues() const {
+  return values;
+}
+
+float FanCurve::getSpeed(float duty) const {
+  if (duty < getStallDuty()) {
+    return 0.0;
+  }
+  return interpolate(values.speeds, duty);
+}
+
+float FanCurve::getDuty(float speed) const {
+  if (speed <= 0.0) {
+    return 0.0;
+  }
+  return max(interpolate(duties, speed), getStallDuty());
+}
+
+float FanCurve::getStallDuty() const {
+  /* A fan that runs at the first point (the lowest duty cycle above 0%) might
+   * run even slower, it's only known to stall below a later one.
+   */
+  return firstRunning > 1 ? (float)firstRunning / LAST_POINT : 0.0;
+}
@@ -0,0 +1,63 @@
+#ifndef FAN_FAN_CURVE_H
+#define FAN_FAN_CURVE_H
+
+#include <stdint.h>
+
+/* The number of duty cycles a fan's speed is measured at, evenly spaced from
+ * 0% to 100%.
+ */
+#define FAN_CURVE_POINTS 16
+
+/* A fan's measured speed at each of the `FAN_CURVE_POINTS` duty cycles, as a
+ * fraction of its maximum RPM scaled to 0-255. Keeping it relative to the
+ * maximum keeps it small, and lets fans of the same model share a curve while
+ * each calibrates its own maximum. Packed, as it's saved in `Settings`.
+ */
+struct __attribute__((packed)) fanCurveValues {
+  uint8_t speeds[FAN_CURVE_POINTS];
+};
+
+/* How fast a fan runs at a given duty cycle, and the reverse.
+ *
+ * Fans are far from linear, and most stop altogether below some duty cycle.
+ * The curve is a table of measured points (see `Fan::characterize()`), and
+ * lookups interpolate between the two points either side. The reverse
+ * direction has its own table, at evenly spaced speeds, worked out whenever
+ * the curve is set, so both lookups are just an index and an interpolation.
+ */
+class FanCurve {
+  public:
+    // A straight line, from stopped at 0% to full speed at 100%.
+    FanCurve();
+
+    /* Replace the curve. It's made non-decreasing first, so a noisy
+     * measurement can't make the reverse lookup ambiguous.
+     */
+    void set(const fanCurveValues &newValues);
+    const fanCurveValues & getValues() const;
+
+    /* The speed (as a fraction of the maximum RPM) at `duty`, both from 0.0 to
+     * 1.0.
+     */
+    float getSpeed(float duty) const;
+
+    /* The duty cycle needed for `speed` (as a fraction of the maximum RPM).
+     * Speeds the fan can't run that slowly at get the stall duty cycle.
+     */
+    float getDuty(float speed) const;
+
+    /* The lowest measured duty cycle the fan keeps running at, or 0.0 if it
+     * ran at every measured duty cycle.
+     */
+    float getStallDuty() const;
+
+  private:
+    fanCurveValues values;
+
+    // The duty cycle (scaled to 0-255) at evenly spaced speeds.
+    uint8_t duties[FAN_CURVE_POINTS];
+
+    // The index of the first point the fan is running at.
+    uint8_t firstRunning;
+};
+#endif
@@ -0,0 +1,93 @@
+#include <math.h>
+#include <Arduino.h>
+#include "FeedforwardFanController.h"
+#include "NoHeap.h"
+
+const char FeedforwardFanController::valueUnits[] PROGMEM = "C";
+constexpr float FeedforwardFanController::valueStep;
+constexpr float FeedforwardFanController::minValue;
+constexpr float FeedforwardFanController::maxValue;
+
+FeedforwardFanController::FeedforwardFanController(
+  FanArray *fans,
+  uint8_t members,
+  ThermometerBank * thermometers,
+  float target,
+  float k_p,
+  float k_i,
+  float k_d,
+  unsigned long period,
+  const thermalModelValues &model
+):
+  BasicFanController(fans, members, F("Feedforward Controller"), target),
+  thermometers(thermometers),
+  model(model, period),
+  feedback(k_p, k_i, k_d),
+  period(period)
+{
+  // Until there's a better idea, run as fast as the model says is needed.
+  feedforwardSpeed = this->model.steadyStateSpeed(value);
+  if (isnan(feedforwardSpeed)) {
+    feedforwardSpeed = 1.0;
+  }
+  feedforwardSpeed = constrain(feedforwardSpeed, 0.0, 1.0);
+}
+
+void FeedforwardFanController::periodic(unsigned long currentMillis) {
+  controllerDebug(F("Updating controller"));
+  const float temperature = thermometers->getTemperature();
+  if (isnan(temperature)) {
+    return;
+  }
+  if (!running || currentMillis - lastUpdate > 2 * period) {
+    /* Measured from a stale `lastUpdate`, the elapsed time could be more than
+     * a `PIDNumber` can hold, and the model's last sample is too old to learn
+     * from. Start both over from now.
+     */
+    controllerDebug(F("Starting"));
+    lastUpdate = currentMillis;
+    running = true;
+    model.restart();
+    return;
+  }
+  const PIDNumber elapsedSeconds = NumberTraits<PIDNumber>::fromRatio(
+    currentMillis - lastUpdate,
+    1000
+  );
+  lastUpdate = currentMillis;
+  // Learn from how the temperature responded to the last period's speed.
+  model.update(temperature, fans->getSpeed(members));
+  const float steadyState = model.steadyStateSpeed(value);
+  if (!isnan(steadyState)) {
+    feedforwardSpeed = constrain(steadyState, 0.0, 1.0);
+  }
+  controllerDebug(F("Feedforward speed"), feedforwardSpeed);
+  const PIDNumber error = PIDNumber(temperature) - PIDNumber(value);
+  feedbackSpeed += float(feedback.update(error, elapsedSeconds));
+  /* Keep the total in range, so the feedback doesn't wind up past what the
+   * fans can do.
+   */
+  feedbackSpeed = constrain(
+    feedbackSpeed,
+    -feedforwardSpeed,
+    1.0 - feedforwardSpeed
+  );
+  controllerDebug(F("Feedback speed"), feedbackSpeed);
+  float newSpeed = feedforwardSpeed + feedbackSpeed;
+  // If the speed would be less than 5%, just stop the fan.
+  newSpeed = newSpeed < 0.05 ? 0.0 : newSpeed;
+  controllerDebug(F("New speed"), newSpeed);
+  fans->setSpeed(newSpeed, members);
+}
+
+unsigned long FeedforwardFanController::getPeriod() const {
+  return period;
+}
+
+ControllerTerms FeedforwardFanController::getTerms() const {
+  return feedback.getTerms();
+}
+
+const ThermalModel & FeedforwardFanController::getModel() const {
+  return model;
+}
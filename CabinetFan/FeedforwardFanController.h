@@ -0,0 +1,84 @@
+#ifndef FAN_FEEDFORWARD_CONTROLLER_H
+#define FAN_FEEDFORWARD_CONTROLLER_H
+
+#include "BasicFanController.h"
+#include "PIDFanController.h"
+#include "ThermalModel.h"
+#include "ThermometerBank.h"
+
+/* A controller that works out the fan speed needed for the set point from a
+ * model of the cabinet, then corrects what the model gets wrong with PID
+ * feedback.
+ *
+ * The `ThermalModel` is identified online from the temperature and fan speed
+ * each period. Its steady state speed for the set point (the feedforward
+ * term) moves as soon as the model sees the cabinet heating up faster, for
+ * example when a load turns on, instead of waiting for the error to build up
+ * like the PID controller does. The PID feedback (with the PID controller's
+ * tuning) is kept as a separate speed that's added on top, so it only has to
+ * make up the model's error.
+ *
+ * Like the PID controller, the first period after starting, or after being
+ * paused for more than two periods, only notes the time (and restarts the
+ * model's samples), as there's nothing to measure the period from.
+ */
+class FeedforwardFanController:
+  public BasicFanController<FeedforwardFanController>
+{
+  public:
+    FeedforwardFanController(
+      FanArray *fans,
+      uint8_t members,
+      ThermometerBank * thermometers,
+      float target,
+      float k_p,
+      float k_i,
+      float k_d,
+      unsigned long period,
+      const thermalModelValues &model
+    );
+
+    /* The abbreviation for the units for the set point. It'd be nice to
+     * include the degree symbol at some point later.
+     */
+    static const char valueUnits[];
+
+    // A suggested amount to increment the set point value by.
+    static constexpr float valueStep = 0.2;
+
+    // 0 degrees Celsius is the minimum value.
+    static constexpr float minValue = 0.0;
+
+    // 100 degrees Celsius is the maximum value.
+    static constexpr float maxValue = 100.0;
+
+    // Called once every `getPeriod()` milliseconds.
+    void periodic(unsigned long currentMillis);
+
+    unsigned long getPeriod() const;
+
+    // The feedback's terms.
+    ControllerTerms getTerms() const;
+
+    const ThermalModel & getModel() const;
+
+  private:
+    ThermometerBank * thermometers;
+
+    ThermalModel model;
+
+    PIDCorrection feedback;
+
+    const unsigned long period;
+
+    // The last time the calculations were done.
+    unsigned long lastUpdate = 0;
+
+    // False until the first period, when there's no `lastUpdate` yet.
+    bool running = false;
+
+    // The speed from the model, and the speed added by the feedback.
+    float feedforwardSpeed;
+    float feedbackSpeed = 0.0;
+};
+#endif
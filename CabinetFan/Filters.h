@@ -0,0 +1,317 @@
+#ifndef FAN_FILTERS_H
+#define FAN_FILTERS_H
+
+#include <stdint.h>
+#include "MovingAverage.h"
+
+/* Small filters for smoothing sensor readings, all configured at compile time
+ * by their template arguments and none of them allocating.
+ *
+ * Every filter has the same interface as `MovingAverage`, so they can be
+ * swapped for each other (and chained with `Cascade`) by changing a template
+ * argument:
+ *
+ *   typedef T value_type;
+ *   void push(T new_value);       // Add a sample.
+ *   T current_value() const;      // The filtered value.
+ *   T update(T new_value);        // `push()`, then `current_value()`.
+ *   bool empty() const;           // True until the first sample is pushed.
+ *
+ * The RAM used by each is noted with it, as on the AVR, which doesn't pad
+ * anything (test_filters checks the notes against the host sizes). Flash
+ * isn't: it depends on the value type, and on which other filters and types
+ * the sketch already pulls in, so it's measured on the whole sketch with
+ * host/memory/elf_report.cmake. cabinetfan_bench_filters prints their sizes
+ * on the host.
+ */
+
+/* Passes samples straight through. For when a filter has to be given, but no
+ * filtering is wanted. RAM: sizeof(T) + 1.
+ */
+template<typename T = float>
+class PassThroughFilter {
+  public:
+    typedef T value_type;
+
+    PassThroughFilter(): value(0), primed(false) {}
+
+    void push(T new_value) {
+      value = new_value;
+      primed = true;
+    }
+
+    T current_value() const {
+      return value;
+    }
+
+    T update(T new_value) {
+      push(new_value);
+      return current_value();
+    }
+
+    bool empty() const {
+      return !primed;
+    }
+
+  private:
+    T value;
+    bool primed;
+};
+
+/* The type `ExponentialMovingAverage` takes its steps in. The step towards a
+ * lower sample is negative, so integers are widened to a signed type that can
+ * hold the difference of any two of them. Floating and fixed point types are
+ * already signed.
+ */
+template<typename T> struct ExponentialMovingAverageStep {
+  typedef T type;
+};
+template<> struct ExponentialMovingAverageStep<int8_t> {
+  typedef int16_t type;
+};
+template<> struct ExponentialMovingAverageStep<uint8_t> {
+  typedef int16_t type;
+};
+template<> struct ExponentialMovingAverageStep<int16_t> {
+  typedef int32_t type;
+};
+template<> struct ExponentialMovingAverageStep<uint16_t> {
+  typedef int32_t type;
+};
+template<> struct ExponentialMovingAverageStep<int32_t> {
+  typedef int64_t type;
+};
+template<> struct ExponentialMovingAverageStep<uint32_t> {
+  typedef int64_t type;
+};
+
+/* An exponential moving average, with a smoothing factor of 1/2^`SHIFT`.
+ * Each sample moves the value 1/2^`SHIFT` of the way towards it, so it takes
+ * about 2^`SHIFT` samples to respond to a step. The first sample is taken as
+ * is, instead of ramping up from zero.
+ *
+ * Dividing by a power of two is a shift for integers, and an exact multiply
+ * for floats. With integer `T`, the value only settles to within 2^`SHIFT` of
+ * the input, so use a type with some headroom to spare for fractional bits.
+ * RAM: sizeof(T) + 1.
+ */
+template<typename T = float, uint8_t SHIFT = 3>
+class ExponentialMovingAverage {
+  public:
+    typedef T value_type;
+
+    ExponentialMovingAverage(): value(0), primed(false) {}
+
+    void push(T new_value) {
+      if (primed) {
+        const Step step = (Step(new_value) - Step(value)) / Step(1 << SHIFT);
+        value = T(Step(value) + step);
+      } else {
+        value = new_value;
+        primed = true;
+      }
+    }
+
+    T current_value() const {
+      return value;
+    }
+
+    T update(T new_value) {
+      push(new_value);
+      return current_value();
+    }
+
+    bool empty() const {
+      return !primed;
+    }
+
+  private:
+    typedef typename ExponentialMovingAverageStep<T>::type Step;
+
+    T value;
+    bool primed;
+};
+
+/* The median of the last `N` samples. Good at throwing out single bad readings
+ * (like a glitched tachometer pulse) without smearing them into the following
+ * values like an average does. Use an odd `N`; with an even number of samples
+ * the lower of the two middle values is used.
+ *
+ * The samples are kept sorted as they're added, so each push is O(N).
+ * RAM: 2 * N * sizeof(T) + 2.
+ */
+template<typename T = float, uint8_t N = 5>
+class MedianFilter {
+  public:
+    typedef T value_type;
+
+    MedianFilter(): count(0), next(0) {}
+
+    void push(T new_value) {
+      uint8_t position;
+      if (count == N) {
+        // Take out the oldest sample, closing the gap it leaves.
+        position = find(values[next]);
+        for (; position + 1 < count; position++) {
+          sorted[position] = sorted[position + 1];
+        }
+        count--;
+      }
+      // Insertion sort the new sample in.
+      position = count;
+      while (position > 0 && sorted[position - 1] > new_value) {
+        sorted[position] = sorted[position - 1];
+        position--;
+      }
+      sorted[position] = new_value;
+      count++;
+      values[next] = new_value;
+      next = (next + 1) % N;
+    }
+
+    T current_value() const {
+      return count > 0 ? sorted[(count - 1) / 2] : T(0);
+    }
+
+    T update(T new_value) {
+      push(new_value);
+      return current_value();
+    }
+
+    bool empty() const {
+      return count == 0;
+    }
+
+  private:
+    // The samples in the order they arrived, as a circular buffer.
+    T values[N];
+    // The same samples, sorted.
+    T sorted[N];
+    uint8_t count;
+    // The index in `values` for the next sample.
+    uint8_t next;
+
+    uint8_t find(T value) const {
+      uint8_t position = 0;
+      while (position < count - 1 && sorted[position] != value) {
+        position++;
+      }
+      return position;
+    }
+};
+
+/* A second order IIR filter (a biquad), in transposed direct form II.
+ *
+ * `C` supplies the coefficients, normalized so a0 is 1, as `static constexpr
+ * float` members `b0`, `b1`, `b2`, `a1` and `a2` (see
+ * `ButterworthLowPassTenth` for an example). They're converted to `T` once, so
+ * `T` can be a `Fixed` to keep the per-sample math in integers.
+ *
+ * The first sample sets the filter's state as if it had been seeing that
+ * value forever, so it starts at the input instead of ringing up from zero.
+ * RAM: 3 * sizeof(T) + 1, and 5 * sizeof(T) shared by every biquad with the
+ * same `T` and `C`.
+ */
+template<typename T, typename C>
+class Biquad {
+  public:
+    typedef T value_type;
+
+    Biquad(): output(0), state1(0), state2(0), primed(false) {}
+
+    void push(T new_value) {
+      if (!primed) {
+        prime(new_value);
+      }
+      output = b0 * new_value + state1;
+      state1 = b1 * new_value - a1 * output + state2;
+      state2 = b2 * new_value - a2 * output;
+    }
+
+    T current_value() const {
+      return output;
+    }
+
+    T update(T new_value) {
+      push(new_value);
+      return current_value();
+    }
+
+    bool empty() const {
+      return !primed;
+    }
+
+  private:
+    static const T b0;
+    static const T b1;
+    static const T b2;
+    static const T a1;
+    static const T a2;
+
+    T output;
+    T state1;
+    T state2;
+    bool primed;
+
+    // Set the state for a steady input of `value`.
+    void prime(T value) {
+      const float gain = (C::b0 + C::b1 + C::b2) / (1 + C::a1 + C::a2);
+      const T steady = T(gain) * value;
+      state2 = b2 * value - a2 * steady;
+      state1 = b1 * value - a1 * steady + state2;
+      primed = true;
+    }
+};
+
+template<typename T, typename C> const T Biquad<T, C>::b0 = T(C::b0);
+template<typename T, typename C> const T Biquad<T, C>::b1 = T(C::b1);
+template<typename T, typename C> const T Biquad<T, C>::b2 = T(C::b2);
+template<typename T, typename C> const T Biquad<T, C>::a1 = T(C::a1);
+template<typename T, typename C> const T Biquad<T, C>::a2 = T(C::a2);
+
+/* A second order Butterworth low-pass filter with its cutoff at a tenth of the
+ * sample rate (so 0.1Hz when sampling once a second), for `Biquad`.
+ */
+struct ButterworthLowPassTenth {
+  static constexpr float b0 = 0.06745527;
+  static constexpr float b1 = 0.13491055;
+  static constexpr float b2 = 0.06745527;
+  static constexpr float a1 = -1.14298050;
+  static constexpr float a2 = 0.41280160;
+};
+
+/* Runs samples through `First`, then `Second`. For example, a median to throw
+ * out spikes followed by an average to smooth what's left:
+ *
+ *   Cascade< MedianFilter<float, 3>, ExponentialMovingAverage<float, 2> >
+ *
+ * Both filters need the same `value_type`. Cascades can be nested to chain
+ * more than two filters. RAM: the sum of the two filters.
+ */
+template<typename First, typename Second>
+class Cascade {
+  public:
+    typedef typename First::value_type value_type;
+
+    void push(value_type new_value) {
+      second.push(first.update(new_value));
+    }
+
+    value_type current_value() const {
+      return second.current_value();
+    }
+
+    value_type update(value_type new_value) {
+      push(new_value);
+      return current_value();
+    }
+
+    bool empty() const {
+      return second.empty();
+    }
+
+  private:
+    First first;
+    Second second;
+};
+#endif
@@ -0,0 +1,125 @@
+#ifndef FAN_FIXED_H
+#define FAN_FIXED_H
+
+#include <stdint.h>
+
+/* A signed Q-format fixed point number, with `F` fractional bits stored in a
+ * `T`. Products and quotients are calculated in the wider type `W` before being
+ * scaled back down.
+ *
+ * The 32u4 doesn't have an FPU, so every float operation is a call into the
+ * soft-float library. Additions, subtractions and comparisons of fixed point
+ * numbers are plain integer instructions, and multiplication is an integer
+ * multiply (which the 32u4 *does* have hardware support for) and a shift.
+ *
+ * There's no overflow checking, so choose `F` with the range of the values
+ * in mind. The default, Q16.16, covers +/-32767 with a resolution of about
+ * 0.000015.
+ */
+template<uint8_t F = 16, typename T = int32_t, typename W = int64_t>
+class Fixed {
+  public:
+    static const uint8_t FRACTIONAL_BITS = F;
+
+    Fixed(): raw(0) {}
+
+    explicit Fixed(float value):
+      raw((T)(value * ONE + (value < 0 ? -0.5f : 0.5f)))
+    {}
+
+    explicit Fixed(double value):
+      raw((T)(value * ONE + (value < 0 ? -0.5 : 0.5)))
+    {}
+
+    explicit Fixed(int value): raw((T)value << F) {}
+    explicit Fixed(long value): raw((T)value << F) {}
+
+    // Create a value directly from its raw (scaled) representation.
+    static Fixed fromRaw(T raw) {
+      Fixed value;
+      value.raw = raw;
+      return value;
+    }
+
+    /* Create the value `numerator / denominator`, without the numerator having
+     * to fit in the fixed point range first.
+     */
+    static Fixed fromRatio(long numerator, long denominator) {
+      return fromRaw((T)(((W)numerator << F) / denominator));
+    }
+
+    T getRaw() const {
+      return raw;
+    }
+
+    // `ONE` is a power of two, so multiplying by its inverse is exact.
+    explicit operator float() const {
+      return (float)raw * (1.0f / ONE);
+    }
+
+    Fixed operator-() const {
+      return fromRaw(-raw);
+    }
+
+    Fixed & operator+=(Fixed rhs) {
+      raw += rhs.raw;
+      return *this;
+    }
+
+    Fixed & operator-=(Fixed rhs) {
+      raw -= rhs.raw;
+      return *this;
+    }
+
+    Fixed & operator*=(Fixed rhs) {
+      // Round to nearest instead of truncating towards negative infinity.
+      raw = (T)(((W)raw * rhs.raw + HALF) >> F);
+      return *this;
+    }
+
+    Fixed & operator/=(Fixed rhs) {
+      raw = (T)(((W)raw << F) / rhs.raw);
+      return *this;
+    }
+
+    friend Fixed operator+(Fixed lhs, Fixed rhs) { return lhs += rhs; }
+    friend Fixed operator-(Fixed lhs, Fixed rhs) { return lhs -= rhs; }
+    friend Fixed operator*(Fixed lhs, Fixed rhs) { return lhs *= rhs; }
+    friend Fixed operator/(Fixed lhs, Fixed rhs) { return lhs /= rhs; }
+
+    friend bool operator==(Fixed lhs, Fixed rhs) { return lhs.raw == rhs.raw; }
+    friend bool operator!=(Fixed lhs, Fixed rhs) { return lhs.raw != rhs.raw; }
+    friend bool operator<(Fixed lhs, Fixed rhs) { return lhs.raw < rhs.raw; }
+    friend bool operator>(Fixed lhs, Fixed rhs) { return lhs.raw > rhs.raw; }
+    friend bool operator<=(Fixed lhs, Fixed rhs) { return lhs.raw <= rhs.raw; }
+    friend bool operator>=(Fixed lhs, Fixed rhs) { return lhs.raw >= rhs.raw; }
+
+    // Mirrors `signbit()` from <math.h>, so templates can use either type.
+    friend bool signbit(Fixed value) { return value.raw < 0; }
+
+  private:
+    static const T ONE = (T)1 << F;
+    static const T HALF = (T)1 << (F - 1);
+
+    T raw;
+};
+
+/* Helpers for writing arithmetic once for both floating and fixed point
+ * types. The general version covers `float` and `double`.
+ */
+template<typename N>
+struct NumberTraits {
+  // `numerator / denominator`, as an `N`.
+  static N fromRatio(long numerator, long denominator) {
+    return N(numerator) / N(denominator);
+  }
+};
+
+template<uint8_t F, typename T, typename W>
+struct NumberTraits< Fixed<F, T, W> > {
+  static Fixed<F, T, W> fromRatio(long numerator, long denominator) {
+    return Fixed<F, T, W>::fromRatio(numerator, denominator);
+  }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef FAN_HISTOGRAM_H
+#define FAN_HISTOGRAM_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+/* A histogram with power of two buckets, and the largest value seen, for
+ * keeping track of timings without storing them.
+ *
+ * Bucket 0 counts zeros, and bucket `i` counts values from `2^(i-1)` to
+ * `2^i - 1`, except the last, which counts everything from there up. Adding a
+ * value is a handful of shifts and an increment, cheap enough to do on every
+ * trip through the loop. When a bucket fills up, every bucket is halved, so
+ * the counts keep their proportions instead of saturating.
+ *
+ * `T` is the (unsigned) type of the values, and `N` the number of buckets.
+ */
+template<typename T, uint8_t N>
+class Log2Histogram: public Printable {
+  public:
+    Log2Histogram() {
+      reset();
+    }
+
+    void add(T value) {
+      uint8_t bucket = 0;
+      for (T remaining = value; remaining != 0 && bucket < N - 1; ) {
+        remaining >>= 1;
+        bucket++;
+      }
+      if (counts[bucket] == UINT16_MAX) {
+        for (uint8_t i = 0; i < N; i++) {
+          counts[i] >>= 1;
+        }
+      }
+      counts[bucket]++;
+      if (value > maximum) {
+        maximum = value;
+      }
+    }
+
+    void reset() {
+      for (uint8_t i = 0; i < N; i++) {
+        counts[i] = 0;
+      }
+      maximum = 0;
+    }
+
+    uint16_t getCount(uint8_t bucket) const {
+      return counts[bucket];
+    }
+
+    T getMaximum() const {
+      return maximum;
+    }
+
+    /* Prints the maximum, then each bucket that isn't empty as
+     * "lowest-highest:count" (just "lowest+:count" for the last bucket).
+     */
+    virtual size_t printTo(Print& p) const {
+      size_t printed = p.print(F("max "));
+      printed += p.print(maximum);
+      for (uint8_t i = 0; i < N; i++) {
+        if (counts[i] == 0) {
+          continue;
+        }
+        const unsigned long lowest = i == 0 ? 0 : 1UL << (i - 1);
+        const unsigned long highest = i == 0 ? 0 : (1UL << i) - 1;
+        printed += p.print(' ');
+        printed += p.print(lowest);
+        if (i == N - 1) {
+          printed += p.print('+');
+        } else if (highest != lowest) {
+          printed += p.print('-');
+          printed += p.print(highest);
+        }
+        printed += p.print(':');
+        printed += p.print(counts[i]);
+      }
+      return printed;
+    }
+
+  private:
+    uint16_t counts[N];
+    T maximum;
+};
+#endif
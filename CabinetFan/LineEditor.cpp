@@ -0,0 +1,101 @@
+#include <stddef.h>
+#include "LineEditor.h"
+#include "NoHeap.h"
+
+static const char BACKSPACE = 0x08;
+static const char DELETE = 0x7F;
+
+static bool isLineEnd(char c) {
+  return c == '\r' || c == '\n';
+}
+
+static bool isWhitespace(char c) {
+  // Using the expansive definition of "non-printable" for whitespace
+  return c > 0 && c <= ' ';
+}
+
+LineEditor::LineEditor():
+  length(0),
+  overflowed(false),
+  completed(false),
+  discarding(false),
+  lastEnd(0)
+{
+  buffer[0] = '\0';
+}
+
+bool LineEditor::feed(char next) {
+  if (completed) {
+    clear();
+  }
+  if (isLineEnd(next)) {
+    // The second half of a CR LF (or LF CR) pair doesn't end another line.
+    bool isPair = lastEnd != 0 && lastEnd != next && length == 0;
+    lastEnd = isPair ? 0 : next;
+    if (isPair) {
+      return false;
+    }
+    if (discarding) {
+      discarding = false;
+      clear();
+      return false;
+    }
+    completed = true;
+    return true;
+  }
+  lastEnd = 0;
+  if (discarding) {
+    return false;
+  }
+  if (next == BACKSPACE || next == DELETE) {
+    if (length > 0) {
+      buffer[--length] = '\0';
+    }
+  } else if (length < LINE_EDITOR_LENGTH) {
+    buffer[length++] = next;
+    buffer[length] = '\0';
+  } else {
+    overflowed = true;
+  }
+  return false;
+}
+
+char * LineEditor::getLine() {
+  return buffer;
+}
+
+bool LineEditor::isOverflowed() const {
+  return overflowed;
+}
+
+void LineEditor::clear() {
+  length = 0;
+  buffer[0] = '\0';
+  overflowed = false;
+  completed = false;
+}
+
+void LineEditor::discard() {
+  clear();
+  discarding = true;
+}
+
+char * LineEditor::nextToken(char **cursor) {
+  char *start = *cursor;
+  while (isWhitespace(*start)) {
+    start++;
+  }
+  if (*start == '\0') {
+    *cursor = start;
+    return NULL;
+  }
+  char *end = start;
+  while (*end != '\0' && !isWhitespace(*end)) {
+    end++;
+  }
+  if (*end != '\0') {
+    *end++ = '\0';
+  }
+  *cursor = end;
+  return start;
+}
@@ -0,0 +1,58 @@
+#ifndef FAN_LINE_EDITOR_H
+#define FAN_LINE_EDITOR_H
+
+#include <stdint.h>
+
+// The longest line (not counting the terminating NUL) that can be entered.
+#define LINE_EDITOR_LENGTH 31
+
+/* Collects a line of input one character at a time, without blocking and
+ * without allocating.
+ *
+ * Characters are fed in with `feed()` as they arrive, which returns true once
+ * a line has been completed with a carriage return, line feed, or both (a CR
+ * LF pair only ends one line). Backspace and delete remove the last character.
+ * The completed line stays in the buffer until the next character is fed in.
+ *
+ * If a line is too long, the extra characters are dropped and `isOverflowed()`
+ * returns true for that line.
+ */
+class LineEditor {
+  public:
+    LineEditor();
+
+    // Add a character, returning true if it completed a line.
+    bool feed(char next);
+
+    // The current (or just completed) line, NUL terminated.
+    char * getLine();
+
+    // True if characters were dropped from the current line.
+    bool isOverflowed() const;
+
+    // Throw away the current line.
+    void clear();
+
+    /* Throw away the current line and everything up to the end of it, without
+     * completing it.
+     */
+    void discard();
+
+    /* Split the next whitespace separated token off of `*cursor`, in place.
+     * Returns NULL once there are no more tokens. Start with `*cursor` pointing
+     * at the line to tokenize.
+     */
+    static char * nextToken(char **cursor);
+
+  private:
+    char buffer[LINE_EDITOR_LENGTH + 1];
+    uint8_t length;
+    bool overflowed;
+    // Set when the last line was completed, so the next character starts over.
+    bool completed;
+    // Set when a line is being thrown away.
+    bool discarding;
+    // The character that ended the last line, to join CR LF pairs.
+    char lastEnd;
+};
+#endif
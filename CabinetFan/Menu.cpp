@@ -1,20 +1,48 @@
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <stdlib.h>
+#include <string.h>
 #include "Menu.h"
+#include "Trace.h"
 #include "util.h"
+#include "NoHeap.h"
 
-// The timeout when waiting for input from the user over serial
-static int INPUT_TIMEOUT = 5000;
+/* How long (in milliseconds) a prompt waits for an answer before going back to
+ * accepting commands.
+ */
+static const unsigned long INPUT_TIMEOUT = 5000;
+
+// How often (in milliseconds) a line is logged when logging is enabled.
+static const unsigned long LOG_PERIOD = 1000;
 
 Menu::Menu(
-  Fan *fan,
-  Thermometer *thermometer,
+  FanArray *fans,
+  ThermometerBank *thermometers,
   Stream *controlInterface
 ):
-  fan(fan),
-  thermometer(thermometer),
-  controlInterface(controlInterface)
+  fans(fans),
+  thermometers(thermometers),
+  controlInterface(controlInterface),
+  telemetry(fans, thermometers, controlInterface),
+  autoTuner(fans, thermometers)
 {
-  controller = settings.createCurrentController(fan, thermometer);
+  thermometers->setSource(settings.getTemperatureSource());
+  fans->setFullSpeedRPM(settings.getMaxRPM());
+  for (uint8_t i = 0; i < fans->size(); i++) {
+    fans->get(i)->setCurve(settings.getFanCurve());
+  }
+  settings.createCurrentController(&controller, fans, thermometers);
+  telemetry.setController(&controller);
+  /* The tasks run in this order when they're due at the same time. The
+   * controller's first run is a full period away, so it has a temperature and
+   * speed to work with.
+   */
+  unsigned long currentMillis = millis();
+  scheduler.add(thermometers, currentMillis);
+  scheduler.add(fans, currentMillis);
+  scheduler.add(&controller, currentMillis, controller.getPeriod());
+  scheduler.add(this, currentMillis, LOG_PERIOD);
   // Drain the serial buffer
   drain();
   // Show the menu
@@ -22,61 +50,178 @@ Menu::Menu(
 }
 
 void Menu::control() {
-  unsigned long currentMillis = millis();
-  thermometer->periodic(currentMillis);
-  fan->periodic(currentMillis);
-  controller->periodic(currentMillis);
-  if (logEnabled) {
-    if (controlInterface->available()) {
-      // Clear out the buffer
-      drain();
-      controlInterface->println("Stopping logging.");
+#if TIMING_STATS
+  const unsigned long loopStart = micros();
+#endif
+  scheduler.run(millis());
+  if (savePending && !settings.isSaving()) {
+    controlInterface->println(F("Settings saved."));
+    savePending = false;
+  }
+  if (autoTuning && !autoTuner.isRunning()) {
+    finishAutoTune();
+  }
+  if (characterizing && !fans->isCalibrating(controller.getMembers())) {
+    finishCharacterizing();
+  }
+  if (prompt != noPrompt && periodPassed(millis(), promptStart, INPUT_TIMEOUT)) {
+    controlInterface->println();
+    controlInterface->println(F("Timed out waiting for input."));
+    prompt = noPrompt;
+    lineEditor.clear();
+  }
+  /* Only one character is handled each time around, so no matter how much is
+   * being typed (or pasted) the tasks keep running on time.
+   */
+  if (controlInterface->available()) {
+    char next = controlInterface->read();
+    if (logEnabled) {
+      // Whatever was typed to stop logging isn't a command.
+      lineEditor.discard();
+      controlInterface->println(F("Stopping logging."));
       logEnabled = false;
-    } else if (periodPassed(currentMillis, lastLogTimestamp, 1000)) {
-      controlInterface->print(currentMillis);
-      controlInterface->print('\t');
-      controlInterface->print(fan->getRPM());
-      controlInterface->print('\t');
-      controlInterface->println(thermometer->getTemperature());
-      lastLogTimestamp = currentMillis;
-    }
-  } else {
-    if (controlInterface->available()) {
-      char command = controlInterface->read();
-      drain(true);
-      rootMenu(command);
+    } else if (telemetry.isEnabled()) {
+      lineEditor.discard();
+      telemetry.stop();
+      scheduler.remove(&telemetry);
+      controlInterface->println();
+      controlInterface->print(F("Stopping telemetry. Dropped records: "));
+      controlInterface->println(telemetry.getDropped());
+    } else if (lineEditor.feed(next)) {
+      handleLine(lineEditor.getLine());
     }
   }
+#if TIMING_STATS
+  loopDuration.add(micros() - loopStart);
+#endif
+  if (idleSleepEnabled) {
+    idle();
+  }
 }
 
-void Menu::drain(bool onlyWhitespace) {
-  if (onlyWhitespace) {
-    char next = 0;
-    // Using the expansive definition of "non-printable" for whitespace
-    while (controlInterface->available() && next < 32) {
-      controlInterface->read();
-      next = controlInterface->peek();
-    }
-  } else {
-    while (controlInterface->available()) {
-      controlInterface->read();
-    }
+void Menu::idle() {
+  /* Idle sleep keeps the timers (so PWM and millis()), USB and the external
+   * interrupts running, while stopping the CPU. Any interrupt wakes it back
+   * up: the Timer0 overflow behind millis() (about once a millisecond), USB,
+   * the tachometer, the ADC and the EEPROM. Waking up just goes around the
+   * loop again, which is cheap when nothing is due.
+   */
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  cli();
+  bool busy = (
+    scheduler.timeUntilNextDeadline(millis()) == 0 ||
+    controlInterface->available() ||
+    (savePending && !settings.isSaving())
+  );
+  if (!busy) {
+    sleep_enable();
+    /* The instruction after `sei` is always run before any interrupts, so an
+     * interrupt can't sneak in between checking and sleeping (and leave the CPU
+     * asleep with work to do).
+     */
+    sei();
+    sleep_cpu();
+    sleep_disable();
   }
+  sei();
 }
 
-void Menu::rootMenu(char command) {
+void Menu::periodic(unsigned long currentMillis) {
+  if (logEnabled) {
+    controlInterface->print(currentMillis);
+    controlInterface->print('\t');
+    controlInterface->print(fans->getRPM(controller.getMembers()));
+    controlInterface->print('\t');
+    controlInterface->println(thermometers->getTemperature());
+  }
+}
+
+unsigned long Menu::getPeriod() const {
+  return LOG_PERIOD;
+}
+
+const __FlashStringHelper * Menu::getTaskName() const {
+  return F("log");
+}
+
+void Menu::drain() {
+  while (controlInterface->available()) {
+    controlInterface->read();
+  }
+}
+
+void Menu::handleLine(char *line) {
+  TRACE_SCOPE(traceMenu);
+  if (lineEditor.isOverflowed()) {
+    controlInterface->println(F("Input too long, ignoring."));
+    prompt = noPrompt;
+    return;
+  }
+  char *cursor = line;
+  char *token = LineEditor::nextToken(&cursor);
+  Prompt answering = prompt;
+  prompt = noPrompt;
+  if (answering != noPrompt) {
+    // Finish off the line the prompt was printed on.
+    controlInterface->println();
+  }
+  switch (answering) {
+    case controllerPrompt:
+      changeController(token != NULL ? token : line);
+      break;
+    case valuePrompt:
+      editValue(token != NULL ? token : line);
+      break;
+    case fansPrompt:
+      changeFans(token != NULL ? token : line);
+      break;
+    case sourcePrompt:
+      changeTemperatureSource(token != NULL ? token : line);
+      break;
+    case rpmPrompt:
+      changeFullSpeedRPM(token != NULL ? token : line);
+      break;
+    default:
+      if (token == NULL) {
+        // An empty line shows the help.
+        printHelp();
+      } else if (token[1] != '\0') {
+        controlInterface->println();
+        controlInterface->print(F("Unrecognized command \""));
+        controlInterface->print(token);
+        controlInterface->println(F("\""));
+        printHelp();
+      } else {
+        rootMenu(token[0], LineEditor::nextToken(&cursor));
+      }
+  }
+}
+
+void Menu::startPrompt(Prompt newPrompt) {
+  prompt = newPrompt;
+  promptStart = millis();
+}
+
+void Menu::rootMenu(char command, char *argument) {
   // print a newline to clear the entered character
   controlInterface->println();
   switch (command) {
     case 's':
     case 'S':
       // _S_ave
+      rememberThermalModel();
       if (settings.isDirty()) {
-        controlInterface->print("Saving...");
-        settings.save();
-        controlInterface->println("done!");
+        // The settings are written in the background, see control().
+        if (settings.save()) {
+          controlInterface->println(F("Saving..."));
+          savePending = true;
+        } else {
+          controlInterface->println(F("Unable to save the settings."));
+        }
       } else {
-        controlInterface->println("No settings have changed, skipping save.");
+        controlInterface->println(F(
+          "No settings have changed, skipping save."
+        ));
       }
       break;
     case 'p':
@@ -93,54 +238,185 @@ void Menu::rootMenu(char command) {
       ));
       logEnabled = true;
       break;
+    case 't':
+    case 'T':
+      // Binary _T_elemetry
+      startTelemetry(argument);
+      break;
     case 'c':
     case 'C':
       // _C_hange controller
-      changeController();
+      changeController(argument);
+      break;
+    case 'f':
+    case 'F':
+      // Change the controlled _F_ans
+      changeFans(argument);
+      break;
+    case 'm':
+    case 'M':
+      // Change the _M_easured temperature
+      changeTemperatureSource(argument);
       break;
     case 'e':
     case 'E':
       // _E_dit values
-      editValue();
+      editValue(argument);
+      break;
+    case 'v':
+    case 'V':
+      // Control fan _V_elocity (RPM)
+      changeFullSpeedRPM(argument);
       break;
     case 'r':
     case 'R':
       // _R_ecalibrate fan limits
+      controlInterface->println(F("Recalibrating fan limits"));
+      fans->calibrate();
+      break;
+    case 'u':
+    case 'U':
+      // Timing statistics, in _u_s (and ms)
+#if TIMING_STATS
+      timingStats(argument);
+#else
+      controlInterface->println(F(
+        "Timing statistics aren't built in, see TIMING_STATS in Scheduler.h."
+      ));
+#endif
+      break;
+    case 'x':
+    case 'X':
+      // E_x_ecution trace
+#if TRACE
+      traceDump(controlInterface);
+#else
+      controlInterface->println(F(
+        "Tracing isn't built in, see TRACE in Trace.h."
+      ));
+#endif
+      break;
+    case 'w':
+    case 'W':
+      // S_w_eep the duty cycle to characterize the fans
+      controlInterface->println(F(
+        "Characterizing the controlled fans, this takes up to a minute."
+      ));
+      fans->characterize(controller.getMembers());
+      characterizing = true;
+      break;
+    case 'a':
+    case 'A':
+      // _A_uto-tune the PID controller
+      toggleAutoTune();
       break;
     case 'd':
     case 'D':
       // Toggle fan controller _D_ebug
-      controlInterface->println("Toggling controller debug logging");
-      controller->toggleDebug();
+      controlInterface->println(F("Toggling controller debug logging"));
+      controller.toggleDebug();
+      break;
+    case 'i':
+    case 'I':
+      // Toggle _I_dle sleep
+      idleSleepEnabled = !idleSleepEnabled;
+      controlInterface->print(F("Idle sleep "));
+      controlInterface->println(
+        idleSleepEnabled ? F("enabled") : F("disabled")
+      );
       break;
     default:
       // Print help
-      controlInterface->print("Unrecognized command ");
+      controlInterface->print(F("Unrecognized command "));
       if (command < 32) {
-        controlInterface->print("0x");
+        controlInterface->print(F("0x"));
         controlInterface->println(command, HEX);
       } else {
-        controlInterface->print("'");
+        controlInterface->print('\'');
         controlInterface->print(command);
-        controlInterface->println("'");
+        controlInterface->println('\'');
       }
-      __attribute__ ((fallthrough));
-    case '\n':
-    case '\r':
       printHelp();
   }
 }
 
 void Menu::printStatus() const {
   // Controller status
-  controlInterface->print("Current controller: ");
-  controlInterface->println(*controller);
-  // Fan RPM
-  controlInterface->print("RPM: ");
-  controlInterface->println(fan->getRPM());
+  controlInterface->print(F("Current controller: "));
+  controlInterface->println(controller);
+  if (autoTuning) {
+    controlInterface->print(F("Auto-tuning, cycles measured: "));
+    controlInterface->println(autoTuner.getCycles());
+  }
+  thermalModelValues model;
+  if (controller.getThermalModel(&model)) {
+    controlInterface->print(F("Model: "));
+    controlInterface->print(model.offset);
+    controlInterface->print(F(" C stopped, "));
+    controlInterface->print(model.gain);
+    controlInterface->print(F(" C at full speed, time constant "));
+    controlInterface->print(model.timeConstant);
+    controlInterface->println(F(" s"));
+  }
+  // Fan RPM, marking the controlled fans when there's more than one.
+  uint8_t members = controller.getMembers();
+  for (uint8_t i = 0; i < fans->size(); i++) {
+    const Fan *fan = fans->get(i);
+    if (fans->size() > 1) {
+      controlInterface->print(F("Fan "));
+      controlInterface->print(i + 1);
+      if (FanArray::isSelected(i, members)) {
+        controlInterface->print('*');
+      }
+      controlInterface->print(' ');
+    }
+    switch (fan->getSetupError()) {
+      case pwmTimerInUse:
+        controlInterface->print(F("NO PWM, timer in use for a tachometer, "));
+        break;
+      case captureTimerInUse:
+        controlInterface->print(F("NOT SENSED, timer in use for PWM, "));
+        break;
+      default:
+        break;
+    }
+    controlInterface->print(F("RPM: "));
+    controlInterface->print(fan->getRPM());
+    if (fan->isCalibrating()) {
+      controlInterface->print(F(", calibrating: "));
+      controlInterface->print(fan->getCalibrationProgress());
+      controlInterface->println(F("%"));
+    } else {
+      controlInterface->print(F(", max RPM: "));
+      controlInterface->print(fan->getMaxRPM());
+      if (fan->hasCalibrationFault()) {
+        controlInterface->print(F(" (no RPM at full speed)"));
+      }
+      const float stallDuty = fan->getCurve().getStallDuty();
+      if (stallDuty > 0.0) {
+        controlInterface->print(F(", stalls below: "));
+        controlInterface->print(stallDuty * 100, 0);
+        controlInterface->print('%');
+      }
+      controlInterface->println();
+    }
+    // Fault counters, once there's been a fault.
+    if (fan->getStallCount() > 0) {
+      controlInterface->print(
+        fan->isStalled() ? F("  STALLED") : F("  Running")
+      );
+      controlInterface->print(F(", stalls: "));
+      controlInterface->print(fan->getStallCount());
+      controlInterface->print(F(", failed restarts: "));
+      controlInterface->print(fan->getFailedRestartCount());
+      controlInterface->print(F(", minimum duty: "));
+      controlInterface->print(fan->getMinimumDuty() * 100, 0);
+      controlInterface->println(F("%"));
+    }
+  }
   // temperature
-  controlInterface->print("Temperature: ");
-  controlInterface->println(*thermometer);
+  controlInterface->print(F("Temperature: "));
+  controlInterface->println(*thermometers);
 }
 
 void Menu::printHelp() const {
@@ -150,72 +426,375 @@ void Menu::printHelp() const {
     "s - Save current values to EEPROM.\r\n"
     "p - Print current values.\r\n"
     "l - Continuously log fan RPM once per second.\r\n"
-    "c - Change the current controller.\r\n"
-    "e - Change the current controller value.\r\n"
+    "t [ms] - Stream binary telemetry every ms milliseconds.\r\n"
+    "c [name] - Change the current controller.\r\n"
+    "e [value] - Change the current controller value.\r\n"
+    "f [fan] - Change which fans are controlled (a number or \"all\").\r\n"
+    "m [sensor] - Change which temperature is controlled.\r\n"
+    "v [rpm] - Control fan RPM, rpm being full speed (0 for duty cycle).\r\n"
     "r - Recalibrate fan limits.\r\n"
+    "w - Measure the controlled fans' speed at each duty cycle.\r\n"
+    "a - Auto-tune the PID controller (again to cancel).\r\n"
     "d - Toggle fan controller debug logging.\r\n"
+    "i - Toggle sleeping while idle.\r\n"
+    "u [reset] - Print (or reset) the timing statistics, if built with "
+    "TIMING_STATS.\r\n"
+    "x - Print (and clear) the trace buffer, if built with TRACE.\r\n"
     "\r\n"
-    "Any unknown command shows this help text."
+    "Any unknown command (or an empty line) shows this help text."
   ));
 }
 
-void Menu::editValue() {
-  // Print the current value
-  controlInterface->print("Current value: ");
-  controlInterface->print(controller->getValue());
-  controlInterface->print(" ");
-  controlInterface->println(controller->valueUnits);
-  // Give the limits
-  float minValue = controller->minValue;
-  float maxValue = controller->maxValue;
-  controlInterface->print("Enter a value between ");
-  controlInterface->print(minValue);
-  controlInterface->print(" and ");
-  controlInterface->print(maxValue);
-  controlInterface->print(": ");
-  /* Start reading in a new value. Give a larger timeout to read the prompt and
-   * enter a number.
-   */
-  controlInterface->setTimeout(INPUT_TIMEOUT);
-  float newValue = controlInterface->parseFloat();
-  if (newValue < minValue || newValue > maxValue) {
-    controlInterface->println("Out of range value entered. Ignoring.");
+#if TIMING_STATS
+void Menu::timingStats(char *input) {
+  if (input != NULL && strcasecmp_P(input, PSTR("reset")) == 0) {
+    loopDuration.reset();
+    scheduler.resetStats();
+    controlInterface->println(F("Timing statistics reset."));
+    return;
+  }
+  controlInterface->print(F("Loop duration (us): "));
+  controlInterface->println(loopDuration);
+  controlInterface->println(F("Lateness (ms):"));
+  for (uint8_t i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    const SchedulerBase::TaskStats &stats = scheduler.getStats(i);
+    if (stats.task != NULL) {
+      controlInterface->print(F("  "));
+      controlInterface->print(scheduler.getTaskName(i));
+      controlInterface->print(F(": "));
+      controlInterface->println(stats.lateness);
+    }
+  }
+}
+#endif
+
+void Menu::editValue(char *input) {
+  float minValue = controller.getMinValue();
+  float maxValue = controller.getMaxValue();
+  if (input == NULL) {
+    // Print the current value
+    controlInterface->print(F("Current value: "));
+    controlInterface->print(controller.getValue());
+    controlInterface->print(' ');
+    controlInterface->println(controller.getValueUnits());
+    // Give the limits
+    controlInterface->print(F("Enter a value between "));
+    controlInterface->print(minValue);
+    controlInterface->print(F(" and "));
+    controlInterface->print(maxValue);
+    controlInterface->print(F(": "));
+    startPrompt(valuePrompt);
+    return;
+  }
+  char *end;
+  float newValue = strtod(input, &end);
+  if (end == input || *end != '\0') {
+    controlInterface->print(F("Invalid value \""));
+    controlInterface->print(input);
+    controlInterface->println(F("\". Ignoring."));
+  } else if (newValue < minValue || newValue > maxValue) {
+    controlInterface->println(F("Out of range value entered. Ignoring."));
   } else {
     settings.setValue(newValue);
-    controller->setValue(newValue);
-    controlInterface->println("New value set. Settings have NOT been saved.");
-  }
-}
-
-void Menu::changeController() {
-  // Print the current controller and what the options are.
-  controlInterface->print("Current controller: ");
-  controlInterface->println(*controller);
-  controlInterface->println("Available controllers:");
-  controlInterface->println("\tconstant");
-  controlInterface->println("\tproportional");
-  controlInterface->println("\tpid");
-  // Get the new controller
-  controlInterface->setTimeout(INPUT_TIMEOUT);
-  String controllerInput = controlInterface->readStringUntil('\n');
-  controllerInput.trim();
+    controller.setValue(newValue);
+    controlInterface->println(F(
+      "New value set. Settings have NOT been saved."
+    ));
+  }
+}
+
+void Menu::changeController(char *input) {
+  if (input == NULL) {
+    // Print the current controller and what the options are.
+    controlInterface->print(F("Current controller: "));
+    controlInterface->println(controller);
+    controlInterface->println(F("Available controllers:"));
+    controlInterface->println(F("\tconstant"));
+    controlInterface->println(F("\tproportional"));
+    controlInterface->println(F("\tpid"));
+    controlInterface->println(F("\tfeedforward"));
+    startPrompt(controllerPrompt);
+    return;
+  }
   ControllerType newController;
-  if (controllerInput.equalsIgnoreCase(String("constant"))) {
+  if (strcasecmp_P(input, PSTR("constant")) == 0) {
     newController = ControllerType::constant;
-    controlInterface->println("Changing to constant speed controller");
-  } else if (controllerInput.equalsIgnoreCase(String("proportional"))) {
+    controlInterface->println(F("Changing to constant speed controller"));
+  } else if (strcasecmp_P(input, PSTR("proportional")) == 0) {
     newController = ControllerType::proportional;
-    controlInterface->println("Changing to proportional speed controller");
-  } else if (controllerInput.equalsIgnoreCase(String("pid"))) {
+    controlInterface->println(F("Changing to proportional speed controller"));
+  } else if (strcasecmp_P(input, PSTR("pid")) == 0) {
     newController = ControllerType::pid;
-    controlInterface->println("Changing to PID controller");
+    controlInterface->println(F("Changing to PID controller"));
+  } else if (strcasecmp_P(input, PSTR("feedforward")) == 0) {
+    newController = ControllerType::feedforward;
+    controlInterface->println(F("Changing to feedforward controller"));
   } else {
-    controlInterface->print("Unknown controller type \"");
-    controlInterface->print(controllerInput);
-    controlInterface->println("\"");
+    controlInterface->print(F("Unknown controller type \""));
+    controlInterface->print(input);
+    controlInterface->println(F("\""));
     return;
   }
+  if (autoTuning) {
+    stopAutoTune();
+    controlInterface->println(F("Auto-tuning cancelled."));
+  }
+  rememberThermalModel();
   settings.setController(newController);
-  delete controller;
-  controller = settings.createCurrentController(fan, thermometer);
+  settings.createCurrentController(&controller, fans, thermometers);
+  // Reschedule the new controller for a full period from now.
+  scheduler.replace(
+    &controller,
+    &controller,
+    millis(),
+    controller.getPeriod()
+  );
+}
+
+void Menu::changeFans(char *input) {
+  if (input == NULL) {
+    controlInterface->print(F("Controlled fans: "));
+    if (controller.getMembers() == ALL_FANS) {
+      controlInterface->println(F("all"));
+    } else {
+      for (uint8_t i = 0; i < fans->size(); i++) {
+        if (FanArray::isSelected(i, controller.getMembers())) {
+          controlInterface->print(i + 1);
+          controlInterface->print(' ');
+        }
+      }
+      controlInterface->println();
+    }
+    controlInterface->print(F("Enter a fan between 1 and "));
+    controlInterface->print(fans->size());
+    controlInterface->print(F(", or \"all\": "));
+    startPrompt(fansPrompt);
+    return;
+  }
+  uint8_t newMembers;
+  if (strcasecmp_P(input, PSTR("all")) == 0) {
+    newMembers = ALL_FANS;
+  } else {
+    char *end;
+    unsigned long number = strtoul(input, &end, 10);
+    if (end == input || *end != '\0' || number < 1 || number > fans->size()) {
+      controlInterface->print(F("Unknown fan \""));
+      controlInterface->print(input);
+      controlInterface->println(F("\". Ignoring."));
+      return;
+    }
+    newMembers = 1 << (number - 1);
+  }
+  settings.setFanMembers(newMembers);
+  controller.setMembers(newMembers);
+  controlInterface->println(F(
+    "Controlled fans changed. Settings have NOT been saved."
+  ));
+}
+
+void Menu::printTemperatureSource(uint8_t source) const {
+  switch (source) {
+    case HOTTEST_TEMPERATURE:
+      controlInterface->print(F("hottest"));
+      break;
+    case MEAN_TEMPERATURE:
+      controlInterface->print(F("mean"));
+      break;
+    default: {
+      const __FlashStringHelper *name = thermometers->get(source)->getName();
+      if (name != NULL) {
+        controlInterface->print(name);
+      } else {
+        controlInterface->print(source + 1);
+      }
+    }
+  }
+}
+
+void Menu::changeTemperatureSource(char *input) {
+  if (input == NULL) {
+    controlInterface->print(F("Controlled temperature: "));
+    printTemperatureSource(thermometers->getSource());
+    controlInterface->println();
+    controlInterface->print(F("Temperatures: "));
+    controlInterface->println(*thermometers);
+    controlInterface->println(F("Available temperatures:"));
+    controlInterface->println(F("\thottest"));
+    controlInterface->println(F("\tmean"));
+    for (uint8_t i = 0; i < thermometers->size(); i++) {
+      controlInterface->print('\t');
+      printTemperatureSource(i);
+      controlInterface->println();
+    }
+    startPrompt(sourcePrompt);
+    return;
+  }
+  uint8_t newSource;
+  int8_t index = thermometers->find(input);
+  if (strcasecmp_P(input, PSTR("hottest")) == 0) {
+    newSource = HOTTEST_TEMPERATURE;
+  } else if (strcasecmp_P(input, PSTR("mean")) == 0) {
+    newSource = MEAN_TEMPERATURE;
+  } else if (index >= 0) {
+    newSource = index;
+  } else {
+    // Unnamed thermometers are picked by number.
+    char *end;
+    unsigned long number = strtoul(input, &end, 10);
+    if (
+      end == input ||
+      *end != '\0' ||
+      number < 1 ||
+      number > thermometers->size()
+    ) {
+      controlInterface->print(F("Unknown temperature \""));
+      controlInterface->print(input);
+      controlInterface->println(F("\". Ignoring."));
+      return;
+    }
+    newSource = number - 1;
+  }
+  settings.setTemperatureSource(newSource);
+  thermometers->setSource(newSource);
+  controlInterface->print(F("Controlled temperature changed to "));
+  printTemperatureSource(newSource);
+  controlInterface->println(F(". Settings have NOT been saved."));
+}
+
+void Menu::changeFullSpeedRPM(char *input) {
+  if (input == NULL) {
+    controlInterface->print(F("Full speed: "));
+    if (fans->getFullSpeedRPM() == 0) {
+      controlInterface->println(F("100% duty cycle"));
+    } else {
+      controlInterface->print(fans->getFullSpeedRPM());
+      controlInterface->println(F(" RPM"));
+    }
+    controlInterface->print(F("Enter an RPM between 0 (duty cycle) and "));
+    controlInterface->print(UINT16_MAX);
+    controlInterface->print(F(": "));
+    startPrompt(rpmPrompt);
+    return;
+  }
+  char *end;
+  unsigned long rpm = strtoul(input, &end, 10);
+  if (end == input || *end != '\0' || rpm > UINT16_MAX) {
+    controlInterface->print(F("Invalid RPM \""));
+    controlInterface->print(input);
+    controlInterface->println(F("\". Ignoring."));
+    return;
+  }
+  // Carry the current speed over to the new meaning of speed.
+  const uint8_t members = controller.getMembers();
+  const float speed = fans->getSpeed(members);
+  settings.setMaxRPM(rpm);
+  fans->setFullSpeedRPM(rpm);
+  fans->setSpeed(speed, members);
+  controlInterface->println(F(
+    "Full speed changed. Settings have NOT been saved."
+  ));
+}
+
+void Menu::startTelemetry(char *input) {
+  unsigned long period = TELEMETRY_DEFAULT_PERIOD;
+  if (input != NULL) {
+    char *end;
+    period = strtoul(input, &end, 10);
+    if (end == input || *end != '\0' || period == 0) {
+      controlInterface->print(F("Invalid period \""));
+      controlInterface->print(input);
+      controlInterface->println(F("\". Ignoring."));
+      return;
+    }
+  }
+  controlInterface->print(F("Streaming binary telemetry every "));
+  controlInterface->print(period);
+  controlInterface->println(F(
+    " ms until any other character is entered."
+  ));
+  telemetry.start(period);
+  // The first record goes out once a full period has passed.
+  scheduler.add(&telemetry, millis(), period);
+}
+
+void Menu::toggleAutoTune() {
+  if (autoTuning) {
+    stopAutoTune();
+    controlInterface->println(F("Auto-tuning cancelled."));
+    return;
+  }
+  float setPoint = settings.getValue(pid);
+  controlInterface->print(F("Auto-tuning the PID controller at "));
+  controlInterface->print(setPoint);
+  controlInterface->print(' ');
+  controlInterface->println(flashString(PIDFanController::valueUnits));
+  controlInterface->println(F(
+    "The fans are switched between high and low speed until the temperature "
+    "has gone around the set point a few times, which can take an hour."
+  ));
+  autoTuner.start(controller.getMembers(), setPoint);
+  scheduler.replace(&controller, &autoTuner, millis(), autoTuner.getPeriod());
+  autoTuning = true;
+}
+
+void Menu::stopAutoTune() {
+  autoTuner.stop();
+  scheduler.replace(&autoTuner, &controller, millis(), controller.getPeriod());
+  autoTuning = false;
+}
+
+void Menu::finishAutoTune() {
+  if (autoTuner.getState() != autoTuneFinished) {
+    controlInterface->println(F(
+      "Auto-tuning failed, the temperature stopped crossing the set point."
+    ));
+    stopAutoTune();
+    return;
+  }
+  AutoTuneGains gains = autoTuner.getGains();
+  controlInterface->print(F("Auto-tuning finished. Ultimate gain: "));
+  controlInterface->print(autoTuner.getUltimateGain(), 4);
+  controlInterface->print(F(", ultimate period: "));
+  controlInterface->print(autoTuner.getUltimatePeriod());
+  controlInterface->println(F(" ms"));
+  controlInterface->print(F("PID gains: Kp "));
+  controlInterface->print(gains.k_p, 4);
+  controlInterface->print(F(", Ki "));
+  controlInterface->print(gains.k_i, 4);
+  controlInterface->print(F(", Kd "));
+  controlInterface->print(gains.k_d, 4);
+  controlInterface->print(F(", period "));
+  controlInterface->print(gains.period);
+  controlInterface->println(F(" ms"));
+  // Switch to the newly tuned PID controller.
+  settings.setPIDTuning(gains.k_p, gains.k_i, gains.k_d, gains.period);
+  rememberThermalModel();
+  settings.setController(pid);
+  settings.createCurrentController(&controller, fans, thermometers);
+  stopAutoTune();
+  controlInterface->println(F(
+    "Now using the PID controller. Settings have NOT been saved."
+  ));
+}
+
+void Menu::rememberThermalModel() {
+  thermalModelValues model;
+  if (controller.getThermalModel(&model)) {
+    settings.setThermalModel(model);
+  }
+}
+
+void Menu::finishCharacterizing() {
+  characterizing = false;
+  // The fans share one curve, so the first of them speaks for the rest.
+  const uint8_t members = controller.getMembers();
+  for (uint8_t i = 0; i < fans->size(); i++) {
+    if (FanArray::isSelected(i, members)) {
+      settings.setFanCurve(fans->get(i)->getCurve().getValues());
+      break;
+    }
+  }
+  controlInterface->println(F(
+    "Fans characterized. Settings have NOT been saved."
+  ));
 }
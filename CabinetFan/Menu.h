@@ -3,42 +3,150 @@
 
 #include <stdint.h>
 #include <Arduino.h>
-#include "Fan.h"
-#include "Thermometer.h"
+#include "AutoTuner.h"
+#include "FanArray.h"
+#include "ThermometerBank.h"
 #include "FanController.h"
+#include "Histogram.h"
 #include "Settings.h"
+#include "Scheduler.h"
+#include "LineEditor.h"
+#include "Telemetry.h"
 
-class Menu {
+/* When enabled, the MCU idles in between tasks instead of spinning. It can be
+ * toggled at runtime from the menu.
+ */
+#ifndef IDLE_SLEEP
+#define IDLE_SLEEP 1
+#endif
+
+class Menu: public Task {
   public:
     Menu(
-      Fan *fan,
-      Thermometer *thermometer,
+      FanArray *fans,
+      ThermometerBank *thermometers,
       Stream *controlInterface = &Serial
     );
 
     void control();
 
+    // Prints a log line, when logging is enabled.
+    void periodic(unsigned long currentMillis);
+    unsigned long getPeriod() const;
+    const __FlashStringHelper * getTaskName() const;
+
   private:
-    Fan *fan;
+    FanArray *fans;
 
-    Thermometer *thermometer;
+    ThermometerBank *thermometers;
 
     Settings settings = Settings();
 
-    FanController *controller;
+    FanController controller;
+
+    /* Runs the thermometers, fans, controller and logging tasks, and the
+     * telemetry and auto-tuner while they're in use.
+     */
+    Scheduler<
+      ThermometerBank,
+      FanArray,
+      FanController,
+      Menu,
+      Telemetry,
+      AutoTuner
+    > scheduler;
 
     Stream *controlInterface;
 
     bool logEnabled = false;
 
-    unsigned long lastLogTimestamp = 0;
+    // Binary telemetry, scheduled only while it's enabled.
+    Telemetry telemetry;
+
+    // Set when a save has been started, until it's been reported as finished.
+    bool savePending = false;
+
+    // Stands in for the controller while tuning the PID controller.
+    AutoTuner autoTuner;
+
+    /* Set while the auto-tuner has the controller's place in the scheduler,
+     * until it's been reported as finished.
+     */
+    bool autoTuning = false;
+
+    bool idleSleepEnabled = IDLE_SLEEP;
+
+    // Set while the fans are being characterized, until it's been reported.
+    bool characterizing = false;
+
+#if TIMING_STATS
+    /* How long (in microseconds) each trip through `control()` takes, not
+     * counting time asleep. The last bucket is for 16 milliseconds and over.
+     */
+    Log2Histogram<uint32_t, 16> loopDuration;
+#endif
+
+    // What the next line of input is expected to be.
+    enum Prompt: uint8_t {
+      // A command.
+      noPrompt,
+      // The name of a controller, for `changeController()`.
+      controllerPrompt,
+      // A new set point, for `editValue()`.
+      valuePrompt,
+      // Which fans to control, for `changeFans()`.
+      fansPrompt,
+      // Which temperature to control, for `changeTemperatureSource()`.
+      sourcePrompt,
+      // The RPM at full speed, for `changeFullSpeedRPM()`.
+      rpmPrompt
+    };
+
+    // Input is collected into lines a character at a time.
+    LineEditor lineEditor;
+
+    Prompt prompt = noPrompt;
+
+    // When the current prompt was shown, so it can time out.
+    unsigned long promptStart = 0;
+
+    void drain();
+
+    // Sleep until the next interrupt, if there's nothing to do until then.
+    void idle();
 
-    void drain(bool onlyWhitespace = false);
+    // Act on a complete line of input.
+    void handleLine(char *line);
 
-    void rootMenu(char command);
+    /* Run a command, with an optional argument (`NULL` if none was given).
+     * Commands that need an argument prompt for it if it's missing.
+     */
+    void rootMenu(char command, char *argument);
     void printStatus() const;
     void printHelp() const;
-    void editValue();
-    void changeController();
+    void editValue(char *input);
+    void changeController(char *input);
+    void changeFans(char *input);
+    void changeTemperatureSource(char *input);
+    void printTemperatureSource(uint8_t source) const;
+    void changeFullSpeedRPM(char *input);
+    void startTelemetry(char *input);
+#if TIMING_STATS
+    // Print the timing statistics, or clear them if `input` is "reset".
+    void timingStats(char *input);
+#endif
+    // Start auto-tuning, or cancel it if it's already running.
+    void toggleAutoTune();
+    // Put the controller back in the scheduler in place of the auto-tuner.
+    void stopAutoTune();
+    // Report (and use) the result once the auto-tuner is done.
+    void finishAutoTune();
+    /* Copy what the controller has learned about the cabinet (if anything)
+     * to the settings, so it isn't lost when the controller is replaced.
+     */
+    void rememberThermalModel();
+    // Save the curve measured by characterizing once it's done.
+    void finishCharacterizing();
+    void startPrompt(Prompt newPrompt);
 };
 #endif
\ No newline at end of file
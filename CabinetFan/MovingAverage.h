@@ -1,9 +1,71 @@
 #ifndef FAN_MOVING_AVERAGE_H
 #define FAN_MOVING_AVERAGE_H
 
+#include <stdint.h>
+
+/* The type `MovingAverage` keeps its running sum in. Integer samples are summed
+ * exactly in a wider integer, so the sum can't drift or overflow (for up to
+ * 255 samples), and the average needs no floating point math. Other types are
+ * summed as themselves.
+ */
+template<typename T> struct MovingAverageSum {
+  typedef T type;
+  static const bool isInteger = false;
+};
+template<> struct MovingAverageSum<int8_t> {
+  typedef int16_t type;
+  static const bool isInteger = true;
+};
+template<> struct MovingAverageSum<uint8_t> {
+  typedef uint16_t type;
+  static const bool isInteger = true;
+};
+template<> struct MovingAverageSum<int16_t> {
+  typedef int32_t type;
+  static const bool isInteger = true;
+};
+template<> struct MovingAverageSum<uint16_t> {
+  typedef uint32_t type;
+  static const bool isInteger = true;
+};
+
+// log2(n), for powers of two.
+constexpr uint8_t movingAverageShift(uint8_t n) {
+  return n <= 1 ? 0 : 1 + movingAverageShift(n / 2);
+}
+
+/* Divides the sum of a full `MovingAverage` by `N`. For integer sums when `N`
+ * is a power of two, that's a shift.
+ */
+template<typename S, uint8_t N, bool SHIFT>
+struct MovingAverageDivide {
+  static S divide(S sum) {
+    return sum / S(N);
+  }
+};
+template<typename S, uint8_t N>
+struct MovingAverageDivide<S, N, true> {
+  static S divide(S sum) {
+    return sum >> movingAverageShift(N);
+  }
+};
+
+/* The average of the last `N` values. See Filters.h for other filters with the
+ * same interface.
+ *
+ * With an integer `T` (see `MovingAverageSum`), the average is rounded down,
+ * and picking a power of two for `N` turns the division into a shift once the
+ * buffer has filled. For example, `MovingAverage<uint16_t, 8>` of raw ADC
+ * counts needs no floating point math at all.
+ *
+ * RAM: N * sizeof(T) + the size of the sum + 3 (with 2 byte pointers).
+ */
 template<typename T = float, uint8_t N = 10>
 class MovingAverage {
   public:
+    typedef T value_type;
+    typedef typename MovingAverageSum<T>::type sum_type;
+
     /* Create a `MovingAverage` that averages the last N values.
     */
     MovingAverage():
@@ -33,10 +95,16 @@ class MovingAverage {
       }
     }
 
-    /* Calculate the current moving average.
+    /* Calculate the current moving average, or 0 if there aren't any values
+     * yet.
      */
-    T current_value() {
-      return sum / T(count);
+    T current_value() const {
+      if (count == 0) {
+        return T(0);
+      } else if (count == N) {
+        return T(Divide::divide(sum));
+      }
+      return T(sum / sum_type(count));
     }
 
     /* Add a new value and calculate the current movign average.
@@ -46,7 +114,18 @@ class MovingAverage {
       return current_value();
     }
 
+    // True until the first value is added.
+    bool empty() const {
+      return count == 0;
+    }
+
   private:
+    typedef MovingAverageDivide<
+      sum_type,
+      N,
+      MovingAverageSum<T>::isInteger && (N & (N - 1)) == 0
+    > Divide;
+
     // The current number of values in the average.
     uint8_t count;
 
@@ -55,7 +134,7 @@ class MovingAverage {
      * to the list, instead of every value being summed every time the average
      * is being retrieved.
      */
-    T sum;
+    sum_type sum;
 
     /* The values that are being averaged.
      * This is a circular buffer, accessed through the `current` pointer.
@@ -0,0 +1,25 @@
+#ifndef FAN_NO_HEAP_H
+#define FAN_NO_HEAP_H
+
+/* Everything in the firmware is allocated statically (or on the stack), so
+ * how much RAM it needs is known when it's linked, and can't change (or
+ * fragment) however long it runs. Objects that can't be built until `setup()`
+ * are static locals there, and the controllers share one buffer in
+ * `FanController`.
+ *
+ * Including this makes using the heap a compile error: a plain `new` fails
+ * with the message below (placement `new` is still fine), and the C
+ * allocation functions are poisoned.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+
+#define NO_HEAP_ERROR \
+  __attribute__((error("CabinetFan doesn't use the heap, allocate statically")))
+
+void * operator new(size_t size) NO_HEAP_ERROR;
+void * operator new[](size_t size) NO_HEAP_ERROR;
+
+#pragma GCC poison malloc calloc realloc
+#endif
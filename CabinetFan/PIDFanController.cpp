@@ -1,79 +1,171 @@
 #include <math.h>
 #include <Arduino.h>
 #include "PIDFanController.h"
-#include "util.h"
+#include "NoHeap.h"
 
 // The minimum change in speed needed before actually changing the speed.
 static const float MIN_SPEED_CHANGE = 0.01;
 
-// It'd be nice to include the degree symbol at some point later.
-const char * PIDFanController::valueUnits = "C";
+template<typename N>
+const char BasicPIDFanController<N>::valueUnits[] PROGMEM = "C";
+template<typename N>
+const char BasicPIDFanController<N>::defaultName[] PROGMEM = "PID Controller";
+template<typename N>
+constexpr float BasicPIDFanController<N>::valueStep;
+template<typename N>
+constexpr float BasicPIDFanController<N>::minValue;
+template<typename N>
+constexpr float BasicPIDFanController<N>::maxValue;
 
-PIDFanController::PIDFanController(
-  Fan *fan,
-  Thermometer * thermometer,
-  const char * name,
+template<typename N>
+BasicPIDCorrection<N>::BasicPIDCorrection(float k_p, float k_i, float k_d):
+  k_p(k_p),
+  k_i(k_i),
+  k_d(k_d)
+{}
+
+template<typename N>
+N BasicPIDCorrection<N>::update(N error, N elapsedSeconds) {
+  N correction = N(0.0);
+  // Proportional.
+  proportionalTerm = k_p * error;
+  correction += proportionalTerm;
+  // Derivative.
+  derivativeTerm = k_d * ((error - previousError) / elapsedSeconds);
+  correction += derivativeTerm;
+  // When the error crosses the setpoint, reset the integral
+  if (signbit(previousError) != signbit(error)) {
+    errorIntegral = N(0.0);
+  }
+  previousError = error;
+  // Integral. Only bother updating it if integral control is enabled.
+  if (k_i != N(0.0)) {
+    errorIntegral += error * elapsedSeconds;
+    // Constrain the error integral to 300
+    errorIntegral = max(min(errorIntegral, N(300.0)), N(-300.0));
+    integralTerm = k_i * errorIntegral;
+    correction += integralTerm;
+  }
+  return correction;
+}
+
+template<typename N>
+ControllerTerms BasicPIDCorrection<N>::getTerms() const {
+  ControllerTerms terms;
+  terms.proportional = Fixed<16>(proportionalTerm);
+  terms.integral = Fixed<16>(integralTerm);
+  terms.derivative = Fixed<16>(derivativeTerm);
+  return terms;
+}
+
+template<typename N>
+BasicPIDFanController<N>::BasicPIDFanController(
+  FanArray *fans,
+  uint8_t members,
+  ThermometerBank * thermometers,
+  const __FlashStringHelper * name,
   float target,
   float k_p,
   float k_i,
   float k_d,
   unsigned long period
 ):
-  FanController(fan, 0.0, 100, target),
-  thermometer(thermometer),
-  k_p(k_p),
-  k_i(k_i),
-  k_d(k_d),
+  BasicFanController< BasicPIDFanController<N> >(
+    fans,
+    members,
+    name,
+    target
+  ),
+  thermometers(thermometers),
+  correction(k_p, k_i, k_d),
+  target(N(value)),
   period(period)
 {
-  this->name = name;
-  controllerDebug("Name", name);
-  controllerDebug("Kp", k_p);
-  controllerDebug("Ki", k_i);
-  controllerDebug("Kd", k_d);
-  controllerDebug("Period", period);
+  controllerDebug(F("Name"), name);
+  controllerDebug(F("Kp"), k_p);
+  controllerDebug(F("Ki"), k_i);
+  controllerDebug(F("Kd"), k_d);
+  controllerDebug(F("Period"), period);
+}
+
+template<typename N>
+void BasicPIDFanController<N>::setValue(float newValue) {
+  BasicFanController< BasicPIDFanController<N> >::setValue(newValue);
+  target = N(value);
 }
 
-void PIDFanController::periodic(unsigned long currentMillis) {
-  if (periodPassed(currentMillis, lastUpdate, period)) {
-    controllerDebug("Updating controller", "");
-    float elapsedSeconds = ((float)(currentMillis - lastUpdate)) / 1000.;
-    controllerDebug("Elapsed seconds", elapsedSeconds);
-    // Update `lastUpdate` after we have the elapsed time.
+template<typename N>
+void BasicPIDFanController<N>::periodic(unsigned long currentMillis) {
+  controllerDebug(F("Updating controller"));
+  const float temperature = thermometers->getTemperature();
+  if (isnan(temperature)) {
+    controllerDebug(F("No temperature yet"));
+    return;
+  }
+  if (!running || currentMillis - lastUpdate > 2 * period) {
+    /* Measured from a stale `lastUpdate`, the elapsed time could be hours,
+     * which is more than a `Fixed` can hold. Start measuring from now.
+     */
+    controllerDebug(F("Starting"));
     lastUpdate = currentMillis;
-    float temp = thermometer->getTemperature();
-    controllerDebug("Current temp", temp);
-    const float error = temp - value;
-    controllerDebug("error", error);
-    float correction = 0.0;
-    // Proportional.
-    correction += k_p * error;
-    controllerDebug("Correction after Kp", correction);
-    // Derivative.
-    correction += k_d * ((error - previousError) / elapsedSeconds);
-    controllerDebug("Correction after Kd", correction);
-    // When the error crosses the setpoint, reset the integral
-    if (signbit(previousError) != signbit(error)) {
-      errorIntegral = 0.0;
-    }
-    previousError = error;
-    // Integral. Only bother updating it if integral control is enabled.
-    if (k_i != 0.0) {
-      errorIntegral += error * elapsedSeconds;
-      // Constrain the error integral to 300
-      errorIntegral = max(min(errorIntegral, 300.0), -300.0);
-      controllerDebug("Error integral", errorIntegral);
-      correction += k_i * errorIntegral;
-      controllerDebug("Correction after Ki", correction);
-    }
-    // Apply the correction and set a new speed as needed.
-    float currentSpeed = fan->getSpeed();
-    controllerDebug("Current Speed", currentSpeed);
-    // Constrain the new speed to the proper bounds.
-    float newSpeed = min(1.0, max(0.0, currentSpeed + correction));
-    // If the speed would be less than 5%, just stop the fan.
-    newSpeed = newSpeed < 0.05 ? 0.0 : newSpeed;
-    controllerDebug("New speed", newSpeed);
-    fan->setSpeed(newSpeed);
+    running = true;
+    return;
+  }
+  const N elapsedSeconds = NumberTraits<N>::fromRatio(
+    currentMillis - lastUpdate,
+    1000
+  );
+  debugValue(F("Elapsed seconds"), elapsedSeconds);
+  // Update `lastUpdate` after we have the elapsed time.
+  lastUpdate = currentMillis;
+  const N temp = N(temperature);
+  debugValue(F("Current temp"), temp);
+  const N error = temp - target;
+  debugValue(F("error"), error);
+  const N change = correction.update(error, elapsedSeconds);
+  if (debug) {
+    ControllerTerms terms = correction.getTerms();
+    controllerDebug(F("Kp term"), float(terms.proportional));
+    controllerDebug(F("Ki term"), float(terms.integral));
+    controllerDebug(F("Kd term"), float(terms.derivative));
+  }
+  /* Apply the correction to the speed the fans are actually running at, which
+   * can differ from what was asked for last time (see `Fan::setSpeed()`).
+   */
+  N speed = N(fans->getSpeed(members));
+  debugValue(F("Current Speed"), speed);
+  // Constrain the new speed to the proper bounds.
+  speed = min(N(1.0), max(N(0.0), speed + change));
+  // If the speed would be less than 5%, just stop the fan.
+  speed = speed < N(0.05) ? N(0.0) : speed;
+  debugValue(F("New speed"), speed);
+  fans->setSpeed(float(speed), members);
+}
+
+template<typename N>
+unsigned long BasicPIDFanController<N>::getPeriod() const {
+  return period;
+}
+
+template<typename N>
+ControllerTerms BasicPIDFanController<N>::getTerms() const {
+  return correction.getTerms();
+}
+
+template<typename N>
+void BasicPIDFanController<N>::debugValue(
+  const __FlashStringHelper * message,
+  N value
+) {
+  if (debug) {
+    controllerDebug(message, float(value));
   }
-}
\ No newline at end of file
+}
+
+/* Only the version selected by `PID_FIXED_POINT` ends up being linked in, but
+ * both are instantiated so that they're both always compiled.
+ */
+template class BasicPIDCorrection<float>;
+template class BasicPIDCorrection< Fixed<16> >;
+template class BasicPIDFanController<float>;
+template class BasicPIDFanController< Fixed<16> >;
@@ -1,23 +1,88 @@
 #ifndef FAN_PID_CONTROLLER_H
 #define FAN_PID_CONTROLLER_H
 
-#include "FanController.h"
-#include "Thermometer.h"
+#include "BasicFanController.h"
+#include "Fixed.h"
+#include "ThermometerBank.h"
+
+/* The PID calculations can be done with either floats or Q16.16 fixed point
+ * numbers. The 32u4 doesn't have an FPU, so each float operation is a call
+ * into the soft-float library, where most fixed point ones are integer
+ * instructions. Set to 0 to use floats instead.
+ */
+#ifndef PID_FIXED_POINT
+#define PID_FIXED_POINT 1
+#endif
+
+/* The PID calculation itself: each period, how much to change the fan speed by
+ * for the error between the temperature and the set point. The correction is
+ * added to the speed from the period before (the velocity form of PID), so
+ * `k_p` acts like the integral gain of a conventional PID controller, and
+ * `k_d` like its proportional gain (see `AutoTuner::getGains()`).
+ *
+ * `N` is the number type the calculations are done with, as for
+ * `BasicPIDFanController`.
+ */
+template<typename N>
+class BasicPIDCorrection {
+  public:
+    BasicPIDCorrection(float k_p, float k_i, float k_d);
+
+    /* The correction for `error` (the temperature minus the set point),
+     * `elapsedSeconds` after the last one.
+     */
+    N update(N error, N elapsedSeconds);
+
+    // How much each term contributed to the last correction.
+    ControllerTerms getTerms() const;
+
+  private:
+    // The tuning constants.
+    const N k_p;
+    const N k_i;
+    const N k_d;
+
+    // The running values.
+    N errorIntegral = N(0.0);
+    N previousError = N(0.0);
+
+    // The contribution of each term to the last correction.
+    N proportionalTerm = N(0.0);
+    N integralTerm = N(0.0);
+    N derivativeTerm = N(0.0);
+};
 
 /* A PID Controller that adjusts the fan speed to achieve a set temperature.
  * The temperature is set in degrees Celsius, and can be set between 0 and 100.
+ *
+ * `N` is the number type the controller does its calculations with, either
+ * `float` or a `Fixed`. The set point is kept as an `N`, so each period only
+ * converts the temperature and the fans' current speed on the way in, and the
+ * new speed on the way out. The tuning constants are floats either way, so
+ * both versions behave the same (within the precision of `N`).
+ *
+ * The first period after the controller starts, or after it's been paused
+ * (while auto-tuning) for more than two periods, only notes the time. There's
+ * no elapsed time to measure a change over until the next one.
  */
-class PIDFanController: public FanController {
+template<typename N>
+class BasicPIDFanController:
+  public BasicFanController< BasicPIDFanController<N> >
+{
   public:
+    // The name used when none is given, in flash.
+    static const char defaultName[];
+
     /* Setting any of the tuning constants (`k_p`, `k_i`, `k_p`) to 0 will
      * disable that portion of the controller.
      * The default set point temperature is 27 degrees Celsius, about 80 degrees
      * Fahrenheit.
      */
-    PIDFanController(
-      Fan *fan,
-      Thermometer * thermometer,
-      const char * name = "PID Controller",
+    BasicPIDFanController(
+      FanArray *fans,
+      uint8_t members,
+      ThermometerBank * thermometers,
+      const __FlashStringHelper * name = flashString(defaultName),
       float target = 27.0,
       float k_p = 1,
       float k_i = 0,
@@ -25,27 +90,48 @@ class PIDFanController: public FanController {
       unsigned long period = 1000
     );
 
-    // The abbreviation for the units for the set point.
-    static const char * valueUnits;
+    /* The abbreviation for the units for the set point. It'd be nice to
+     * include the degree symbol at some point later.
+     */
+    static const char valueUnits[];
 
     // A suggested amount to increment the set point value by.
-    const float valueStep = 0.2;
+    static constexpr float valueStep = 0.2;
 
     // 0 degrees Celsius is the minimum value.
-    const float minValue = 0.0;
+    static constexpr float minValue = 0.0;
 
     // 100 degrees Celsius is the maximum value.
-    const float maxValue = 100.0;
+    static constexpr float maxValue = 100.0;
+
+    // Set a new set point, clamped to the controller's limits.
+    void setValue(float newValue);
+
+    // Called once every `getPeriod()` milliseconds.
+    void periodic(unsigned long currentMillis);
+
+    unsigned long getPeriod() const;
+
+    ControllerTerms getTerms() const;
 
-    virtual void periodic(unsigned long currentMillis);
+    // The base class is a template, so its members have to be brought in.
+    using ControllerBase::debug;
+    using ControllerBase::controllerDebug;
   private:
-    // The thermometer used for determining the process variable
-    Thermometer * thermometer;
+    using ControllerBase::fans;
+    using ControllerBase::members;
+    using ControllerBase::value;
 
-    // The tuning constants.
-    const float k_p;
-    const float k_i;
-    const float k_d;
+    // The thermometers used for determining the process variable
+    ThermometerBank * thermometers;
+
+    BasicPIDCorrection<N> correction;
+
+    // `value`, as an `N`.
+    N target;
+
+    // False until the first period, when there's no `lastUpdate` yet.
+    bool running = false;
 
     // The period over which change is measured.
     const unsigned long period;
@@ -53,8 +139,18 @@ class PIDFanController: public FanController {
     // The last time the calculations were done.
     unsigned long lastUpdate = 0;
 
-    // The running values.
-    float errorIntegral = 0.0;
-    float previousError = 0.0;
+    /* Log a debug value. Converting `N` to a float isn't free, so it's only
+     * done when debugging is enabled.
+     */
+    void debugValue(const __FlashStringHelper * message, N value);
 };
-#endif
\ No newline at end of file
+
+// The number type selected by `PID_FIXED_POINT`.
+#if PID_FIXED_POINT
+typedef Fixed<16> PIDNumber;
+#else
+typedef float PIDNumber;
+#endif
+typedef BasicPIDCorrection<PIDNumber> PIDCorrection;
+typedef BasicPIDFanController<PIDNumber> PIDFanController;
+#endif
@@ -0,0 +1,207 @@
+#include <limits.h>
+#include "Scheduler.h"
+#include "NoHeap.h"
+
+/* Deadlines are compared by the sign of their difference, so they keep working
+ * when `millis()` overflows (as long as they're within about 24 days of each
+ * other).
+ */
+static bool isDue(unsigned long deadline, unsigned long currentMillis) {
+  return (long)(currentMillis - deadline) >= 0;
+}
+
+const __FlashStringHelper * Task::getTaskName() const {
+  return F("task");
+}
+
+SchedulerBase::SchedulerBase(): numTasks(0), nextOrder(0) {
+  for (uint8_t i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    stats[i].task = NULL;
+  }
+}
+
+bool SchedulerBase::add(
+  Task *task,
+  uint8_t type,
+  unsigned long currentMillis,
+  unsigned long phase
+) {
+  if (numTasks == SCHEDULER_MAX_TASKS) {
+    return false;
+  }
+  Entry &entry = heap[numTasks];
+  entry.task = task;
+  entry.type = type;
+  entry.deadline = currentMillis + phase;
+  entry.order = nextOrder++;
+  // There's a slot for every entry, so one's free if an entry is.
+  entry.stats = 0;
+  while (stats[entry.stats].task != NULL) {
+    entry.stats++;
+  }
+  stats[entry.stats].task = task;
+  stats[entry.stats].type = type;
+#if TIMING_STATS
+  stats[entry.stats].lateness.reset();
+#endif
+  siftUp(numTasks++);
+  return true;
+}
+
+void SchedulerBase::remove(Task *task) {
+  int8_t index = find(task);
+  if (index >= 0) {
+    stats[heap[index].stats].task = NULL;
+    removeAt(index);
+  }
+}
+
+void SchedulerBase::replace(
+  Task *oldTask,
+  Task *newTask,
+  uint8_t type,
+  unsigned long currentMillis,
+  unsigned long phase
+) {
+  int8_t index = find(oldTask);
+  if (index < 0) {
+    add(newTask, type, currentMillis, phase);
+    return;
+  }
+  uint8_t order = heap[index].order;
+  uint8_t slot = heap[index].stats;
+  removeAt(index);
+  Entry &entry = heap[numTasks];
+  entry.task = newTask;
+  entry.type = type;
+  entry.deadline = currentMillis + phase;
+  entry.order = order;
+  entry.stats = slot;
+  if (newTask != oldTask) {
+    stats[slot].task = newTask;
+    stats[slot].type = type;
+#if TIMING_STATS
+    stats[slot].lateness.reset();
+#endif
+  }
+  siftUp(numTasks++);
+}
+
+bool SchedulerBase::isTaskDue(unsigned long currentMillis) const {
+  return numTasks > 0 && isDue(heap[0].deadline, currentMillis);
+}
+
+Task * SchedulerBase::dueTask() const {
+  return heap[0].task;
+}
+
+uint8_t SchedulerBase::dueType() const {
+  return heap[0].type;
+}
+
+void SchedulerBase::reschedule(
+  unsigned long currentMillis,
+  unsigned long period
+) {
+#if TIMING_STATS
+  const unsigned long lateness = currentMillis - heap[0].deadline;
+  stats[heap[0].stats].lateness.add(min(lateness, (unsigned long)UINT16_MAX));
+#endif
+  if (period == 0) {
+    period = 1;
+  }
+  heap[0].deadline += period;
+  if (isDue(heap[0].deadline, currentMillis)) {
+    // Fallen behind, skip the missed runs.
+    heap[0].deadline = currentMillis + period;
+  }
+  siftDown(0);
+}
+
+unsigned long SchedulerBase::timeUntilNextDeadline(
+  unsigned long currentMillis
+) const {
+  if (numTasks == 0) {
+    return ULONG_MAX;
+  }
+  if (isDue(heap[0].deadline, currentMillis)) {
+    return 0;
+  }
+  return heap[0].deadline - currentMillis;
+}
+
+const SchedulerBase::TaskStats & SchedulerBase::getStats(
+  uint8_t slot
+) const {
+  return stats[slot];
+}
+
+void SchedulerBase::resetStats() {
+#if TIMING_STATS
+  for (uint8_t i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    stats[i].lateness.reset();
+  }
+#endif
+}
+
+bool SchedulerBase::isBefore(const Entry &a, const Entry &b) const {
+  long difference = (long)(a.deadline - b.deadline);
+  if (difference != 0) {
+    return difference < 0;
+  }
+  return a.order < b.order;
+}
+
+void SchedulerBase::siftUp(uint8_t index) {
+  while (index > 0) {
+    uint8_t parent = (index - 1) / 2;
+    if (!isBefore(heap[index], heap[parent])) {
+      break;
+    }
+    Entry swap = heap[parent];
+    heap[parent] = heap[index];
+    heap[index] = swap;
+    index = parent;
+  }
+}
+
+void SchedulerBase::siftDown(uint8_t index) {
+  while (true) {
+    uint8_t smallest = index;
+    uint8_t left = index * 2 + 1;
+    uint8_t right = left + 1;
+    if (left < numTasks && isBefore(heap[left], heap[smallest])) {
+      smallest = left;
+    }
+    if (right < numTasks && isBefore(heap[right], heap[smallest])) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      break;
+    }
+    Entry swap = heap[smallest];
+    heap[smallest] = heap[index];
+    heap[index] = swap;
+    index = smallest;
+  }
+}
+
+void SchedulerBase::removeAt(uint8_t index) {
+  numTasks--;
+  if (index == numTasks) {
+    return;
+  }
+  // Move the last entry into the hole, then restore the heap around it.
+  heap[index] = heap[numTasks];
+  siftDown(index);
+  siftUp(index);
+}
+
+int8_t SchedulerBase::find(Task *task) const {
+  for (uint8_t i = 0; i < numTasks; i++) {
+    if (heap[i].task == task) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,265 @@
+#ifndef FAN_SCHEDULER_H
+#define FAN_SCHEDULER_H
+
+#include <stdint.h>
+#include "Arduino.h"
+#include "Histogram.h"
+
+// The most tasks a `Scheduler` can hold.
+#define SCHEDULER_MAX_TASKS 8
+
+/* Set to 1 to keep the timing statistics the `u` menu command prints: how
+ * late the scheduler runs each task, and how long each trip through the loop
+ * takes. The histograms take about 200 bytes of RAM (one per task slot, and
+ * the loop's), so with it off (the default) they aren't allocated.
+ */
+#ifndef TIMING_STATS
+#define TIMING_STATS 0
+#endif
+
+/* How late (in milliseconds) each task was run is kept in a histogram with
+ * this many buckets, the last being for 64 milliseconds and over.
+ */
+#define SCHEDULER_LATENESS_BUCKETS 8
+
+typedef Log2Histogram<uint16_t, SCHEDULER_LATENESS_BUCKETS> LatenessHistogram;
+
+/* Something that needs to be run periodically by a `Scheduler`. There's
+ * nothing virtual here: the scheduler knows each task's type, and calls its
+ * methods directly. A task provides
+ *
+ *   // Do the periodic work. Called once each time the task is due.
+ *   void periodic(unsigned long currentMillis);
+ *   // How often (in milliseconds) `periodic()` should be called.
+ *   unsigned long getPeriod() const;
+ *
+ * and can hide `getTaskName()` to be reported by name.
+ */
+class Task {
+  public:
+    /* A short name for the task (in flash), for reporting its timing. The
+     * default is defined out of line, as GCC won't put a `F()` string from an
+     * inline function in the same section as the ones from ordinary functions.
+     */
+    const __FlashStringHelper * getTaskName() const;
+};
+
+/* The deadline keeping shared by every `Scheduler`, whatever its task types.
+ * See `Scheduler` for how tasks are run.
+ */
+class SchedulerBase {
+  public:
+    // Remove a task (if it's been added).
+    void remove(Task *task);
+
+    /* The number of milliseconds until the next task is due (0 if one is
+     * already due), or `ULONG_MAX` if there are no tasks.
+     */
+    unsigned long timeUntilNextDeadline(unsigned long currentMillis) const;
+
+    /* How late each task has been run, relative to its deadline (only kept
+     * with `TIMING_STATS`). The statistics stay in the same slot for as long
+     * as the task is scheduled (a replacement takes over the slot, starting
+     * afresh if it's a different task).
+     */
+    struct TaskStats {
+      // `NULL` if the slot is unused.
+      Task *task;
+      // The task's index in the `Scheduler`'s task types.
+      uint8_t type;
+#if TIMING_STATS
+      LatenessHistogram lateness;
+#endif
+    };
+
+    // The statistics in `slot`, from 0 to `SCHEDULER_MAX_TASKS - 1`.
+    const TaskStats & getStats(uint8_t slot) const;
+
+    // Clear every task's statistics.
+    void resetStats();
+
+  protected:
+    SchedulerBase();
+
+    /* `type` is the task's index in the `Scheduler`'s task types, for
+     * dispatching to it.
+     */
+    bool add(
+      Task *task,
+      uint8_t type,
+      unsigned long currentMillis,
+      unsigned long phase
+    );
+    void replace(
+      Task *oldTask,
+      Task *newTask,
+      uint8_t type,
+      unsigned long currentMillis,
+      unsigned long phase
+    );
+
+    // True if the task at the top of the heap is due.
+    bool isTaskDue(unsigned long currentMillis) const;
+
+    // The task at the top of the heap, and its type.
+    Task * dueTask() const;
+    uint8_t dueType() const;
+
+    /* Record how late the task at the top of the heap is, and move its
+     * deadline `period` on (or a period from now, if it's fallen behind).
+     */
+    void reschedule(unsigned long currentMillis, unsigned long period);
+
+  private:
+    struct Entry {
+      Task *task;
+      // The task's index in the `Scheduler`'s task types.
+      uint8_t type;
+      unsigned long deadline;
+      // Breaks ties between equal deadlines, in the order tasks were added.
+      uint8_t order;
+      // The task's slot in `stats`.
+      uint8_t stats;
+    };
+
+    Entry heap[SCHEDULER_MAX_TASKS];
+    TaskStats stats[SCHEDULER_MAX_TASKS];
+    uint8_t numTasks;
+    uint8_t nextOrder;
+
+    bool isBefore(const Entry &a, const Entry &b) const;
+    void siftUp(uint8_t index);
+    void siftDown(uint8_t index);
+    void removeAt(uint8_t index);
+    int8_t find(Task *task) const;
+};
+
+/* The index of `T` in `Tasks`, for a task's type to be stored with it. */
+template<typename T, typename... Tasks> struct SchedulerTaskType;
+template<typename T> struct SchedulerTaskType<T> {
+  static_assert(sizeof(T) == 0, "Not one of the Scheduler's task types");
+};
+template<typename T, typename... Rest> struct SchedulerTaskType<T, T, Rest...> {
+  static const uint8_t value = 0;
+};
+template<typename T, typename U, typename... Rest>
+struct SchedulerTaskType<T, U, Rest...> {
+  static const uint8_t value = 1 + SchedulerTaskType<T, Rest...>::value;
+};
+
+/* Calls the methods of a task of type `type` (an index into `Tasks`). Each
+ * call is qualified with the task's class, so it's a direct call the compiler
+ * can inline, rather than a virtual one.
+ */
+template<typename... Tasks> struct SchedulerDispatch;
+template<> struct SchedulerDispatch<> {
+  static void periodic(uint8_t, Task *, unsigned long) {}
+  static unsigned long getPeriod(uint8_t, Task *) {
+    return 0;
+  }
+  static const __FlashStringHelper * getTaskName(uint8_t, const Task *task) {
+    return task->getTaskName();
+  }
+};
+template<typename T, typename... Rest> struct SchedulerDispatch<T, Rest...> {
+  static void periodic(uint8_t type, Task *task, unsigned long currentMillis) {
+    if (type == 0) {
+      static_cast<T *>(task)->T::periodic(currentMillis);
+    } else {
+      SchedulerDispatch<Rest...>::periodic(type - 1, task, currentMillis);
+    }
+  }
+
+  static unsigned long getPeriod(uint8_t type, Task *task) {
+    if (type == 0) {
+      return static_cast<T *>(task)->T::getPeriod();
+    }
+    return SchedulerDispatch<Rest...>::getPeriod(type - 1, task);
+  }
+
+  static const __FlashStringHelper * getTaskName(
+    uint8_t type,
+    const Task *task
+  ) {
+    if (type == 0) {
+      return static_cast<const T *>(task)->T::getTaskName();
+    }
+    return SchedulerDispatch<Rest...>::getTaskName(type - 1, task);
+  }
+};
+
+/* A cooperative, deadline based scheduler, for tasks of the types `Tasks`.
+ *
+ * Instead of every component checking on each trip through the loop whether
+ * its own period has passed, the tasks are kept in a min-heap ordered by their
+ * next deadline. `run()` only looks at the top of the heap, and only calls the
+ * tasks that are due. Tasks due at the same time run in the order they were
+ * added.
+ *
+ * Deadlines advance by exactly one period each run, so tasks keep a fixed
+ * phase relative to each other. If a task falls more than a period behind
+ * (for example when something blocked for a while) it's run once and then
+ * rescheduled a period from now, instead of being run repeatedly to catch up.
+ *
+ * Like `FanController`, the task types are known at compile time, so running
+ * a task is a branch on its type and a direct call, not a virtual call, and
+ * `Task` doesn't need a vtable.
+ */
+template<typename... Tasks>
+class Scheduler: public SchedulerBase {
+  public:
+    /* Add a task, first due `phase` milliseconds after `currentMillis`. Returns
+     * false if the scheduler is full.
+     */
+    template<typename T>
+    bool add(T *task, unsigned long currentMillis, unsigned long phase = 0) {
+      return SchedulerBase::add(
+        task,
+        SchedulerTaskType<T, Tasks...>::value,
+        currentMillis,
+        phase
+      );
+    }
+
+    /* Replace one task with another, keeping the old one's place in the run
+     * order. The new task is due `phase` milliseconds after `currentMillis`.
+     */
+    template<typename T>
+    void replace(
+      Task *oldTask,
+      T *newTask,
+      unsigned long currentMillis,
+      unsigned long phase = 0
+    ) {
+      SchedulerBase::replace(
+        oldTask,
+        newTask,
+        SchedulerTaskType<T, Tasks...>::value,
+        currentMillis,
+        phase
+      );
+    }
+
+    // The name of the task in a statistics slot (see `getStats()`).
+    const __FlashStringHelper * getTaskName(uint8_t slot) const {
+      const TaskStats &slotStats = getStats(slot);
+      return Dispatch::getTaskName(slotStats.type, slotStats.task);
+    }
+
+    // Run every task that is due.
+    void run(unsigned long currentMillis) {
+      while (isTaskDue(currentMillis)) {
+        Task *task = dueTask();
+        const uint8_t type = dueType();
+        /* Reschedule before running the task, so the task can add or remove
+         * tasks itself.
+         */
+        reschedule(currentMillis, Dispatch::getPeriod(type, task));
+        Dispatch::periodic(type, task, currentMillis);
+      }
+    }
+
+  private:
+    typedef SchedulerDispatch<Tasks...> Dispatch;
+};
+#endif
@@ -1,188 +1,283 @@
-#include <util/crc16.h>
-#include <avr/eeprom.h>
+#include <string.h>
 #include "Settings.h"
+#include "EEPROMWriter.h"
 #include "ConstantSpeed.h"
+#include "FeedforwardFanController.h"
 #include "PIDFanController.h"
+#include "NoHeap.h"
 
-// Default values for the PID controllers
-/* Right now there isn't any facility for changing these values in the
- * controllers, but I'm hoping to add it (or add some sort of automatic,
- * on-line tuning).
+/* Default values for the PID controllers. These are a starting point; the PID
+ * controller's values can be tuned for a particular cabinet by the auto-tuner
+ * (see AutoTuner.h).
  */
 const float DEFAULT_K_P = 0.02;
 const float DEFAULT_K_I = 0.02;
 const float DEFAULT_K_D = 0.05;
 const float DEFAULT_SET_POINT = 30.8;
 const unsigned long DEFAULT_PERIOD = 60000;
+/* The default model for the feedforward controller, until it's learned the
+ * cabinet: 40 degrees with the fans stopped, 10 degrees cooler at full speed,
+ * and taking a couple of minutes to respond. The model finds the dead time
+ * itself, so it starts from none.
+ */
+const thermalModelValues DEFAULT_MODEL = {
+  .offset = 40.0,
+  .gain = -10.0,
+  .timeConstant = 120.0,
+  .deadTime = 0.0
+};
 // Default value for the constant speed controller
 const float DEFAULT_SPEED = 1500;
 
-Settings::Settings() {
-  // Attempt to read everything from EEPROM first.
-  eeprom_busy_wait();
-  // the dirty flag isn't stored in EEPROM
-  size_t readSize = sizeof(this) - sizeof(dirty);
-  eeprom_read_block(this, 0x0, readSize);
+// A compaction writes a bank header and a snapshot of everything in one go.
+static_assert(
+  sizeof(storedSettings) +
+    SETTINGS_LOG_BANK_HEADER_SIZE +
+    SETTINGS_LOG_RECORD_OVERHEAD <= EEPROM_WRITER_BUFFER_SIZE,
+  "The settings are too large to be written by EEPROMWriter"
+);
+
+Settings::Settings():
+  log(sizeof(values), savedValues, pendingValues)
+{
+  /* Start with the default values, then replay what's been saved in EEPROM on
+   * top of them.
+   */
+  values.maxRPM = 0;
+  values.minRPM = 0;
+  values.currentType = constant;
+  values.constantSpeedValues = { .value = DEFAULT_SPEED };
+  values.proportionalValues = {
+    .K_p = DEFAULT_K_P,
+    .period = DEFAULT_PERIOD,
+    .value = DEFAULT_SET_POINT
+  };
+  values.pidValues = {
+    .K_p = DEFAULT_K_P,
+    .K_i = DEFAULT_K_I,
+    .K_d = DEFAULT_K_D,
+    .period = DEFAULT_PERIOD,
+    .value = DEFAULT_SET_POINT
+  };
+  values.fanMembers = ALL_FANS;
+  values.temperatureSource = HOTTEST_TEMPERATURE;
+  values.feedforwardValues = {
+    .value = DEFAULT_SET_POINT,
+    .model = DEFAULT_MODEL
+  };
+  // Until the fans are characterized, a straight line.
+  values.fanCurve = FanCurve().getValues();
   /* dirty is a status flag of the object instance, and it starts off as "clean"
    * (aka "not-dirty"). Any modifications will make the object dirty until it is
    * saved.
    */
   dirty = false;
-  if (!checkCRC()) {
-    // CRC failed, reset all values
-    maxRPM = 0;
-    minRPM = 0;
-    currentType = constant;
-    constantSpeedValues = { .value = DEFAULT_SPEED };
-    proportionalValues = {
-      .K_p = DEFAULT_K_P,
-      .period = DEFAULT_PERIOD,
-      .value = DEFAULT_SET_POINT
-    };
-    pidValues = {
-      .K_p = DEFAULT_K_P,
-      .K_i = DEFAULT_K_I,
-      .K_d = DEFAULT_K_D,
-      .period = DEFAULT_PERIOD,
-      .value = DEFAULT_SET_POINT
-    };
+  /* Firmware from before the log kept its settings in a block at address 0,
+   * but only ever wrote the first byte of it, so there's nothing there to
+   * migrate.
+   */
+  if (!log.load(&values)) {
+    // Nothing has been saved yet, so save the defaults.
     dirty = true;
-    // As we've reset all values, recalculate the CRC and save everything.
     save();
   }
 }
 
 void Settings::setController(ControllerType newType) {
-  dirty = currentType != newType;
-  currentType = newType;
+  dirty |= values.currentType != newType;
+  values.currentType = newType;
 }
 
 ControllerType Settings::getController() const {
-  return currentType;
+  return values.currentType;
 }
 
 void Settings::setMaxRPM(uint16_t newMax) {
-  dirty = maxRPM != newMax;
-  maxRPM = newMax;
+  dirty |= values.maxRPM != newMax;
+  values.maxRPM = newMax;
 }
 
 uint16_t Settings::getMaxRPM() const {
-  return maxRPM;
+  return values.maxRPM;
 }
 
 void Settings::setMinRPM(uint8_t newMin) {
-  dirty = minRPM != newMin;
-  minRPM = newMin;
+  dirty |= values.minRPM != newMin;
+  values.minRPM = newMin;
 }
 
 uint8_t Settings::getMinRPM() const {
-  return minRPM;
+  return values.minRPM;
 }
 
 void Settings::setValue(float newValue) {
-  setValue(newValue, currentType);
+  setValue(newValue, values.currentType);
 }
 
 void Settings::setValue(float newValue, ControllerType type) {
-  dirty = getValue(type) != newValue;
+  dirty |= getValue(type) != newValue;
   switch (type) {
     case constant:
-      constantSpeedValues.value = newValue;
+      values.constantSpeedValues.value = newValue;
       break;
     case proportional:
-      proportionalValues.value = newValue;
+      values.proportionalValues.value = newValue;
       break;
     case pid:
-      pidValues.value = newValue;
+      values.pidValues.value = newValue;
+      break;
+    case feedforward:
+      values.feedforwardValues.value = newValue;
       break;
   }
 }
 
 float Settings::getValue() const {
-  return getValue(currentType);
+  return getValue(values.currentType);
 }
 
 float Settings::getValue(ControllerType type) const {
   switch (type) {
     case constant:
-      return constantSpeedValues.value;
+      return values.constantSpeedValues.value;
     case proportional:
-      return proportionalValues.value;
+      return values.proportionalValues.value;
     case pid:
-      return pidValues.value;
+      return values.pidValues.value;
+    case feedforward:
+      return values.feedforwardValues.value;
     // Silence a compiler warning
     default:
       return 0.0;
   }
 }
 
+void Settings::setPIDTuning(
+  float k_p,
+  float k_i,
+  float k_d,
+  unsigned long period
+) {
+  dirty |= (
+    values.pidValues.K_p != k_p ||
+    values.pidValues.K_i != k_i ||
+    values.pidValues.K_d != k_d ||
+    values.pidValues.period != period
+  );
+  values.pidValues.K_p = k_p;
+  values.pidValues.K_i = k_i;
+  values.pidValues.K_d = k_d;
+  values.pidValues.period = period;
+}
+
+void Settings::setThermalModel(const thermalModelValues &model) {
+  dirty |= memcmp(&values.feedforwardValues.model, &model, sizeof(model)) != 0;
+  values.feedforwardValues.model = model;
+}
+
+void Settings::setFanMembers(uint8_t newMembers) {
+  dirty |= values.fanMembers != newMembers;
+  values.fanMembers = newMembers;
+}
+
+uint8_t Settings::getFanMembers() const {
+  return values.fanMembers;
+}
+
+void Settings::setTemperatureSource(uint8_t newSource) {
+  dirty |= values.temperatureSource != newSource;
+  values.temperatureSource = newSource;
+}
+
+uint8_t Settings::getTemperatureSource() const {
+  return values.temperatureSource;
+}
+
+void Settings::setFanCurve(const fanCurveValues &newCurve) {
+  dirty |= memcmp(&values.fanCurve, &newCurve, sizeof(newCurve)) != 0;
+  values.fanCurve = newCurve;
+}
+
+const fanCurveValues & Settings::getFanCurve() const {
+  return values.fanCurve;
+}
+
 bool Settings::isDirty() const {
   return dirty;
 }
 
-void Settings::save() {
+bool Settings::save() {
   if (!isDirty()) {
-    return;
+    return true;
+  }
+  if (!log.save(&values)) {
+    // Still dirty, as nothing is being written.
+    return false;
   }
-  crc = calculateCRC();
-  // As mentioned in the constructor, dirty isn't saved to EEPROM
-  size_t updateSize = sizeof(this) - sizeof(dirty);
-  eeprom_update_block(this, 0x0, updateSize);
-  // TODO: reimplement using EEPROM interrupt handlers so life can go on while
-  // saving.
-  // Reset dirty, as we've now all the values.
+  // Reset dirty, as the current values are now (being) saved.
   dirty = false;
+  return true;
 }
 
-// Not every 
-FanController * Settings::createCurrentController(
-  Fan *fan,
-  Thermometer *thermometer
+bool Settings::isSaving() {
+  return log.isSaving();
+}
+
+void Settings::createCurrentController(
+  FanController *controller,
+  FanArray *fans,
+  ThermometerBank *thermometers
 ) {
-  switch (currentType) {
+  switch (values.currentType) {
+    // Anything unrecognized gets the constant speed controller.
+    default:
     case constant:
-      return new ConstantSpeedController(
-        fan,
-        constantSpeedValues.value
+      controller->createConstantSpeed(
+        fans,
+        values.fanMembers,
+        values.constantSpeedValues.value
       );
+      break;
     case proportional:
-      return new PIDFanController(
-        fan,
-        thermometer,
-        "Proportional Controller",
-        proportionalValues.value,
-        proportionalValues.K_p,
+      controller->createPID(
+        proportional,
+        fans,
+        values.fanMembers,
+        thermometers,
+        F("Proportional Controller"),
+        values.proportionalValues.value,
+        values.proportionalValues.K_p,
         0,
         0,
-        proportionalValues.period
+        values.proportionalValues.period
       );
+      break;
     case pid:
-      return new PIDFanController(
-        fan,
-        thermometer,
-        "PID Controller",
-        pidValues.value,
-        pidValues.K_p,
-        pidValues.K_i,
-        pidValues.K_d,
-        pidValues.period
+      controller->createPID(
+        pid,
+        fans,
+        values.fanMembers,
+        thermometers,
+        F("PID Controller"),
+        values.pidValues.value,
+        values.pidValues.K_p,
+        values.pidValues.K_i,
+        values.pidValues.K_d,
+        values.pidValues.period
       );
-    // Just to silence a compiler warning
-    default:
-      return NULL;
-  }
-}
-
-uint16_t Settings::calculateCRC() const {
-  uint16_t newCRC = 0xffff;
-  uint8_t * valuesBytes = ((uint8_t *)this) + offsetof(Settings, maxRPM);
-  uint8_t * dirtyAddr = ((uint8_t *)this) + offsetof(Settings, dirty);
-  for (; valuesBytes < dirtyAddr; valuesBytes++) {
-    newCRC = _crc16_update(newCRC, *valuesBytes);
+      break;
+    case feedforward:
+      controller->createFeedforward(
+        fans,
+        values.fanMembers,
+        thermometers,
+        values.feedforwardValues.value,
+        values.pidValues.K_p,
+        values.pidValues.K_i,
+        values.pidValues.K_d,
+        values.pidValues.period,
+        values.feedforwardValues.model
+      );
+      break;
   }
-  return newCRC;
 }
-
-bool Settings::checkCRC() const {
-  return crc == calculateCRC();
-}
\ No newline at end of file
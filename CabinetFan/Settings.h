@@ -1,18 +1,15 @@
 #ifndef FAN_SETTINGS_H
 #define FAN_SETTINGS_H
 
-#include "Fan.h"
-#include "Thermometer.h"
+#include "FanArray.h"
+#include "FanCurve.h"
+#include "ThermometerBank.h"
 #include "FanController.h"
-
-enum ControllerType: uint8_t {
-  constant = 0,
-  proportional = 1,
-  pid = 2
-};
+#include "SettingsLog.h"
+#include "ThermalModel.h"
 
 /* The follow structs are all packed because they're being used both as an
- * in-memory representation and for storage in EEPROM.
+ * in-memory representation and for storage in EEPROM (see SettingsLog).
  */
 
 struct __attribute__((packed)) constantSpeedValues {
@@ -33,7 +30,39 @@ struct __attribute__((packed)) pidValues {
   float value;
 };
 
-class __attribute__((packed)) Settings {
+/* The feedforward controller uses the PID controller's tuning for its
+ * feedback, so it only has its own set point and model.
+ */
+struct __attribute__((packed)) feedforwardValues {
+  float value;
+  struct thermalModelValues model;
+};
+
+/* Everything that's saved to EEPROM. New values should be added to the end, so
+ * values saved by older firmware can still be loaded.
+ */
+struct __attribute__((packed)) storedSettings {
+  /* The RPM a fan speed of 1.0 holds the fans at, or 0 to set duty cycles
+   * instead (see `FanArray::setFullSpeedRPM()`).
+   */
+  uint16_t maxRPM;
+  uint8_t minRPM;
+  ControllerType currentType;
+  struct constantSpeedValues constantSpeedValues;
+  struct proportionalValues proportionalValues;
+  struct pidValues pidValues;
+  // Which fans the controller drives, as a `FanArray` mask.
+  uint8_t fanMembers;
+  // Which temperature is controlled, as a `ThermometerBank` source.
+  uint8_t temperatureSource;
+  struct feedforwardValues feedforwardValues;
+  /* The speed curve measured by characterizing the fans, used for all of
+   * them (see `FanCurve`).
+   */
+  struct fanCurveValues fanCurve;
+};
+
+class Settings {
   public:
     Settings();
 
@@ -50,28 +79,47 @@ class __attribute__((packed)) Settings {
     void setValue(float newValue, ControllerType type);
     float getValue() const;
     float getValue(ControllerType type) const;
-    // TODO: At some point expose the PID controller knobs
+
+    // Set the PID controller's tuning (see `AutoTuner`).
+    void setPIDTuning(float k_p, float k_i, float k_d, unsigned long period);
+
+    // Set the feedforward controller's starting model of the cabinet.
+    void setThermalModel(const thermalModelValues &model);
+
+    void setFanMembers(uint8_t newMembers);
+    uint8_t getFanMembers() const;
+
+    void setTemperatureSource(uint8_t newSource);
+    uint8_t getTemperatureSource() const;
+
+    void setFanCurve(const fanCurveValues &newCurve);
+    const fanCurveValues & getFanCurve() const;
 
     bool isDirty() const;
-    void save();
+    /* Start saving the settings to EEPROM. This returns immediately, and only
+     * the values that have changed are written, in the background. Saving
+     * again before an earlier save has finished restarts it with the current
+     * values. Returns false (leaving the settings dirty) if the save couldn't
+     * be started.
+     */
+    bool save();
+    // True while a save is still being written to EEPROM.
+    bool isSaving();
 
-    FanController * createCurrentController(
-      Fan *fan,
-      Thermometer *thermometer
+    // Replace `controller` with the currently selected type of controller.
+    void createCurrentController(
+      FanController *controller,
+      FanArray *fans,
+      ThermometerBank *thermometers
     );
   private:
-    // This is also the order for how the values are laid in the EEPROM.
-    uint16_t crc;
-    uint16_t maxRPM;
-    uint8_t minRPM;
-    ControllerType currentType;
-    struct constantSpeedValues constantSpeedValues;
-    struct proportionalValues proportionalValues;
-    struct pidValues pidValues;
+    struct storedSettings values;
 
     bool dirty;
 
-    uint16_t calculateCRC() const;
-    bool checkCRC() const;
+    // Space for the settings log to keep track of what's been saved.
+    uint8_t savedValues[sizeof(storedSettings)];
+    uint8_t pendingValues[sizeof(storedSettings)];
+    SettingsLog log;
 };
 #endif
\ No newline at end of file
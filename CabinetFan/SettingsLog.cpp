@@ -0,0 +1,289 @@
+#include <avr/eeprom.h>
+#include <string.h>
+#include <util/crc16.h>
+#include "EEPROMWriter.h"
+#include "SettingsLog.h"
+#include "NoHeap.h"
+
+// Marks the start of a bank. Erased EEPROM reads as 0xFF, so anything else.
+static const uint8_t BANK_MAGIC = 0xCF;
+
+/* Unchanged runs shorter than a record's overhead are cheaper to rewrite than
+ * to skip with a new record.
+ */
+static const uint8_t MERGE_GAP = SETTINGS_LOG_RECORD_OVERHEAD;
+
+static uint16_t recordCRC(
+  uint16_t generation,
+  uint8_t offset,
+  uint8_t length,
+  const uint8_t *data
+) {
+  uint16_t crc = generation;
+  crc = _crc16_update(crc, offset);
+  crc = _crc16_update(crc, length);
+  for (uint8_t i = 0; i < length; i++) {
+    crc = _crc16_update(crc, data[i]);
+  }
+  return crc;
+}
+
+// Append a record to `block`, returning the new length of the block.
+static uint8_t appendRecord(
+  uint8_t *block,
+  uint8_t blockLength,
+  uint16_t generation,
+  uint8_t offset,
+  uint8_t length,
+  const uint8_t *data
+) {
+  uint8_t *record = block + blockLength;
+  uint16_t crc = recordCRC(generation, offset, length, data);
+  record[0] = offset;
+  record[1] = length;
+  memcpy(record + 2, data, length);
+  record[length + 2] = crc & 0xFF;
+  record[length + 3] = crc >> 8;
+  return blockLength + length + SETTINGS_LOG_RECORD_OVERHEAD;
+}
+
+SettingsLog::SettingsLog(
+  uint8_t size,
+  uint8_t *savedImage,
+  uint8_t *pendingImage,
+  uint16_t start,
+  uint16_t bankSize
+):
+  size(size),
+  saved(savedImage),
+  pending(pendingImage),
+  start(start),
+  bankSize(bankSize),
+  bank(1),
+  generation(0),
+  end(0),
+  compactionNeeded(true),
+  writing(false)
+{}
+
+bool SettingsLog::load(void *image) {
+  // The EEPROM can't be read while the writer is using it.
+  EEPROMWriter::flush();
+  eeprom_busy_wait();
+  writing = false;
+  compactionNeeded = true;
+  uint16_t generations[2];
+  bool hasHeader[2];
+  for (uint8_t i = 0; i < 2; i++) {
+    hasHeader[i] = readHeader(i, &generations[i]);
+  }
+  // Try the newest bank first, falling back to the other one.
+  uint8_t first = 0;
+  if (hasHeader[0] && hasHeader[1]) {
+    first = (int16_t)(generations[1] - generations[0]) > 0 ? 1 : 0;
+  } else if (hasHeader[1]) {
+    first = 1;
+  }
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    uint8_t candidate = first ^ attempt;
+    if (!hasHeader[candidate]) {
+      continue;
+    }
+    uint16_t offset = SETTINGS_LOG_BANK_HEADER_SIZE;
+    // The first record in a bank has to be a snapshot, starting at offset 0.
+    const uint8_t *snapshot = (const uint8_t *)(uintptr_t)(
+      bankAddress(candidate) + offset
+    );
+    if (eeprom_read_byte(snapshot) != 0) {
+      continue;
+    }
+    uint8_t snapshotLength = eeprom_read_byte(snapshot + 1);
+    uint16_t recordSize = applyRecord(
+      candidate,
+      generations[candidate],
+      offset,
+      (uint8_t *)image
+    );
+    if (recordSize == 0) {
+      continue;
+    }
+    // Replay every delta record after the snapshot.
+    do {
+      offset += recordSize;
+      recordSize = applyRecord(
+        candidate,
+        generations[candidate],
+        offset,
+        (uint8_t *)image
+      );
+    } while (recordSize != 0);
+    bank = candidate;
+    generation = generations[candidate];
+    end = offset;
+    // If the image has grown, the new bytes haven't been saved anywhere yet.
+    compactionNeeded = snapshotLength < size;
+    memcpy(saved, image, size);
+    return true;
+  }
+  return false;
+}
+
+bool SettingsLog::save(const void *image) {
+  finishWrite();
+  const uint8_t *bytes = (const uint8_t *)image;
+  /* If a compaction is in flight it might finish anyway, and then the other
+   * bank would win at boot. Keep writing to that bank so nothing is lost.
+   */
+  bool compacting = compactionNeeded || (writing && pendingBank != bank);
+  uint8_t block[EEPROM_WRITER_BUFFER_SIZE];
+  uint8_t blockLength = 0;
+  uint16_t snapshotLength = size + SETTINGS_LOG_RECORD_OVERHEAD;
+  if (!compacting) {
+    uint8_t index = 0;
+    while (index < size) {
+      if (bytes[index] == saved[index]) {
+        index++;
+        continue;
+      }
+      // Find the end of this run of changes, merging across short gaps.
+      uint8_t runStart = index;
+      uint8_t runEnd = index + 1;
+      for (index = runEnd; index < size; index++) {
+        if (bytes[index] != saved[index]) {
+          runEnd = index + 1;
+        } else if (index - runEnd >= MERGE_GAP) {
+          break;
+        }
+      }
+      uint8_t runLength = runEnd - runStart;
+      uint16_t newLength = blockLength + runLength + SETTINGS_LOG_RECORD_OVERHEAD;
+      if (newLength >= snapshotLength) {
+        // Enough has changed that a single record for everything is smaller.
+        blockLength = appendRecord(block, 0, generation, 0, size, bytes);
+        break;
+      }
+      blockLength = appendRecord(
+        block,
+        blockLength,
+        generation,
+        runStart,
+        runLength,
+        bytes + runStart
+      );
+      index = runEnd;
+    }
+    if (blockLength == 0) {
+      if (!writing) {
+        // Nothing has changed since the last save.
+        return true;
+      }
+      /* The values have gone back to what's saved, but there's a save in
+       * flight with different values. Replace it with a record that doesn't
+       * change anything.
+       */
+      blockLength = appendRecord(block, 0, generation, 0, 1, bytes);
+    }
+    compacting = end + blockLength > bankSize;
+  }
+  uint16_t address;
+  if (compacting) {
+    pendingBank = bank ^ 1;
+    pendingGeneration = generation + 1;
+    block[0] = BANK_MAGIC;
+    block[1] = pendingGeneration & 0xFF;
+    block[2] = pendingGeneration >> 8;
+    blockLength = appendRecord(
+      block,
+      SETTINGS_LOG_BANK_HEADER_SIZE,
+      pendingGeneration,
+      0,
+      size,
+      bytes
+    );
+    pendingEnd = blockLength;
+    address = bankAddress(pendingBank);
+  } else {
+    pendingBank = bank;
+    pendingGeneration = generation;
+    pendingEnd = end + blockLength;
+    address = bankAddress(bank) + end;
+  }
+  if (!EEPROMWriter::write(address, block, blockLength)) {
+    return false;
+  }
+  memcpy(pending, bytes, size);
+  writing = true;
+  return true;
+}
+
+bool SettingsLog::isSaving() {
+  finishWrite();
+  return writing;
+}
+
+uint16_t SettingsLog::getGeneration() const {
+  return generation;
+}
+
+uint16_t SettingsLog::getUsed() const {
+  return end;
+}
+
+uint16_t SettingsLog::bankAddress(uint8_t bankIndex) const {
+  return start + bankIndex * bankSize;
+}
+
+void SettingsLog::finishWrite() {
+  if (!writing || EEPROMWriter::isBusy()) {
+    return;
+  }
+  writing = false;
+  compactionNeeded = false;
+  bank = pendingBank;
+  generation = pendingGeneration;
+  end = pendingEnd;
+  memcpy(saved, pending, size);
+}
+
+bool SettingsLog::readHeader(uint8_t bankIndex, uint16_t *bankGeneration) const {
+  uint8_t header[SETTINGS_LOG_BANK_HEADER_SIZE];
+  eeprom_read_block(
+    header,
+    (const void *)(uintptr_t)bankAddress(bankIndex),
+    SETTINGS_LOG_BANK_HEADER_SIZE
+  );
+  *bankGeneration = header[1] | ((uint16_t)header[2] << 8);
+  return header[0] == BANK_MAGIC;
+}
+
+uint16_t SettingsLog::applyRecord(
+  uint8_t bankIndex,
+  uint16_t bankGeneration,
+  uint16_t offset,
+  uint8_t *image
+) {
+  if (offset + SETTINGS_LOG_RECORD_OVERHEAD > bankSize) {
+    return 0;
+  }
+  const uint8_t *address = (const uint8_t *)(uintptr_t)(
+    bankAddress(bankIndex) + offset
+  );
+  uint8_t recordOffset = eeprom_read_byte(address);
+  uint8_t length = eeprom_read_byte(address + 1);
+  uint16_t recordSize = length + SETTINGS_LOG_RECORD_OVERHEAD;
+  if (
+    length == 0 ||
+    recordOffset + length > size ||
+    offset + recordSize > bankSize
+  ) {
+    return 0;
+  }
+  // The pending image isn't needed while loading, so use it as scratch space.
+  eeprom_read_block(pending, address + 2, length);
+  uint16_t crc = eeprom_read_word((const uint16_t *)(address + 2 + length));
+  if (crc != recordCRC(bankGeneration, recordOffset, length, pending)) {
+    return 0;
+  }
+  memcpy(image + recordOffset, pending, length);
+  return recordSize;
+}
@@ -0,0 +1,114 @@
+#ifndef FAN_SETTINGS_LOG_H
+#define FAN_SETTINGS_LOG_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+// The size of the header at the start of each bank: a magic byte and the
+// generation.
+#define SETTINGS_LOG_BANK_HEADER_SIZE 3
+// The bytes in a record that aren't data: the offset, length, and CRC.
+#define SETTINGS_LOG_RECORD_OVERHEAD 4
+
+/* An append-only log of changes to a block of bytes (an "image"), stored in
+ * EEPROM.
+ *
+ * Rewriting the whole image in place puts all of the wear on the same cells,
+ * and EEPROM is only good for about 100,000 writes per cell. Instead, the space
+ * is split into two banks, and each save appends a small record with just the
+ * bytes that changed to the current bank. When the current bank fills up, the
+ * log is compacted: a full snapshot of the image is written to the start of the
+ * other bank, which then becomes the current bank. Every cell gets written
+ * roughly once per trip through both banks, instead of once per save.
+ *
+ * A bank starts with a header (a magic byte and a 16-bit generation, which
+ * increases with every compaction), followed by a snapshot record covering the
+ * whole image. Each record is:
+ *   offset (1 byte), length (1 byte), data (length bytes), CRC-16 (2 bytes)
+ * The CRC is seeded with the bank's generation, so records left over from an
+ * earlier trip through the bank don't check out. At boot the newest bank with a
+ * valid snapshot is replayed up to the first record that doesn't check out,
+ * which also discards a record that was only partly written when power was
+ * lost. If a compaction is interrupted, the new bank's snapshot won't check out
+ * and the older bank is used instead.
+ *
+ * Writes are done in the background with `EEPROMWriter`. Saving again while a
+ * save is still being written replaces the write in flight, recalculated
+ * against what's actually in EEPROM.
+ */
+class SettingsLog {
+  public:
+    /* `savedImage` and `pendingImage` must each point to `size` bytes of space
+     * that the log can use to keep track of what has been written.
+     */
+    SettingsLog(
+      uint8_t size,
+      uint8_t *savedImage,
+      uint8_t *pendingImage,
+      uint16_t start = 0,
+      uint16_t bankSize = (E2END + 1) / 2
+    );
+
+    /* Replay the log on top of `image`. Bytes that have never been saved (if
+     * the image has grown since it was last compacted) are left alone. Returns
+     * false if there's no valid log, in which case `image` is untouched.
+     */
+    bool load(void *image);
+
+    /* Start writing the differences between `image` and the saved image.
+     * Returns false if the changes can't be written.
+     */
+    bool save(const void *image);
+
+    // True while a save is still being written.
+    bool isSaving();
+
+    // The generation of the current bank, which counts compactions.
+    uint16_t getGeneration() const;
+    // The number of bytes used in the current bank.
+    uint16_t getUsed() const;
+
+  private:
+    const uint8_t size;
+    // The image as of the last completed save.
+    uint8_t * const saved;
+    // The image being written by a save that's still in flight.
+    uint8_t * const pending;
+    const uint16_t start;
+    const uint16_t bankSize;
+
+    // The state of the log in EEPROM, as of the last completed save.
+    uint8_t bank;
+    uint16_t generation;
+    // The offset (from the start of the bank) just past the last record.
+    uint16_t end;
+    // Set when the next save needs to write a complete snapshot.
+    bool compactionNeeded;
+
+    // What the state will be once the save in flight completes.
+    bool writing;
+    uint8_t pendingBank;
+    uint16_t pendingGeneration;
+    uint16_t pendingEnd;
+
+    uint16_t bankAddress(uint8_t bankIndex) const;
+
+    // Promote the pending state once the write in flight has completed.
+    void finishWrite();
+
+    /* Read the bank header, returning false if the bank doesn't have one. The
+     * snapshot record still needs to be checked.
+     */
+    bool readHeader(uint8_t bankIndex, uint16_t *bankGeneration) const;
+
+    /* Check the record at `offset` in the bank, and if it's valid apply it to
+     * `image` and return its total size. Returns 0 for an invalid record.
+     */
+    uint16_t applyRecord(
+      uint8_t bankIndex,
+      uint16_t bankGeneration,
+      uint16_t offset,
+      uint8_t *image
+    );
+};
+#endif
@@ -0,0 +1,131 @@
+#include <math.h>
+#include <string.h>
+#include <util/crc16.h>
+#include "Telemetry.h"
+#include "NoHeap.h"
+
+/* COBS (Consistent Overhead Byte Stuffing) encode `length` bytes into
+ * `output`, returning the encoded length. The encoding has no zero bytes, so a
+ * zero can mark the end of a frame, and a receiver that starts listening
+ * part way through a frame resynchronizes at the next zero.
+ *
+ * `length` has to be less than 254, so only one byte of overhead is ever
+ * needed and `output` must have room for `length + 1` bytes.
+ */
+static uint8_t cobsEncode(
+  const uint8_t *input,
+  uint8_t length,
+  uint8_t *output
+) {
+  uint8_t codeIndex = 0;
+  uint8_t outputIndex = 1;
+  uint8_t code = 1;
+  for (uint8_t i = 0; i < length; i++) {
+    if (input[i] == 0) {
+      output[codeIndex] = code;
+      codeIndex = outputIndex++;
+      code = 1;
+    } else {
+      output[outputIndex++] = input[i];
+      code++;
+    }
+  }
+  output[codeIndex] = code;
+  return outputIndex;
+}
+
+Telemetry::Telemetry(
+  FanArray *fans,
+  ThermometerBank *thermometers,
+  Print *output
+):
+  fans(fans),
+  thermometers(thermometers),
+  output(output)
+{}
+
+void Telemetry::setController(FanController *newController) {
+  controller = newController;
+}
+
+void Telemetry::start(unsigned long newPeriod) {
+  period = newPeriod > 0 ? newPeriod : 1;
+  if (!enabled) {
+    // End whatever text came before, so it isn't mistaken for part of a frame.
+    output->write((uint8_t)0);
+  }
+  enabled = true;
+}
+
+void Telemetry::stop() {
+  enabled = false;
+}
+
+bool Telemetry::isEnabled() const {
+  return enabled;
+}
+
+uint16_t Telemetry::getDropped() const {
+  return dropped;
+}
+
+void Telemetry::periodic(unsigned long currentMillis) {
+  if (!enabled) {
+    return;
+  }
+  // Leave room at the front of the buffer for the COBS overhead byte.
+  uint8_t *raw = frame + 1;
+  telemetryRecord record;
+  record.version = TELEMETRY_RECORD_VERSION;
+  record.sequence = sequence++;
+  record.millis = currentMillis;
+  float temperature = thermometers->getTemperature();
+  if (isnan(temperature)) {
+    record.temperature = TELEMETRY_NO_TEMPERATURE;
+  } else {
+    // Keep clear of the sentinel, and of wrapping around.
+    record.temperature = (int16_t)lround(constrain(
+      temperature * TELEMETRY_TEMPERATURE_SCALE,
+      TELEMETRY_NO_TEMPERATURE + 1,
+      INT16_MAX
+    ));
+  }
+  uint8_t members = ALL_FANS;
+  ControllerTerms terms;
+  if (controller != NULL) {
+    members = controller->getMembers();
+    terms = controller->getTerms();
+  }
+  record.duty = (uint16_t)lround(
+    fans->getDutyCycle(members) * TELEMETRY_DUTY_SCALE
+  );
+  record.rpm = fans->getRPM(members);
+  record.proportional = terms.proportional.getRaw();
+  record.integral = terms.integral.getRaw();
+  record.derivative = terms.derivative.getRaw();
+  memcpy(raw, &record, sizeof(record));
+  uint16_t crc = TELEMETRY_CRC_INITIAL;
+  for (uint8_t i = 0; i < sizeof(record); i++) {
+    crc = _crc_ccitt_update(crc, raw[i]);
+  }
+  raw[sizeof(record)] = crc & 0xFF;
+  raw[sizeof(record) + 1] = crc >> 8;
+  /* Encoding in place works since the output never gets ahead of the input
+   * (the one byte of overhead is the space left at the front).
+   */
+  uint8_t length = cobsEncode(raw, sizeof(record) + TELEMETRY_CRC_SIZE, frame);
+  frame[length++] = 0;
+  if (output->availableForWrite() < length) {
+    dropped++;
+    return;
+  }
+  output->write(frame, length);
+}
+
+unsigned long Telemetry::getPeriod() const {
+  return period;
+}
+
+const __FlashStringHelper * Telemetry::getTaskName() const {
+  return F("telemetry");
+}
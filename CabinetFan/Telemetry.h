@@ -0,0 +1,65 @@
+#ifndef FAN_TELEMETRY_H
+#define FAN_TELEMETRY_H
+
+#include <stdint.h>
+#include <Arduino.h>
+#include "FanArray.h"
+#include "FanController.h"
+#include "Scheduler.h"
+#include "TelemetryRecord.h"
+#include "ThermometerBank.h"
+
+// The default time between records, in milliseconds (100 Hz).
+#define TELEMETRY_DEFAULT_PERIOD 10
+
+/* Streams binary telemetry records (see TelemetryRecord.h) for high rate
+ * logging.
+ *
+ * Each record is a fixed size, so there's no float formatting; building and
+ * encoding one is a handful of integer operations. A record is only written if
+ * the whole frame fits in the output's buffer right away. Otherwise it's
+ * dropped (and the gap shows up in the sequence numbers) instead of blocking
+ * the control loop until the host catches up.
+ *
+ * The host side decoder and CSV converter are in `host/telemetry/`.
+ */
+class Telemetry: public Task {
+  public:
+    Telemetry(FanArray *fans, ThermometerBank *thermometers, Print *output);
+
+    /* The controller whose terms are recorded, along with the speed and RPM of
+     * the fans it controls. Can be `NULL`, in which case all of the fans are
+     * recorded.
+     */
+    void setController(FanController *newController);
+
+    /* Start streaming, one record every `period` milliseconds (1 ms, about
+     * the rate the main loop runs at, is the fastest).
+     */
+    void start(unsigned long newPeriod);
+    void stop();
+    bool isEnabled() const;
+
+    // The number of records dropped because the output was full.
+    uint16_t getDropped() const;
+
+    // Sends a record.
+    void periodic(unsigned long currentMillis);
+    unsigned long getPeriod() const;
+    const __FlashStringHelper * getTaskName() const;
+
+  private:
+    FanArray *fans;
+    ThermometerBank *thermometers;
+    FanController *controller = NULL;
+    Print *output;
+
+    unsigned long period = TELEMETRY_DEFAULT_PERIOD;
+    bool enabled = false;
+    uint8_t sequence = 0;
+    uint16_t dropped = 0;
+
+    // The encoded frame is built here before being written out in one go.
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+};
+#endif
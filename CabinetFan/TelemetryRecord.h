@@ -0,0 +1,48 @@
+#ifndef FAN_TELEMETRY_RECORD_H
+#define FAN_TELEMETRY_RECORD_H
+
+#include <stdint.h>
+
+/* The layout of one binary telemetry record. This header is shared with the
+ * host side decoder (`host/telemetry/`), so it only depends on <stdint.h>.
+ *
+ * Multi-byte fields are little-endian (the AVR's native order). Bump
+ * `TELEMETRY_RECORD_VERSION` whenever the layout changes.
+ */
+#define TELEMETRY_RECORD_VERSION 1
+
+/* `temperature` is in hundredths of a degree Celsius, or
+ * `TELEMETRY_NO_TEMPERATURE` before there's been a reading.
+ */
+#define TELEMETRY_TEMPERATURE_SCALE 100
+#define TELEMETRY_NO_TEMPERATURE INT16_MIN
+
+// `duty` is in hundredths of a percent (so 10000 is 100%).
+#define TELEMETRY_DUTY_SCALE 10000
+
+// The controller terms are Q16.16 fixed point numbers.
+#define TELEMETRY_TERM_FRACTIONAL_BITS 16
+
+struct telemetryRecord {
+  uint8_t version;
+  // Incremented for every record, including ones that had to be dropped.
+  uint8_t sequence;
+  uint32_t millis;
+  int16_t temperature;
+  uint16_t duty;
+  uint16_t rpm;
+  // How much each term contributed to the controller's last correction.
+  int32_t proportional;
+  int32_t integral;
+  int32_t derivative;
+} __attribute__((packed));
+
+/* Each record is followed by a CRC16 (CCITT, as calculated by avr-libc's
+ * `_crc_ccitt_update` starting from 0xFFFF), then the whole thing is COBS
+ * encoded and ended with a zero byte.
+ */
+#define TELEMETRY_CRC_SIZE 2
+#define TELEMETRY_CRC_INITIAL 0xFFFF
+// One byte of COBS overhead, and the zero byte delimiter.
+#define TELEMETRY_FRAME_SIZE (sizeof(telemetryRecord) + TELEMETRY_CRC_SIZE + 2)
+#endif
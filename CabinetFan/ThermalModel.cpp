@@ -0,0 +1,168 @@
+#include <math.h>
+#include <Arduino.h>
+#include "ThermalModel.h"
+#include "NoHeap.h"
+
+/* How much weight each sample loses per period. 0.99 remembers about the last
+ * hundred samples.
+ */
+static const float FORGETTING_FACTOR = 0.99;
+
+/* The starting uncertainty of `a`, `b` and `c`. `a` is a fraction close to 1,
+ * and is multiplied by temperatures in the tens of degrees, so it's known a lot
+ * more precisely than the other two.
+ */
+static const float INITIAL_COVARIANCE[3] = {0.0001, 1.0, 1.0};
+
+/* When the temperature holds steady there's nothing new to learn, and
+ * forgetting alone would grow the covariance without bound (and make the next
+ * update wildly overcorrect). It stops forgetting past this size.
+ */
+static const float MAX_COVARIANCE_TRACE = 100.0;
+
+/* How much weight each delay's past errors lose per period. 0.95 compares
+ * them over about the last twenty samples.
+ */
+static const float RESIDUAL_FORGETTING_FACTOR = 0.95;
+
+/* Another delay has to have less than this fraction of the current one's
+ * errors to be switched to, so it doesn't flap between two that are about as
+ * good.
+ */
+static const float DELAY_SWITCH_RATIO = 0.8;
+
+// The length of the speed buffer.
+static const uint8_t NUM_SPEEDS = THERMAL_MODEL_MAX_DELAY + 1;
+
+ThermalModel::ThermalModel(
+  const thermalModelValues &initial,
+  unsigned long period
+):
+  period(period),
+  nextSpeed(0),
+  numSpeeds(0),
+  previousTemperature(0.0),
+  hasPrevious(false)
+{
+  const float periodSeconds = period / 1000.0;
+  float a = exp(-periodSeconds / initial.timeConstant);
+  parameters[0] = a;
+  parameters[1] = initial.gain * (1 - a);
+  parameters[2] = initial.offset * (1 - a);
+  float periods = round(initial.deadTime / periodSeconds);
+  delay = (uint8_t)constrain(periods, 0, THERMAL_MODEL_MAX_DELAY);
+  for (uint8_t i = 0; i < NUM_SPEEDS; i++) {
+    residuals[i] = 0.0;
+  }
+  resetCovariance();
+}
+
+void ThermalModel::resetCovariance() {
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      covariance[i][j] = i == j ? INITIAL_COVARIANCE[i] : 0.0;
+    }
+  }
+}
+
+float ThermalModel::speedBefore(uint8_t periods) const {
+  return speeds[(nextSpeed + NUM_SPEEDS - 1 - periods) % NUM_SPEEDS];
+}
+
+void ThermalModel::updateDelay(float temperature) {
+  uint8_t best = delay;
+  for (uint8_t i = 0; i < NUM_SPEEDS; i++) {
+    const float error = temperature - (
+      parameters[0] * previousTemperature +
+      parameters[1] * speedBefore(i) +
+      parameters[2]
+    );
+    residuals[i] = RESIDUAL_FORGETTING_FACTOR * residuals[i] + error * error;
+    if (residuals[i] < residuals[best]) {
+      best = i;
+    }
+  }
+  if (residuals[best] < DELAY_SWITCH_RATIO * residuals[delay]) {
+    delay = best;
+  }
+}
+
+void ThermalModel::update(float temperature, float speed) {
+  speeds[nextSpeed] = speed;
+  nextSpeed = (nextSpeed + 1) % NUM_SPEEDS;
+  if (numSpeeds < NUM_SPEEDS) {
+    numSpeeds++;
+  }
+  /* Every delay is compared once there's a speed for each, before the
+   * estimate learns from this sample.
+   */
+  if (hasPrevious && numSpeeds == NUM_SPEEDS) {
+    updateDelay(temperature);
+  }
+  if (hasPrevious && numSpeeds > delay) {
+    const float regressors[3] = {
+      previousTemperature,
+      speedBefore(delay),
+      1.0
+    };
+    float gain[3];
+    float denominator = FORGETTING_FACTOR;
+    float prediction = 0.0;
+    for (uint8_t i = 0; i < 3; i++) {
+      gain[i] = 0.0;
+      for (uint8_t j = 0; j < 3; j++) {
+        gain[i] += covariance[i][j] * regressors[j];
+      }
+      denominator += regressors[i] * gain[i];
+      prediction += regressors[i] * parameters[i];
+    }
+    const float error = temperature - prediction;
+    float trace = 0.0;
+    for (uint8_t i = 0; i < 3; i++) {
+      parameters[i] += gain[i] / denominator * error;
+      trace += covariance[i][i];
+    }
+    /* The covariance is symmetric, so `gain` (before it's divided by
+     * `denominator`) is both `covariance * regressors` and its transpose.
+     */
+    const float forgetting = trace < MAX_COVARIANCE_TRACE ?
+      FORGETTING_FACTOR : 1.0;
+    for (uint8_t i = 0; i < 3; i++) {
+      for (uint8_t j = 0; j < 3; j++) {
+        covariance[i][j] -= gain[i] * gain[j] / denominator;
+        covariance[i][j] /= forgetting;
+      }
+    }
+  }
+  previousTemperature = temperature;
+  hasPrevious = true;
+}
+
+void ThermalModel::restart() {
+  nextSpeed = 0;
+  numSpeeds = 0;
+  hasPrevious = false;
+}
+
+bool ThermalModel::isValid() const {
+  return parameters[0] > 0.0 && parameters[0] < 1.0 && parameters[1] < 0.0;
+}
+
+float ThermalModel::steadyStateSpeed(float temperature) const {
+  if (!isValid()) {
+    return NAN;
+  }
+  // Solving T = a * T + b * speed + c for the speed.
+  return ((1 - parameters[0]) * temperature - parameters[2]) / parameters[1];
+}
+
+thermalModelValues ThermalModel::getValues() const {
+  const float periodSeconds = period / 1000.0;
+  const float a = parameters[0];
+  thermalModelValues values;
+  values.offset = parameters[2] / (1 - a);
+  values.gain = parameters[1] / (1 - a);
+  values.timeConstant = -periodSeconds / log(a);
+  values.deadTime = delay * periodSeconds;
+  return values;
+}
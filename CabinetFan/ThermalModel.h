@@ -0,0 +1,108 @@
+#ifndef FAN_THERMAL_MODEL_H
+#define FAN_THERMAL_MODEL_H
+
+#include <stdint.h>
+
+// The longest dead time (in controller periods) a `ThermalModel` can handle.
+#define THERMAL_MODEL_MAX_DELAY 8
+
+/* A first order plus dead time model of how the cabinet's temperature responds
+ * to the fan speed. With the fans held at `speed`, the temperature settles to
+ *
+ *   offset + gain * speed
+ *
+ * approaching it exponentially with `timeConstant`, starting `deadTime` after
+ * the speed changes. `gain` is negative, as more air cools the cabinet. The
+ * values are independent of how often the model is updated, so they're what's
+ * saved (in `Settings`).
+ */
+struct __attribute__((packed)) thermalModelValues {
+  // The steady state temperature with the fans stopped, in degrees Celsius.
+  float offset;
+  // The change in steady state temperature from stopped to full speed.
+  float gain;
+  // In seconds.
+  float timeConstant;
+  float deadTime;
+};
+
+/* A `thermalModelValues` model, identified online.
+ *
+ * Sampled every `period`, the model is
+ *
+ *   T[k] = a * T[k - 1] + b * speed[k - 1 - d] + c
+ *
+ * with `d` the dead time in periods. Every `update()` refines the estimate of
+ * `a`, `b` and `c` by recursive least squares, with a forgetting factor so it
+ * follows the cabinet as it changes (a heat load turning on shows up as a new
+ * `offset`).
+ *
+ * The dead time is identified alongside them. Each update also predicts the
+ * temperature with the speed from every other candidate delay (0 to
+ * `THERMAL_MODEL_MAX_DELAY` periods), and keeps a decaying sum of each one's
+ * squared error. When another delay's predictions are clearly better than
+ * the one in use, the model switches to it. Only the errors are kept per
+ * candidate, not a whole estimate each. It's about 150 float operations each
+ * time.
+ */
+class ThermalModel {
+  public:
+    ThermalModel(const thermalModelValues &initial, unsigned long period);
+
+    /* Add a sample: the temperature now, and the fan speed over the period
+     * that just finished.
+     */
+    void update(float temperature, float speed);
+
+    /* Forget the samples (but not the estimate), when the next one won't
+     * follow on from the last.
+     */
+    void restart();
+
+    /* True if the estimate makes physical sense: a stable response, where
+     * more air cools the cabinet.
+     */
+    bool isValid() const;
+
+    /* The fan speed that would hold the cabinet at `temperature`, not limited
+     * to the 0.0 to 1.0 range. NaN if the model isn't valid.
+     */
+    float steadyStateSpeed(float temperature) const;
+
+    // The current estimate.
+    thermalModelValues getValues() const;
+
+  private:
+    const unsigned long period;
+
+    // The dead time, in periods.
+    uint8_t delay;
+
+    // The decaying sum of squared errors predicting with each delay.
+    float residuals[THERMAL_MODEL_MAX_DELAY + 1];
+
+    // The parameters being estimated, `a`, `b` and `c`.
+    float parameters[3];
+
+    // The covariance of the estimate.
+    float covariance[3][3];
+
+    // The recent speeds, as a circular buffer.
+    float speeds[THERMAL_MODEL_MAX_DELAY + 1];
+    uint8_t nextSpeed;
+    uint8_t numSpeeds;
+
+    float previousTemperature;
+    bool hasPrevious;
+
+    void resetCovariance();
+
+    // The speed `periods` updates before the last one.
+    float speedBefore(uint8_t periods) const;
+
+    /* Add each delay's error predicting `temperature`, and switch to the best
+     * one if it's clearly better.
+     */
+    void updateDelay(float temperature);
+};
+#endif
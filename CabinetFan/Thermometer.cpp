@@ -1,7 +1,8 @@
 #include "Thermometer.h"
 #include <Arduino.h>
-#include <avr/sleep.h>
-#include "util.h"
+#include "AdcSampler.h"
+#include "Trace.h"
+#include "NoHeap.h"
 
 // The internal reference voltage for the ADC (in mV).
 static const float V_REF = 2560;
@@ -20,104 +21,65 @@ static const float EXTERNAL_SENSOR_SCALING = 10.0;
 // Offset voltage (in mV) for the external temperature sensor (TMP36).
 static const float EXTERNAL_SENSOR_OFFSET = 500.0;
 
-// Global use for retrieving the ADC value via an interrupt handler.
-static volatile uint16_t rawAdcValue;
-
-// How frequently (in milliseconds) to update the temperature from `periodic()`.
-static const int UPDATE_PERIOD = 1000;
-
-uint16_t runLowNoiseAdc();
-
-Thermometer::Thermometer(uint8_t pin): pin(pin) {
-  average = new MovingAverage<float, 10>();
-}
-
-Thermometer::~Thermometer() {
-  delete average;
-}
+Thermometer::Thermometer(uint8_t pin, const __FlashStringHelper * name):
+  pin(pin),
+  name(name)
+{}
 
 float Thermometer::getTemperature() const {
-  return average->current_value();
-}
-
-void Thermometer::updateTemperature() {
-  // Doing this manually for a bit more control over how the ADC conversion is
-  // performed.
-  /* The ADC channels are split between 0-7 and 8-15. The upper channels have
-    * MUX5 set, while the lower ones have it unset. MUX0 through MUX2 then
-    * encode the channel within the range. The internal temperature sensor is
-    * equivalent to channel 15.
-    */
-  uint8_t adcChannel;
-  if (isInternalSensor()) {
-    adcChannel = 15;
-  } else {
-    /* The mapping between pins and channels is weird for the 32u4, and there's
-     * some hacks in the Arduino source to allow using pinx or channel numbers.
-     */
-    adcChannel = analogPinToChannel(pin >= 18 ? pin - 18 : pin);
+  float oversampled = filteredSample();
+  if (isnan(oversampled)) {
+    return NAN;
   }
-  /* Check which channel the muxer is currently set to (if it's set to the
-   * internal temperature sensor, we can skip a conversion).
-   * Because the upper channels are encoded in bit 5 (which is stored in
-   * ADCSRB), that bit is shifted over by 2 so it corresponds to the channel
-   * numbers.
-   */
-  uint8_t oldChannel = (ADMUX & 0x7) | ((ADCSRB & 0x20) >> 2);
-  // Set ADMUX to use the internal voltage reference and the correct channel.
-  // Set the muxer to correct channel, and use the internal voltage source.
-  uint8_t newADMUX = _BV(REFS1) | _BV(REFS0);
-  newADMUX |= adcChannel & 0x7;
-  // Set MUX5 along with the other MUX bits
-  ADMUX = newADMUX;
-  if (adcChannel > 7) {
-    ADCSRB |= _BV(MUX5);
-  } else {
-    ADCSRB &= ~_BV(MUX5);
-  }
-  /* Setting all the bits in ADCSRA. Setting ADPS2 and ADPS1 sets the 64x
-   * prescaler. Also enable the ADC interrupt so that we can wake from ADC sleep
-   * later.
-   */
-  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1);
-  /* The ADC frequency needs to be between 50kHz and 200kHz, and the ItsyBitsy
-   * 32u4 5v has a 16MHz clock. The 128x prescaler gets us down to 125kHz, which
-   * works, but apparently setting the ADHSM bit in ADCSRB lets us use higher
-   * clocks, in which case the 64x divisor should work which gets us down to
-   * 250kHz. If the 128x prescaler is being used, ADPS0 needs to be set as well.
+  /* Scale the oversampled value back to 10-bit ADC counts. The extra bits of
+   * resolution are kept as the fractional part.
    */
-  // Save the value of MUX5 that was set before.
-  ADCSRB = (ADCSRB & _BV(MUX5)) | _BV(ADHSM);
-  /* Trigger an ADC measurement and wait for it to complete. If this is the
-   * first measurement of the internal temperature sensor we need to do two
-   * samples, discarding the first value.
-   */
-  uint8_t numSamples = isInternalSensor() && oldChannel != adcChannel ? 2 : 1;
-  for (int i = 0; i < numSamples; i++) {
-    ADCSRA |= _BV(ADSC);
-    loop_until_bit_is_clear(ADCSRA, ADSC);
-  }
-  float adcValue = float(runLowNoiseAdc());
+  float adcValue = oversampled / (1 << ADC_OVERSAMPLING_BITS);
   if (isInternalSensor()) {
     /* Apparently the output of the internal temperature sensor is in
      * Kelvins directly, so let's just convert it to celsius.
      */
-    average->push(adcValue - KELVIN_CELSIUS);
+    return adcValue - KELVIN_CELSIUS;
   } else {
     // Only supporting the TMP36 for the external temperature sensor.
     float milliVolts = adcValue * V_REF / ADC_RESOLUTION;
-    average->push((milliVolts - EXTERNAL_SENSOR_OFFSET) / EXTERNAL_SENSOR_SCALING);
+    return (milliVolts - EXTERNAL_SENSOR_OFFSET) / EXTERNAL_SENSOR_SCALING;
   }
 }
 
+const __FlashStringHelper * Thermometer::getName() const {
+  return name;
+}
+
+void Thermometer::updateTemperature() {
+  uint16_t oversampled;
+  if (AdcSampler::read(&oversampled)) {
+    addSample(oversampled);
+  }
+}
+
+void Thermometer::addSample(uint16_t oversampled) {
+  pushSample(oversampled);
+}
+
 void Thermometer::periodic() {
   periodic(millis());
 }
 
-void Thermometer::periodic(unsigned long currentMillis) {
-  if (periodPassed(currentMillis, lastUpdate, UPDATE_PERIOD)) {
-    updateTemperature();
+void Thermometer::periodic(unsigned long /* currentMillis */) {
+  TRACE_SCOPE(traceThermometers);
+  /* The Arduino core sets up the ADC in `init()`, which runs after global
+   * constructors (like for the thermometer), so sampling can't be started any
+   * earlier than this.
+   */
+  if (!AdcSampler::isRunning()) {
+    AdcSampler::start(adcChannel());
   }
+  updateTemperature();
+}
+
+unsigned long Thermometer::getPeriod() const {
+  return THERMOMETER_UPDATE_PERIOD;
 }
 
 size_t Thermometer::printTo(Print& p) const {
@@ -128,23 +90,17 @@ bool Thermometer::isInternalSensor() const {
   return pin == Thermometer::INTERNAL_SENSOR;
 }
 
-uint16_t runLowNoiseAdc() {
-  /* Assume everything (channel, voltage reference, etc) is set up prior to this
-   * function, so all that's needed is to kick off a conversion and wait for it
-   * to complete. Using idle sleep to try to get a little less noise than out of
-   * sleep, but can't use ADC noise reduction sleep as that disables outputs
-   * (which are driving the fan).
+uint8_t Thermometer::adcChannel() const {
+  /* The ADC channels are split between 0-7 and 8-15. The upper channels have
+   * MUX5 set, while the lower ones have it unset. MUX0 through MUX2 then
+   * encode the channel within the range. The internal temperature sensor is
+   * equivalent to channel 15.
    */
-  set_sleep_mode(SLEEP_MODE_IDLE);
-  sleep_mode();
-  /* Need this loop in case the CPU is woken up early (ex: by an external
-   * interrupt, like the one used for the fan tachometer). The ADIF flag is
-   * reset when the interrupt handler is run.
+  if (isInternalSensor()) {
+    return 15;
+  }
+  /* The mapping between pins and channels is weird for the 32u4, and there's
+   * some hacks in the Arduino source to allow using pinx or channel numbers.
    */
-  loop_until_bit_is_clear(ADCSRA, ADIF);
-  return rawAdcValue;
+  return analogPinToChannel(pin >= 18 ? pin - 18 : pin);
 }
-
-ISR(ADC_vect) {
-  rawAdcValue = ADCW;
-}
\ No newline at end of file
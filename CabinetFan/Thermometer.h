@@ -3,31 +3,74 @@
 
 #include <stdint.h>
 #include "Arduino.h"
-#include "MovingAverage.h"
+#include "Filters.h"
+#include "Scheduler.h"
 
-class Thermometer: public Printable {
+// How frequently (in milliseconds) the temperature is updated.
+#define THERMOMETER_UPDATE_PERIOD 1000UL
+
+/* A temperature sensor on an ADC channel, and a filter smoothing its
+ * readings. The filter is chosen by the subclass, see `FilteredThermometer`.
+ *
+ * The readings are filtered as raw (oversampled) ADC counts, and only
+ * converted to degrees when the temperature is asked for.
+ *
+ * On its own, a thermometer runs the ADC sampler on its channel from
+ * `periodic()`. Several thermometers can share the ADC by adding them to a
+ * `ThermometerBank` instead, which feeds them their samples.
+ */
+class Thermometer: public Printable, public Task {
   public:
     static const uint8_t INTERNAL_SENSOR = 255;
 
-    Thermometer(uint8_t pin = Thermometer::INTERNAL_SENSOR);
-    ~Thermometer();
+    /* `name` (in flash, from `F()`) is used to pick out the sensor in a
+     * `ThermometerBank`, and can be `NULL` for an unnamed sensor.
+     */
+    Thermometer(
+      uint8_t pin = Thermometer::INTERNAL_SENSOR,
+      const __FlashStringHelper * name = NULL
+    );
 
+    /* The filtered temperature in degrees Celsius, or NaN if there haven't
+     * been any readings yet.
+     */
     float getTemperature() const;
 
+    const __FlashStringHelper * getName() const;
+
+    // The ADC channel (in the MUX bit numbering) for the sensor.
+    uint8_t adcChannel() const;
+
+    /* Add an oversampled reading from the ADC sampler to the filter (see
+     * `AdcSampler::read()`).
+     */
+    void addSample(uint16_t oversampled);
+
     void periodic();
+    // Called by the scheduler once every `getPeriod()` milliseconds.
     void periodic(unsigned long currentMillis);
 
+    unsigned long getPeriod() const;
+
     // Inheriting from Printable
     virtual size_t printTo(Print& p) const;
+
+  protected:
+    // Add an oversampled reading to the filter.
+    virtual void pushSample(uint16_t oversampled) = 0;
+
+    // The filtered reading (in oversampled counts), or NaN if it's empty.
+    virtual float filteredSample() const = 0;
+
   private:
     // The pin the temperature sensor is connected to.
     const uint8_t pin;
 
-    unsigned long lastUpdate = 0;
-
-    MovingAverage<float, 10> * average;
+    const __FlashStringHelper * name;
 
-    // Measure the temperature and update the internal moving average.
+    /* Update the filter with the latest (oversampled)
+     * measurement from the ADC, if there is a new one.
+     */
     void updateTemperature();
 
     /* Convenience function for determining if the internal temperature sensor
@@ -35,4 +78,37 @@ class Thermometer: public Printable {
      */
     bool isInternalSensor() const;
 };
+
+/* A `Thermometer` smoothing its readings with the filter `F`, any of the
+ * filters in Filters.h with a `value_type` that can hold the oversampled ADC
+ * counts (`10 + ADC_OVERSAMPLING_BITS` bits). The filter is held inline, so its
+ * size is part of the thermometer's. For example:
+ *
+ *   FilteredThermometer<> outside = FilteredThermometer<>(A0);
+ *   FilteredThermometer< MedianFilter<uint16_t, 5> > inside =
+ *     FilteredThermometer< MedianFilter<uint16_t, 5> >(A1);
+ *
+ * The default averages the last 8 readings in integers, so the division is a
+ * shift and the sum never drifts.
+ */
+template<typename F = MovingAverage<uint16_t, 8> >
+class FilteredThermometer: public Thermometer {
+  public:
+    FilteredThermometer(
+      uint8_t pin = Thermometer::INTERNAL_SENSOR,
+      const __FlashStringHelper * name = NULL
+    ): Thermometer(pin, name) {}
+
+  protected:
+    virtual void pushSample(uint16_t oversampled) {
+      filter.push(typename F::value_type(oversampled));
+    }
+
+    virtual float filteredSample() const {
+      return filter.empty() ? NAN : float(filter.current_value());
+    }
+
+  private:
+    F filter;
+};
 #endif
@@ -0,0 +1,163 @@
+#include <math.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "ThermometerBank.h"
+#include "AdcSampler.h"
+#include "Trace.h"
+#include "NoHeap.h"
+
+ThermometerBank::ThermometerBank():
+  numThermometers(0),
+  scanPosition(0),
+  source(HOTTEST_TEMPERATURE)
+{}
+
+bool ThermometerBank::add(Thermometer *thermometer) {
+  if (numThermometers == THERMOMETER_BANK_MAX_SENSORS) {
+    return false;
+  }
+  uint8_t index = numThermometers++;
+  thermometers[index] = thermometer;
+  // Insert into the scan order, keeping it sorted by channel.
+  uint8_t position = index;
+  while (
+    position > 0 &&
+    thermometers[scanOrder[position - 1]]->adcChannel() >
+      thermometer->adcChannel()
+  ) {
+    scanOrder[position] = scanOrder[position - 1];
+    position--;
+  }
+  scanOrder[position] = index;
+  return true;
+}
+
+uint8_t ThermometerBank::size() const {
+  return numThermometers;
+}
+
+Thermometer * ThermometerBank::get(uint8_t index) const {
+  return index < numThermometers ? thermometers[index] : NULL;
+}
+
+int8_t ThermometerBank::find(const char * name) const {
+  for (uint8_t i = 0; i < numThermometers; i++) {
+    PGM_P thermometerName =
+      reinterpret_cast<PGM_P>(thermometers[i]->getName());
+    if (thermometerName != NULL && strcasecmp_P(name, thermometerName) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+float ThermometerBank::getTemperature() const {
+  return getTemperature(source);
+}
+
+float ThermometerBank::getTemperature(uint8_t requested) const {
+  switch (requested) {
+    case HOTTEST_TEMPERATURE:
+      return getHottest();
+    case MEAN_TEMPERATURE:
+      return getMean();
+    default:
+      return requested < numThermometers ?
+        thermometers[requested]->getTemperature() : NAN;
+  }
+}
+
+float ThermometerBank::getHottest() const {
+  float hottest = NAN;
+  for (uint8_t i = 0; i < numThermometers; i++) {
+    float temperature = thermometers[i]->getTemperature();
+    if (!isnan(temperature) && (isnan(hottest) || temperature > hottest)) {
+      hottest = temperature;
+    }
+  }
+  return hottest;
+}
+
+float ThermometerBank::getMean() const {
+  float total = 0.0;
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < numThermometers; i++) {
+    float temperature = thermometers[i]->getTemperature();
+    if (!isnan(temperature)) {
+      total += temperature;
+      count++;
+    }
+  }
+  return count > 0 ? total / count : NAN;
+}
+
+void ThermometerBank::setSource(uint8_t newSource) {
+  bool isAggregate = (
+    newSource == HOTTEST_TEMPERATURE ||
+    newSource == MEAN_TEMPERATURE
+  );
+  source = isAggregate || newSource < numThermometers ?
+    newSource : HOTTEST_TEMPERATURE;
+}
+
+uint8_t ThermometerBank::getSource() const {
+  return source;
+}
+
+void ThermometerBank::periodic(unsigned long /* currentMillis */) {
+  TRACE_SCOPE(traceThermometers);
+  if (numThermometers == 0) {
+    return;
+  }
+  /* The Arduino core sets up the ADC in `init()`, which runs after global
+   * constructors, so sampling can't be started any earlier than this.
+   */
+  if (!AdcSampler::isRunning()) {
+    scanPosition = 0;
+    AdcSampler::start(thermometers[scanOrder[0]]->adcChannel());
+    return;
+  }
+  uint16_t oversampled;
+  if (!AdcSampler::read(&oversampled)) {
+    // Still sampling this channel, try again next time.
+    return;
+  }
+  thermometers[scanOrder[scanPosition]]->addSample(oversampled);
+  if (numThermometers > 1) {
+    scanPosition = (scanPosition + 1) % numThermometers;
+    AdcSampler::select(thermometers[scanOrder[scanPosition]]->adcChannel());
+  }
+}
+
+unsigned long ThermometerBank::getPeriod() const {
+  // Spread the thermometers' updates out over the update period.
+  if (numThermometers == 0) {
+    return THERMOMETER_UPDATE_PERIOD;
+  }
+  return THERMOMETER_UPDATE_PERIOD / numThermometers;
+}
+
+const __FlashStringHelper * ThermometerBank::getTaskName() const {
+  return F("thermometers");
+}
+
+size_t ThermometerBank::printTo(Print& p) const {
+  if (numThermometers == 1) {
+    return p.print(*thermometers[0]);
+  }
+  size_t total = 0;
+  for (uint8_t i = 0; i < numThermometers; i++) {
+    if (i > 0) {
+      total += p.print(F(", "));
+    }
+    const __FlashStringHelper *name = thermometers[i]->getName();
+    if (name != NULL) {
+      total += p.print(name);
+    } else {
+      total += p.print(i + 1);
+    }
+    total += p.print(F(": "));
+    total += p.print(*thermometers[i]);
+  }
+  return total;
+}
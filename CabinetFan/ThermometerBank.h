@@ -0,0 +1,88 @@
+#ifndef FAN_THERMOMETER_BANK_H
+#define FAN_THERMOMETER_BANK_H
+
+#include <stdint.h>
+#include "Arduino.h"
+#include "Scheduler.h"
+#include "Thermometer.h"
+
+// The most thermometers a `ThermometerBank` can hold.
+#define THERMOMETER_BANK_MAX_SENSORS 6
+
+/* Which temperature a `ThermometerBank` reports from `getTemperature()`: the
+ * index of one of its thermometers (in the order they were added), or one of
+ * these aggregates.
+ */
+#define HOTTEST_TEMPERATURE 0xFF
+#define MEAN_TEMPERATURE 0xFE
+
+/* Several thermometers sharing the ADC, for measuring intake, exhaust and
+ * component temperatures from one board.
+ *
+ * Instead of each thermometer reconfiguring the ADC for itself, the bank
+ * moves the ADC sampler round-robin through the thermometers' channels, one
+ * oversampled result each time `periodic()` runs. Every thermometer still
+ * gets a new reading once every `THERMOMETER_UPDATE_PERIOD`.
+ *
+ * The channels are visited in ascending order. That keeps all of the lower
+ * (0-7) channels together, then the upper (8-15, MUX5 set) ones, with the
+ * internal sensor (15) last, so MUX5 only changes twice per round and the
+ * samples thrown away while the input settles are kept to a minimum. All of
+ * the channels use the internal 2.56V reference, so the reference never has
+ * to change.
+ */
+class ThermometerBank: public Printable, public Task {
+  public:
+    ThermometerBank();
+
+    // Add a thermometer. Returns false if the bank is full.
+    bool add(Thermometer *thermometer);
+
+    uint8_t size() const;
+
+    // The thermometer at `index`, in the order they were added.
+    Thermometer * get(uint8_t index) const;
+
+    /* The index of the thermometer called `name` (compared ignoring case), or
+     * -1 if there isn't one.
+     */
+    int8_t find(const char * name) const;
+
+    /* The temperature of the current source (see `setSource()`). Thermometers
+     * without any readings yet are skipped by the aggregates.
+     */
+    float getTemperature() const;
+    float getTemperature(uint8_t requested) const;
+    float getHottest() const;
+    float getMean() const;
+
+    /* Choose what `getTemperature()` reports, either a thermometer's index or
+     * an aggregate. Defaults to `HOTTEST_TEMPERATURE`, which is also used if
+     * there's no thermometer at the index.
+     */
+    void setSource(uint8_t newSource);
+    uint8_t getSource() const;
+
+    // Collects the latest result and moves the ADC on to the next channel.
+    void periodic(unsigned long currentMillis);
+    unsigned long getPeriod() const;
+    const __FlashStringHelper * getTaskName() const;
+
+    /* Inheriting from Printable. A single thermometer prints just its
+     * temperature, otherwise each one is printed with its name.
+     */
+    virtual size_t printTo(Print& p) const;
+
+  private:
+    Thermometer *thermometers[THERMOMETER_BANK_MAX_SENSORS];
+    uint8_t numThermometers;
+
+    // Indexes into `thermometers`, in the order their channels are sampled.
+    uint8_t scanOrder[THERMOMETER_BANK_MAX_SENSORS];
+
+    // The position in `scanOrder` being sampled.
+    uint8_t scanPosition;
+
+    uint8_t source;
+};
+#endif
@@ -0,0 +1,45 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "Trace.h"
+#include "NoHeap.h"
+
+#if TRACE
+static TraceRecord records[TRACE_BUFFER_SIZE];
+
+// Where the next record goes, and how many of the records are in use.
+static uint8_t nextRecord = 0;
+static uint8_t numRecords = 0;
+
+// Set while dumping, so the buffer doesn't change underneath it.
+static volatile bool paused = false;
+
+void traceRecord(uint8_t event) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (!paused) {
+      records[nextRecord].micros = micros();
+      records[nextRecord].event = event;
+      nextRecord = (nextRecord + 1) % TRACE_BUFFER_SIZE;
+      if (numRecords < TRACE_BUFFER_SIZE) {
+        numRecords++;
+      }
+    }
+  }
+}
+
+void traceDump(Print *out) {
+  paused = true;
+  const uint8_t first =
+    (nextRecord + TRACE_BUFFER_SIZE - numRecords) % TRACE_BUFFER_SIZE;
+  out->println(F("trace begin"));
+  for (uint8_t i = 0; i < numRecords; i++) {
+    const TraceRecord &record = records[(first + i) % TRACE_BUFFER_SIZE];
+    out->print(record.micros, HEX);
+    out->print(' ');
+    out->println(record.event, HEX);
+  }
+  out->println(F("trace end"));
+  nextRecord = 0;
+  numRecords = 0;
+  paused = false;
+}
+#endif
@@ -0,0 +1,79 @@
+#ifndef FAN_TRACE_H
+#define FAN_TRACE_H
+
+#include <stdint.h>
+
+/* Set to 1 to record when the tasks and interrupt handlers start and finish,
+ * for finding out where the time goes. With it off (the default) the
+ * `TRACE_SCOPE` markers compile to nothing, and the buffer isn't allocated.
+ */
+#ifndef TRACE
+#define TRACE 0
+#endif
+
+/* The number of records kept, the oldest being overwritten. Each record is 5
+ * bytes of RAM.
+ */
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 64
+#endif
+
+// What a trace record marks the start (or end) of.
+enum TraceEvent: uint8_t {
+  traceThermometers = 0,
+  traceFans = 1,
+  traceController = 2,
+  traceMenu = 3,
+  traceTachInterrupt = 4,
+  traceAdcInterrupt = 5
+};
+
+// Set in a record's event for the end of it, clear for the start.
+#define TRACE_END_FLAG 0x80
+
+struct __attribute__((packed)) TraceRecord {
+  // From `micros()`, so 4 microsecond resolution at 16MHz.
+  uint32_t micros;
+  // A `TraceEvent`, with `TRACE_END_FLAG` set for the end.
+  uint8_t event;
+};
+
+#if TRACE
+#include "Arduino.h"
+
+static_assert(
+  TRACE_BUFFER_SIZE <= UINT8_MAX,
+  "The trace buffer is indexed with a uint8_t"
+);
+
+// Add a record to the trace buffer. Safe to call from interrupt handlers.
+void traceRecord(uint8_t event);
+
+/* Print the trace buffer, oldest first, then empty it. Nothing is recorded
+ * while it's printing. The format is a "trace begin" line, a line of
+ * "<micros> <event>" (both in hex) for each record, then "trace end".
+ * host/trace/trace2json.cpp turns it into a Chrome trace.
+ */
+void traceDump(Print *out);
+
+// Records the start of `event` when created, and its end when destroyed.
+class TraceScope {
+  public:
+    TraceScope(uint8_t event): event(event) {
+      traceRecord(event);
+    }
+
+    ~TraceScope() {
+      traceRecord(event | TRACE_END_FLAG);
+    }
+
+  private:
+    const uint8_t event;
+};
+
+// Trace `event` from here to the end of the enclosing block.
+#define TRACE_SCOPE(event) TraceScope traceScope(event)
+#else
+#define TRACE_SCOPE(event) do {} while (0)
+#endif
+#endif
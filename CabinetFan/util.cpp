@@ -1,4 +1,5 @@
 #include <limits.h>
+#include "NoHeap.h"
 /*
  * Check if enough time has elapsed, accounting for millis() overflow.
  */
@@ -1,10 +1,19 @@
 #ifndef FAN_UTIL_H
 #define FAN_UTIL_H
 
+#include "Arduino.h"
+
 bool periodPassed(
     unsigned long currentMillis,
     unsigned long lastUpdate,
     unsigned long period
 );
 
+/* Tag a string stored with `PROGMEM` so that `Print` reads it from flash, the
+ * same as a string from `F()`. The Arduino core doesn't have a macro for this.
+ */
+inline const __FlashStringHelper * flashString(const char *progmemString) {
+  return reinterpret_cast<const __FlashStringHelper *>(progmemString);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,14 @@
+#ifndef FAN_HOST_BENCH_H
+#define FAN_HOST_BENCH_H
+
+#include <stdint.h>
+#include <time.h>
+
+// A monotonic clock for the host benchmarks, in nanoseconds.
+static inline uint64_t benchNanoseconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include <stdio.h>
+
+#include "Filters.h"
+#include "Fixed.h"
+#include "MovingAverage.h"
+#include "bench.h"
+
+/* Times each filter in Filters.h per sample, and prints its size, on the
+ * host. The host has an FPU and pads members to their alignment, so the float
+ * filters are relatively faster, and everything a little bigger, than on the
+ * 32u4 (Filters.h notes the AVR sizes). They're for comparing filters, and for
+ * seeing which way a change moves one.
+ */
+
+static const int SAMPLES = 1000000;
+
+// Samples like the oversampled ADC counts a thermometer filters, with noise.
+static uint16_t sample(int i) {
+  return 6000 + ((i * 37) & 0x3F);
+}
+
+template<typename F>
+static void run(const char *name) {
+  F filter;
+  volatile float sink;
+  uint64_t start = benchNanoseconds();
+  for (int i = 0; i < SAMPLES; i++) {
+    sink = float(filter.update(typename F::value_type(sample(i))));
+  }
+  (void)sink;
+  double nanoseconds = (double)(benchNanoseconds() - start) / SAMPLES;
+  printf("%-40s %8.2f %8u\n", name, nanoseconds, (unsigned)sizeof(F));
+}
+
+int main() {
+  printf("%-40s %8s %8s\n", "filter", "ns", "bytes");
+  run< PassThroughFilter<uint16_t> >("PassThroughFilter<uint16_t>");
+  run< MovingAverage<uint16_t, 8> >("MovingAverage<uint16_t, 8>");
+  run< MovingAverage<float, 8> >("MovingAverage<float, 8>");
+  run< ExponentialMovingAverage<uint16_t, 3> >(
+    "ExponentialMovingAverage<uint16_t, 3>"
+  );
+  run< ExponentialMovingAverage<float, 3> >(
+    "ExponentialMovingAverage<float, 3>"
+  );
+  run< ExponentialMovingAverage<Fixed<16>, 3> >(
+    "ExponentialMovingAverage<Fixed<16>, 3>"
+  );
+  run< MedianFilter<uint16_t, 3> >("MedianFilter<uint16_t, 3>");
+  run< MedianFilter<uint16_t, 5> >("MedianFilter<uint16_t, 5>");
+  run< Biquad<float, ButterworthLowPassTenth> >("Biquad<float>");
+  run< Biquad<Fixed<16>, ButterworthLowPassTenth> >("Biquad<Fixed<16> >");
+  run< Cascade<
+    MedianFilter<uint16_t, 3>,
+    ExponentialMovingAverage<uint16_t, 2>
+  > >("Median 3, then EMA 2 (uint16_t)");
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+
+#include "Fixed.h"
+#include "PIDFanController.h"
+#include "bench.h"
+
+/* Times one period of the PID controller's arithmetic, with floats and with
+ * Q16.16 fixed point: the temperature and speed converted in, the correction,
+ * clamping the new speed and converting it out for the fans.
+ *
+ * These are the host's timings. It has an FPU, and the 32u4 doesn't, so they
+ * don't say which version is faster on the board. They're for seeing which
+ * way a change moves each version on the host.
+ */
+
+static const int UPDATES = 1000000;
+
+template<typename N>
+static float update(
+  BasicPIDCorrection<N> *correction,
+  N target,
+  float currentSpeed,
+  float temperature
+) {
+  N change = correction->update(N(temperature) - target, N(1.0f));
+  N speed = min(N(1.0f), max(N(0.0f), N(currentSpeed) + change));
+  speed = speed < N(0.05f) ? N(0.0f) : speed;
+  return float(speed);
+}
+
+template<typename N>
+static double run() {
+  BasicPIDCorrection<N> correction(0.02, 0.02, 0.05);
+  N target = N(27.0f);
+  float speed = 0.0;
+  volatile float sink;
+  uint64_t start = benchNanoseconds();
+  for (int i = 0; i < UPDATES; i++) {
+    // Wander around the set point so every branch is taken.
+    speed = update(&correction, target, speed, 26.0f + (i & 0xFF) / 128.0f);
+    sink = speed;
+  }
+  (void)sink;
+  return (double)(benchNanoseconds() - start) / UPDATES;
+}
+
+int main() {
+  printf("%-20s %10s\n", "PID update", "ns");
+  printf("%-20s %10.2f\n", "float", run<float>());
+  printf("%-20s %10.2f\n", "Fixed<16>", run< Fixed<16> >());
+  return 0;
+}
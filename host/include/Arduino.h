@@ -0,0 +1,96 @@
+#ifndef FAN_HOST_ARDUINO_H
+#define FAN_HOST_ARDUINO_H
+
+/* Host stand-in for the Arduino core, as configured for an ATmega32u4 board
+ * (the Leonardo pin mapping, which the ItsyBitsy 32u4 shares).
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "WString.h"
+#include "Print.h"
+#include "Printable.h"
+#include "Stream.h"
+#include "USBAPI.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define interrupts() sei()
+#define noInterrupts() cli()
+
+#define NOT_A_PIN 0
+#define NOT_AN_INTERRUPT -1
+
+#define NOT_ON_TIMER 0
+#define TIMER0A 1
+#define TIMER0B 2
+#define TIMER1A 3
+#define TIMER1B 4
+#define TIMER1C 5
+#define TIMER2  6
+#define TIMER2A 7
+#define TIMER2B 8
+#define TIMER3A 9
+#define TIMER3B 10
+#define TIMER3C 11
+#define TIMER4A 12
+#define TIMER4B 13
+#define TIMER4C 14
+#define TIMER4D 15
+
+#define NUM_DIGITAL_PINS 31
+#define NUM_ANALOG_INPUTS 12
+
+static const uint8_t A0 = 18;
+static const uint8_t A1 = 19;
+static const uint8_t A2 = 20;
+static const uint8_t A3 = 21;
+static const uint8_t A4 = 22;
+static const uint8_t A5 = 23;
+static const uint8_t A6 = 24;
+static const uint8_t A7 = 25;
+static const uint8_t A8 = 26;
+static const uint8_t A9 = 27;
+static const uint8_t A10 = 28;
+static const uint8_t A11 = 29;
+
+// Pin mapping helpers, with the same tables as the Leonardo variant.
+uint8_t digitalPinToTimer(uint8_t pin);
+int8_t digitalPinToInterrupt(uint8_t pin);
+uint8_t analogPinToChannel(uint8_t pin);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Provided by the sketch.
+void setup(void);
+void loop(void);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef FAN_HOST_PRINTABLE_H
+#define FAN_HOST_PRINTABLE_H
+
+#include <stddef.h>
+
+class Print;
+
+// Same interface as the Arduino core's Printable.
+class Printable {
+  public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef FAN_HOST_STREAM_H
+#define FAN_HOST_STREAM_H
+
+#include <stddef.h>
+
+#include "Print.h"
+#include "WString.h"
+
+/* Same interface as the Arduino core's Stream. The timed read functions wait
+ * in simulated time, so a timeout costs nothing in wall-clock time.
+ */
+class Stream: public Print {
+  public:
+    Stream(): timeout(1000) {}
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+    unsigned long getTimeout() const { return timeout; }
+
+    long parseInt();
+    float parseFloat();
+
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytesUntil(char terminator, char *buffer, size_t length);
+    String readString();
+    String readStringUntil(char terminator);
+
+  protected:
+    unsigned long timeout;
+
+    int timedRead();
+    int timedPeek();
+    // Skip anything that can't start a number, returning the next character.
+    int peekNextDigit();
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef FAN_HOST_USBAPI_H
+#define FAN_HOST_USBAPI_H
+
+#include <stdint.h>
+
+#include "Stream.h"
+
+/* The 32u4's USB CDC serial port. On the host, input is queued with
+ * `sim::serialInput()` and output goes to standard output (or is captured,
+ * see `sim::captureSerial()`).
+ */
+class Serial_: public Stream {
+  public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual int availableForWrite();
+    virtual void flush();
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+
+    operator bool() { return true; }
+};
+
+extern Serial_ Serial;
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef FAN_HOST_WSTRING_H
+#define FAN_HOST_WSTRING_H
+
+#include <stddef.h>
+
+/* Strings in flash are tagged with this (incomplete) type so that `Print`
+ * can pick the right overload, exactly as the Arduino core does.
+ */
+class __FlashStringHelper;
+#define F(string_literal) \
+  (reinterpret_cast<const __FlashStringHelper *>(PSTR(string_literal)))
+
+/* A heap-allocated string, with the subset of the Arduino core's `String`
+ * interface that CabinetFan uses.
+ */
+class String {
+  public:
+    String(const char *cstr = "");
+    String(const String &str);
+    explicit String(char c);
+    ~String();
+
+    String & operator=(const String &rhs);
+    String & operator=(const char *cstr);
+
+    String & operator+=(const String &rhs);
+    String & operator+=(const char *cstr);
+    String & operator+=(char c);
+
+    unsigned int length() const { return len; }
+    const char * c_str() const { return buffer; }
+    char charAt(unsigned int index) const;
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    bool equals(const String &s) const;
+    bool equals(const char *cstr) const;
+    bool equalsIgnoreCase(const String &s) const;
+    bool operator==(const String &rhs) const { return equals(rhs); }
+    bool operator==(const char *cstr) const { return equals(cstr); }
+    bool operator!=(const String &rhs) const { return !equals(rhs); }
+    bool operator!=(const char *cstr) const { return !equals(cstr); }
+
+    void trim();
+    long toInt() const;
+    float toFloat() const;
+
+  private:
+    char *buffer;
+    unsigned int len;
+
+    void copy(const char *cstr, unsigned int length);
+    void append(const char *cstr, unsigned int length);
+};
+
+#endif
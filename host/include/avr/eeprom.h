@@ -0,0 +1,28 @@
+#ifndef FAN_HOST_AVR_EEPROM_H
+#define FAN_HOST_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <avr/io.h>
+
+/* The avr-libc EEPROM API, backed by the simulator's EEPROM array. Writes go
+ * through the simulated EEPROM controller, so they take the same ~3.4ms per
+ * byte of simulated time as on the hardware.
+ */
+
+#define EEMEM
+
+#define eeprom_is_ready() bit_is_clear(EECR, EEPE)
+#define eeprom_busy_wait() do { \
+  while (!eeprom_is_ready()) { sim::idle(); } \
+} while (0)
+
+uint8_t eeprom_read_byte(const uint8_t *address);
+uint16_t eeprom_read_word(const uint16_t *address);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_write_byte(uint8_t *address, uint8_t value);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+void eeprom_write_block(const void *src, void *dst, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef FAN_HOST_AVR_INTERRUPT_H
+#define FAN_HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+/* Interrupt vectors are ordinary C functions on the host, named after the
+ * vector. The simulator calls them when the matching flag is raised and the
+ * interrupt is enabled.
+ */
+#define ISR(vector, ...) \
+  extern "C" void vector(void); \
+  extern "C" void vector(void)
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+
+// Re-enabling interrupts lets anything that was pending run immediately.
+#define sei() do { SREG |= _BV(SREG_I); sim::poll(); } while (0)
+#define cli() do { SREG &= ~_BV(SREG_I); } while (0)
+
+#endif
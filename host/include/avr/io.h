@@ -0,0 +1,314 @@
+#ifndef FAN_HOST_AVR_IO_H
+#define FAN_HOST_AVR_IO_H
+
+/* Host stand-in for <avr/io.h>, modelled on the ATmega32u4 (iom32u4.h).
+ *
+ * Only the registers and bits used by CabinetFan are declared. On the host
+ * they're ordinary variables; `sim.h` describes how the simulated peripherals
+ * behind them react.
+ */
+
+#include <stdint.h>
+#include "sim.h"
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+/* A busy-wait on real hardware spins while the peripheral works. On the host
+ * the peripheral only works when asked to, so each spin hands time to the
+ * simulator.
+ */
+#define loop_until_bit_is_set(sfr, bit) do { sim::idle(); } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do { sim::idle(); } while (bit_is_set(sfr, bit))
+
+#define E2END 0x3FF
+#define RAMEND 0x0AFF
+
+/* Interrupt flag registers are cleared by writing a one to a flag, rather than
+ * being written like ordinary registers. Flags are set by the simulator
+ * through `value`.
+ */
+struct FlagRegister {
+  uint8_t value;
+
+  void operator=(uint8_t bits) {
+    value &= ~bits;
+  }
+
+  // Read-modify-write, so this clears every flag that's already set too.
+  void operator|=(uint8_t bits) {
+    value &= ~(value | bits);
+  }
+
+  void operator&=(uint8_t bits) {
+    value &= ~(value & bits);
+  }
+
+  operator uint8_t() const {
+    return value;
+  }
+};
+
+// Status register
+extern volatile uint8_t SREG;
+#define SREG_I 7
+
+// Sleep mode control
+extern volatile uint8_t SMCR;
+#define SE 0
+#define SM0 1
+#define SM1 2
+#define SM2 3
+
+// Timer/Counter0 (owned by the Arduino core for millis())
+extern volatile uint8_t TCCR0A;
+extern volatile uint8_t TCCR0B;
+extern volatile uint8_t TCNT0;
+extern volatile uint8_t TIMSK0;
+extern FlagRegister TIFR0;
+
+// Timer/Counter1
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TCCR1C;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t ICR1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint16_t OCR1C;
+extern volatile uint8_t TIMSK1;
+extern FlagRegister TIFR1;
+
+#define WGM10 0
+#define WGM11 1
+#define COM1C0 2
+#define COM1C1 3
+#define COM1B0 4
+#define COM1B1 5
+#define COM1A0 6
+#define COM1A1 7
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define ICES1 6
+#define ICNC1 7
+#define FOC1C 5
+#define FOC1B 6
+#define FOC1A 7
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define OCIE1C 3
+#define ICIE1 5
+#define TOV1 0
+#define OCF1A 1
+#define OCF1B 2
+#define OCF1C 3
+#define ICF1 5
+
+// Timer/Counter3
+extern volatile uint8_t TCCR3A;
+extern volatile uint8_t TCCR3B;
+extern volatile uint8_t TCCR3C;
+extern volatile uint16_t TCNT3;
+extern volatile uint16_t ICR3;
+extern volatile uint16_t OCR3A;
+extern volatile uint16_t OCR3B;
+extern volatile uint16_t OCR3C;
+extern volatile uint8_t TIMSK3;
+extern FlagRegister TIFR3;
+
+#define WGM30 0
+#define WGM31 1
+#define COM3C0 2
+#define COM3C1 3
+#define COM3B0 4
+#define COM3B1 5
+#define COM3A0 6
+#define COM3A1 7
+#define CS30 0
+#define CS31 1
+#define CS32 2
+#define WGM32 3
+#define WGM33 4
+#define ICES3 6
+#define ICNC3 7
+#define FOC3C 5
+#define FOC3B 6
+#define FOC3A 7
+#define TOIE3 0
+#define OCIE3A 1
+#define OCIE3B 2
+#define OCIE3C 3
+#define ICIE3 5
+#define TOV3 0
+#define OCF3A 1
+#define OCF3B 2
+#define OCF3C 3
+#define ICF3 5
+
+// Timer/Counter4 (10-bit high speed)
+extern volatile uint8_t TCCR4A;
+extern volatile uint8_t TCCR4B;
+extern volatile uint8_t TCCR4C;
+extern volatile uint8_t TCCR4D;
+extern volatile uint8_t TCCR4E;
+extern volatile uint8_t TC4H;
+
+/* Timer/Counter4's counter and compare registers are 10 bits wide and share
+ * TC4H as their high byte: writing the low byte latches TC4H in as bits 8 and
+ * 9, and reading the low byte loads bits 8 and 9 into TC4H.
+ */
+struct Tc4Register {
+  uint16_t value;
+
+  void operator=(uint8_t low) {
+    value = ((uint16_t)(TC4H & 0x3) << 8) | low;
+  }
+
+  operator uint8_t() const {
+    TC4H = value >> 8;
+    return value & 0xff;
+  }
+};
+
+extern Tc4Register TCNT4;
+extern Tc4Register OCR4A;
+extern Tc4Register OCR4B;
+extern Tc4Register OCR4C;
+extern Tc4Register OCR4D;
+extern volatile uint8_t TIMSK4;
+extern FlagRegister TIFR4;
+
+#define PWM4B 0
+#define PWM4A 1
+#define FOC4B 2
+#define FOC4A 3
+#define COM4B0 4
+#define COM4B1 5
+#define COM4A0 6
+#define COM4A1 7
+#define CS40 0
+#define CS41 1
+#define CS42 2
+#define CS43 3
+#define PSR4 6
+#define PWM4X 7
+#define PWM4D 0
+#define FOC4D 1
+#define COM4D0 2
+#define COM4D1 3
+#define WGM40 0
+#define WGM41 1
+
+// External interrupts
+extern volatile uint8_t EICRA;
+extern volatile uint8_t EICRB;
+extern volatile uint8_t EIMSK;
+extern FlagRegister EIFR;
+
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define ISC20 4
+#define ISC21 5
+#define ISC30 6
+#define ISC31 7
+#define ISC60 4
+#define ISC61 5
+#define INT0 0
+#define INT1 1
+#define INT2 2
+#define INT3 3
+#define INT6 6
+#define INTF0 0
+#define INTF1 1
+#define INTF2 2
+#define INTF3 3
+#define INTF6 6
+
+// Analog to digital converter
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t ADCSRB;
+extern volatile uint16_t ADCW;
+#define ADC ADCW
+extern volatile uint8_t DIDR0;
+extern volatile uint8_t DIDR2;
+
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define MUX4 4
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define ADTS3 3
+#define MUX5 5
+#define ACME 6
+#define ADHSM 7
+
+// EEPROM
+extern volatile uint8_t EEDR;
+extern volatile uint16_t EEAR;
+
+/* Setting EERE reads the EEPROM straight away (the CPU is halted until the data
+ * is in EEDR), so a read can't wait for the simulator to notice the bit.
+ * Everything else, including starting a write with EEPE, is handled by the
+ * simulator.
+ */
+struct EepromControlRegister {
+  uint8_t value;
+
+  EepromControlRegister & operator=(uint8_t bits) {
+    value = bits;
+    read();
+    return *this;
+  }
+
+  EepromControlRegister & operator|=(uint8_t bits) {
+    return *this = value | bits;
+  }
+
+  EepromControlRegister & operator&=(uint8_t bits) {
+    return *this = value & bits;
+  }
+
+  operator uint8_t() const {
+    return value;
+  }
+
+  private:
+    void read() {
+      if (value & 0x01) {
+        EEDR = sim::eeprom()[EEAR & E2END];
+        value &= ~0x01;
+      }
+    }
+};
+
+extern EepromControlRegister EECR;
+
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+#define EEPM0 4
+#define EEPM1 5
+
+#endif
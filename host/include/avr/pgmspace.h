@@ -0,0 +1,29 @@
+#ifndef FAN_HOST_AVR_PGMSPACE_H
+#define FAN_HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+/* There's only one address space on the host, so program memory is just
+ * ordinary (constant) memory. It's kept in its own section, as on the AVR, so
+ * the memory report can tell what would be in flash from what would be copied
+ * to RAM.
+ */
+#define PROGMEM __attribute__((section(".progmem.data")))
+#define PGM_P const char *
+#define PSTR(s) (__extension__({static const char __c[] PROGMEM = (s); &__c[0];}))
+
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_float(address) (*(const float *)(address))
+#define pgm_read_ptr(address) (*(const void * const *)(address))
+
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strcasecmp_P strcasecmp
+#define strncasecmp_P strncasecmp
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef FAN_HOST_AVR_SLEEP_H
+#define FAN_HOST_AVR_SLEEP_H
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE (0)
+#define SLEEP_MODE_ADC _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE (_BV(SM0) | _BV(SM1))
+#define SLEEP_MODE_STANDBY (_BV(SM1) | _BV(SM2))
+#define SLEEP_MODE_EXT_STANDBY (_BV(SM0) | _BV(SM1) | _BV(SM2))
+
+#define set_sleep_mode(mode) do { \
+  SMCR = (SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode); \
+} while (0)
+#define sleep_enable() do { SMCR |= _BV(SE); } while (0)
+#define sleep_disable() do { SMCR &= ~_BV(SE); } while (0)
+
+// Sleeps until an interrupt is dispatched (see `sim::sleep`).
+void sleep_cpu(void);
+
+#define sleep_mode() do { sleep_enable(); sleep_cpu(); sleep_disable(); } while (0)
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef FAN_HOST_SIM_H
+#define FAN_HOST_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Control surface for the host (Linux) backend.
+ *
+ * The host backend stands in for the ATmega32u4 and the Arduino core: the
+ * peripheral registers are plain variables, and this module plays the part of
+ * the hardware behind them. Simulated time only moves when something asks it
+ * to (`advance()`, `delay()`, or firmware busy-waiting on a register), which
+ * keeps runs deterministic and lets a whole day of operation be replayed in a
+ * fraction of a second.
+ *
+ * Interrupt handlers defined with `ISR()` are dispatched from here, with the
+ * same rules as the hardware: the vector's enable bit must be set and the
+ * global interrupt flag (the I bit in SREG) must be set. Flags raised while
+ * interrupts are disabled stay pending until they are re-enabled.
+ */
+namespace sim {
+  // Return every register, pin, the clock and the EEPROM to their reset state.
+  void reset();
+
+  // Microseconds of simulated time since reset.
+  uint64_t now();
+
+  // Move simulated time forward, raising and dispatching interrupts on the way.
+  void advance(uint32_t micros);
+
+  /* Dispatch any pending interrupts and complete any peripheral operation that
+   * is due at the current time. Does not move time forward.
+   */
+  void poll();
+
+  /* Move time forward to the next scheduled peripheral event (or by one
+   * microsecond if none is scheduled) and dispatch it. This is what a
+   * busy-wait or sleep on the host turns into.
+   */
+  void idle();
+
+  /* Drive the tachometer signal on an Arduino pin. The signal toggles four
+   * times per rotation, matching a standard PC fan (two pulses per rotation).
+   * An RPM of 0 stops the signal.
+   */
+  void setTachRPM(uint8_t pin, uint16_t rpm);
+
+  /* Attach a simulated fan: its tachometer signal follows the duty cycle on
+   * `controlPin`, spinning at `maxRPM` at 100% and stopping below `stallDuty`.
+   */
+  void attachFan(
+    uint8_t controlPin,
+    uint8_t tachPin,
+    uint16_t maxRPM,
+    float stallDuty = 0.2
+  );
+
+  /* Set the voltage (in millivolts) seen by an ADC channel (0-13). Conversions
+   * add up to an LSB of (repeatable) noise, like the real ADC.
+   */
+  void setAnalogInput(uint8_t channel, float milliVolts);
+
+  // Set the temperature reported by the internal temperature sensor.
+  void setInternalTemperature(float celsius);
+
+  /* The duty cycle (0.0 to 1.0) currently being generated on an Arduino PWM
+   * pin, computed from the timer's TOP and output compare registers.
+   */
+  float dutyCycle(uint8_t pin);
+
+  // Queue characters to be read from `Serial`.
+  void serialInput(const char * text);
+  void serialInput(const uint8_t * data, size_t length);
+
+  /* By default, anything written to `Serial` goes to standard output. When
+   * capturing, it is buffered instead and can be retrieved (and cleared) with
+   * `takeSerialOutput()`.
+   */
+  void captureSerial(bool capture);
+  size_t takeSerialOutput(char * buffer, size_t size);
+
+  // Direct access to the simulated EEPROM contents.
+  uint8_t * eeprom();
+  size_t eepromSize();
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef FAN_HOST_UTIL_ATOMIC_H
+#define FAN_HOST_UTIL_ATOMIC_H
+
+#include <avr/interrupt.h>
+
+/* Host version of avr-libc's ATOMIC_BLOCK. Interrupts are only dispatched by
+ * the simulator, so clearing the I bit is enough to keep them out of the
+ * block, exactly as on the hardware.
+ */
+
+static inline uint8_t __iCliRetVal(void) {
+  cli();
+  return 1;
+}
+
+static inline void __iSeiParam(const uint8_t *__s) {
+  (void)__s;
+  sei();
+}
+
+static inline void __iRestore(const uint8_t *__s) {
+  SREG = *__s;
+  if (*__s & _BV(SREG_I)) {
+    sim::poll();
+  }
+}
+
+#define ATOMIC_BLOCK(type) \
+  for (type, __ToDo = __iCliRetVal(); __ToDo; __ToDo = 0)
+
+#define ATOMIC_RESTORESTATE \
+  uint8_t sreg_save __attribute__((__cleanup__(__iRestore))) = SREG
+
+#define ATOMIC_FORCEON \
+  uint8_t sreg_save __attribute__((__cleanup__(__iSeiParam))) = 0
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef FAN_HOST_UTIL_CRC16_H
+#define FAN_HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+// Same polynomial (0xA001, reflected 0x8005) as avr-libc's `_crc16_update`.
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+  crc ^= a;
+  for (uint8_t i = 0; i < 8; ++i) {
+    if (crc & 1) {
+      crc = (crc >> 1) ^ 0xA001;
+    } else {
+      crc = (crc >> 1);
+    }
+  }
+  return crc;
+}
+
+// Same polynomial as avr-libc's `_crc_ccitt_update`.
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+  data ^= crc & 0xff;
+  data ^= data << 4;
+  return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+      ^ ((uint16_t)data << 3));
+}
+
+#endif
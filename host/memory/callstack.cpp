@@ -0,0 +1,277 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cxxabi.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Works out the worst-case stack depth of the firmware's functions, by adding
+ * up the stack frames along the call graph that GCC writes with
+ * `-fcallgraph-info=su` (GCC 10 or newer, including avr-gcc).
+ *
+ * Usage: cabinetfan_callstack file.ci|file.o...
+ *
+ * An object file is taken to mean the call graph file next to it. For each
+ * file it prints the function with the deepest stack, and then the calls
+ * making up the deepest stack of all. The depth is a lower bound where a
+ * chain has calls the graph can't follow, which are flagged:
+ *
+ *   indirect   a call through a pointer (including virtual functions)
+ *   external   a call to a function without a frame size, outside the graph
+ *   recursive  a call back into a function already on the stack
+ *   dynamic    a frame whose size depends on its arguments (alloca or VLAs)
+ */
+
+static const unsigned INDIRECT = 1;
+static const unsigned EXTERNAL = 2;
+static const unsigned RECURSIVE = 4;
+static const unsigned DYNAMIC = 8;
+
+struct Function {
+  std::string name;
+  std::string file;
+  // The function's own frame, when it's defined in one of the files.
+  bool defined;
+  unsigned long frame;
+  unsigned flags;
+  std::vector<std::string> callees;
+
+  // Filled in by `depth()`.
+  bool visiting;
+  bool done;
+  unsigned long depth;
+  // `flags`, plus the calls this function makes that can't be followed.
+  unsigned callFlags;
+  // `callFlags` of every function on the deepest path from here.
+  unsigned depthFlags;
+  std::string deepestCallee;
+};
+
+static std::map<std::string, Function> functions;
+
+static Function & getFunction(const std::string &title) {
+  Function &function = functions[title];
+  if (function.name.empty()) {
+    function.name = title;
+  }
+  return function;
+}
+
+/* GCC labels the parts it splits out of a function (".part.0" and so on) with
+ * just the number and the arguments, so name those from their title instead.
+ */
+static std::string cloneName(const std::string &title) {
+  std::string mangled = title.substr(title.rfind(':') + 1);
+  size_t suffix = mangled.find('.');
+  int status;
+  char *demangled = abi::__cxa_demangle(
+    mangled.substr(0, suffix).c_str(),
+    NULL,
+    NULL,
+    &status
+  );
+  std::string name = status == 0 ? demangled : mangled.substr(0, suffix);
+  free(demangled);
+  if (suffix != std::string::npos) {
+    name += " [" + mangled.substr(suffix + 1) + "]";
+  }
+  return name;
+}
+
+/* Copy the quoted string after `key` in `line` into `value`, returning false
+ * if there isn't one. The label's "\n" escapes are left as they are.
+ */
+static bool quoted(const char *line, const char *key, std::string *value) {
+  const char *start = strstr(line, key);
+  if (start == NULL) {
+    return false;
+  }
+  start += strlen(key);
+  const char *end = start;
+  while (*end != '\0' && *end != '"') {
+    end += *end == '\\' && end[1] != '\0' ? 2 : 1;
+  }
+  value->assign(start, end - start);
+  return true;
+}
+
+static bool readGraph(const char *path) {
+  FILE *input = fopen(path, "r");
+  if (input == NULL) {
+    perror(path);
+    return false;
+  }
+  const char *base = strrchr(path, '/');
+  std::string file = base != NULL ? base + 1 : path;
+  file = file.substr(0, file.rfind(".ci"));
+  std::string line;
+  char buffer[1024];
+  while (fgets(buffer, sizeof(buffer), input) != NULL) {
+    line += buffer;
+    if (line[line.size() - 1] != '\n') {
+      // Demangled template names make for some long lines.
+      continue;
+    }
+    std::string title;
+    std::string label;
+    std::string target;
+    if (strncmp(line.c_str(), "node:", 5) == 0 &&
+        quoted(line.c_str(), "title: \"", &title) &&
+        quoted(line.c_str(), "label: \"", &label)) {
+      Function &function = getFunction(title);
+      // The label is the name, the location, then (if defined) the frame.
+      size_t nameEnd = label.find("\\n");
+      function.name = label.substr(0, nameEnd);
+      if (!function.name.empty() && isdigit(function.name[0])) {
+        function.name = cloneName(title);
+      }
+      size_t frameStart = label.rfind("\\n");
+      unsigned long frame;
+      char kind[32];
+      if (frameStart != nameEnd && sscanf(
+          label.c_str() + frameStart + 2,
+          "%lu bytes (%31[a-z,])",
+          &frame,
+          kind
+        ) == 2) {
+        function.defined = true;
+        function.file = file;
+        function.frame = frame;
+        if (strncmp(kind, "dynamic", 7) == 0) {
+          function.flags |= DYNAMIC;
+        }
+      }
+    } else if (strncmp(line.c_str(), "edge:", 5) == 0 &&
+        quoted(line.c_str(), "sourcename: \"", &title) &&
+        quoted(line.c_str(), "targetname: \"", &target)) {
+      getFunction(title).callees.push_back(target);
+    }
+    line.clear();
+  }
+  fclose(input);
+  return true;
+}
+
+static void depth(const std::string &title) {
+  Function &function = functions[title];
+  if (function.done) {
+    return;
+  }
+  function.visiting = true;
+  function.depth = 0;
+  function.callFlags = function.flags;
+  for (size_t i = 0; i < function.callees.size(); i++) {
+    const std::string &calleeTitle = function.callees[i];
+    if (calleeTitle == "__indirect_call") {
+      function.callFlags |= INDIRECT;
+      continue;
+    }
+    Function &callee = functions[calleeTitle];
+    if (!callee.defined) {
+      function.callFlags |= EXTERNAL;
+      continue;
+    }
+    if (callee.visiting) {
+      function.callFlags |= RECURSIVE;
+      continue;
+    }
+    depth(calleeTitle);
+    if (function.deepestCallee.empty() || callee.depth > function.depth) {
+      function.depth = callee.depth;
+      function.deepestCallee = calleeTitle;
+    }
+  }
+  function.depth += function.frame;
+  function.depthFlags = function.callFlags;
+  if (!function.deepestCallee.empty()) {
+    function.depthFlags |= functions[function.deepestCallee].depthFlags;
+  }
+  function.visiting = false;
+  function.done = true;
+}
+
+static std::string describeFlags(unsigned flags) {
+  static const char *NAMES[] = {"indirect", "external", "recursive", "dynamic"};
+  std::string description;
+  for (unsigned i = 0; i < 4; i++) {
+    if (flags & (1 << i)) {
+      description += description.empty() ? "" : ", ";
+      description += NAMES[i];
+    }
+  }
+  return description;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s file.ci|file.o...\n", argv[0]);
+    return 1;
+  }
+  for (int i = 1; i < argc; i++) {
+    std::string path = argv[i];
+    size_t length = path.size();
+    if (length > 2 && path.compare(length - 2, 2, ".o") == 0) {
+      path = path.substr(0, length - 2) + ".ci";
+    }
+    if (!readGraph(path.c_str())) {
+      return 1;
+    }
+  }
+
+  // The deepest function in each file.
+  std::map<std::string, std::string> deepest;
+  std::string overall;
+  std::map<std::string, Function>::iterator it;
+  for (it = functions.begin(); it != functions.end(); ++it) {
+    if (!it->second.defined) {
+      continue;
+    }
+    depth(it->first);
+    std::string &fileDeepest = deepest[it->second.file];
+    if (fileDeepest.empty() ||
+        it->second.depth > functions[fileDeepest].depth) {
+      fileDeepest = it->first;
+    }
+    if (overall.empty() || it->second.depth > functions[overall].depth) {
+      overall = it->first;
+    }
+  }
+  if (overall.empty()) {
+    fprintf(stderr, "No stack frames found, build with -fcallgraph-info=su\n");
+    return 1;
+  }
+
+  printf("%-30s %8s  %s\n", "file", "stack", "deepest function");
+  std::map<std::string, std::string>::iterator file;
+  for (file = deepest.begin(); file != deepest.end(); ++file) {
+    const Function &function = functions[file->second];
+    std::string flags = describeFlags(function.depthFlags);
+    printf(
+      "%-30s %8lu  %s%s%s%s\n",
+      file->first.c_str(),
+      function.depth,
+      function.name.c_str(),
+      flags.empty() ? "" : " (",
+      flags.c_str(),
+      flags.empty() ? "" : ")"
+    );
+  }
+
+  printf("\nDeepest stack, %lu bytes:\n", functions[overall].depth);
+  for (std::string title = overall; !title.empty(); ) {
+    const Function &function = functions[title];
+    std::string flags = describeFlags(function.callFlags);
+    printf(
+      "%8lu  %s%s%s%s\n",
+      function.frame,
+      function.name.c_str(),
+      flags.empty() ? "" : " (",
+      flags.c_str(),
+      flags.empty() ? "" : ")"
+    );
+    title = function.deepestCallee;
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+# Reports the board's memory use from the sketch's linked ELF file. Run as a
+# script, with the AVR binutils:
+#
+#   cmake -DSIZE=avr-size -DNM=avr-nm -DELF=CabinetFan.ino.elf \
+#     -P elf_report.cmake
+#
+# It prints flash (.text and the .data initializers) and RAM (.data, .bss and
+# .noinit) against the ATmega32u4's, and the largest variables in RAM. What's
+# left of the RAM is the most the stack can use; cabinetfan_callstack works
+# out how much it needs. FLASH_SIZE defaults to what the Caterina bootloader
+# leaves, and RAM_SIZE to the 32u4's 2.5 KB.
+
+cmake_minimum_required(VERSION 3.13)
+
+if(NOT SIZE OR NOT NM OR NOT ELF)
+  message(FATAL_ERROR "SIZE, NM and ELF have to be set")
+endif()
+if(NOT FLASH_SIZE)
+  set(FLASH_SIZE 28672)
+endif()
+if(NOT RAM_SIZE)
+  set(RAM_SIZE 2560)
+endif()
+if(NOT SYMBOLS)
+  set(SYMBOLS 20)
+endif()
+
+execute_process(
+  COMMAND ${SIZE} -A "${ELF}"
+  OUTPUT_VARIABLE sections
+  RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${SIZE} failed on ${ELF}")
+endif()
+foreach(section text data bss noinit)
+  set(${section} 0)
+endforeach()
+string(REPLACE "\n" ";" sections "${sections}")
+foreach(line ${sections})
+  if(line MATCHES "^\\.(text|data|bss|noinit) +([0-9]+)")
+    math(EXPR ${CMAKE_MATCH_1} "${${CMAKE_MATCH_1}} + ${CMAKE_MATCH_2}")
+  endif()
+endforeach()
+
+math(EXPR flash "${text} + ${data}")
+math(EXPR ram "${data} + ${bss} + ${noinit}")
+math(EXPR stack "${RAM_SIZE} - ${ram}")
+message("flash: ${flash} of ${FLASH_SIZE} bytes (.text ${text}, .data ${data})")
+message("RAM:   ${ram} of ${RAM_SIZE} bytes "
+  "(.data ${data}, .bss ${bss}, .noinit ${noinit})")
+message("left for the stack: ${stack} bytes")
+
+# Each line is "address size type name", smallest first.
+execute_process(
+  COMMAND ${NM} --size-sort -C -S "${ELF}"
+  OUTPUT_VARIABLE symbols
+  RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${NM} failed on ${ELF}")
+endif()
+string(REPLACE ";" "\\;" symbols "${symbols}")
+string(REPLACE "\n" ";" symbols "${symbols}")
+list(REVERSE symbols)
+message("\nlargest variables in RAM:")
+set(printed 0)
+foreach(symbol ${symbols})
+  if(printed EQUAL SYMBOLS)
+    break()
+  endif()
+  if(symbol MATCHES "^[0-9a-f]+ ([0-9a-f]+) [bBdD] (.*)$")
+    math(EXPR bytes "0x${CMAKE_MATCH_1}")
+    set(cell "${bytes}")
+    string(LENGTH "${cell}" length)
+    while(length LESS 8)
+      string(PREPEND cell " ")
+      math(EXPR length "${length} + 1")
+    endwhile()
+    message("${cell}  ${CMAKE_MATCH_2}")
+    math(EXPR printed "${printed} + 1")
+  endif()
+endforeach()
@@ -0,0 +1,99 @@
+# Reports how much static memory each firmware module uses in the host build,
+# from the sections of its object file. Run as a script:
+#
+#   cmake -DSIZE=size -DOBJECTS="a.o|b.o" -P report.cmake
+#
+# (The object files are separated with "|" rather than as a CMake list, so a
+# custom command can pass them in one argument.)
+#
+# The columns are bytes of:
+#   data     initialized variables (and vtables), copied to RAM at startup
+#   rodata   constants outside of flash, which the AVR also copies to RAM
+#   bss      zeroed variables
+#   progmem  PROGMEM data and F() strings, which stay in flash on the AVR
+#
+# These are x86 objects, with 8 byte pointers, so the sizes aren't the
+# ATmega32u4's. They're for comparing modules, and for seeing which way a
+# change moves them. elf_report.cmake reports the board's memory from the
+# sketch's ELF file.
+
+cmake_minimum_required(VERSION 3.13)
+
+if(NOT SIZE OR NOT OBJECTS)
+  message(FATAL_ERROR "SIZE and OBJECTS have to be set")
+endif()
+
+function(pad_left text width output)
+  string(LENGTH "${text}" length)
+  set(padded "${text}")
+  while(length LESS width)
+    string(PREPEND padded " ")
+    math(EXPR length "${length} + 1")
+  endwhile()
+  set(${output} "${padded}" PARENT_SCOPE)
+endfunction()
+
+function(print_row module data rodata bss progmem)
+  string(LENGTH "${module}" length)
+  set(padded "${module}")
+  while(length LESS 30)
+    string(APPEND padded " ")
+    math(EXPR length "${length} + 1")
+  endwhile()
+  foreach(column data rodata bss progmem)
+    pad_left("${${column}}" 8 cell)
+    string(APPEND padded "${cell}")
+  endforeach()
+  message("${padded}")
+endfunction()
+
+print_row(module data rodata bss progmem)
+foreach(column data rodata bss progmem)
+  set(total_${column} 0)
+endforeach()
+
+string(REPLACE "|" ";" OBJECTS "${OBJECTS}")
+list(SORT OBJECTS)
+foreach(object ${OBJECTS})
+  get_filename_component(module "${object}" NAME)
+  string(REGEX REPLACE "\\.o(bj)?$" "" module "${module}")
+
+  execute_process(
+    COMMAND ${SIZE} -A "${object}"
+    OUTPUT_VARIABLE sections
+    RESULT_VARIABLE result
+  )
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${SIZE} failed on ${object}")
+  endif()
+  foreach(column data rodata bss progmem)
+    set(${column} 0)
+  endforeach()
+  string(REPLACE "\n" ";" sections "${sections}")
+  foreach(section ${sections})
+    if(NOT section MATCHES "^(\\.[^ ]+) +([0-9]+)")
+      continue()
+    endif()
+    set(name "${CMAKE_MATCH_1}")
+    set(bytes "${CMAKE_MATCH_2}")
+    if(name MATCHES "^\\.progmem")
+      set(column progmem)
+    elseif(name MATCHES "^\\.data")
+      set(column data)
+    elseif(name MATCHES "^\\.rodata")
+      set(column rodata)
+    elseif(name MATCHES "^\\.bss")
+      set(column bss)
+    else()
+      continue()
+    endif()
+    math(EXPR ${column} "${${column}} + ${bytes}")
+  endforeach()
+
+  print_row("${module}" ${data} ${rodata} ${bss} ${progmem})
+  foreach(column data rodata bss progmem)
+    math(EXPR total_${column} "${total_${column}} + ${${column}}")
+  endforeach()
+endforeach()
+
+print_row(total ${total_data} ${total_rodata} ${total_bss} ${total_progmem})
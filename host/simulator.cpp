@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <Arduino.h>
+#include "sim.h"
+
+/* Runs the CabinetFan sketch against a simulated cabinet.
+ *
+ * Usage: cabinetfan_sim [seconds]
+ *
+ * Anything on standard input is typed into the serial menu once `setup()` has
+ * finished, and the sketch's serial output is written to standard output.
+ * A line of the form `@seconds` holds back the rest of the input until that
+ * many simulated seconds have passed. The sketch runs for the given number of
+ * simulated seconds (60 by default).
+ */
+
+// Pins, matching CabinetFan.ino
+static const uint8_t CONTROL_PIN = 9;
+static const uint8_t TACH_PIN = 0;
+static const uint8_t TEMP_CHANNEL = 9;
+
+// The simulated fan is a Gelid Silent 12 PWM.
+static const uint16_t FAN_MAX_RPM = 1500;
+
+/* A first order thermal model of the cabinet: it settles `HEAT_RISE` degrees
+ * above ambient with the fan stopped, and proportionally less the more air is
+ * moving through it.
+ */
+static const float AMBIENT = 25.0;
+static const float HEAT_RISE = 20.0;
+static const float COOLING = 3.0;
+static const float TIME_CONSTANT = 120.0;
+
+// How often the thermal model is stepped, in microseconds.
+static const uint32_t MODEL_STEP = 1000;
+
+/* Roughly how long (in microseconds) a trip through `loop()` takes on the
+ * hardware when there's nothing to do. Nothing in the sketch busy-waits any
+ * more, so without this time would barely move between iterations.
+ */
+static const uint32_t LOOP_MICROS = 50;
+
+// Output voltage of a TMP36 at a given temperature.
+static float tmp36MilliVolts(float celsius) {
+  return 500.0 + celsius * 10.0;
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 60.0;
+
+  sim::reset();
+  sim::attachFan(CONTROL_PIN, TACH_PIN, FAN_MAX_RPM);
+  float temperature = AMBIENT;
+  sim::setAnalogInput(TEMP_CHANNEL, tmp36MilliVolts(temperature));
+
+  setup();
+
+  // Read all of the input, to be typed in as it comes due.
+  char *input = NULL;
+  size_t inputLength = 0;
+  if (!isatty(STDIN_FILENO)) {
+    char buffer[256];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), stdin)) > 0) {
+      input = (char *)realloc(input, inputLength + length + 1);
+      memcpy(input + inputLength, buffer, length);
+      inputLength += length;
+    }
+    if (input != NULL) {
+      input[inputLength] = '\0';
+    }
+  }
+  const uint64_t start = sim::now();
+  char *pending = input;
+  uint64_t pendingAt = start;
+
+  uint64_t end = sim::now() + (uint64_t)(seconds * 1000000);
+  uint64_t lastStep = sim::now();
+  while (sim::now() < end) {
+    while (pending != NULL && *pending != '\0' && sim::now() >= pendingAt) {
+      // Type everything up to the next `@` line.
+      char *delay = pending[0] == '@' ? pending : strstr(pending, "\n@");
+      size_t length = delay != NULL ? delay - pending : strlen(pending);
+      if (delay != NULL && delay != pending) {
+        // Keep the newline before the `@` line.
+        length++;
+        delay++;
+      }
+      sim::serialInput((const uint8_t *)pending, length);
+      if (delay == NULL) {
+        pending = NULL;
+        break;
+      }
+      pendingAt = start + (uint64_t)(atof(delay + 1) * 1000000);
+      char *next = strchr(delay, '\n');
+      pending = next != NULL ? next + 1 : NULL;
+    }
+    loop();
+    sim::advance(LOOP_MICROS);
+    if (sim::now() - lastStep >= MODEL_STEP) {
+      float elapsed = (sim::now() - lastStep) / 1000000.0;
+      lastStep = sim::now();
+      float airflow = sim::dutyCycle(CONTROL_PIN);
+      float target = AMBIENT + HEAT_RISE / (1.0 + COOLING * airflow);
+      temperature += (target - temperature) * elapsed / TIME_CONSTANT;
+      sim::setAnalogInput(TEMP_CHANNEL, tmp36MilliVolts(temperature));
+    }
+  }
+  fflush(stdout);
+  free(input);
+  return 0;
+}
@@ -0,0 +1,6 @@
+/* The Arduino IDE builds a sketch by prepending `#include <Arduino.h>` (and
+ * prototypes for its functions) to the .ino file. This does the same for the
+ * host build.
+ */
+#include <Arduino.h>
+#include "CabinetFan.ino"
@@ -0,0 +1,134 @@
+#include <Arduino.h>
+#include "Stream.h"
+
+// Reads wait in simulated time, one millisecond at a time.
+int Stream::timedRead() {
+  unsigned long start = millis();
+  do {
+    int c = read();
+    if (c >= 0) {
+      return c;
+    }
+    delay(1);
+  } while (millis() - start < timeout);
+  return -1;
+}
+
+int Stream::timedPeek() {
+  unsigned long start = millis();
+  do {
+    int c = peek();
+    if (c >= 0) {
+      return c;
+    }
+    delay(1);
+  } while (millis() - start < timeout);
+  return -1;
+}
+
+int Stream::peekNextDigit() {
+  while (true) {
+    int c = timedPeek();
+    if (c < 0 || c == '-' || c == '.' || (c >= '0' && c <= '9')) {
+      return c;
+    }
+    read();
+  }
+}
+
+long Stream::parseInt() {
+  bool isNegative = false;
+  long value = 0;
+  int c = peekNextDigit();
+  if (c < 0) {
+    return 0;
+  }
+  do {
+    if (c == '-') {
+      isNegative = true;
+    } else if (c >= '0' && c <= '9') {
+      value = value * 10 + c - '0';
+    }
+    read();
+    c = timedPeek();
+  } while (c >= '0' && c <= '9');
+  return isNegative ? -value : value;
+}
+
+float Stream::parseFloat() {
+  bool isNegative = false;
+  bool isFraction = false;
+  long value = 0;
+  float fraction = 1.0;
+  int c = peekNextDigit();
+  if (c < 0) {
+    return 0;
+  }
+  do {
+    if (c == '-') {
+      isNegative = true;
+    } else if (c == '.') {
+      isFraction = true;
+    } else if (c >= '0' && c <= '9') {
+      value = value * 10 + c - '0';
+      if (isFraction) {
+        fraction *= 0.1;
+      }
+    }
+    read();
+    c = timedPeek();
+  } while ((c >= '0' && c <= '9') || (c == '.' && !isFraction));
+  if (isNegative) {
+    value = -value;
+  }
+  if (isFraction) {
+    return value * fraction;
+  }
+  return value;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = timedRead();
+    if (c < 0) {
+      break;
+    }
+    *buffer++ = (char)c;
+    count++;
+  }
+  return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length) {
+  size_t index = 0;
+  while (index < length) {
+    int c = timedRead();
+    if (c < 0 || c == terminator) {
+      break;
+    }
+    *buffer++ = (char)c;
+    index++;
+  }
+  return index;
+}
+
+String Stream::readString() {
+  String ret;
+  int c = timedRead();
+  while (c >= 0) {
+    ret += (char)c;
+    c = timedRead();
+  }
+  return ret;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String ret;
+  int c = timedRead();
+  while (c >= 0 && c != terminator) {
+    ret += (char)c;
+    c = timedRead();
+  }
+  return ret;
+}
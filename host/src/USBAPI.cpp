@@ -0,0 +1,33 @@
+#include "USBAPI.h"
+#include "sim_internal.h"
+
+Serial_ Serial;
+
+int Serial_::available() {
+  return sim::internal::serialAvailable();
+}
+
+int Serial_::read() {
+  return sim::internal::serialRead();
+}
+
+int Serial_::peek() {
+  return sim::internal::serialPeek();
+}
+
+int Serial_::availableForWrite() {
+  // Same as the size of the USB CDC endpoint buffer.
+  return 64;
+}
+
+void Serial_::flush() {
+}
+
+size_t Serial_::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t Serial_::write(const uint8_t *buffer, size_t size) {
+  sim::internal::serialWrite(buffer, size);
+  return size;
+}
@@ -0,0 +1,114 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "WString.h"
+
+String::String(const char *cstr): buffer(NULL), len(0) {
+  copy(cstr ? cstr : "", cstr ? strlen(cstr) : 0);
+}
+
+String::String(const String &str): buffer(NULL), len(0) {
+  copy(str.buffer, str.len);
+}
+
+String::String(char c): buffer(NULL), len(0) {
+  char buf[2] = {c, '\0'};
+  copy(buf, 1);
+}
+
+String::~String() {
+  free(buffer);
+}
+
+String & String::operator=(const String &rhs) {
+  if (this != &rhs) {
+    copy(rhs.buffer, rhs.len);
+  }
+  return *this;
+}
+
+String & String::operator=(const char *cstr) {
+  copy(cstr ? cstr : "", cstr ? strlen(cstr) : 0);
+  return *this;
+}
+
+String & String::operator+=(const String &rhs) {
+  append(rhs.buffer, rhs.len);
+  return *this;
+}
+
+String & String::operator+=(const char *cstr) {
+  if (cstr) {
+    append(cstr, strlen(cstr));
+  }
+  return *this;
+}
+
+String & String::operator+=(char c) {
+  append(&c, 1);
+  return *this;
+}
+
+char String::charAt(unsigned int index) const {
+  if (index >= len) {
+    return 0;
+  }
+  return buffer[index];
+}
+
+bool String::equals(const String &s) const {
+  return len == s.len && strcmp(buffer, s.buffer) == 0;
+}
+
+bool String::equals(const char *cstr) const {
+  return strcmp(buffer, cstr ? cstr : "") == 0;
+}
+
+bool String::equalsIgnoreCase(const String &s) const {
+  return len == s.len && strcasecmp(buffer, s.buffer) == 0;
+}
+
+void String::trim() {
+  char *begin = buffer;
+  while (isspace(*begin)) {
+    begin++;
+  }
+  char *end = buffer + len;
+  while (end > begin && isspace(*(end - 1))) {
+    end--;
+  }
+  len = end - begin;
+  memmove(buffer, begin, len);
+  buffer[len] = '\0';
+}
+
+long String::toInt() const {
+  return atol(buffer);
+}
+
+float String::toFloat() const {
+  return atof(buffer);
+}
+
+void String::copy(const char *cstr, unsigned int length) {
+  char *newBuffer = (char *)realloc(buffer, length + 1);
+  if (newBuffer == NULL) {
+    return;
+  }
+  buffer = newBuffer;
+  memmove(buffer, cstr, length);
+  buffer[length] = '\0';
+  len = length;
+}
+
+void String::append(const char *cstr, unsigned int length) {
+  char *newBuffer = (char *)realloc(buffer, len + length + 1);
+  if (newBuffer == NULL) {
+    return;
+  }
+  buffer = newBuffer;
+  memmove(buffer + len, cstr, length);
+  len += length;
+  buffer[len] = '\0';
+}
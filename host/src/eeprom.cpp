@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <avr/eeprom.h>
+#include "sim.h"
+#include "sim_internal.h"
+
+/* The avr-libc EEPROM routines. Reads come straight from the simulated array
+ * (they're effectively instant on the hardware too), while writes go through
+ * the EEPROM control registers so they take as long as the real thing.
+ */
+
+static uint16_t toAddress(const void *address) {
+  return (uint16_t)(uintptr_t)address;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address) {
+  eeprom_busy_wait();
+  return sim::internal::eepromRead(toAddress(address));
+}
+
+uint16_t eeprom_read_word(const uint16_t *address) {
+  uint16_t low = eeprom_read_byte((const uint8_t *)address);
+  uint16_t high = eeprom_read_byte((const uint8_t *)address + 1);
+  return low | (high << 8);
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+  uint8_t *out = (uint8_t *)dst;
+  const uint8_t *address = (const uint8_t *)src;
+  while (n--) {
+    *out++ = eeprom_read_byte(address++);
+  }
+}
+
+void eeprom_write_byte(uint8_t *address, uint8_t value) {
+  eeprom_busy_wait();
+  EEAR = toAddress(address);
+  EEDR = value;
+  // Erase and write in one operation.
+  EECR &= ~(_BV(EEPM1) | _BV(EEPM0));
+  EECR |= _BV(EEMPE);
+  EECR |= _BV(EEPE);
+  sim::poll();
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value) {
+  if (eeprom_read_byte(address) != value) {
+    eeprom_write_byte(address, value);
+  }
+}
+
+void eeprom_write_block(const void *src, void *dst, size_t n) {
+  const uint8_t *in = (const uint8_t *)src;
+  uint8_t *address = (uint8_t *)dst;
+  while (n--) {
+    eeprom_write_byte(address++, *in++);
+  }
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n) {
+  const uint8_t *in = (const uint8_t *)src;
+  uint8_t *address = (uint8_t *)dst;
+  while (n--) {
+    eeprom_update_byte(address++, *in++);
+  }
+}
@@ -0,0 +1,779 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <string>
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim.h"
+#include "sim_internal.h"
+
+/* The register file. Everything resets to 0 except where the datasheet says
+ * otherwise (see `sim::reset()`).
+ */
+volatile uint8_t SREG;
+volatile uint8_t SMCR;
+volatile uint8_t TCCR0A;
+volatile uint8_t TCCR0B;
+volatile uint8_t TCNT0;
+volatile uint8_t TIMSK0;
+FlagRegister TIFR0;
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint8_t TCCR1C;
+volatile uint16_t TCNT1;
+volatile uint16_t ICR1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+volatile uint16_t OCR1C;
+volatile uint8_t TIMSK1;
+FlagRegister TIFR1;
+volatile uint8_t TCCR3A;
+volatile uint8_t TCCR3B;
+volatile uint8_t TCCR3C;
+volatile uint16_t TCNT3;
+volatile uint16_t ICR3;
+volatile uint16_t OCR3A;
+volatile uint16_t OCR3B;
+volatile uint16_t OCR3C;
+volatile uint8_t TIMSK3;
+FlagRegister TIFR3;
+volatile uint8_t TCCR4A;
+volatile uint8_t TCCR4B;
+volatile uint8_t TCCR4C;
+volatile uint8_t TCCR4D;
+volatile uint8_t TCCR4E;
+volatile uint8_t TC4H;
+Tc4Register TCNT4;
+Tc4Register OCR4A;
+Tc4Register OCR4B;
+Tc4Register OCR4C;
+Tc4Register OCR4D;
+volatile uint8_t TIMSK4;
+FlagRegister TIFR4;
+volatile uint8_t EICRA;
+volatile uint8_t EICRB;
+volatile uint8_t EIMSK;
+FlagRegister EIFR;
+volatile uint8_t ADMUX;
+volatile uint8_t ADCSRA;
+volatile uint8_t ADCSRB;
+volatile uint16_t ADCW;
+volatile uint8_t DIDR0;
+volatile uint8_t DIDR2;
+EepromControlRegister EECR;
+volatile uint8_t EEDR;
+volatile uint16_t EEAR;
+
+/* Interrupt vectors are declared weak, so only the handlers the firmware
+ * actually defines get linked in. The rest resolve to NULL.
+ */
+extern "C" {
+  void INT0_vect(void) __attribute__((weak));
+  void INT1_vect(void) __attribute__((weak));
+  void INT2_vect(void) __attribute__((weak));
+  void INT3_vect(void) __attribute__((weak));
+  void INT6_vect(void) __attribute__((weak));
+  void TIMER1_CAPT_vect(void) __attribute__((weak));
+  void TIMER1_OVF_vect(void) __attribute__((weak));
+  void ADC_vect(void) __attribute__((weak));
+  void EE_READY_vect(void) __attribute__((weak));
+  void TIMER3_CAPT_vect(void) __attribute__((weak));
+  void TIMER3_OVF_vect(void) __attribute__((weak));
+}
+
+typedef void (*Vector)(void);
+
+// The external interrupt handlers, indexed by Arduino interrupt number.
+static const Vector externalVectors[] = {
+  INT0_vect, INT1_vect, INT2_vect, INT3_vect, INT6_vect
+};
+static const uint8_t NUM_EXTERNAL_VECTORS = 5;
+
+static const uint32_t CYCLES_PER_MICROSECOND = F_CPU / 1000000;
+
+// The Arduino core runs Timer0 with a 64x prescaler, overflowing every 1024µs.
+static const uint32_t TIMER0_OVERFLOW_MICROS = 64UL * 256 * 1000000 / F_CPU;
+
+// Programming times from the datasheet (section 5.3.2, table 5-2).
+static const uint32_t EEPROM_ERASE_WRITE_MICROS = 3400;
+static const uint32_t EEPROM_SPLIT_MICROS = 1800;
+
+static uint64_t nowMicros;
+
+// Incremented whenever something would wake the CPU from sleep.
+static uint32_t wakeups;
+
+// Guards against dispatching interrupts from inside an interrupt handler.
+static bool dispatching;
+
+static uint64_t nextTimer0Overflow;
+
+struct TachSignal {
+  uint16_t rpm;
+  bool level;
+  uint64_t nextEdge;
+};
+static TachSignal tach[NUM_DIGITAL_PINS];
+
+struct AttachedFan {
+  uint8_t controlPin;
+  uint8_t tachPin;
+  uint16_t maxRPM;
+  float stallDuty;
+};
+static const uint8_t MAX_ATTACHED_FANS = 5;
+static AttachedFan fans[MAX_ATTACHED_FANS];
+static uint8_t numFans;
+
+/* Timer/Counter1 and Timer/Counter3 count in normal mode (WGM = 0), and
+ * their input capture units timestamp edges on the ICPn pins. The PWM modes
+ * don't need their counters simulated, as only the output duty cycle matters.
+ */
+struct Timer16 {
+  volatile uint8_t &tccrA;
+  volatile uint8_t &tccrB;
+  volatile uint16_t &tcnt;
+  volatile uint16_t &icr;
+  volatile uint8_t &timsk;
+  FlagRegister &tifr;
+  Vector captureVector;
+  Vector overflowVector;
+  // The Arduino pin connected to ICPn.
+  uint8_t capturePin;
+  // The CPU cycle the counter was last brought up to date at.
+  uint64_t lastCycle;
+};
+static Timer16 timers16[] = {
+  // ICP1 is PD4, aka D4
+  {TCCR1A, TCCR1B, TCNT1, ICR1, TIMSK1, TIFR1, TIMER1_CAPT_vect, TIMER1_OVF_vect, 4, 0},
+  // ICP3 is PC7, aka D13
+  {TCCR3A, TCCR3B, TCNT3, ICR3, TIMSK3, TIFR3, TIMER3_CAPT_vect, TIMER3_OVF_vect, 13, 0},
+};
+static const uint8_t NUM_TIMERS16 = 2;
+
+static float analogInputs[14];
+static float internalTemperature;
+// State for the (deterministic) noise added to ADC conversions.
+static uint32_t adcNoiseState;
+
+static bool adcConverting;
+static bool adcFirstConversion;
+static uint64_t adcDone;
+
+static bool eepromWriting;
+static uint64_t eepromDone;
+static uint8_t eepromData[E2END + 1];
+
+static std::deque<uint8_t> serialIn;
+static bool serialCapture;
+static std::string serialOut;
+
+// Map an Arduino interrupt number to its bit in EIMSK and EIFR.
+static uint8_t externalInterruptBit(uint8_t interruptNumber) {
+  return interruptNumber < 4 ? interruptNumber : INT6;
+}
+
+// The ISCn1:ISCn0 sense control bits for an Arduino interrupt number.
+static uint8_t externalSenseControl(uint8_t interruptNumber) {
+  if (interruptNumber < 4) {
+    return (EICRA >> (interruptNumber * 2)) & 0x3;
+  }
+  return (EICRB >> ISC60) & 0x3;
+}
+
+static uint64_t currentCycle() {
+  return nowMicros * CYCLES_PER_MICROSECOND;
+}
+
+static uint8_t timerMode(const Timer16 &timer) {
+  return (timer.tccrA & 0x3) | ((timer.tccrB >> 1) & 0xC);
+}
+
+// The clock prescaler, or 0 if the timer is stopped (or externally clocked).
+static uint16_t timerPrescaler(const Timer16 &timer) {
+  static const uint16_t prescalers[] = {0, 1, 8, 64, 256, 1024, 0, 0};
+  return prescalers[timer.tccrB & 0x7];
+}
+
+/* Bring the counters up to the current time. The register bits are in the
+ * same places for both timers, so Timer/Counter1's names are used for both.
+ */
+static void syncTimers() {
+  uint64_t cycle = currentCycle();
+  for (uint8_t i = 0; i < NUM_TIMERS16; i++) {
+    Timer16 &timer = timers16[i];
+    uint16_t prescaler = timerPrescaler(timer);
+    if (prescaler == 0 || timerMode(timer) != 0) {
+      timer.lastCycle = cycle;
+      continue;
+    }
+    uint64_t ticks = (cycle - timer.lastCycle) / prescaler;
+    timer.lastCycle += ticks * prescaler;
+    uint64_t count = timer.tcnt + ticks;
+    if (count > 0xFFFF) {
+      timer.tifr.value |= _BV(TOV1);
+    }
+    timer.tcnt = count & 0xFFFF;
+  }
+}
+
+static uint64_t nextTimerOverflow() {
+  uint64_t next = UINT64_MAX;
+  uint64_t cycle = currentCycle();
+  for (uint8_t i = 0; i < NUM_TIMERS16; i++) {
+    Timer16 &timer = timers16[i];
+    uint16_t prescaler = timerPrescaler(timer);
+    if (prescaler == 0 || timerMode(timer) != 0) {
+      continue;
+    }
+    uint64_t overflowCycle = timer.lastCycle + (0x10000UL - timer.tcnt) * prescaler;
+    uint64_t overflowMicros = (overflowCycle + CYCLES_PER_MICROSECOND - 1) / CYCLES_PER_MICROSECOND;
+    if (overflowCycle <= cycle) {
+      overflowMicros = nowMicros;
+    }
+    if (overflowMicros < next) {
+      next = overflowMicros;
+    }
+  }
+  return next;
+}
+
+static void captureEdge(uint8_t pin, bool rising) {
+  for (uint8_t i = 0; i < NUM_TIMERS16; i++) {
+    Timer16 &timer = timers16[i];
+    if (timer.capturePin != pin || timerPrescaler(timer) == 0) {
+      continue;
+    }
+    // The modes using ICRn for TOP disable input capture.
+    uint8_t mode = timerMode(timer);
+    if (mode == 8 || mode == 10 || mode == 12 || mode == 14) {
+      continue;
+    }
+    if (rising == (bool)bit_is_set(timer.tccrB, ICES1)) {
+      timer.icr = timer.tcnt;
+      timer.tifr.value |= _BV(ICF1);
+    }
+  }
+}
+
+static void tachEdge(uint8_t pin) {
+  TachSignal &signal = tach[pin];
+  signal.level = !signal.level;
+  captureEdge(pin, signal.level);
+  int8_t interruptNumber = digitalPinToInterrupt(pin);
+  if (interruptNumber == NOT_AN_INTERRUPT) {
+    return;
+  }
+  bool triggered;
+  switch (externalSenseControl(interruptNumber)) {
+    case 0:
+      // Low level; close enough to treat as the falling edge.
+    case 2:
+      triggered = !signal.level;
+      break;
+    case 3:
+      triggered = signal.level;
+      break;
+    default:
+      triggered = true;
+      break;
+  }
+  if (triggered) {
+    EIFR.value |= _BV(externalInterruptBit(interruptNumber));
+  }
+}
+
+static uint16_t adcPrescaler() {
+  uint8_t bits = ADCSRA & (_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0));
+  return bits == 0 ? 2 : 1 << bits;
+}
+
+static uint64_t adcConversionMicros() {
+  // 25 ADC clocks for the first conversion after enabling, 13 after that.
+  uint32_t cycles = adcFirstConversion ? 25 : 13;
+  uint64_t micros = (uint64_t)cycles * adcPrescaler() * 1000000 / F_CPU;
+  return micros > 0 ? micros : 1;
+}
+
+/* Noise on an ADC conversion, in LSBs. The real ADC has a bit under an LSB of
+ * noise; this is a triangular distribution spanning +/-1 LSB from a fixed
+ * seed, so runs stay repeatable.
+ */
+static float adcNoise() {
+  float total = 0;
+  for (uint8_t i = 0; i < 2; i++) {
+    adcNoiseState = adcNoiseState * 1664525UL + 1013904223UL;
+    total += (adcNoiseState >> 8) / (float)(1UL << 24);
+  }
+  return total - 1.0f;
+}
+
+static uint16_t adcSample() {
+  uint8_t mux = (ADMUX & 0x1F) | ((ADCSRB & _BV(MUX5)) ? 0x20 : 0);
+  float reference;
+  switch (ADMUX >> REFS0) {
+    case 3:
+      reference = 2560.0;
+      break;
+    default:
+      // AVcc, and assuming AREF is tied to AVcc.
+      reference = 5000.0;
+      break;
+  }
+  float milliVolts;
+  if (mux == 0x27) {
+    /* The firmware treats the internal sensor's output as Kelvins, so that's
+     * what it gets.
+     */
+    return (uint16_t)lround(internalTemperature + 273.15);
+  } else if (mux <= 0x07) {
+    milliVolts = analogInputs[mux];
+  } else if (mux >= 0x20 && mux <= 0x25) {
+    milliVolts = analogInputs[8 + (mux & 0x7)];
+  } else if (mux == 0x1E) {
+    // Band gap reference
+    milliVolts = 1100.0;
+  } else {
+    // Ground and the (unsimulated) differential channels
+    milliVolts = 0.0;
+  }
+  long value = lround(milliVolts * 1024.0 / reference + adcNoise());
+  return (uint16_t)constrain(value, 0L, 1023L);
+}
+
+// Start any operation the firmware has requested through the registers.
+static void startOperations() {
+  if (ADCSRA & _BV(ADEN)) {
+    if ((ADCSRA & _BV(ADSC)) && !adcConverting) {
+      adcConverting = true;
+      adcDone = nowMicros + adcConversionMicros();
+    }
+  } else {
+    // Disabling the ADC aborts any conversion.
+    adcConverting = false;
+    adcFirstConversion = true;
+    ADCSRA &= ~_BV(ADSC);
+  }
+  if ((EECR & _BV(EEPE)) && !eepromWriting) {
+    eepromWriting = true;
+    uint8_t mode = (EECR >> EEPM0) & 0x3;
+    eepromDone = nowMicros + (mode == 0 ? EEPROM_ERASE_WRITE_MICROS : EEPROM_SPLIT_MICROS);
+    EECR &= ~_BV(EEMPE);
+  }
+}
+
+// Finish anything that is due at the current time.
+static void processEvents() {
+  syncTimers();
+  for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++) {
+    TachSignal &signal = tach[pin];
+    while (signal.rpm != 0 && signal.nextEdge <= nowMicros) {
+      tachEdge(pin);
+      // Four edges per rotation
+      signal.nextEdge += 15000000UL / signal.rpm;
+    }
+  }
+  if (adcConverting && adcDone <= nowMicros) {
+    ADCW = adcSample();
+    ADCSRA |= _BV(ADIF);
+    adcFirstConversion = false;
+    // Only free running mode (ADTS = 0) is simulated for auto triggering.
+    if ((ADCSRA & _BV(ADATE)) && (ADCSRB & 0x0F) == 0) {
+      adcDone = nowMicros + adcConversionMicros();
+    } else {
+      adcConverting = false;
+      ADCSRA &= ~_BV(ADSC);
+    }
+  }
+  if (eepromWriting && eepromDone <= nowMicros) {
+    uint16_t address = EEAR & E2END;
+    switch ((EECR >> EEPM0) & 0x3) {
+      case 0:
+        eepromData[address] = EEDR;
+        break;
+      case 1:
+        eepromData[address] = 0xFF;
+        break;
+      case 2:
+        eepromData[address] &= EEDR;
+        break;
+    }
+    eepromWriting = false;
+    EECR &= ~_BV(EEPE);
+  }
+  while (nextTimer0Overflow <= nowMicros) {
+    nextTimer0Overflow += TIMER0_OVERFLOW_MICROS;
+    wakeups++;
+    // Attached fans follow their PWM signal at the Timer0 tick rate.
+    for (uint8_t i = 0; i < numFans; i++) {
+      float duty = sim::dutyCycle(fans[i].controlPin);
+      uint16_t rpm = duty < fans[i].stallDuty ? 0 : fans[i].maxRPM * duty;
+      sim::setTachRPM(fans[i].tachPin, rpm);
+    }
+  }
+}
+
+static uint64_t nextEventTime() {
+  uint64_t next = nextTimer0Overflow;
+  uint64_t timerOverflow = nextTimerOverflow();
+  if (timerOverflow < next) {
+    next = timerOverflow;
+  }
+  for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++) {
+    if (tach[pin].rpm != 0 && tach[pin].nextEdge < next) {
+      next = tach[pin].nextEdge;
+    }
+  }
+  if (adcConverting && adcDone < next) {
+    next = adcDone;
+  }
+  if (eepromWriting && eepromDone < next) {
+    next = eepromDone;
+  }
+  return next;
+}
+
+/* Find the highest priority pending (and enabled) interrupt, clearing its flag
+ * as the hardware does when the vector is executed.
+ */
+static Vector nextPendingVector() {
+  for (uint8_t i = 0; i < NUM_EXTERNAL_VECTORS; i++) {
+    uint8_t bit = _BV(externalInterruptBit(i));
+    if ((EIFR & bit) && (EIMSK & bit)) {
+      EIFR.value &= ~bit;
+      if (externalVectors[i] != NULL) {
+        return externalVectors[i];
+      }
+    }
+  }
+  Timer16 &timer1 = timers16[0];
+  if ((timer1.tifr & _BV(ICF1)) && (timer1.timsk & _BV(ICIE1))) {
+    timer1.tifr.value &= ~_BV(ICF1);
+    if (timer1.captureVector != NULL) {
+      return timer1.captureVector;
+    }
+  }
+  if ((timer1.tifr & _BV(TOV1)) && (timer1.timsk & _BV(TOIE1))) {
+    timer1.tifr.value &= ~_BV(TOV1);
+    if (timer1.overflowVector != NULL) {
+      return timer1.overflowVector;
+    }
+  }
+  if ((ADCSRA & _BV(ADIF)) && (ADCSRA & _BV(ADIE))) {
+    ADCSRA &= ~_BV(ADIF);
+    if (ADC_vect != NULL) {
+      return ADC_vect;
+    }
+  }
+  // EE_READY is level triggered, firing for as long as the EEPROM is ready.
+  if ((EECR & _BV(EERIE)) && !(EECR & _BV(EEPE)) && EE_READY_vect != NULL) {
+    return EE_READY_vect;
+  }
+  Timer16 &timer3 = timers16[1];
+  if ((timer3.tifr & _BV(ICF3)) && (timer3.timsk & _BV(ICIE3))) {
+    timer3.tifr.value &= ~_BV(ICF3);
+    if (timer3.captureVector != NULL) {
+      return timer3.captureVector;
+    }
+  }
+  if ((timer3.tifr & _BV(TOV3)) && (timer3.timsk & _BV(TOIE3))) {
+    timer3.tifr.value &= ~_BV(TOV3);
+    if (timer3.overflowVector != NULL) {
+      return timer3.overflowVector;
+    }
+  }
+  return NULL;
+}
+
+static void dispatch() {
+  if (dispatching) {
+    return;
+  }
+  dispatching = true;
+  while (SREG & _BV(SREG_I)) {
+    Vector vector = nextPendingVector();
+    if (vector == NULL) {
+      break;
+    }
+    // The I bit is cleared while a handler runs, and restored by RETI.
+    SREG &= ~_BV(SREG_I);
+    vector();
+    SREG |= _BV(SREG_I);
+    wakeups++;
+    startOperations();
+  }
+  dispatching = false;
+}
+
+namespace sim {
+  void reset() {
+    nowMicros = 0;
+    wakeups = 0;
+    dispatching = false;
+    nextTimer0Overflow = TIMER0_OVERFLOW_MICROS;
+    // The Arduino core enables interrupts before `setup()` is called.
+    SREG = _BV(SREG_I);
+    SMCR = 0;
+    TCCR0A = TCCR0B = TCNT0 = TIMSK0 = 0;
+    TCCR1A = TCCR1B = TCCR1C = TIMSK1 = 0;
+    TCNT1 = ICR1 = OCR1A = OCR1B = OCR1C = 0;
+    TCCR3A = TCCR3B = TCCR3C = TIMSK3 = 0;
+    TCNT3 = ICR3 = OCR3A = OCR3B = OCR3C = 0;
+    TCCR4A = TCCR4B = TCCR4C = TCCR4D = TCCR4E = TC4H = TIMSK4 = 0;
+    TIFR0.value = TIFR1.value = TIFR3.value = TIFR4.value = EIFR.value = 0;
+    TCNT4.value = OCR4A.value = OCR4B.value = OCR4D.value = 0;
+    // OCR4C holds TOP for Timer/Counter4 and resets to 0x3FF.
+    OCR4C.value = 0x3FF;
+    EICRA = EICRB = EIMSK = 0;
+    ADMUX = ADCSRA = ADCSRB = DIDR0 = DIDR2 = 0;
+    ADCW = 0;
+    EECR = EEDR = 0;
+    EEAR = 0;
+    for (uint8_t i = 0; i < NUM_TIMERS16; i++) {
+      timers16[i].lastCycle = 0;
+    }
+    memset(tach, 0, sizeof(tach));
+    numFans = 0;
+    memset(analogInputs, 0, sizeof(analogInputs));
+    internalTemperature = 25.0;
+    adcNoiseState = 1;
+    adcConverting = false;
+    adcFirstConversion = true;
+    eepromWriting = false;
+    // Erased EEPROM reads as all ones.
+    memset(eepromData, 0xFF, sizeof(eepromData));
+    serialIn.clear();
+    serialOut.clear();
+    internal::resetPins();
+  }
+
+  uint64_t now() {
+    return nowMicros;
+  }
+
+  void advance(uint32_t micros) {
+    uint64_t target = nowMicros + micros;
+    startOperations();
+    dispatch();
+    uint64_t next = nextEventTime();
+    while (next <= target) {
+      nowMicros = next;
+      processEvents();
+      startOperations();
+      dispatch();
+      next = nextEventTime();
+    }
+    nowMicros = target;
+    syncTimers();
+  }
+
+  void poll() {
+    startOperations();
+    processEvents();
+    dispatch();
+  }
+
+  void idle() {
+    startOperations();
+    dispatch();
+    uint64_t next = nextEventTime();
+    if (next > nowMicros) {
+      nowMicros = next;
+    }
+    processEvents();
+    startOperations();
+    dispatch();
+  }
+
+  void setTachRPM(uint8_t pin, uint16_t rpm) {
+    if (pin >= NUM_DIGITAL_PINS) {
+      return;
+    }
+    TachSignal &signal = tach[pin];
+    if (signal.rpm == 0 && rpm != 0) {
+      signal.nextEdge = nowMicros + 15000000UL / rpm;
+    }
+    signal.rpm = rpm;
+  }
+
+  void attachFan(
+    uint8_t controlPin,
+    uint8_t tachPin,
+    uint16_t maxRPM,
+    float stallDuty
+  ) {
+    if (numFans < MAX_ATTACHED_FANS) {
+      fans[numFans++] = {controlPin, tachPin, maxRPM, stallDuty};
+    }
+  }
+
+  void setAnalogInput(uint8_t channel, float milliVolts) {
+    if (channel < sizeof(analogInputs) / sizeof(analogInputs[0])) {
+      analogInputs[channel] = milliVolts;
+    }
+  }
+
+  void setInternalTemperature(float celsius) {
+    internalTemperature = celsius;
+  }
+
+  float dutyCycle(uint8_t pin) {
+    uint8_t timer = digitalPinToTimer(pin);
+    uint16_t top;
+    uint16_t compare;
+    uint8_t outputMode;
+    switch (timer) {
+      case TIMER1A:
+      case TIMER1B:
+      case TIMER1C:
+      case TIMER3A:
+      case TIMER3B:
+      case TIMER3C: {
+        bool isTimer1 = timer <= TIMER1C;
+        uint8_t tccrA = isTimer1 ? TCCR1A : TCCR3A;
+        uint8_t tccrB = isTimer1 ? TCCR1B : TCCR3B;
+        uint8_t channel = timer - (isTimer1 ? TIMER1A : TIMER3A);
+        uint8_t wgm = (tccrA & 0x3) | ((tccrB >> 1) & 0xC);
+        switch (wgm) {
+          case 1:
+          case 5:
+            top = 0xFF;
+            break;
+          case 2:
+          case 6:
+            top = 0x1FF;
+            break;
+          case 3:
+          case 7:
+            top = 0x3FF;
+            break;
+          case 8:
+          case 10:
+          case 14:
+            top = isTimer1 ? ICR1 : ICR3;
+            break;
+          case 9:
+          case 11:
+          case 15:
+            top = isTimer1 ? OCR1A : OCR3A;
+            break;
+          default:
+            // Not a PWM mode.
+            return 0.0;
+        }
+        const volatile uint16_t *compareRegisters[] = {
+          isTimer1 ? &OCR1A : &OCR3A,
+          isTimer1 ? &OCR1B : &OCR3B,
+          isTimer1 ? &OCR1C : &OCR3C,
+        };
+        compare = *compareRegisters[channel];
+        outputMode = (tccrA >> (6 - channel * 2)) & 0x3;
+        break;
+      }
+      case TIMER4A:
+        if (!(TCCR4A & _BV(PWM4A))) {
+          return 0.0;
+        }
+        top = OCR4C.value;
+        compare = OCR4A.value;
+        outputMode = (TCCR4A >> COM4A0) & 0x3;
+        break;
+      case TIMER4B:
+        if (!(TCCR4A & _BV(PWM4B))) {
+          return 0.0;
+        }
+        top = OCR4C.value;
+        compare = OCR4B.value;
+        outputMode = (TCCR4A >> COM4B0) & 0x3;
+        break;
+      case TIMER4D:
+        if (!(TCCR4C & _BV(PWM4D))) {
+          return 0.0;
+        }
+        top = OCR4C.value;
+        compare = OCR4D.value;
+        outputMode = (TCCR4C >> COM4D0) & 0x3;
+        break;
+      default:
+        return 0.0;
+    }
+    if (top == 0 || outputMode < 2) {
+      // The output compare pin is disconnected (or toggling).
+      return 0.0;
+    }
+    float duty = compare >= top ? 1.0 : (float)compare / top;
+    // COMnx1:COMnx0 = 3 is inverting mode.
+    return outputMode == 3 ? 1.0 - duty : duty;
+  }
+
+  void serialInput(const char *text) {
+    serialInput((const uint8_t *)text, strlen(text));
+  }
+
+  void serialInput(const uint8_t *data, size_t length) {
+    serialIn.insert(serialIn.end(), data, data + length);
+  }
+
+  void captureSerial(bool capture) {
+    serialCapture = capture;
+  }
+
+  size_t takeSerialOutput(char *buffer, size_t size) {
+    if (size == 0) {
+      return 0;
+    }
+    size_t length = serialOut.copy(buffer, size - 1);
+    buffer[length] = '\0';
+    serialOut.erase(0, length);
+    return length;
+  }
+
+  uint8_t * eeprom() {
+    return eepromData;
+  }
+
+  size_t eepromSize() {
+    return sizeof(eepromData);
+  }
+
+  namespace internal {
+    int serialAvailable() {
+      return serialIn.size();
+    }
+
+    int serialRead() {
+      if (serialIn.empty()) {
+        return -1;
+      }
+      uint8_t c = serialIn.front();
+      serialIn.pop_front();
+      return c;
+    }
+
+    int serialPeek() {
+      return serialIn.empty() ? -1 : serialIn.front();
+    }
+
+    void serialWrite(const uint8_t *data, size_t length) {
+      if (serialCapture) {
+        serialOut.append((const char *)data, length);
+      } else {
+        fwrite(data, 1, length, stdout);
+      }
+    }
+
+    uint8_t eepromRead(uint16_t address) {
+      return eepromData[address & E2END];
+    }
+
+    void sleep() {
+      uint32_t startWakeups = wakeups;
+      do {
+        idle();
+      } while (wakeups == startWakeups);
+    }
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef FAN_HOST_SIM_INTERNAL_H
+#define FAN_HOST_SIM_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Pieces of the simulator shared between the host backend's translation units,
+ * but not part of the API offered to firmware or test harnesses.
+ */
+namespace sim {
+  namespace internal {
+    // Serial port plumbing for `Serial_`.
+    int serialAvailable();
+    int serialRead();
+    int serialPeek();
+    void serialWrite(const uint8_t *data, size_t length);
+
+    // Direct EEPROM array access for the avr-libc EEPROM functions.
+    uint8_t eepromRead(uint16_t address);
+
+    /* Sleep until an interrupt is dispatched, or until the next Timer0 overflow
+     * (which the Arduino core always has enabled).
+     */
+    void sleep();
+
+    // Reset hooks for the parts of the backend that keep their own state.
+    void resetPins();
+  }
+}
+
+#endif
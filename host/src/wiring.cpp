@@ -0,0 +1,110 @@
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include "sim.h"
+#include "sim_internal.h"
+
+// The same pin tables as the Arduino core's Leonardo variant.
+static const uint8_t digitalPinTimers[NUM_DIGITAL_PINS] = {
+  NOT_ON_TIMER, // D0 - PD2
+  NOT_ON_TIMER, // D1 - PD3
+  NOT_ON_TIMER, // D2 - PD1
+  TIMER0B,      // D3 - PD0
+  NOT_ON_TIMER, // D4 - PD4
+  TIMER3A,      // D5 - PC6
+  TIMER4D,      // D6 - PD7
+  NOT_ON_TIMER, // D7 - PE6
+  NOT_ON_TIMER, // D8 - PB4
+  TIMER1A,      // D9 - PB5
+  TIMER1B,      // D10 - PB6
+  TIMER0A,      // D11 - PB7
+  NOT_ON_TIMER, // D12 - PD6
+  TIMER4A,      // D13 - PC7
+};
+
+static const uint8_t analogPinChannels[NUM_ANALOG_INPUTS] = {
+  7, 6, 5, 4, 1, 0, 8, 10, 11, 12, 13, 9
+};
+
+static uint8_t pinModes[NUM_DIGITAL_PINS];
+static uint8_t pinLevels[NUM_DIGITAL_PINS];
+
+uint8_t digitalPinToTimer(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return NOT_ON_TIMER;
+  }
+  return digitalPinTimers[pin];
+}
+
+int8_t digitalPinToInterrupt(uint8_t pin) {
+  switch (pin) {
+    case 0:
+      return 2;
+    case 1:
+      return 3;
+    case 2:
+      return 1;
+    case 3:
+      return 0;
+    case 7:
+      return 4;
+    default:
+      return NOT_AN_INTERRUPT;
+  }
+}
+
+uint8_t analogPinToChannel(uint8_t pin) {
+  if (pin >= NUM_ANALOG_INPUTS) {
+    return 0;
+  }
+  return analogPinChannels[pin];
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < NUM_DIGITAL_PINS) {
+    pinModes[pin] = mode;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < NUM_DIGITAL_PINS) {
+    pinLevels[pin] = value ? HIGH : LOW;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return LOW;
+  }
+  return pinLevels[pin];
+}
+
+unsigned long millis(void) {
+  return sim::now() / 1000;
+}
+
+unsigned long micros(void) {
+  return sim::now();
+}
+
+void delay(unsigned long ms) {
+  sim::advance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::advance(us);
+}
+
+void sleep_cpu(void) {
+  if (SMCR & _BV(SE)) {
+    sim::internal::sleep();
+  }
+}
+
+namespace sim {
+  namespace internal {
+    void resetPins() {
+      memset(pinModes, 0, sizeof(pinModes));
+      memset(pinLevels, 0, sizeof(pinLevels));
+    }
+  }
+}
@@ -0,0 +1,167 @@
+#include <math.h>
+#include "TelemetryDecoder.h"
+#include "TelemetryRecord.h"
+
+namespace telemetry {
+  // Little-endian field readers, so the decoder doesn't depend on host order.
+  static uint16_t readU16(const uint8_t *data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+  }
+
+  static uint32_t readU32(const uint8_t *data) {
+    return (
+      (uint32_t)data[0] |
+      ((uint32_t)data[1] << 8) |
+      ((uint32_t)data[2] << 16) |
+      ((uint32_t)data[3] << 24)
+    );
+  }
+
+  static double fromTerm(const uint8_t *data) {
+    return (int32_t)readU32(data) /
+      (double)(1L << TELEMETRY_TERM_FRACTIONAL_BITS);
+  }
+
+  long cobsDecode(const uint8_t *input, size_t length, uint8_t *output) {
+    size_t inputIndex = 0;
+    size_t outputIndex = 0;
+    while (inputIndex < length) {
+      uint8_t code = input[inputIndex++];
+      if (code == 0 || inputIndex + code - 1 > length) {
+        return -1;
+      }
+      for (uint8_t i = 1; i < code; i++) {
+        output[outputIndex++] = input[inputIndex++];
+      }
+      /* A full block (0xFF) isn't followed by a zero, and neither is the last
+       * block.
+       */
+      if (code != 0xFF && inputIndex < length) {
+        output[outputIndex++] = 0;
+      }
+    }
+    return (long)outputIndex;
+  }
+
+  uint16_t crc(const uint8_t *data, size_t length) {
+    uint16_t crc = TELEMETRY_CRC_INITIAL;
+    for (size_t i = 0; i < length; i++) {
+      uint8_t next = data[i] ^ (crc & 0xFF);
+      next ^= next << 4;
+      crc = (
+        (((uint16_t)next << 8) | (crc >> 8)) ^
+        (uint8_t)(next >> 4) ^
+        ((uint16_t)next << 3)
+      );
+    }
+    return crc;
+  }
+
+  Decoder::Decoder():
+    length(0),
+    overflowed(false),
+    synchronized(false),
+    haveSequence(false),
+    lastSequence(0),
+    records(0),
+    crcErrors(0),
+    malformed(0),
+    lost(0)
+  {}
+
+  bool Decoder::feed(uint8_t byte, Sample *sample) {
+    if (byte != 0) {
+      if (length < MAX_FRAME) {
+        frame[length++] = byte;
+      } else {
+        overflowed = true;
+      }
+      return false;
+    }
+    bool decoded = false;
+    if (!synchronized) {
+      synchronized = true;
+    } else if (overflowed) {
+      malformed++;
+    } else if (length > 0) {
+      decoded = decodeFrame(sample);
+    }
+    length = 0;
+    overflowed = false;
+    return decoded;
+  }
+
+  bool Decoder::decodeFrame(Sample *sample) {
+    uint8_t decoded[MAX_FRAME];
+    long decodedLength = cobsDecode(frame, length, decoded);
+    const size_t expected = sizeof(telemetryRecord) + TELEMETRY_CRC_SIZE;
+    if (decodedLength != (long)expected) {
+      malformed++;
+      return false;
+    }
+    const size_t size = sizeof(telemetryRecord);
+    if (crc(decoded, size) != readU16(decoded + size)) {
+      crcErrors++;
+      return false;
+    }
+    uint8_t version = decoded[offsetof(telemetryRecord, version)];
+    if (version != TELEMETRY_RECORD_VERSION) {
+      malformed++;
+      return false;
+    }
+    sample->sequence = decoded[offsetof(telemetryRecord, sequence)];
+    sample->millis = readU32(decoded + offsetof(telemetryRecord, millis));
+    const int16_t temperature = (int16_t)readU16(
+      decoded + offsetof(telemetryRecord, temperature)
+    );
+    sample->temperature = temperature == TELEMETRY_NO_TEMPERATURE ?
+      NAN : temperature / (double)TELEMETRY_TEMPERATURE_SCALE;
+    sample->duty = readU16(
+      decoded + offsetof(telemetryRecord, duty)
+    ) / (double)TELEMETRY_DUTY_SCALE;
+    sample->rpm = readU16(decoded + offsetof(telemetryRecord, rpm));
+    sample->proportional = fromTerm(
+      decoded + offsetof(telemetryRecord, proportional)
+    );
+    sample->integral = fromTerm(decoded + offsetof(telemetryRecord, integral));
+    sample->derivative = fromTerm(
+      decoded + offsetof(telemetryRecord, derivative)
+    );
+    if (haveSequence) {
+      lost += (uint8_t)(sample->sequence - lastSequence - 1);
+    }
+    haveSequence = true;
+    lastSequence = sample->sequence;
+    records++;
+    return true;
+  }
+
+  void writeCsvHeader(FILE *output) {
+    fprintf(
+      output,
+      "sequence,millis,temperature,duty,rpm,proportional,integral,derivative\n"
+    );
+  }
+
+  void writeCsvRow(FILE *output, const Sample &sample) {
+    fprintf(
+      output,
+      "%u,%lu,",
+      (unsigned)sample.sequence,
+      (unsigned long)sample.millis
+    );
+    // A missing temperature is left empty.
+    if (!isnan(sample.temperature)) {
+      fprintf(output, "%.2f", sample.temperature);
+    }
+    fprintf(
+      output,
+      ",%.4f,%u,%.5f,%.5f,%.5f\n",
+      sample.duty,
+      (unsigned)sample.rpm,
+      sample.proportional,
+      sample.integral,
+      sample.derivative
+    );
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef FAN_HOST_TELEMETRY_DECODER_H
+#define FAN_HOST_TELEMETRY_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Decodes the firmware's binary telemetry stream (see
+ * CabinetFan/TelemetryRecord.h) on the host.
+ *
+ * The stream is a series of COBS encoded frames, each ended by a zero byte.
+ * Anything else on the serial port (menu text, for example) just turns into
+ * frames that fail to decode, and are counted and skipped.
+ */
+namespace telemetry {
+  // One telemetry record, converted to natural units.
+  struct Sample {
+    uint8_t sequence;
+    uint32_t millis;
+    // Degrees Celsius, or NaN if there wasn't a reading yet.
+    double temperature;
+    // Fan duty cycle, from 0 to 1.
+    double duty;
+    uint16_t rpm;
+    // The controller's terms, in fan speed (0 to 1) units.
+    double proportional;
+    double integral;
+    double derivative;
+  };
+
+  /* Decode `length` COBS encoded bytes (without the zero delimiter) into
+   * `output`, which needs room for `length` bytes. Returns the decoded length,
+   * or -1 if the input isn't valid COBS.
+   */
+  long cobsDecode(const uint8_t *input, size_t length, uint8_t *output);
+
+  // CRC16 (CCITT), the same as avr-libc's `_crc_ccitt_update` from 0xFFFF.
+  uint16_t crc(const uint8_t *data, size_t length);
+
+  class Decoder {
+    public:
+      Decoder();
+
+      /* Add one byte of the stream. Returns true when it completed a valid
+       * record, which is stored in `sample`.
+       */
+      bool feed(uint8_t byte, Sample *sample);
+
+      // Records decoded successfully.
+      unsigned long getRecords() const { return records; }
+
+      // Frames that decoded, but failed the CRC check.
+      unsigned long getCrcErrors() const { return crcErrors; }
+
+      /* Frames that weren't valid COBS, were the wrong size, or had an unknown
+       * record version.
+       */
+      unsigned long getMalformed() const { return malformed; }
+
+      // Records missing from the sequence numbers (dropped by the firmware).
+      unsigned long getLost() const { return lost; }
+
+    private:
+      // Longer frames than this can't be telemetry, so are thrown away.
+      static const size_t MAX_FRAME = 255;
+
+      uint8_t frame[MAX_FRAME];
+      size_t length;
+      // Set when the current frame is too long.
+      bool overflowed;
+      // Bytes before the first delimiter are the tail of something else.
+      bool synchronized;
+
+      bool haveSequence;
+      uint8_t lastSequence;
+
+      unsigned long records;
+      unsigned long crcErrors;
+      unsigned long malformed;
+      unsigned long lost;
+
+      bool decodeFrame(Sample *sample);
+  };
+
+  // Write the CSV header line for `writeCsvRow()`.
+  void writeCsvHeader(FILE *output);
+  void writeCsvRow(FILE *output, const Sample &sample);
+}
+#endif
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include "TelemetryDecoder.h"
+
+/* Converts a binary telemetry stream from the firmware (the `t` menu command)
+ * to CSV.
+ *
+ * Usage: cabinetfan_telemetry2csv [file]
+ *
+ * Reads the stream from `file` (or standard input) and writes one CSV row per
+ * record to standard output. A summary of any bad frames and lost records is
+ * written to standard error at the end.
+ */
+int main(int argc, char **argv) {
+  FILE *input = stdin;
+  if (argc > 1) {
+    input = fopen(argv[1], "rb");
+    if (input == NULL) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+  telemetry::Decoder decoder;
+  telemetry::Sample sample;
+  telemetry::writeCsvHeader(stdout);
+  int next;
+  while ((next = fgetc(input)) != EOF) {
+    if (decoder.feed((uint8_t)next, &sample)) {
+      telemetry::writeCsvRow(stdout, sample);
+    }
+  }
+  if (input != stdin) {
+    fclose(input);
+  }
+  fprintf(
+    stderr,
+    "%lu records, %lu lost, %lu CRC errors, %lu malformed frames\n",
+    decoder.getRecords(),
+    decoder.getLost(),
+    decoder.getCrcErrors(),
+    decoder.getMalformed()
+  );
+  return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef FAN_HOST_CHECK_H
+#define FAN_HOST_CHECK_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Just enough of a test harness for the host tests: each failed check prints
+ * where it was and what it got, and `checkResult()` is the exit status.
+ */
+static unsigned checkFailures = 0;
+
+#define CHECK_REPORT(ok, format, ...) do { \
+  if (!(ok)) { \
+    checkFailures++; \
+    fprintf(stderr, "%s:%d: " format "\n", __FILE__, __LINE__, __VA_ARGS__); \
+  } \
+} while (0)
+
+#define CHECK(condition) \
+  CHECK_REPORT((condition), "%s is false", #condition)
+
+#define CHECK_EQUAL(actual, expected) do { \
+  double actualValue = (actual); \
+  double expectedValue = (expected); \
+  CHECK_REPORT( \
+    actualValue == expectedValue, \
+    "%s is %g, not %g", \
+    #actual, \
+    actualValue, \
+    expectedValue \
+  ); \
+} while (0)
+
+#define CHECK_CLOSE(actual, expected, tolerance) do { \
+  double actualValue = (actual); \
+  double expectedValue = (expected); \
+  CHECK_REPORT( \
+    fabs(actualValue - expectedValue) <= (tolerance), \
+    "%s is %g, not %g +/- %g", \
+    #actual, \
+    actualValue, \
+    expectedValue, \
+    (double)(tolerance) \
+  ); \
+} while (0)
+
+#define CHECK_STRING(actual, expected) do { \
+  const char *actualValue = (actual); \
+  const char *expectedValue = (expected); \
+  CHECK_REPORT( \
+    strcmp(actualValue, expectedValue) == 0, \
+    "%s is \"%s\", not \"%s\"", \
+    #actual, \
+    actualValue, \
+    expectedValue \
+  ); \
+} while (0)
+
+static inline int checkResult() {
+  if (checkFailures != 0) {
+    fprintf(stderr, "%u checks failed\n", checkFailures);
+    return 1;
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#include <math.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include "AutoTuner.h"
+#include "Fan.h"
+#include "FanArray.h"
+#include "Menu.h"
+#include "PIDFanController.h"
+#include "ThermometerBank.h"
+#include "sim.h"
+#include "check.h"
+
+/* Relay auto-tuning against the first order cabinet from simulator.cpp: it
+ * settles `HEAT_RISE` degrees above ambient with the fans stopped, and
+ * proportionally less the more air is moving through it.
+ */
+static const float AMBIENT = 25.0;
+static const float HEAT_RISE = 20.0;
+static const float COOLING = 3.0;
+static const float TIME_CONSTANT = 120.0;
+
+static FanArray fans;
+static ThermometerBank thermometers;
+static FilteredThermometer< PassThroughFilter<uint16_t> > cabinet(A11);
+
+// Output voltage of a TMP36 at a given temperature.
+static float tmp36MilliVolts(float celsius) {
+  return 500.0 + celsius * 10.0;
+}
+
+// Feed the thermometer the (oversampled) ADC counts for `celsius`.
+static void setTemperature(float celsius) {
+  cabinet.addSample(lround(tmp36MilliVolts(celsius) * 1023.0 / 2560.0 * 4.0));
+}
+
+// Step the cabinet `seconds` forward, at the fans' current speed.
+static void step(float *temperature, float seconds) {
+  const float target = AMBIENT + HEAT_RISE / (1.0 + COOLING * fans.getSpeed());
+  *temperature += (target - *temperature) * seconds / TIME_CONSTANT;
+}
+
+/* Run the tuner until it stops, or `hours` have passed. Returns the
+ * temperature the cabinet ends up at.
+ */
+static float tune(AutoTuner *tuner, float setPoint, float hours) {
+  float temperature = AMBIENT;
+  const unsigned long start = millis();
+  tuner->start(ALL_FANS, setPoint);
+  for (unsigned long now = start;
+       tuner->isRunning() && now - start < hours * 3600000UL;
+       now += AUTO_TUNER_PERIOD) {
+    step(&temperature, AUTO_TUNER_PERIOD / 1000.0);
+    setTemperature(temperature);
+    tuner->periodic(now);
+  }
+  return temperature;
+}
+
+// The steady temperature at a fan speed.
+static float settled(float speed) {
+  return AMBIENT + HEAT_RISE / (1.0 + COOLING * speed);
+}
+
+/* The period of the oscillation, in seconds, if the temperature was watched
+ * continuously: it heats from one side of the hysteresis band to the other
+ * heading for where it'd settle at the low speed, then cools back, heading
+ * for where it'd settle at the high speed. (The speeds are AutoTuner.cpp's.)
+ */
+static float relayPeriod(float setPoint) {
+  const float hysteresis = 0.2;
+  const float hot = settled(0.2);
+  const float cold = settled(1.0);
+  const float low = setPoint - hysteresis;
+  const float high = setPoint + hysteresis;
+  return TIME_CONSTANT * (
+    log((hot - low) / (hot - high)) + log((high - cold) / (low - cold))
+  );
+}
+
+/* Closing the loop with the tuned gains, the cabinet is brought to the set
+ * point from ambient, and held there.
+ */
+static void checkGains(const AutoTuneGains &gains, float setPoint) {
+  fans.setSpeed(0.5);
+  BasicPIDFanController<float> controller(
+    &fans,
+    ALL_FANS,
+    &thermometers,
+    F("Test"),
+    setPoint,
+    gains.k_p,
+    gains.k_i,
+    gains.k_d,
+    gains.period
+  );
+  float temperature = AMBIENT;
+  float lowest = HEAT_RISE + AMBIENT;
+  float highest = AMBIENT;
+  for (unsigned long now = 0; now < 3600000UL; now += gains.period) {
+    step(&temperature, gains.period / 1000.0);
+    setTemperature(temperature);
+    controller.periodic(now);
+    if (now > 1800000UL) {
+      lowest = min(lowest, temperature);
+      highest = max(highest, temperature);
+    }
+  }
+  // Settled for the second half hour, not oscillating.
+  CHECK_CLOSE(lowest, setPoint, 0.2);
+  CHECK_CLOSE(highest, setPoint, 0.2);
+}
+
+static void testFinishes(float setPoint) {
+  AutoTuner tuner(&fans, &thermometers);
+  tune(&tuner, setPoint, 2.0);
+  CHECK_EQUAL(tuner.getState(), autoTuneFinished);
+  CHECK(!tuner.isRunning());
+  CHECK_EQUAL(tuner.getCycles(), 4);
+  // Sampling once a second only makes the swings a little longer.
+  const float period = tuner.getUltimatePeriod() / 1000.0;
+  CHECK(period >= relayPeriod(setPoint));
+  CHECK(period < relayPeriod(setPoint) + 2 * AUTO_TUNER_PERIOD / 1000.0);
+  CHECK(tuner.getUltimateGain() > 0.1);
+  CHECK(tuner.getUltimateGain() < 10.0);
+
+  AutoTuneGains gains = tuner.getGains();
+  CHECK(gains.k_p > 0.0);
+  CHECK_EQUAL(gains.k_i, 0.0);
+  CHECK(gains.k_d > gains.k_p);
+  CHECK(gains.period >= THERMOMETER_UPDATE_PERIOD);
+  CHECK(gains.period <= tuner.getUltimatePeriod() / 4);
+  checkGains(gains, setPoint);
+}
+
+// A set point the relay speeds can't get either side of gives up.
+static void testUnreachable() {
+  AutoTuner tuner(&fans, &thermometers);
+  tune(&tuner, settled(1.0) - 1.0, 2.0);
+  CHECK_EQUAL(tuner.getState(), autoTuneFailed);
+  // And leaves the fans at full speed.
+  CHECK_EQUAL(fans.getSpeed(), 1.0);
+}
+
+static char output[4096];
+
+// Run the menu for a while, returning what it printed.
+static const char * run(Menu *menu, unsigned long millis) {
+  const uint64_t end = sim::now() + millis * 1000ULL;
+  while (sim::now() < end) {
+    menu->control();
+  }
+  const size_t length = sim::takeSerialOutput(output, sizeof(output) - 1);
+  output[length] = '\0';
+  return output;
+}
+
+/* Cancelling from the menu puts the controller back in the scheduler, and it
+ * takes the fans back from the relay.
+ */
+static void testCancel() {
+  sim::setAnalogInput(9, tmp36MilliVolts(AMBIENT));
+  static Menu menu(&fans, &thermometers, &Serial);
+  run(&menu, 100);
+  // A constant speed to tell the controller from the relay.
+  sim::serialInput("c constant\ne 0.5\n");
+  run(&menu, 2000);
+  CHECK_EQUAL(fans.getSpeed(), 0.5);
+  // The cabinet's below the set point, so the relay heats it up.
+  sim::serialInput("a\n");
+  CHECK(strstr(run(&menu, 3000), "Auto-tuning the PID controller") != NULL);
+  CHECK_CLOSE(fans.getSpeed(), 0.2, 0.001);
+  sim::serialInput("a\n");
+  CHECK(strstr(run(&menu, 3000), "Auto-tuning cancelled.") != NULL);
+  CHECK_EQUAL(fans.getSpeed(), 0.5);
+  // The auto-tuner isn't running any more, to switch the relay back.
+  run(&menu, 10000);
+  CHECK_EQUAL(fans.getSpeed(), 0.5);
+}
+
+int main() {
+  sim::reset();
+  sim::captureSerial(true);
+  static Fan fan(9, 1500);
+  fans.add(&fan);
+  thermometers.add(&cabinet);
+  testFinishes(33.0);
+  testFinishes(35.0);
+  testUnreachable();
+  testCancel();
+  return checkResult();
+}
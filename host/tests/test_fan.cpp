@@ -0,0 +1,92 @@
+#include <Arduino.h>
+#include "Fan.h"
+#include "sim.h"
+#include "check.h"
+
+/* A fan on the simulated board, driven the way the scheduler would. */
+
+// Pins, matching CabinetFan.ino
+static const uint8_t CONTROL_PIN = 9;
+static const uint8_t TACH_PIN = 0;
+
+static void run(Fan *fan, unsigned long milliseconds) {
+  const unsigned long end = millis() + milliseconds;
+  while (millis() < end) {
+    sim::advance(fan->getPeriod() * 1000);
+    fan->periodic(millis());
+  }
+}
+
+/* A fan that's jammed when it's calibrated has to be caught as stalled, even
+ * though there's no maximum speed to compare it to.
+ */
+static void testJammedAtCalibration(Fan *fan) {
+  run(fan, 5000);
+  CHECK(!fan->isCalibrating());
+  CHECK(fan->hasCalibrationFault());
+  CHECK_EQUAL(fan->getMaxRPM(), 0);
+  run(fan, 5000);
+  CHECK(fan->isStalled());
+  CHECK_EQUAL(fan->getStallCount(), 1);
+  // Still jammed, so each restart fails.
+  run(fan, 20000);
+  CHECK(fan->isStalled());
+  CHECK(fan->getFailedRestartCount() > 0);
+
+  // Once it's free, a restart gets it going, and it has a maximum again.
+  sim::attachFan(CONTROL_PIN, TACH_PIN, 1500);
+  run(fan, 60000);
+  CHECK(!fan->isStalled());
+  CHECK(fan->getMaxRPM() > 1000);
+  // Calibrating again clears the fault.
+  fan->calibrate();
+  run(fan, 5000);
+  CHECK(!fan->hasCalibrationFault());
+  CHECK_CLOSE(fan->getMaxRPM(), 1500, 50);
+}
+
+/* Timer/Counters 1 and 3 can generate PWM or time a tachometer, but not both,
+ * so the second fan asking for one is refused. Timer/Counter1 is already
+ * generating PWM for the fan on pin 9.
+ */
+static void testTimerConflicts() {
+  // ICP1 is on Timer/Counter1.
+  static Fan captureConflict(10, (uint8_t)4);
+  CHECK_EQUAL(captureConflict.getSetupError(), captureTimerInUse);
+  CHECK(sim::dutyCycle(9) > 0);
+
+  // Timing a tachometer with ICP3 claims Timer/Counter3...
+  static Fan captureFan(6, (uint8_t)13);
+  CHECK_EQUAL(captureFan.getSetupError(), fanSetupOK);
+  CHECK_EQUAL(TCCR3A, 0);
+  const uint8_t captureTCCR3B = TCCR3B;
+  // ...so it can't generate PWM on pin 5 as well.
+  static Fan pwmConflict(5, 1500);
+  CHECK_EQUAL(pwmConflict.getSetupError(), pwmTimerInUse);
+  CHECK_EQUAL(TCCR3A, 0);
+  CHECK_EQUAL(TCCR3B, captureTCCR3B);
+  // Setting its speed leaves the timer's registers alone too.
+  const uint16_t captureOCR3A = OCR3A;
+  pwmConflict.setSpeed(0.5);
+  CHECK_EQUAL(OCR3A, captureOCR3A);
+  // The first fan's speed is still measured.
+  sim::setTachRPM(13, 1200);
+  run(&captureFan, 2000);
+  CHECK_CLOSE(captureFan.getRPM(), 1200, 10);
+  /* A revolution shorter than the 16 bit RPM allows (here just over, from
+   * rounding down to whole ticks) is reported as the highest RPM, instead of
+   * wrapping around to a slow one.
+   */
+  sim::setTachRPM(13, UINT16_MAX);
+  run(&captureFan, 2000);
+  CHECK(captureFan.getRPM() > 60000);
+}
+
+int main() {
+  sim::reset();
+  sim::captureSerial(true);
+  static Fan fan(CONTROL_PIN, TACH_PIN, phaseFrequencyCorrect);
+  testJammedAtCalibration(&fan);
+  testTimerConflicts();
+  return checkResult();
+}
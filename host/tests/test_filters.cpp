@@ -0,0 +1,138 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Filters.h"
+#include "Fixed.h"
+#include "check.h"
+
+/* The filters in Filters.h, with each of the value types the firmware uses
+ * them with.
+ */
+
+// A step in the input from `from` to `to`, returning the filtered value.
+template<typename F>
+static float step(
+  typename F::value_type from,
+  typename F::value_type to,
+  int samples
+) {
+  F filter;
+  filter.push(from);
+  for (int i = 0; i < samples; i++) {
+    filter.push(to);
+  }
+  return float(filter.current_value());
+}
+
+static void testExponentialMovingAverage() {
+  // The first sample is taken as is.
+  CHECK_EQUAL((step< ExponentialMovingAverage<float, 3> >(20.0, 20.0, 0)), 20);
+  // 1/8 of the way each sample.
+  CHECK_CLOSE((step< ExponentialMovingAverage<float, 3> >(0.0, 8.0, 1)), 1, 0);
+  CHECK_CLOSE((step< ExponentialMovingAverage<float, 3> >(8.0, 0.0, 1)), 7, 0);
+
+  // Unsigned values have to be able to go down as well as up.
+  CHECK_CLOSE(
+    (step< ExponentialMovingAverage<uint16_t, 3> >(16000, 0, 100)),
+    0,
+    8
+  );
+  CHECK_CLOSE(
+    (step< ExponentialMovingAverage<uint16_t, 3> >(0, 16000, 100)),
+    16000,
+    8
+  );
+  CHECK_CLOSE((step< ExponentialMovingAverage<uint8_t, 2> >(255, 0, 50)), 0, 4);
+  CHECK_CLOSE(
+    (step< ExponentialMovingAverage<uint32_t, 4> >(4000000000UL, 0, 400)),
+    0,
+    16
+  );
+  CHECK_CLOSE(
+    (step< ExponentialMovingAverage<int16_t, 3> >(-8000, 8000, 100)),
+    8000,
+    8
+  );
+
+  // Fixed point follows float.
+  CHECK_CLOSE(
+    (step< ExponentialMovingAverage<Fixed<16>, 3> >(
+      Fixed<16>(30.0f),
+      Fixed<16>(20.0f),
+      10
+    )),
+    (step< ExponentialMovingAverage<float, 3> >(30.0, 20.0, 10)),
+    0.001
+  );
+}
+
+static void testMedianFilter() {
+  MedianFilter<uint16_t, 3> filter;
+  CHECK(filter.empty());
+  filter.push(100);
+  CHECK_EQUAL(filter.current_value(), 100);
+  // A single glitch is thrown out.
+  filter.push(5000);
+  filter.push(102);
+  CHECK_EQUAL(filter.current_value(), 102);
+  filter.push(101);
+  CHECK_EQUAL(filter.current_value(), 102);
+  // The glitch has aged out.
+  filter.push(90);
+  CHECK_EQUAL(filter.current_value(), 101);
+}
+
+static void testBiquad() {
+  typedef Biquad<float, ButterworthLowPassTenth> FloatBiquad;
+  typedef Biquad<Fixed<16>, ButterworthLowPassTenth> FixedBiquad;
+  // Starting at the input, instead of ringing up from zero.
+  CHECK_CLOSE((step<FloatBiquad>(25.0, 25.0, 0)), 25, 0.001);
+  // Settling at the new value, with fixed point following float.
+  CHECK_CLOSE((step<FloatBiquad>(25.0, 30.0, 100)), 30, 0.001);
+  CHECK_CLOSE(
+    (step<FixedBiquad>(Fixed<16>(25.0f), Fixed<16>(30.0f), 20)),
+    (step<FloatBiquad>(25.0, 30.0, 20)),
+    0.01
+  );
+}
+
+static void testCascade() {
+  Cascade< MedianFilter<uint16_t, 3>, ExponentialMovingAverage<uint16_t, 1> >
+    filter;
+  filter.push(1000);
+  filter.push(9000);
+  CHECK_EQUAL(filter.current_value(), 1000);
+  filter.push(2000);
+  CHECK_EQUAL(filter.current_value(), 1500);
+}
+
+/* The sizes noted in Filters.h are the AVR's, where nothing is padded. The
+ * host pads members to their alignment, so the AVR size has to be between
+ * its unpadded and padded sizes here.
+ */
+template<typename F>
+static void checkSize(size_t avrSize) {
+  size_t alignment = alignof(F);
+  size_t padded = (avrSize + alignment - 1) / alignment * alignment;
+  CHECK(sizeof(F) >= avrSize);
+  CHECK(sizeof(F) <= padded);
+}
+
+static void testSizes() {
+  checkSize< PassThroughFilter<float> >(4 + 1);
+  checkSize< ExponentialMovingAverage<uint16_t> >(2 + 1);
+  checkSize< ExponentialMovingAverage<float> >(4 + 1);
+  checkSize< MedianFilter<uint16_t, 5> >(2 * 5 * 2 + 2);
+  checkSize< MedianFilter<float, 3> >(2 * 3 * 4 + 2);
+  checkSize< Biquad<float, ButterworthLowPassTenth> >(3 * 4 + 1);
+  checkSize< Biquad<Fixed<16>, ButterworthLowPassTenth> >(3 * 4 + 1);
+}
+
+int main() {
+  testExponentialMovingAverage();
+  testMedianFilter();
+  testBiquad();
+  testCascade();
+  testSizes();
+  return checkResult();
+}
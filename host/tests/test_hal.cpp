@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include "sim.h"
+#include "check.h"
+
+/* Tests of the simulated ATmega32u4 and Arduino core: that each shim behaves
+ * the way the firmware relies on the hardware behaving.
+ */
+
+static volatile uint16_t tachInterrupts;
+
+ISR(INT2_vect) {
+  tachInterrupts++;
+}
+
+static volatile uint8_t adcInterrupts;
+
+ISR(ADC_vect) {
+  adcInterrupts++;
+}
+
+static void testClock() {
+  sim::reset();
+  CHECK_EQUAL(millis(), 0UL);
+  sim::advance(2500);
+  CHECK_EQUAL(micros(), 2500UL);
+  CHECK_EQUAL(millis(), 2UL);
+  delay(10);
+  CHECK_EQUAL(millis(), 12UL);
+  delayMicroseconds(600);
+  CHECK_EQUAL(micros(), 13100UL);
+}
+
+static void testSerial() {
+  sim::reset();
+  sim::captureSerial(true);
+  sim::serialInput("ab");
+  CHECK_EQUAL(Serial.available(), 2);
+  CHECK_EQUAL(Serial.peek(), 'a');
+  CHECK_EQUAL(Serial.read(), 'a');
+  CHECK_EQUAL(Serial.read(), 'b');
+  CHECK_EQUAL(Serial.read(), -1);
+
+  char output[64];
+  Serial.print(F("flash "));
+  Serial.print(42);
+  Serial.print(' ');
+  Serial.print(-7L);
+  Serial.print(' ');
+  Serial.print(255, HEX);
+  Serial.print(' ');
+  Serial.println(3.14159, 3);
+  sim::takeSerialOutput(output, sizeof(output));
+  CHECK_STRING(output, "flash 42 -7 FF 3.142\r\n");
+  // Taking the output clears it.
+  CHECK_EQUAL(sim::takeSerialOutput(output, sizeof(output)), 0U);
+  sim::captureSerial(false);
+}
+
+static void testPWM() {
+  sim::reset();
+  // Timer/Counter1 in phase correct PWM with ICR1 as TOP (mode 10).
+  TCCR1A = _BV(COM1A1) | _BV(WGM11);
+  TCCR1B = _BV(WGM13) | _BV(CS10);
+  ICR1 = 320;
+  OCR1A = 80;
+  CHECK_CLOSE(sim::dutyCycle(9), 0.25, 0.001);
+  // Inverting output.
+  TCCR1A |= _BV(COM1A0);
+  CHECK_CLOSE(sim::dutyCycle(9), 0.75, 0.001);
+  // Timer/Counter4 uses OCR4C as TOP.
+  TCCR4A = _BV(COM4A1) | _BV(PWM4A);
+  OCR4C = 200;
+  OCR4A = 50;
+  CHECK_CLOSE(sim::dutyCycle(13), 0.25, 0.001);
+  // A pin that isn't on a timer has no PWM.
+  CHECK_CLOSE(sim::dutyCycle(4), 0.0, 0.001);
+}
+
+static void testExternalInterrupts() {
+  sim::reset();
+  tachInterrupts = 0;
+  // D0 is INT2, interrupting on falling edges.
+  EICRA = _BV(ISC21);
+  EIMSK = _BV(INT2);
+  // 1500 RPM is 100 edges a second, half of them falling.
+  sim::setTachRPM(0, 1500);
+  sim::advance(1000000);
+  CHECK_EQUAL(tachInterrupts, 50);
+
+  // Either edge.
+  tachInterrupts = 0;
+  EICRA = _BV(ISC20);
+  sim::advance(1000000);
+  CHECK_EQUAL(tachInterrupts, 100);
+
+  // Edges while interrupts are disabled are held until they're re-enabled,
+  // and only once.
+  tachInterrupts = 0;
+  cli();
+  sim::advance(100000);
+  CHECK_EQUAL(tachInterrupts, 0);
+  sei();
+  CHECK_EQUAL(tachInterrupts, 1);
+
+  // A stopped fan has no edges.
+  tachInterrupts = 0;
+  sim::setTachRPM(0, 0);
+  sim::advance(1000000);
+  CHECK_EQUAL(tachInterrupts, 0);
+}
+
+static void testADC() {
+  sim::reset();
+  adcInterrupts = 0;
+  // Channel 0 against AVcc, with a 128x prescaler (8µs ADC clock).
+  sim::setAnalogInput(0, 2500);
+  ADMUX = _BV(REFS0);
+  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+  ADCSRA |= _BV(ADSC);
+  // The first conversion takes 25 ADC clocks.
+  sim::advance(199);
+  CHECK(ADCSRA & _BV(ADSC));
+  sim::advance(1);
+  CHECK(!(ADCSRA & _BV(ADSC)));
+  CHECK_EQUAL(adcInterrupts, 1);
+  CHECK_CLOSE(ADC, 512, 1);
+
+  // Later ones take 13, and the internal 2.56V reference.
+  sim::setAnalogInput(0, 1280);
+  ADMUX = _BV(REFS1) | _BV(REFS0);
+  ADCSRA |= _BV(ADSC);
+  sim::advance(104);
+  CHECK(!(ADCSRA & _BV(ADSC)));
+  CHECK_CLOSE(ADC, 512, 1);
+
+  // The temperature sensor reads in Kelvins.
+  sim::setInternalTemperature(30);
+  ADMUX = _BV(REFS1) | _BV(REFS0) | 0x07;
+  ADCSRB = _BV(MUX5);
+  ADCSRA |= _BV(ADSC);
+  sim::advance(104);
+  CHECK_EQUAL(ADC, 303);
+}
+
+static void testEEPROM() {
+  sim::reset();
+  uint8_t *address = (uint8_t *)16;
+  // Erased EEPROM reads as all ones.
+  CHECK_EQUAL(eeprom_read_byte(address), 0xFF);
+  eeprom_write_byte(address, 0x5A);
+  CHECK(!eeprom_is_ready());
+  CHECK_EQUAL(sim::eeprom()[16], 0xFF);
+  // An erase and write takes 3.4ms.
+  sim::advance(3399);
+  CHECK(!eeprom_is_ready());
+  sim::advance(1);
+  CHECK(eeprom_is_ready());
+  CHECK_EQUAL(sim::eeprom()[16], 0x5A);
+
+  // Writes wait for the one before them.
+  uint64_t start = sim::now();
+  uint16_t word = 0x1234;
+  eeprom_update_block(&word, address, sizeof(word));
+  eeprom_busy_wait();
+  CHECK_EQUAL(sim::now() - start, 6800U);
+  CHECK_EQUAL(eeprom_read_word((const uint16_t *)address), 0x1234);
+  // Updating with the same value doesn't write.
+  start = sim::now();
+  eeprom_update_byte(address, 0x34);
+  CHECK(eeprom_is_ready());
+  CHECK_EQUAL(sim::now() - start, 0U);
+}
+
+int main() {
+  testClock();
+  testSerial();
+  testPWM();
+  testExternalInterrupts();
+  testADC();
+  testEEPROM();
+  return checkResult();
+}
@@ -0,0 +1,182 @@
+#include <string.h>
+
+#include <Arduino.h>
+#include "Fan.h"
+#include "FanArray.h"
+#include "LineEditor.h"
+#include "Menu.h"
+#include "Thermometer.h"
+#include "ThermometerBank.h"
+#include "sim.h"
+#include "check.h"
+
+/* Collecting lines of input, on its own and as the menu reads them from the
+ * (simulated) serial port.
+ */
+
+/* Feed `text` in, returning how many lines it completed. The last one is left
+ * in the editor.
+ */
+static int feed(LineEditor *editor, const char *text) {
+  int lines = 0;
+  for (; *text != '\0'; text++) {
+    if (editor->feed(*text)) {
+      lines++;
+    }
+  }
+  return lines;
+}
+
+static void testBackspace() {
+  LineEditor editor;
+  // Backspace and delete at the start of a line do nothing.
+  CHECK_EQUAL(feed(&editor, "\b\x7F" "ab\b\bc\r"), 1);
+  CHECK_STRING(editor.getLine(), "c");
+  // Backspace past the start of the next line doesn't reach the last one.
+  CHECK_EQUAL(feed(&editor, "d\b\b\r"), 1);
+  CHECK_STRING(editor.getLine(), "");
+}
+
+static void testOverflow() {
+  LineEditor editor;
+  char line[LINE_EDITOR_LENGTH + 1];
+  memset(line, 'x', LINE_EDITOR_LENGTH);
+  line[LINE_EDITOR_LENGTH] = '\0';
+  // A line that just fits isn't overflowed.
+  CHECK_EQUAL(feed(&editor, line), 0);
+  CHECK(!editor.isOverflowed());
+  CHECK_EQUAL(feed(&editor, "\n"), 1);
+  CHECK_STRING(editor.getLine(), line);
+  CHECK(!editor.isOverflowed());
+  // One more character is dropped, and the line is marked.
+  CHECK_EQUAL(feed(&editor, line), 0);
+  CHECK_EQUAL(feed(&editor, "yz"), 0);
+  CHECK(editor.isOverflowed());
+  CHECK_EQUAL(strlen(editor.getLine()), LINE_EDITOR_LENGTH);
+  // Backspacing doesn't bring back what was dropped.
+  CHECK_EQUAL(feed(&editor, "\b\n"), 1);
+  CHECK(editor.isOverflowed());
+  CHECK_EQUAL(strlen(editor.getLine()), LINE_EDITOR_LENGTH - 1);
+  // The next line starts afresh.
+  CHECK_EQUAL(feed(&editor, "p\n"), 1);
+  CHECK(!editor.isOverflowed());
+  CHECK_STRING(editor.getLine(), "p");
+}
+
+static void testLineEndings() {
+  LineEditor editor;
+  CHECK_EQUAL(feed(&editor, "a\r"), 1);
+  CHECK_STRING(editor.getLine(), "a");
+  CHECK_EQUAL(feed(&editor, "b\n"), 1);
+  CHECK_STRING(editor.getLine(), "b");
+  /* A CR LF pair (or LF CR) ends one line. The line is cleared by the next
+   * character, even the second half of the pair.
+   */
+  CHECK_EQUAL(feed(&editor, "c\r\n"), 1);
+  CHECK_STRING(editor.getLine(), "");
+  CHECK_EQUAL(feed(&editor, "d\n\r"), 1);
+  // Even when the pair arrives one half at a time.
+  CHECK_EQUAL(feed(&editor, "e\r"), 1);
+  CHECK_EQUAL(feed(&editor, "\n"), 0);
+  CHECK_EQUAL(feed(&editor, "f\r"), 1);
+  CHECK_STRING(editor.getLine(), "f");
+  // But two of the same end two lines, the second empty.
+  CHECK_EQUAL(feed(&editor, "g\r\r"), 2);
+  CHECK_STRING(editor.getLine(), "");
+  CHECK_EQUAL(feed(&editor, "h\n\n"), 2);
+  CHECK_EQUAL(feed(&editor, "i\r\n\r\n"), 2);
+  CHECK_STRING(editor.getLine(), "");
+}
+
+static void testDiscard() {
+  LineEditor editor;
+  CHECK_EQUAL(feed(&editor, "ab"), 0);
+  editor.discard();
+  // Everything up to the end of the line is dropped, without completing it.
+  CHECK_EQUAL(feed(&editor, "cd\r\n"), 0);
+  CHECK_EQUAL(feed(&editor, "e\r"), 1);
+  CHECK_STRING(editor.getLine(), "e");
+}
+
+static void testTokens() {
+  char line[] = "  m\tintake  ";
+  char *cursor = line;
+  CHECK_STRING(LineEditor::nextToken(&cursor), "m");
+  CHECK_STRING(LineEditor::nextToken(&cursor), "intake");
+  CHECK(LineEditor::nextToken(&cursor) == NULL);
+  CHECK(LineEditor::nextToken(&cursor) == NULL);
+}
+
+static char output[4096];
+
+// Run the menu for a while, returning what it printed.
+static const char * run(Menu *menu, unsigned long millis) {
+  const uint64_t end = sim::now() + millis * 1000ULL;
+  while (sim::now() < end) {
+    menu->control();
+  }
+  const size_t length = sim::takeSerialOutput(output, sizeof(output) - 1);
+  output[length] = '\0';
+  return output;
+}
+
+static int count(const char *text, const char *needle) {
+  int found = 0;
+  for (const char *at = strstr(text, needle); at != NULL; ) {
+    found++;
+    at = strstr(at + 1, needle);
+  }
+  return found;
+}
+
+/* The menu reads a character each time around the loop, so a command typed a
+ * bit at a time (with the tasks running in between) is put back together.
+ */
+static void testMenu() {
+  sim::reset();
+  sim::captureSerial(true);
+  sim::attachFan(9, 0, 1500);
+  sim::setAnalogInput(9, 750);
+  static FilteredThermometer<> thermometer(A11);
+  static ThermometerBank thermometers;
+  static FanArray fans;
+  static Fan fan(9, (byte)0, phaseFrequencyCorrect);
+  fans.add(&fan);
+  thermometers.add(&thermometer);
+  static Menu menu(&fans, &thermometers, &Serial);
+  CHECK_EQUAL(count(run(&menu, 100), "Available commands:"), 1);
+
+  // "p", with a typo fixed, split up between trips through the loop.
+  sim::serialInput("x");
+  CHECK_STRING(run(&menu, 50), "");
+  sim::serialInput("\b");
+  run(&menu, 50);
+  sim::serialInput("p\r");
+  const char *printed = run(&menu, 50);
+  CHECK_EQUAL(count(printed, "Current controller: "), 1);
+  // The LF of the CR LF pair, arriving later, isn't another (empty) line.
+  sim::serialInput("\n");
+  CHECK_STRING(run(&menu, 50), "");
+
+  // An overflowed line is ignored, whenever its end arrives.
+  char line[LINE_EDITOR_LENGTH + 2];
+  memset(line, 'p', sizeof(line) - 1);
+  line[sizeof(line) - 1] = '\0';
+  sim::serialInput(line);
+  CHECK_STRING(run(&menu, 50), "");
+  sim::serialInput("\r\n");
+  CHECK_EQUAL(count(run(&menu, 50), "Input too long, ignoring."), 1);
+  // And the next line works.
+  sim::serialInput("p\n");
+  CHECK_EQUAL(count(run(&menu, 50), "Current controller: "), 1);
+}
+
+int main() {
+  testBackspace();
+  testOverflow();
+  testLineEndings();
+  testDiscard();
+  testTokens();
+  testMenu();
+  return checkResult();
+}
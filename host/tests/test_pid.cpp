@@ -0,0 +1,202 @@
+#include <math.h>
+#include <stdio.h>
+
+#include <Arduino.h>
+#include "Fan.h"
+#include "FanArray.h"
+#include "Fixed.h"
+#include "PIDFanController.h"
+#include "ThermometerBank.h"
+#include "sim.h"
+#include "check.h"
+
+/* The fixed point PID calculations have to match the floating point ones
+ * (within Q16.16's precision), or switching `PID_FIXED_POINT` would change how
+ * the fans are controlled.
+ */
+
+static void testFixedConversions() {
+  const float values[] = {0.0, 1.0, -1.0, 0.05, 27.3, -300.0, 1.0 / 3};
+  for (unsigned i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    CHECK_CLOSE(float(Fixed<16>(values[i])), values[i], 1.0 / (1 << 17));
+  }
+  CHECK_EQUAL(float(Fixed<16>::fromRatio(1500, 1000)), 1.5);
+  CHECK_EQUAL(float(Fixed<16>(3.0f) * Fixed<16>(-0.5f)), -1.5);
+  CHECK_EQUAL(float(Fixed<16>(3.0f) / Fixed<16>(4.0f)), 0.75);
+}
+
+/* The same sequence of errors given to both, with a set of gains from each
+ * corner of what the auto-tuner comes up with. The gains are rounded to
+ * Q16.16 too, so the tolerance grows with the size of the correction.
+ */
+static void testCorrection(float k_p, float k_i, float k_d) {
+  BasicPIDCorrection<float> floatCorrection(k_p, k_i, k_d);
+  BasicPIDCorrection< Fixed<16> > fixedCorrection(k_p, k_i, k_d);
+  for (int i = 0; i < 600; i++) {
+    // A slow swing across the set point, with some quicker wobbles on it.
+    float error = 4.0 * sin(i / 50.0) + 0.3 * sin(i / 3.0);
+    float elapsed = 1.0 + (i % 3) * 0.25;
+    float floatChange = floatCorrection.update(error, elapsed);
+    float fixedChange = float(
+      fixedCorrection.update(Fixed<16>(error), Fixed<16>(elapsed))
+    );
+    CHECK_CLOSE(fixedChange, floatChange, 0.001 * (1 + fabs(floatChange)));
+  }
+  ControllerTerms floatTerms = floatCorrection.getTerms();
+  ControllerTerms fixedTerms = fixedCorrection.getTerms();
+  const Fixed<16> ControllerTerms::*terms[] = {
+    &ControllerTerms::proportional,
+    &ControllerTerms::integral,
+    &ControllerTerms::derivative,
+  };
+  for (unsigned i = 0; i < 3; i++) {
+    float floatTerm = float(floatTerms.*terms[i]);
+    CHECK_CLOSE(
+      float(fixedTerms.*terms[i]),
+      floatTerm,
+      0.001 * (1 + fabs(floatTerm))
+    );
+  }
+}
+
+/* Closing the loop around a simple model of a cabinet, neither version should
+ * drift away from the other as the errors accumulate. (An integral gain makes
+ * this model oscillate, so there isn't one.)
+ */
+template<typename N>
+static float settle(float *temperature) {
+  BasicPIDCorrection<N> correction(0.02, 0.0, 0.05);
+  const N target = N(27.0f);
+  N speed = N(0.0f);
+  *temperature = 35.0;
+  for (int i = 0; i < 3600; i++) {
+    N change = correction.update(N(*temperature) - target, N(1.0f));
+    speed = min(N(1.0f), max(N(0.0f), speed + change));
+    speed = speed < N(0.05f) ? N(0.0f) : speed;
+    // Heading for 35C with the fan off, and 23C at full speed.
+    *temperature += (35.0 - 12.0 * float(speed) - *temperature) / 120.0;
+  }
+  return float(speed);
+}
+
+static void testClosedLoop() {
+  float floatTemperature;
+  float fixedTemperature;
+  float floatSpeed = settle<float>(&floatTemperature);
+  float fixedSpeed = settle< Fixed<16> >(&fixedTemperature);
+  CHECK_CLOSE(floatTemperature, 27.0, 0.05);
+  CHECK_CLOSE(fixedTemperature, floatTemperature, 0.01);
+  CHECK_CLOSE(fixedSpeed, floatSpeed, 0.005);
+}
+
+/* The whole controller, on the simulated board. The controller is told the
+ * time, so it can be started well past the point where the milliseconds since
+ * the last update (from 0) would overflow a Q16.16 number of seconds.
+ */
+static const unsigned long TEN_HOURS = 10UL * 60 * 60 * 1000;
+
+static FanArray fans;
+static ThermometerBank thermometers;
+static FilteredThermometer< PassThroughFilter<uint16_t> > cabinet(A0);
+
+// Feed the thermometer a TMP36 reading at `celsius`.
+static void setTemperature(float celsius) {
+  float milliVolts = 500.0 + celsius * 10.0;
+  cabinet.addSample(lround(milliVolts * 1023.0 / 2560.0 * 4.0));
+}
+
+/* Run a controller in the same cabinet model as `settle()`, for `seconds`
+ * periods from `start`, returning the temperature. `speeds` gets the fan speed
+ * after each period.
+ */
+template<typename N>
+static float control(unsigned long start, int seconds, float *speeds) {
+  fans.setSpeed(0.5);
+  BasicPIDFanController<N> controller(
+    &fans,
+    ALL_FANS,
+    &thermometers,
+    F("Test"),
+    27.0,
+    0.02,
+    0.0,
+    0.05
+  );
+  float temperature = 35.0;
+  for (int i = 0; i < seconds; i++) {
+    setTemperature(temperature);
+    sim::advance(1000000);
+    fans.periodic(millis());
+    controller.periodic(start + i * 1000UL);
+    speeds[i] = fans.getSpeed();
+    temperature += (35.0 - 12.0 * fans.getDutyCycle() - temperature) / 120.0;
+  }
+  return temperature;
+}
+
+static void testLongUptime() {
+  const int SECONDS = 1800;
+  static float floatSpeeds[SECONDS];
+  static float fixedSpeeds[SECONDS];
+  float floatTemperature = control<float>(TEN_HOURS, SECONDS, floatSpeeds);
+  float fixedTemperature = control< Fixed<16> >(
+    TEN_HOURS,
+    SECONDS,
+    fixedSpeeds
+  );
+  // The first period only starts the clock, so the fan isn't touched.
+  CHECK_EQUAL(floatSpeeds[0], 0.5);
+  CHECK_EQUAL(fixedSpeeds[0], 0.5);
+  for (int i = 0; i < SECONDS; i++) {
+    CHECK_CLOSE(fixedSpeeds[i], floatSpeeds[i], 0.02);
+  }
+  CHECK_CLOSE(floatTemperature, 27.0, 0.5);
+  CHECK_CLOSE(fixedTemperature, floatTemperature, 0.1);
+}
+
+/* After being paused (while auto-tuning) for an hour, the controller starts
+ * over instead of integrating the error over the hour as one period.
+ */
+template<typename N>
+static void checkResume() {
+  BasicPIDFanController<N> controller(
+    &fans,
+    ALL_FANS,
+    &thermometers,
+    F("Test"),
+    27.0,
+    0.02,
+    0.02,
+    0.0
+  );
+  setTemperature(30.0);
+  fans.setSpeed(0.5);
+  controller.periodic(TEN_HOURS);
+  controller.periodic(TEN_HOURS + 1000);
+  // 0.06 each from the proportional and integral (3C for 1s) terms.
+  CHECK_CLOSE(fans.getSpeed(), 0.62, 0.001);
+  // Something else sets the speed while the controller is paused.
+  fans.setSpeed(0.3);
+  controller.periodic(TEN_HOURS + 1000 + 3600000UL);
+  CHECK_CLOSE(fans.getSpeed(), 0.3, 0.001);
+  // The integral has another second of error, not another hour.
+  controller.periodic(TEN_HOURS + 2000 + 3600000UL);
+  CHECK_CLOSE(fans.getSpeed(), 0.3 + 0.06 + 0.12, 0.001);
+}
+
+int main() {
+  sim::reset();
+  sim::captureSerial(true);
+  static Fan fan(9, 1500);
+  fans.add(&fan);
+  thermometers.add(&cabinet);
+  testFixedConversions();
+  testCorrection(0.02, 0.02, 0.05);
+  testCorrection(1.0, 0.0, 0.0);
+  testCorrection(0.1, 0.05, 0.5);
+  testClosedLoop();
+  testLongUptime();
+  checkResume<float>();
+  checkResume< Fixed<16> >();
+  return checkResult();
+}
@@ -0,0 +1,219 @@
+#include <limits.h>
+
+#include <Arduino.h>
+#include "Scheduler.h"
+#include "check.h"
+
+/* The scheduler with stub tasks, each recording when it was run in a shared
+ * log.
+ */
+
+struct Run {
+  uint8_t id;
+  unsigned long millis;
+};
+
+static Run runs[256];
+static uint16_t numRuns = 0;
+
+class Recorder: public Task {
+  public:
+    uint8_t id;
+    unsigned long period;
+    // Removed from `scheduler` when it's run, if not `NULL`.
+    Task *removes = NULL;
+    SchedulerBase *scheduler = NULL;
+
+    Recorder(uint8_t id = 0, unsigned long period = 1000):
+      id(id),
+      period(period) {}
+
+    void periodic(unsigned long currentMillis) {
+      if (numRuns < sizeof(runs) / sizeof(runs[0])) {
+        runs[numRuns].id = id;
+        runs[numRuns].millis = currentMillis;
+        numRuns++;
+      }
+      if (removes != NULL) {
+        scheduler->remove(removes);
+      }
+    }
+
+    unsigned long getPeriod() const {
+      return period;
+    }
+};
+
+typedef Scheduler<Recorder> TestScheduler;
+
+/* Tasks run in the order of their deadlines, and ones due at the same time in
+ * the order they were added.
+ */
+static void testDeadlineOrder() {
+  numRuns = 0;
+  TestScheduler scheduler;
+  Recorder a(0), b(1), c(2), d(3);
+  CHECK(scheduler.add(&a, 0, 30));
+  CHECK(scheduler.add(&b, 0, 10));
+  CHECK(scheduler.add(&c, 0, 20));
+  CHECK(scheduler.add(&d, 0, 10));
+  CHECK_EQUAL(scheduler.timeUntilNextDeadline(0), 10);
+  scheduler.run(9);
+  CHECK_EQUAL(numRuns, 0);
+  scheduler.run(30);
+  CHECK_EQUAL(numRuns, 4);
+  const uint8_t order[] = {1, 3, 2, 0};
+  for (uint8_t i = 0; i < 4; i++) {
+    CHECK_EQUAL(runs[i].id, order[i]);
+    CHECK_EQUAL(runs[i].millis, 30);
+  }
+  // Each is next due a period after its last deadline, not after it ran.
+  CHECK_EQUAL(scheduler.timeUntilNextDeadline(30), 980);
+}
+
+/* Running late by a varying amount doesn't push the deadlines back, so the
+ * task keeps to its period on average.
+ */
+static void testPeriodDrift() {
+  numRuns = 0;
+  TestScheduler scheduler;
+  Recorder task(0, 100);
+  CHECK(scheduler.add(&task, 0));
+  for (unsigned long now = 0; now < 10000; now += 7) {
+    scheduler.run(now);
+  }
+  CHECK_EQUAL(numRuns, 100);
+  for (uint16_t i = 0; i < numRuns; i++) {
+    CHECK(runs[i].millis >= i * 100UL);
+    CHECK(runs[i].millis < i * 100UL + 7);
+  }
+#if TIMING_STATS
+  CHECK_EQUAL(scheduler.getStats(0).lateness.getMaximum(), 6);
+#endif
+}
+
+/* After a long stall, a task is run once, not once for every missed period,
+ * and carries on a period later.
+ */
+static void testCatchUp() {
+  numRuns = 0;
+  TestScheduler scheduler;
+  Recorder task(0, 100);
+  Recorder other(1, 300);
+  CHECK(scheduler.add(&task, 0));
+  CHECK(scheduler.add(&other, 0, 50));
+  scheduler.run(0);
+  scheduler.run(50);
+  CHECK_EQUAL(numRuns, 2);
+  scheduler.run(1050);
+  CHECK_EQUAL(numRuns, 4);
+  CHECK_EQUAL(scheduler.timeUntilNextDeadline(1050), 100);
+  scheduler.run(1149);
+  CHECK_EQUAL(numRuns, 4);
+  scheduler.run(1150);
+  CHECK_EQUAL(numRuns, 5);
+  CHECK_EQUAL(runs[4].id, 0);
+#if TIMING_STATS
+  CHECK_EQUAL(scheduler.getStats(0).lateness.getMaximum(), 950);
+  CHECK_EQUAL(scheduler.getStats(1).lateness.getMaximum(), 700);
+#endif
+
+  // The deadlines still work when `millis()` overflows.
+  TestScheduler wrapping;
+  Recorder late(2, 100);
+  const unsigned long start = ULONG_MAX - 50;
+  CHECK(wrapping.add(&late, start));
+  wrapping.run(start);
+  CHECK_EQUAL(wrapping.timeUntilNextDeadline(start + 99), 1);
+  wrapping.run(start + 99);
+  CHECK_EQUAL(wrapping.timeUntilNextDeadline(start + 100), 0);
+}
+
+// A repeatable pseudo-random number.
+static uint16_t nextRandom(uint32_t *state) {
+  *state = *state * 1664525 + 1013904223;
+  return *state >> 16;
+}
+
+/* Adding and removing tasks in any order keeps the heap in order: the next
+ * deadline is always the earliest of the tasks left, and they run in order.
+ */
+static void testAddRemove() {
+  numRuns = 0;
+  TestScheduler scheduler;
+  Recorder tasks[SCHEDULER_MAX_TASKS + 1];
+  unsigned long deadlines[SCHEDULER_MAX_TASKS + 1];
+  bool added[SCHEDULER_MAX_TASKS + 1] = {false};
+  uint8_t numAdded = 0;
+  for (uint8_t i = 0; i <= SCHEDULER_MAX_TASKS; i++) {
+    tasks[i].id = i;
+    tasks[i].period = 100000;
+  }
+  uint32_t state = 1;
+  for (uint8_t step = 0; step < 200; step++) {
+    const uint8_t i = nextRandom(&state) % (SCHEDULER_MAX_TASKS + 1);
+    if (added[i]) {
+      scheduler.remove(&tasks[i]);
+      added[i] = false;
+      numAdded--;
+    } else {
+      deadlines[i] = 1 + nextRandom(&state) % 1000;
+      const bool full = numAdded == SCHEDULER_MAX_TASKS;
+      CHECK_EQUAL(scheduler.add(&tasks[i], 0, deadlines[i]), !full);
+      if (!full) {
+        added[i] = true;
+        numAdded++;
+      }
+    }
+    unsigned long earliest = ULONG_MAX;
+    for (uint8_t j = 0; j <= SCHEDULER_MAX_TASKS; j++) {
+      if (added[j] && deadlines[j] < earliest) {
+        earliest = deadlines[j];
+      }
+    }
+    CHECK_EQUAL(scheduler.timeUntilNextDeadline(0), earliest);
+  }
+  // Removing a task that isn't there does nothing.
+  for (uint8_t i = 0; i <= SCHEDULER_MAX_TASKS; i++) {
+    if (!added[i]) {
+      scheduler.remove(&tasks[i]);
+    }
+  }
+  scheduler.run(1000);
+  CHECK_EQUAL(numRuns, numAdded);
+  for (uint16_t i = 1; i < numRuns; i++) {
+    CHECK(deadlines[runs[i - 1].id] <= deadlines[runs[i].id]);
+  }
+}
+
+// A task can remove another (or itself) when it's run.
+static void testRemoveWhileRunning() {
+  numRuns = 0;
+  TestScheduler scheduler;
+  Recorder a(0, 100), b(1, 100), c(2, 100);
+  a.scheduler = &scheduler;
+  a.removes = &b;
+  c.scheduler = &scheduler;
+  c.removes = &c;
+  CHECK(scheduler.add(&a, 0));
+  CHECK(scheduler.add(&b, 0, 10));
+  CHECK(scheduler.add(&c, 0, 20));
+  scheduler.run(200);
+  CHECK_EQUAL(numRuns, 2);
+  CHECK_EQUAL(runs[0].id, 0);
+  CHECK_EQUAL(runs[1].id, 2);
+  CHECK(scheduler.getStats(1).task == NULL);
+  CHECK(scheduler.getStats(2).task == NULL);
+  scheduler.run(1000);
+  CHECK_EQUAL(numRuns, 3);
+  CHECK_EQUAL(runs[2].id, 0);
+}
+
+int main() {
+  testDeadlineOrder();
+  testPeriodDrift();
+  testCatchUp();
+  testAddRemove();
+  testRemoveWhileRunning();
+  return checkResult();
+}
@@ -0,0 +1,274 @@
+#include <string.h>
+
+#include <Arduino.h>
+#include "EEPROMWriter.h"
+#include "Settings.h"
+#include "SettingsLog.h"
+#include "sim.h"
+#include "check.h"
+
+/* The settings log against the simulated EEPROM. The banks are kept small, so
+ * a few saves are enough to fill one.
+ */
+
+static const uint8_t IMAGE_SIZE = 16;
+static const uint16_t BANK_SIZE = 64;
+
+struct Log {
+  uint8_t saved[IMAGE_SIZE];
+  uint8_t pending[IMAGE_SIZE];
+  SettingsLog log;
+
+  Log(): log(IMAGE_SIZE, saved, pending, 0, BANK_SIZE) {}
+};
+
+static void erase() {
+  memset(sim::eeprom(), 0xFF, sim::eepromSize());
+}
+
+static void fill(uint8_t *image, uint8_t value) {
+  for (uint8_t i = 0; i < IMAGE_SIZE; i++) {
+    image[i] = value + i;
+  }
+}
+
+// Load the log as it would be at boot, into an image starting as 0xAA.
+static bool reload(uint8_t *image) {
+  Log fresh;
+  memset(image, 0xAA, IMAGE_SIZE);
+  return fresh.log.load(image);
+}
+
+/* Wait for the save in flight to be written, returning true once the log has
+ * caught up with it.
+ */
+static bool finish(SettingsLog &log) {
+  EEPROMWriter::flush();
+  return !log.isSaving();
+}
+
+/* The address of the current bank. The first save compacts into bank 0, as
+ * generation 1, and each compaction after switches banks.
+ */
+static uint16_t currentBank(const SettingsLog &log) {
+  return ((log.getGeneration() - 1) % 2) * BANK_SIZE;
+}
+
+static bool sameImage(const uint8_t *image, const uint8_t *expected) {
+  return memcmp(image, expected, IMAGE_SIZE) == 0;
+}
+
+static void testEmpty() {
+  erase();
+  uint8_t image[IMAGE_SIZE];
+  CHECK(!reload(image));
+  // The image is left alone.
+  CHECK_EQUAL(image[0], 0xAA);
+}
+
+static void testRoundTrip() {
+  erase();
+  Log log;
+  uint8_t image[IMAGE_SIZE];
+  fill(image, 10);
+  CHECK(log.log.save(image));
+  CHECK(log.log.isSaving());
+  CHECK(finish(log.log));
+  CHECK_EQUAL(log.log.getGeneration(), 1);
+  uint8_t loaded[IMAGE_SIZE];
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, image));
+
+  // A change is appended as a small record, not another snapshot.
+  const uint16_t used = log.log.getUsed();
+  image[3] = 99;
+  CHECK(log.log.save(image));
+  CHECK(finish(log.log));
+  CHECK_EQUAL(log.log.getUsed(), used + 1 + SETTINGS_LOG_RECORD_OVERHEAD);
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, image));
+}
+
+static void testCompaction() {
+  erase();
+  Log log;
+  uint8_t image[IMAGE_SIZE];
+  fill(image, 0);
+  CHECK(log.log.save(image));
+  CHECK(finish(log.log));
+  uint16_t generation = log.log.getGeneration();
+  uint8_t loaded[IMAGE_SIZE];
+  for (uint8_t i = 0; i < 40; i++) {
+    image[i % IMAGE_SIZE] = i * 3;
+    CHECK(log.log.save(image));
+    CHECK(finish(log.log));
+    CHECK(log.log.getUsed() <= BANK_SIZE);
+    CHECK(reload(loaded));
+    CHECK(sameImage(loaded, image));
+  }
+  /* After the 23 byte header and snapshot, a bank holds eight 5 byte
+   * records, so 40 saves compact it four times.
+   */
+  CHECK_EQUAL(log.log.getGeneration(), generation + 4);
+}
+
+/* A record that was only partly written (or otherwise doesn't check out) is
+ * dropped, leaving the state before it.
+ */
+static void testTornRecord() {
+  erase();
+  Log log;
+  uint8_t image[IMAGE_SIZE];
+  fill(image, 20);
+  CHECK(log.log.save(image));
+  CHECK(finish(log.log));
+  image[5] = 1;
+  CHECK(log.log.save(image));
+  CHECK(finish(log.log));
+  uint8_t before[IMAGE_SIZE];
+  memcpy(before, image, IMAGE_SIZE);
+  image[6] = 2;
+  CHECK(log.log.save(image));
+  CHECK(finish(log.log));
+  // Lose the last byte of the CRC, as if the power went out before it.
+  const uint16_t end = log.log.getUsed();
+  const uint16_t bankStart = currentBank(log.log);
+  sim::eeprom()[bankStart + end - 1] = 0xFF;
+  uint8_t loaded[IMAGE_SIZE];
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, before));
+
+  // A flipped data bit is caught by the CRC too.
+  image[6] = 3;
+  Log fresh;
+  CHECK(fresh.log.load(loaded));
+  CHECK(fresh.log.save(image));
+  CHECK(finish(fresh.log));
+  const uint16_t record =
+    fresh.log.getUsed() - 1 - SETTINGS_LOG_RECORD_OVERHEAD;
+  sim::eeprom()[bankStart + record + 2] ^= 0x10;
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, before));
+}
+
+/* A compaction that didn't finish leaves the new bank without a valid
+ * snapshot, and the old bank is used instead.
+ */
+static void testTornCompaction() {
+  erase();
+  Log log;
+  uint8_t image[IMAGE_SIZE];
+  fill(image, 30);
+  CHECK(log.log.save(image));
+  CHECK(finish(log.log));
+  uint8_t before[IMAGE_SIZE];
+  uint16_t generation = log.log.getGeneration();
+  // Save until the bank fills and the log compacts into the other one.
+  for (uint8_t i = 0; log.log.getGeneration() == generation; i++) {
+    CHECK(!log.log.isSaving());
+    memcpy(before, image, IMAGE_SIZE);
+    image[i % IMAGE_SIZE] ^= 0x55;
+    CHECK(log.log.save(image));
+    CHECK(finish(log.log));
+  }
+  uint8_t loaded[IMAGE_SIZE];
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, image));
+  // Undo the second half of the snapshot, as if the power went out part way.
+  const uint16_t bankStart = currentBank(log.log);
+  const uint16_t snapshot = SETTINGS_LOG_BANK_HEADER_SIZE;
+  memset(
+    sim::eeprom() + bankStart + snapshot + 2 + IMAGE_SIZE / 2,
+    0xFF,
+    IMAGE_SIZE / 2 + 2
+  );
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, before));
+}
+
+/* Saving again while a save is in flight replaces it, and what's loaded is
+ * the last save.
+ */
+static void testSaveInFlight() {
+  erase();
+  Log log;
+  uint8_t first[IMAGE_SIZE];
+  fill(first, 40);
+  CHECK(log.log.save(first));
+  CHECK(finish(log.log));
+
+  uint8_t second[IMAGE_SIZE];
+  memcpy(second, first, IMAGE_SIZE);
+  second[2] = 0;
+  second[12] = 0;
+  CHECK(log.log.save(second));
+  // Part of the way through writing the record.
+  sim::advance(10000);
+  CHECK(log.log.isSaving());
+  uint8_t third[IMAGE_SIZE];
+  memcpy(third, second, IMAGE_SIZE);
+  third[7] = 0;
+  CHECK(log.log.save(third));
+  CHECK(finish(log.log));
+  uint8_t loaded[IMAGE_SIZE];
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, third));
+
+  // Going back to what's saved while a save is in flight still replaces it.
+  CHECK(log.log.save(second));
+  sim::advance(10000);
+  CHECK(log.log.isSaving());
+  CHECK(log.log.save(third));
+  CHECK(finish(log.log));
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, third));
+
+  // Likewise with a compaction in flight, which keeps going to the new bank.
+  uint16_t generation = log.log.getGeneration();
+  uint8_t image[IMAGE_SIZE];
+  memcpy(image, third, IMAGE_SIZE);
+  for (uint8_t i = 0; log.log.getGeneration() == generation; i++) {
+    image[i % IMAGE_SIZE] ^= 0x0F;
+    CHECK(log.log.save(image));
+    if (log.log.getUsed() + 2 * SETTINGS_LOG_RECORD_OVERHEAD > BANK_SIZE) {
+      // This save is the compaction, so interrupt it with another.
+      sim::advance(10000);
+      image[0] ^= 0xF0;
+      CHECK(log.log.save(image));
+    }
+    CHECK(finish(log.log));
+  }
+  CHECK(reload(loaded));
+  CHECK(sameImage(loaded, image));
+}
+
+/* Firmware from before the log only wrote the low byte of its CRC, at address
+ * 0. Even when that byte happens to be the bank magic, the defaults are
+ * loaded, and saved as the first snapshot.
+ */
+static void testLegacySettings() {
+  erase();
+  sim::eeprom()[0] = 0xCF;
+  Settings legacy;
+  CHECK_EQUAL(legacy.getController(), constant);
+  CHECK_EQUAL(legacy.getValue(), 1500);
+  CHECK(!legacy.isDirty());
+  legacy.setValue(1200);
+  CHECK(legacy.save());
+  EEPROMWriter::flush();
+  CHECK(!legacy.isSaving());
+  Settings upgraded;
+  CHECK_EQUAL(upgraded.getValue(), 1200);
+}
+
+int main() {
+  sim::reset();
+  testEmpty();
+  testRoundTrip();
+  testCompaction();
+  testTornRecord();
+  testTornCompaction();
+  testSaveInFlight();
+  testLegacySettings();
+  return checkResult();
+}
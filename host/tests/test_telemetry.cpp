@@ -0,0 +1,222 @@
+#include <math.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include "Fan.h"
+#include "FanArray.h"
+#include "FanController.h"
+#include "Telemetry.h"
+#include "TelemetryDecoder.h"
+#include "ThermometerBank.h"
+#include "sim.h"
+#include "check.h"
+
+/* Records encoded by the firmware's `Telemetry`, decoded by the host's
+ * `telemetry::Decoder`.
+ */
+
+// Collects what's written, with a settable amount of room.
+class Capture: public Print {
+  public:
+    uint8_t data[1024];
+    size_t length = 0;
+    int room = sizeof(data);
+
+    virtual size_t write(uint8_t byte) {
+      data[length++] = byte;
+      room--;
+      return 1;
+    }
+
+    virtual int availableForWrite() {
+      return room;
+    }
+
+    void clear() {
+      length = 0;
+      room = sizeof(data);
+    }
+};
+
+static FanArray fans;
+static ThermometerBank thermometers;
+static FilteredThermometer< PassThroughFilter<uint16_t> > cabinet(A0);
+static FanController controller;
+static Capture capture;
+
+/* Decode everything captured, returning the number of records. The decoder
+ * is joining the stream at the start of a frame, so it's given a delimiter
+ * first.
+ */
+static int decode(
+  telemetry::Decoder *decoder,
+  telemetry::Sample *samples,
+  int maxSamples
+) {
+  int count = 0;
+  telemetry::Sample sample;
+  decoder->feed(0, &sample);
+  for (size_t i = 0; i < capture.length; i++) {
+    if (decoder->feed(capture.data[i], &sample) && count < maxSamples) {
+      samples[count++] = sample;
+    }
+  }
+  capture.clear();
+  return count;
+}
+
+// COBS encode `length` bytes into `output`, ending with the zero delimiter.
+static size_t encode(const uint8_t *input, size_t length, uint8_t *output) {
+  size_t codeIndex = 0;
+  size_t outputIndex = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (input[i] == 0) {
+      output[codeIndex] = code;
+      codeIndex = outputIndex++;
+      code = 1;
+    } else {
+      output[outputIndex++] = input[i];
+      code++;
+    }
+  }
+  output[codeIndex] = code;
+  output[outputIndex++] = 0;
+  return outputIndex;
+}
+
+static void testRoundTrip(Telemetry *stream) {
+  telemetry::Decoder decoder;
+  telemetry::Sample samples[4];
+  // Before the thermometer has a reading.
+  stream->periodic(1000);
+  // Then with one, and the controller's terms from a correction.
+  cabinet.addSample(2600);
+  controller.periodic(60000);
+  controller.periodic(120000);
+  stream->periodic(120000);
+  CHECK_EQUAL(decode(&decoder, samples, 4), 2);
+  CHECK_EQUAL(decoder.getRecords(), 2);
+  CHECK_EQUAL(decoder.getLost(), 0);
+  CHECK_EQUAL(decoder.getCrcErrors(), 0);
+  CHECK_EQUAL(decoder.getMalformed(), 0);
+
+  CHECK_EQUAL(samples[0].sequence, 0);
+  CHECK_EQUAL(samples[0].millis, 1000);
+  CHECK(isnan(samples[0].temperature));
+
+  const telemetry::Sample &sample = samples[1];
+  CHECK_EQUAL(sample.sequence, 1);
+  CHECK_EQUAL(sample.millis, 120000);
+  const float temperature = thermometers.getTemperature();
+  CHECK_EQUAL(
+    sample.temperature,
+    lround(temperature * TELEMETRY_TEMPERATURE_SCALE) /
+      (double)TELEMETRY_TEMPERATURE_SCALE
+  );
+  CHECK_EQUAL(
+    sample.duty,
+    lround(fans.getDutyCycle() * TELEMETRY_DUTY_SCALE) /
+      (double)TELEMETRY_DUTY_SCALE
+  );
+  CHECK(sample.duty > 0);
+  CHECK_EQUAL(sample.rpm, fans.getRPM());
+  ControllerTerms terms = controller.getTerms();
+  CHECK(terms.proportional != Fixed<16>(0));
+  CHECK_EQUAL(sample.proportional, float(terms.proportional));
+  CHECK_EQUAL(sample.integral, float(terms.integral));
+  CHECK_EQUAL(sample.derivative, float(terms.derivative));
+}
+
+// A corrupted record is rejected and counted.
+static void testBadCRC(Telemetry *stream) {
+  telemetry::Decoder decoder;
+  telemetry::Sample samples[2];
+  stream->periodic(130000);
+  // Pull the frame apart, change the RPM, and put it back together.
+  uint8_t payload[sizeof(capture.data)];
+  long length = telemetry::cobsDecode(
+    capture.data,
+    capture.length - 1,
+    payload
+  );
+  CHECK_EQUAL(length, sizeof(telemetryRecord) + TELEMETRY_CRC_SIZE);
+  payload[offsetof(telemetryRecord, rpm)] ^= 0x01;
+  capture.length = encode(payload, length, capture.data);
+  CHECK_EQUAL(decode(&decoder, samples, 2), 0);
+  CHECK_EQUAL(decoder.getCrcErrors(), 1);
+  CHECK_EQUAL(decoder.getRecords(), 0);
+}
+
+static void testMalformedCOBS() {
+  uint8_t output[8];
+  // A zero code can't appear inside a frame.
+  const uint8_t zeroCode[] = {0x02, 0x11, 0x00, 0x12};
+  CHECK_EQUAL(telemetry::cobsDecode(zeroCode, sizeof(zeroCode), output), -1);
+  // A code claiming more bytes than there are.
+  const uint8_t overrun[] = {0x02, 0x11, 0x05, 0x12, 0x13};
+  CHECK_EQUAL(telemetry::cobsDecode(overrun, sizeof(overrun), output), -1);
+  // And a valid one, for comparison.
+  const uint8_t valid[] = {0x02, 0x11, 0x03, 0x12, 0x13};
+  CHECK_EQUAL(telemetry::cobsDecode(valid, sizeof(valid), output), 4);
+  CHECK_EQUAL(output[1], 0);
+
+  // The decoder counts the overrunning frame, and keeps going.
+  telemetry::Decoder decoder;
+  telemetry::Sample sample;
+  decoder.feed(0, &sample);
+  for (size_t i = 0; i < sizeof(overrun); i++) {
+    decoder.feed(overrun[i], &sample);
+  }
+  CHECK(!decoder.feed(0, &sample));
+  CHECK_EQUAL(decoder.getMalformed(), 1);
+}
+
+/* Records that don't fit in the output are dropped by the firmware, and the
+ * gap in the sequence shows up as lost records.
+ */
+static void testSequenceGap(Telemetry *stream) {
+  telemetry::Decoder decoder;
+  telemetry::Sample samples[4];
+  const uint16_t dropped = stream->getDropped();
+  stream->periodic(140000);
+  capture.room = 0;
+  stream->periodic(140010);
+  stream->periodic(140020);
+  stream->periodic(140030);
+  capture.room = sizeof(capture.data) - capture.length;
+  stream->periodic(140040);
+  CHECK_EQUAL(stream->getDropped(), dropped + 3);
+  CHECK_EQUAL(decode(&decoder, samples, 4), 2);
+  CHECK_EQUAL(decoder.getLost(), 3);
+  CHECK_EQUAL((uint8_t)(samples[1].sequence - samples[0].sequence), 4);
+}
+
+int main() {
+  sim::reset();
+  sim::captureSerial(true);
+  static Fan fan(9, 1500);
+  fans.add(&fan);
+  thermometers.add(&cabinet);
+  controller.createPID(
+    pid,
+    &fans,
+    ALL_FANS,
+    &thermometers,
+    F("Test"),
+    27.0,
+    0.02,
+    0.02,
+    0.05,
+    60000
+  );
+  fans.setSpeed(0.5);
+  static Telemetry stream(&fans, &thermometers, &capture);
+  stream.setController(&controller);
+  stream.start(10);
+  testRoundTrip(&stream);
+  testBadCRC(&stream);
+  testMalformedCOBS();
+  testSequenceGap(&stream);
+  return checkResult();
+}
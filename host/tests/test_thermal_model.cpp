@@ -0,0 +1,127 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "ThermalModel.h"
+#include "check.h"
+
+/* Identifying a simulated first order plus dead time cabinet, starting from
+ * (a copy of) the default model in Settings.cpp.
+ */
+
+static const thermalModelValues DEFAULT_MODEL = {
+  .offset = 40.0,
+  .gain = -10.0,
+  .timeConstant = 120.0,
+  .deadTime = 0.0
+};
+
+static const unsigned long PERIOD = 10000;
+
+// A repeatable pseudo-random number from 0 to 1.
+static float noise(uint32_t *state) {
+  *state = *state * 1664525 + 1013904223;
+  return (*state >> 8) / (float)(1UL << 24);
+}
+
+/* Run `model` against a cabinet with the values `cabinet`, with the fans
+ * changing speed every few minutes, for `periods` periods. The temperature is
+ * quantized like the TMP36 readings, with a little noise on top.
+ */
+static void identify(
+  ThermalModel *model,
+  const thermalModelValues &cabinet,
+  int periods
+) {
+  const float periodSeconds = PERIOD / 1000.0;
+  const float a = exp(-periodSeconds / cabinet.timeConstant);
+  const int delay = lround(cabinet.deadTime / periodSeconds);
+  float history[THERMAL_MODEL_MAX_DELAY + 1] = {0.0};
+  uint32_t state = 1;
+  float temperature = cabinet.offset;
+  float speed = 0.0;
+  for (int k = 0; k < periods; k++) {
+    if (k % 20 == 0) {
+      speed = 0.2 + 0.8 * noise(&state);
+    }
+    for (int i = THERMAL_MODEL_MAX_DELAY; i > 0; i--) {
+      history[i] = history[i - 1];
+    }
+    history[0] = speed;
+    const float settled = cabinet.offset + cabinet.gain * history[delay];
+    temperature = a * temperature + (1 - a) * settled;
+    float measured = temperature + 0.05 * (noise(&state) - 0.5);
+    measured = round(measured * 16.0) / 16.0;
+    model->update(measured, speed);
+  }
+}
+
+static void checkValues(
+  const ThermalModel &model,
+  const thermalModelValues &expected
+) {
+  CHECK(model.isValid());
+  thermalModelValues values = model.getValues();
+  CHECK_CLOSE(values.offset, expected.offset, 0.5);
+  CHECK_CLOSE(values.gain, expected.gain, 0.5);
+  CHECK_CLOSE(values.timeConstant, expected.timeConstant, 10.0);
+  CHECK_EQUAL(values.deadTime, expected.deadTime);
+}
+
+static void testConverges(const thermalModelValues &cabinet) {
+  ThermalModel model(DEFAULT_MODEL, PERIOD);
+  identify(&model, cabinet, 2000);
+  checkValues(model, cabinet);
+}
+
+// The initial guess at the dead time can be too long as well as too short.
+static void testLongerInitialDelay() {
+  thermalModelValues initial = DEFAULT_MODEL;
+  initial.deadTime = 80.0;
+  const thermalModelValues cabinet = {
+    .offset = 38.0,
+    .gain = -12.0,
+    .timeConstant = 200.0,
+    .deadTime = 20.0
+  };
+  ThermalModel model(initial, PERIOD);
+  identify(&model, cabinet, 2000);
+  checkValues(model, cabinet);
+}
+
+// Restarting keeps the estimate, and it carries on converging.
+static void testRestart() {
+  const thermalModelValues cabinet = {
+    .offset = 45.0,
+    .gain = -15.0,
+    .timeConstant = 150.0,
+    .deadTime = 30.0
+  };
+  ThermalModel model(DEFAULT_MODEL, PERIOD);
+  identify(&model, cabinet, 1000);
+  model.restart();
+  checkValues(model, cabinet);
+  identify(&model, cabinet, 1000);
+  checkValues(model, cabinet);
+  // The speed needed to hold a temperature follows from the values.
+  CHECK_CLOSE(model.steadyStateSpeed(37.5), 0.5, 0.05);
+}
+
+int main() {
+  const thermalModelValues noDeadTime = {
+    .offset = 45.0,
+    .gain = -15.0,
+    .timeConstant = 150.0,
+    .deadTime = 0.0
+  };
+  testConverges(noDeadTime);
+  const thermalModelValues deadTime = {
+    .offset = 45.0,
+    .gain = -15.0,
+    .timeConstant = 150.0,
+    .deadTime = 30.0
+  };
+  testConverges(deadTime);
+  testLongerInitialDelay();
+  testRestart();
+  return checkResult();
+}
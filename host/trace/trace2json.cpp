@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "Trace.h"
+
+/* Converts trace buffer dumps from the firmware (the `x` menu command, in a
+ * build with `TRACE` set) to the Chrome trace event format, for viewing in
+ * Perfetto (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * Usage: cabinetfan_trace2json [file]
+ *
+ * Reads the serial output from `file` (or standard input), picking out the
+ * dumps from anything else printed around them, and writes the JSON to
+ * standard output.
+ */
+
+// Indexed by `TraceEvent`.
+static const char *EVENT_NAMES[] = {
+  "thermometers",
+  "fans",
+  "controller",
+  "menu",
+  "tach interrupt",
+  "ADC interrupt"
+};
+static const unsigned NUM_EVENTS = sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]);
+
+int main(int argc, char **argv) {
+  FILE *input = stdin;
+  if (argc > 1) {
+    input = fopen(argv[1], "r");
+    if (input == NULL) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+  printf("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  char line[128];
+  bool inDump = false;
+  bool first = true;
+  // `micros()` wraps every 71 minutes, so keep a 64-bit time going.
+  uint64_t wraps = 0;
+  uint32_t lastMicros = 0;
+  // How many of each event have started without ending.
+  unsigned open[NUM_EVENTS] = {0};
+  unsigned long records = 0;
+  unsigned long skipped = 0;
+  while (fgets(line, sizeof(line), input) != NULL) {
+    if (strncmp(line, "trace begin", 11) == 0) {
+      inDump = true;
+      // Each dump starts afresh.
+      memset(open, 0, sizeof(open));
+      continue;
+    } else if (strncmp(line, "trace end", 9) == 0) {
+      inDump = false;
+      continue;
+    } else if (!inDump) {
+      continue;
+    }
+    unsigned long micros;
+    unsigned event;
+    if (sscanf(line, "%lx %x", &micros, &event) != 2) {
+      skipped++;
+      continue;
+    }
+    bool end = event & TRACE_END_FLAG;
+    event &= ~TRACE_END_FLAG;
+    if (event >= NUM_EVENTS) {
+      skipped++;
+      continue;
+    }
+    if (records > 0 && (uint32_t)micros < lastMicros) {
+      wraps += UINT64_C(1) << 32;
+    }
+    lastMicros = micros;
+    records++;
+    if (end) {
+      if (open[event] == 0) {
+        // It started before the oldest record in the buffer.
+        continue;
+      }
+      open[event]--;
+    } else {
+      open[event]++;
+    }
+    printf(
+      "%s  {\"name\": \"%s\", \"ph\": \"%s\", \"ts\": %llu, "
+      "\"pid\": 1, \"tid\": 1}",
+      first ? "" : ",\n",
+      EVENT_NAMES[event],
+      end ? "E" : "B",
+      (unsigned long long)(wraps + (uint32_t)micros)
+    );
+    first = false;
+  }
+  printf("\n]}\n");
+  if (input != stdin) {
+    fclose(input);
+  }
+  fprintf(stderr, "%lu records, %lu unreadable lines\n", records, skipped);
+  return 0;
+}